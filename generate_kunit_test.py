@@ -74,6 +74,7 @@ def query_model(prompt: str) -> str:
 
 # Setup OpenAI Client for OpenRouter
 from openai import OpenAI
+from llm_cache import get_cache
 
 # ----------------------
 # Setup OpenRouter Client
@@ -88,6 +89,7 @@ client = OpenAI(
 # ----------------------
 MODEL_NAME ="qwen/qwen3-coder:free" #mini variants
 TEMPERATURE = 0.2
+MAX_TOKENS = 9053  # Increased token limit to prevent incomplete code generation
 
 
 # ----------------------
@@ -103,20 +105,22 @@ def query_model(prompt: str) -> str:
     Returns:
         The generated text from the model as a string.
     """
-    try:
-        completion = client.chat.completions.create(
-            model=MODEL_NAME,
-            messages=[
-                {"role": "user", "content": prompt}
-            ],
-            temperature=TEMPERATURE,
-            max_tokens=9053,  # Increased token limit to prevent incomplete code generation
-            
-        )
-        return completion.choices[0].message.content
-    except Exception as e:
-        print(f"An error occurred while querying the model: {e}")
-        return f"// Error generating response: {e}"
+    def call():
+        try:
+            completion = client.chat.completions.create(
+                model=MODEL_NAME,
+                messages=[
+                    {"role": "user", "content": prompt}
+                ],
+                temperature=TEMPERATURE,
+                max_tokens=MAX_TOKENS,
+            )
+            return completion.choices[0].message.content
+        except Exception as e:
+            print(f"An error occurred while querying the model: {e}")
+            return f"// Error generating response: {e}"
+
+    return get_cache().get_or_call(prompt, MODEL_NAME, TEMPERATURE, MAX_TOKENS, call)
 
 
 # ----------------------
@@ -209,3 +213,4 @@ Produce **only the raw C code** for the `generated_kunit_test.c` file. Do not in
     print(f"✅ Test generated and saved to: {out_file}")
 
 print("\nAll tests have been generated.")
+print(get_cache().summary())
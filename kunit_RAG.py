@@ -5,6 +5,7 @@ from pathlib import Path
 from dotenv import load_dotenv
 from sentence_transformers import SentenceTransformer
 from openai import OpenAI
+from llm_cache import get_cache
 
 # --------------------- Configuration ---------------------
 BASE_DIR = Path("/home/amd/nithin/KunitGen/main_test_dir")  # ✅ Fixed missing quote
@@ -74,21 +75,24 @@ def retrieve_context(query_text: str, top_k: int = 3):
 
 # --------------------- Model Query -------------------------
 def query_model(prompt: str):
-    try:
-        completion = client.chat.completions.create(
-            model=MODEL_NAME,
-            messages=[{"role": "user", "content": prompt}],
-            temperature=TEMPERATURE,
-            max_tokens=MAX_TOKENS,
-        )
-        return (
-            completion.choices[0]
-            .message.content.replace("```c", "")
-            .replace("```", "")
-            .strip()
-        )
-    except Exception as e:
-        return f"// Error: {e}"
+    def call():
+        try:
+            completion = client.chat.completions.create(
+                model=MODEL_NAME,
+                messages=[{"role": "user", "content": prompt}],
+                temperature=TEMPERATURE,
+                max_tokens=MAX_TOKENS,
+            )
+            return (
+                completion.choices[0]
+                .message.content.replace("```c", "")
+                .replace("```", "")
+                .strip()
+            )
+        except Exception as e:
+            return f"// Error: {e}"
+
+    return get_cache().get_or_call(prompt, MODEL_NAME, TEMPERATURE, MAX_TOKENS, call)
 
 # --------------------- File Helpers ------------------------
 def safe_read(p: Path, fallback="// Missing file"):
@@ -162,6 +166,7 @@ def main():
     for f in files:
         generate_test_for_function(f)
     print("\n--- ✅ All functions processed. ---")
+    print(get_cache().summary())
 
 if __name__ == "__main__":
     main()
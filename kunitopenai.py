@@ -29,6 +29,7 @@ import numpy as np
 from pathlib import Path
 from dotenv import load_dotenv
 from openai import OpenAI
+from llm_cache import get_cache
 
 # --------------------- Configuration ---------------------
 BASE_DIR = Path("/home/amd/nithin/KunitGen")
@@ -115,21 +116,24 @@ def retrieve_context(query_text: str, top_k: int = 3):
 # --------------------- Model Query -------------------------
 def query_model(prompt: str):
     """Query NVIDIA code generation model."""
-    try:
-        completion = nvidia_client.chat.completions.create(
-            model=NVIDIA_GEN_MODEL,
-            messages=[{"role": "user", "content": prompt}],
-            temperature=TEMPERATURE,
-            max_tokens=MAX_TOKENS,
-        )
-        return (
-            completion.choices[0]
-            .message.content.replace("```c", "")
-            .replace("```", "")
-            .strip()
-        )
-    except Exception as e:
-        return f"// Error: {e}"
+    def call():
+        try:
+            completion = nvidia_client.chat.completions.create(
+                model=NVIDIA_GEN_MODEL,
+                messages=[{"role": "user", "content": prompt}],
+                temperature=TEMPERATURE,
+                max_tokens=MAX_TOKENS,
+            )
+            return (
+                completion.choices[0]
+                .message.content.replace("```c", "")
+                .replace("```", "")
+                .strip()
+            )
+        except Exception as e:
+            return f"// Error: {e}"
+
+    return get_cache().get_or_call(prompt, NVIDIA_GEN_MODEL, TEMPERATURE, MAX_TOKENS, call)
 
 # --------------------- File Helpers ------------------------
 def safe_read(p: Path, fallback="// Missing file"):
@@ -192,6 +196,7 @@ def main():
     for f in files:
         generate_test_for_function(f)
     print("\n--- ✅ All functions processed. ---")
+    print(get_cache().summary())
 
 if __name__ == "__main__":
     main()
@@ -0,0 +1,167 @@
+import hashlib
+import json
+import os
+import threading
+import time
+from pathlib import Path
+
+
+# ---------------- Configuration ----------------
+DEFAULT_CACHE_DIR = Path.home() / ".cache" / "kunitgen" / "llm"
+DEFAULT_MAX_MB = 512
+DEFAULT_MAX_AGE_DAYS = 30
+
+
+# ---------------- Response Cache ----------------
+class LLMCache:
+    """
+    On-disk cache of LLM responses, shared by all the generator scripts.
+
+    An entry is keyed by the SHA-256 of (prompt, model, temperature,
+    max_tokens), so re-running a sweep over unchanged functions makes no
+    API calls at all. Entries live in <dir>/<key[:2]>/<key>.json and are
+    written atomically, so several processes can share one directory.
+
+    Eviction is least recently used: a hit touches the entry's mtime, and
+    once the directory grows past max_mb the oldest entries go first.
+    Entries older than max_age_days are dropped regardless.
+
+    Environment:
+        KUNIT_LLM_CACHE=0             disable the cache
+        KUNIT_LLM_CACHE_DIR           cache directory
+        KUNIT_LLM_CACHE_MAX_MB        size cap (default 512)
+        KUNIT_LLM_CACHE_MAX_AGE_DAYS  age cap, 0 for none (default 30)
+    """
+
+    def __init__(self, cache_dir: Path = None, max_mb: float = None, max_age_days: float = None,
+                 enabled: bool = None):
+        if enabled is None:
+            enabled = os.environ.get("KUNIT_LLM_CACHE", "1") != "0"
+        if cache_dir is None:
+            cache_dir = os.environ.get("KUNIT_LLM_CACHE_DIR", DEFAULT_CACHE_DIR)
+        if max_mb is None:
+            max_mb = float(os.environ.get("KUNIT_LLM_CACHE_MAX_MB", DEFAULT_MAX_MB))
+        if max_age_days is None:
+            max_age_days = float(os.environ.get("KUNIT_LLM_CACHE_MAX_AGE_DAYS", DEFAULT_MAX_AGE_DAYS))
+
+        self.enabled = enabled
+        self.cache_dir = Path(cache_dir)
+        self.max_bytes = int(max_mb * 1024 * 1024)
+        self.max_age = max_age_days * 86400
+        self.stats = {"hits": 0, "misses": 0, "stores": 0, "evictions": 0}
+        self._lock = threading.Lock()
+        # Evicting walks the whole directory, so only do it every so many stores
+        self._evict_every = 32
+
+        if self.enabled:
+            self.cache_dir.mkdir(parents=True, exist_ok=True)
+            self.evict()
+
+    @staticmethod
+    def key(prompt: str, model: str, temperature: float, max_tokens: int) -> str:
+        blob = json.dumps({"prompt": prompt, "model": model, "temperature": float(temperature),
+                           "max_tokens": int(max_tokens)}, sort_keys=True, ensure_ascii=False)
+        return hashlib.sha256(blob.encode("utf-8")).hexdigest()
+
+    def _path(self, key: str) -> Path:
+        return self.cache_dir / key[:2] / f"{key}.json"
+
+    def _count(self, stat: str, n: int = 1):
+        with self._lock:
+            self.stats[stat] += n
+
+    def get(self, key: str):
+        """The cached response for key, or None."""
+        if not self.enabled:
+            return None
+        path = self._path(key)
+        try:
+            entry = json.loads(path.read_text(encoding="utf-8"))
+            os.utime(path)
+        except (OSError, ValueError):
+            self._count("misses")
+            return None
+        self._count("hits")
+        return entry["response"]
+
+    def put(self, key: str, response: str, model: str = None):
+        if not self.enabled:
+            return
+        path = self._path(key)
+        path.parent.mkdir(parents=True, exist_ok=True)
+        tmp = path.with_suffix(f".{os.getpid()}.{threading.get_ident()}.tmp")
+        tmp.write_text(json.dumps({"model": model, "created": time.time(), "response": response}),
+                       encoding="utf-8")
+        os.replace(tmp, path)
+        with self._lock:
+            self.stats["stores"] += 1
+            due = self.stats["stores"] % self._evict_every == 0
+        if due:
+            self.evict()
+
+    def get_or_call(self, prompt: str, model: str, temperature: float, max_tokens: int, fn,
+                    is_error=lambda response: not response or response.startswith("// Error")):
+        """
+        Return the cached response for this request, or call fn() and cache
+        what it returns. Responses is_error() flags are passed through but
+        never stored, so a failed call is retried on the next run.
+        """
+        key = self.key(prompt, model, temperature, max_tokens)
+        response = self.get(key)
+        if response is not None:
+            return response
+        response = fn()
+        if not is_error(response):
+            self.put(key, response, model)
+        return response
+
+    def evict(self):
+        """Drop expired entries, then the least recently used ones past the size cap."""
+        if not self.enabled:
+            return
+        now = time.time()
+        entries, total, evicted = [], 0, 0
+        for path in self.cache_dir.glob("*/*.json"):
+            try:
+                st = path.stat()
+            except OSError:
+                continue
+            if self.max_age and now - st.st_mtime > self.max_age:
+                path.unlink(missing_ok=True)
+                evicted += 1
+                continue
+            entries.append((st.st_mtime, st.st_size, path))
+            total += st.st_size
+
+        if total > self.max_bytes:
+            for _, size, path in sorted(entries):
+                path.unlink(missing_ok=True)
+                evicted += 1
+                total -= size
+                if total <= self.max_bytes:
+                    break
+        if evicted:
+            self._count("evictions", evicted)
+
+    def summary(self) -> str:
+        with self._lock:
+            s = dict(self.stats)
+        if not self.enabled:
+            return "💾 LLM cache disabled"
+        lookups = s["hits"] + s["misses"]
+        rate = 100.0 * s["hits"] / lookups if lookups else 0.0
+        return (f"💾 LLM cache: {s['hits']} hits, {s['misses']} misses ({rate:.0f}% hit rate), "
+                f"{s['stores']} stored, {s['evictions']} evicted — {self.cache_dir}")
+
+
+_shared = None
+_shared_lock = threading.Lock()
+
+
+def get_cache() -> LLMCache:
+    """The process-wide cache every generator goes through."""
+    global _shared
+    with _shared_lock:
+        if _shared is None:
+            _shared = LLMCache()
+        return _shared
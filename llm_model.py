@@ -1,9 +1,16 @@
+import json
 import os
+import queue
+import shutil
 import subprocess
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
 from pathlib import Path
 import re
 import dspy  # ✅ new
 from dotenv import load_dotenv
+from llm_cache import get_cache
 from KunitGeneration.model_interface.prompts.unittest_kunit_prompts import kunit_generation_prompt
 
 
@@ -24,20 +31,53 @@ class DSPyKUnitModule:
             raise ValueError("NVIDIA_API_KEY not set in environment.")
         
         # Initialize DSPy LLM backend
+        self.lm_name = "openai/gpt-4o-mini"  # or replace with your NVIDIA-integrated model
+        self.temperature = temperature
+        self.max_tokens = 8192
         dspy.settings.configure(
             lm=dspy.LM(
-                "openai/gpt-4o-mini",  # or replace with your NVIDIA-integrated model
+                self.lm_name,
                 api_key=self.api_key,
-                temperature=temperature,
-                max_tokens=8192,
+                temperature=self.temperature,
+                max_tokens=self.max_tokens,
+                cache=False,  # llm_cache below is the one cache shared with the other scripts
             )
         )
         self.model = dspy.Predict(KUnitSignature)
+        self.cache = get_cache()
 
     def generate(self, source_code: str, error_logs: str) -> str:
         """Generate KUnit test via DSPy declarative model."""
-        response = self.model(source_code=source_code, error_logs=error_logs)
-        return response.kunit_test_code.strip()
+        # DSPy builds the prompt from the signature and the inputs, so those are what get hashed
+        prompt = json.dumps([KUnitSignature.__doc__, source_code, error_logs])
+
+        def call():
+            response = self.model(source_code=source_code, error_logs=error_logs)
+            return response.kunit_test_code.strip()
+
+        return self.cache.get_or_call(prompt, self.lm_name, self.temperature, self.max_tokens, call)
+
+
+# ---------------- Build Sandbox ----------------
+class BuildSandbox:
+    """
+    One place to build and run candidates in: a kernel source tree with its own
+    kunit.py and pre-check output directories, kunitconfig and logs. With a
+    single sandbox that is the kernel tree itself; with more, each one is a git
+    worktree of it, so their Makefile/Kconfig edits and copied test files never
+    meet.
+    """
+
+    def __init__(self, index: int, source_dir: Path, log_dir: Path):
+        self.index = index
+        self.source_dir = source_dir
+        self.build_dir = source_dir / ".kunit"
+        self.precheck_dir = source_dir / ".kunit_precheck"
+        self.kunitconfig = source_dir / ".kunitgen.config"
+        suffix = "" if index == 0 else f".{index}"
+        self.raw_log_file = log_dir / f"compile_error{suffix}.txt"
+        self.error_log_file = log_dir / f"clean_compile_errors{suffix}.txt"
+        self.precheck_ready = None
 
 
 # ---------------- Main Test Generator ----------------
@@ -45,9 +85,26 @@ class KUnitTestGenerator:
     """
     Generate, compile, and validate KUnit tests for Linux kernel C functions.
     Uses DSPy for declarative LLM test generation.
+
+    run() keeps up to `concurrency` LLM requests in flight and verifies the
+    finished candidates in `sandboxes` isolated build sandboxes, one candidate
+    per sandbox at a time. concurrency=1 with one sandbox is the old
+    one-function-at-a-time mode, and gives the same tests.
+
+    Each candidate is first compiled on its own against a persistent, already
+    configured O= tree (the pre-check); the full kunit.py run only happens once
+    that object builds cleanly.
+
+    With batch=True, each round generates a candidate for every pending
+    function, pre-checks them, and builds and runs all that pass in a single
+    kunit.py invocation per sandbox. The compiler diagnostics and KTAP results
+    are then split back per test file, and only the failing functions go round
+    again.
     """
 
-    def __init__(self, main_test_dir: Path, model_name: str, temperature: float, max_retries: int = 3):
+    def __init__(self, main_test_dir: Path, model_name: str, temperature: float, max_retries: int = 3,
+                 concurrency: int = None, precheck: bool = True, batch: bool = False,
+                 kernel_dir: Path = None, sandboxes: int = None, sandbox_root: Path = None):
         if not main_test_dir.is_dir():
             raise FileNotFoundError(f"❌ Test directory does not exist: {main_test_dir}")
 
@@ -59,11 +116,39 @@ class KUnitTestGenerator:
             self.base_dir / "reference_testcases" / "kunit_test2.c",
             self.base_dir / "reference_testcases" / "kunit_test3.c",
         ]
-        self.error_log_file = self.base_dir / "compilation_log" / "clean_compile_errors.txt"
+        self.log_dir = self.base_dir / "compilation_log"
+        self.error_log_file = self.log_dir / "clean_compile_errors.txt"
+
+        self.kernel_dir = Path(kernel_dir or os.environ.get("KUNIT_KERNEL_DIR", "/home/amd/linux"))
+        if sandboxes is None:
+            sandboxes = int(os.environ.get("KUNIT_SANDBOXES", "1"))
+        if sandboxes < 1:
+            raise ValueError(f"❌ sandboxes must be at least 1, got {sandboxes}")
+        self.num_sandboxes = sandboxes
+        self.sandbox_root = Path(sandbox_root or self.kernel_dir.parent / f"{self.kernel_dir.name}-kunitgen")
+        self._sandboxes = None
+        self._free_sandboxes = None
+        # Route the compiler through ccache when there is one; CCACHE_BASEDIR
+        # makes the worktrees' paths relative, so they all share one cache.
+        self.cc = "ccache gcc" if shutil.which("ccache") else None
+        self.build_env = dict(os.environ)
+        if self.cc:
+            self.build_env["CCACHE_BASEDIR"] = os.path.commonpath([str(self.kernel_dir), str(self.sandbox_root)])
+            self.build_env["CCACHE_NOHASHDIR"] = "1"
+
+        self.precheck = precheck
+        self.batch = batch
+        self.stage_times = {"generate": 0.0, "pre-check": 0.0, "kunit.py": 0.0}
+        self._stats_lock = threading.Lock()
 
         self.model_name = model_name
         self.temperature = temperature
         self.max_retries = max_retries
+        if concurrency is None:
+            concurrency = int(os.environ.get("KUNIT_LLM_CONCURRENCY", "4"))
+        if concurrency < 1:
+            raise ValueError(f"❌ concurrency must be at least 1, got {concurrency}")
+        self.concurrency = concurrency
 
         self.generator = DSPyKUnitModule(model_name, temperature)
 
@@ -81,15 +166,95 @@ class KUnitTestGenerator:
 
         return context
 
+    # ---------------- Build Sandboxes ----------------
+    def _git(self, cwd: Path, *args, stdin: bytes = None) -> subprocess.CompletedProcess:
+        return subprocess.run(["git", "-C", str(cwd), *args], input=stdin,
+                              stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+
+    def _sync_worktree(self, path: Path) -> bool:
+        """
+        Point the worktree at path to the kernel tree's HEAD, plus the kernel
+        tree's uncommitted changes (e.g. the driver under test). Untracked files
+        are not carried over.
+        """
+        head = self._git(self.kernel_dir, "rev-parse", "HEAD")
+        if head.returncode:
+            return False
+        head = head.stdout.decode().strip()
+
+        if not (path / ".git").exists():
+            result = self._git(self.kernel_dir, "worktree", "add", "--detach", "-f", str(path), head)
+        else:
+            result = self._git(path, "reset", "--hard", "-q", head)
+        if result.returncode:
+            print(result.stderr.decode()[-2000:])
+            return False
+
+        diff = self._git(self.kernel_dir, "diff", "--binary", "HEAD").stdout
+        if diff and self._git(path, "apply", "--whitespace=nowarn", stdin=diff).returncode:
+            print(f"⚠️  Could not apply the kernel tree's local changes to '{path}'.")
+            return False
+        return True
+
+    def _setup_sandboxes(self) -> list:
+        if self._sandboxes is not None:
+            return self._sandboxes
+
+        self.log_dir.mkdir(parents=True, exist_ok=True)
+        sources = [self.kernel_dir]
+        if self.num_sandboxes > 1:
+            print(f"🧱 Syncing {self.num_sandboxes} build sandboxes under '{self.sandbox_root}'...")
+            self.sandbox_root.mkdir(parents=True, exist_ok=True)
+            sources = [self.sandbox_root / f"sandbox{i}" for i in range(self.num_sandboxes)]
+            if not all(self._sync_worktree(path) for path in sources):
+                print("⚠️  Could not set up git worktrees of the kernel tree, building in it directly.")
+                sources = [self.kernel_dir]
+
+        self._sandboxes = [BuildSandbox(i, path, self.log_dir) for i, path in enumerate(sources)]
+        self._free_sandboxes = queue.Queue()
+        for sb in self._sandboxes:
+            self._write_kunitconfig(sb)
+            self._free_sandboxes.put(sb)
+        # Share the cores out between the sandboxes building at once
+        self.jobs = max(1, (os.cpu_count() or 1) // len(self._sandboxes))
+        return self._sandboxes
+
+    def _with_sandbox(self, fn, *args):
+        """Run fn(sandbox, *args) on whichever sandbox is free next."""
+        sb = self._free_sandboxes.get()
+        try:
+            return fn(sb, *args)
+        finally:
+            self._free_sandboxes.put(sb)
+
+    def _make(self, build_dir: Path, *targets) -> list:
+        cmd = ["make", "ARCH=x86_64", f"O={build_dir}", f"-j{self.jobs}"]
+        if self.cc:
+            cmd.append(f"CC={self.cc}")
+        return cmd + list(targets)
+
+    def _kunit_py(self, sb: BuildSandbox, action: str, build_dir: Path, *extra) -> list:
+        cmd = ["./tools/testing/kunit/kunit.py", action, f"--build_dir={build_dir}",
+               f"--kunitconfig={sb.kunitconfig}", "--arch=x86_64"]
+        if action != "config":
+            cmd.append(f"--jobs={self.jobs}")
+        if self.cc:
+            cmd += ["--make_options", f"CC={self.cc}"]
+        return cmd + list(extra)
+
+    def _add_time(self, stage: str, seconds: float):
+        with self._stats_lock:
+            self.stage_times[stage] += seconds or 0.0
+
     # ---------------- Kernel Integration ----------------
-    def _update_makefile(self, test_name: str):
-        makefile_path = Path("/home/amd/linux/drivers/gpio/Makefile")
+    def _update_makefile(self, sb: BuildSandbox, *test_names: str):
+        """Leave only the entries of test_names enabled in the sandbox's Makefile."""
+        makefile_path = sb.source_dir / "drivers" / "gpio" / "Makefile"
         if not makefile_path.exists():
             print(f"⚠️  Makefile not found at '{makefile_path}' — skipping.")
             return
 
-        config_name = test_name.upper()
-        entry = f"obj-$(CONFIG_{config_name}) += {test_name}.o"
+        entries = [f"obj-$(CONFIG_{name.upper()}) += {name}.o" for name in test_names]
         text = makefile_path.read_text(encoding="utf-8")
         pattern = re.compile(r'^(obj-\$\(\s*CONFIG_[A-Z0-9_]+\s*\)\s*\+=\s*\w+\.o)', re.MULTILINE)
 
@@ -97,13 +262,16 @@ class KUnitTestGenerator:
         if updated_text != text:
             makefile_path.write_text(updated_text, encoding="utf-8")
             print("📝 Commented existing Makefile entries.")
-        if entry not in updated_text:
+        # A whole-line match, so an entry commented out above is added back
+        missing = [e for e in entries if e not in updated_text.splitlines()]
+        if missing:
             with open(makefile_path, "a", encoding="utf-8") as f:
-                f.write("\n" + entry + "\n")
-            print(f"🧩 Added Makefile entry: {entry}")
+                for entry in missing:
+                    f.write("\n" + entry + "\n")
+                    print(f"🧩 Added Makefile entry: {entry}")
 
-    def _update_kconfig(self, test_name: str):
-        main_kconfig = Path("/home/amd/linux/drivers/gpio/Kconfig")
+    def _update_kconfig(self, sb: BuildSandbox, test_name: str):
+        main_kconfig = sb.source_dir / "drivers" / "gpio" / "Kconfig"
         backup_path = main_kconfig.with_suffix(".KunitGen_backup")
         config_name = test_name.upper()
         kconfig_entry = (
@@ -136,33 +304,26 @@ class KUnitTestGenerator:
         print(f"✅ Added Kconfig entry for {config_name}")
         return True
 
-    def _update_test_config(self, test_name: str):
-        cfg_path = Path("/home/amd/linux/my_gpio.config")
-        if not cfg_path.exists():
-            print(f"⚠️  my_gpio.config not found — skipping.")
-            return
-        config_line = f"CONFIG_{test_name.upper()}=y"
-        cfg_text = cfg_path.read_text(encoding="utf-8")
-        if config_line not in cfg_text:
-            with open(cfg_path, "a", encoding="utf-8") as f:
-                f.write("\n" + config_line + "\n")
-            print(f"🧩 Enabled {config_line} in my_gpio.config.")
+    def _write_kunitconfig(self, sb: BuildSandbox, *test_names: str):
+        """
+        The sandbox's kunitconfig: my_gpio.config from the kernel tree without any
+        generated test's symbol, plus those of test_names, so a run never picks up
+        other functions' tests.
+        """
+        cfg_path = self.kernel_dir / "my_gpio.config"
+        lines = cfg_path.read_text(encoding="utf-8").splitlines() if cfg_path.exists() else []
+        generated = {f"CONFIG_{p.stem.upper()}_KUNIT_TEST" for p in self.functions_dir.glob("*.c")}
+        lines = [line for line in lines if line.split("=")[0].strip() not in generated]
+        lines += [f"CONFIG_{name.upper()}=y" for name in test_names]
+        sb.kunitconfig.write_text("\n".join(lines) + "\n", encoding="utf-8")
+
+    def _install_tests(self, sb: BuildSandbox, *test_names: str):
+        for name in test_names:
+            shutil.copy(self.output_dir / f"{name}.c", sb.source_dir / "drivers" / "gpio" / f"{name}.c")
 
     # ---------------- Compilation Check ----------------
-    def _compile_and_check(self) -> bool:
-        print("⚙️  Building kernel to validate test...")
-        kernel_dir = Path("/home/amd/linux")
-        cmd = (
-            f"cp /home/amd/nithin/KunitGen/main_test_dir/generated_tests/*.c /home/amd/linux/drivers/gpio && "
-            f"./tools/testing/kunit/kunit.py run --kunitconfig=my_gpio.config --arch=x86_64 --raw_output > "
-            f"/home/amd/nithin/KunitGen/main_test_dir/compilation_log/compile_error.txt 2>&1"
-        )
-        subprocess.run(cmd, shell=True, cwd=kernel_dir)
-        if not self.error_log_file.exists():
-            print(f"❌ Log not found: {self.error_log_file}")
-            return False
-
-        log_lines = self.error_log_file.read_text(encoding="utf-8").splitlines()
+    def _extract_errors(self, log_text: str) -> list:
+        log_lines = log_text.splitlines()
         seen, error_blocks = set(), []
         i = 0
         while i < len(log_lines):
@@ -178,10 +339,96 @@ class KUnitTestGenerator:
                     else:
                         error_blocks.append(clean_error)
             i += 1
+        return error_blocks
 
+    def _write_errors(self, sb: BuildSandbox, error_blocks: list):
         extracted = "\n\n".join(error_blocks) or "No explicit error lines found."
-        extracted_log = self.error_log_file.parent / "clean_compile_errors.txt"
-        extracted_log.write_text(extracted, encoding="utf-8")
+        sb.error_log_file.write_text(extracted, encoding="utf-8")
+
+    def _prepare_precheck_tree(self, sb: BuildSandbox) -> bool:
+        """
+        Configure and prepare the sandbox's pre-check tree once. It is kept
+        between runs, so later pre-checks only ever rebuild the one object under
+        test.
+        """
+        if sb.precheck_ready is not None:
+            return sb.precheck_ready
+
+        sb.precheck_ready = False
+        if (sb.precheck_dir / "include" / "generated" / "autoconf.h").exists():
+            sb.precheck_ready = True
+            return True
+
+        print(f"🛠️  Preparing pre-check build tree '{sb.precheck_dir}' (one time)...")
+        steps = [
+            self._kunit_py(sb, "config", sb.precheck_dir),
+            self._make(sb.precheck_dir, "prepare"),
+        ]
+        for cmd in steps:
+            result = subprocess.run(cmd, cwd=sb.source_dir, env=self.build_env, stdout=subprocess.PIPE,
+                                    stderr=subprocess.STDOUT, text=True)
+            if result.returncode:
+                print(f"⚠️  Pre-check tree setup failed ({' '.join(cmd[:2])}), using full kunit.py runs only.")
+                print(result.stdout[-2000:])
+                return False
+
+        sb.precheck_ready = True
+        return True
+
+    def _precheck_object(self, sb: BuildSandbox, test_name: str) -> bool:
+        """Build only drivers/gpio/<test_name>.o in the sandbox's prepared tree."""
+        print(f"⚡ Pre-checking {test_name}.o in sandbox {sb.index}...")
+        self._install_tests(sb, test_name)
+        steps = [
+            ["./scripts/config", "--file", str(sb.precheck_dir / ".config"),
+             "--enable", f"CONFIG_{test_name.upper()}"],
+            self._make(sb.precheck_dir, "olddefconfig"),
+            self._make(sb.precheck_dir, f"drivers/gpio/{test_name}.o"),
+        ]
+        output, returncode = [], 0
+        for cmd in steps:
+            result = subprocess.run(cmd, cwd=sb.source_dir, env=self.build_env, stdout=subprocess.PIPE,
+                                    stderr=subprocess.STDOUT, text=True)
+            output.append(result.stdout)
+            returncode = result.returncode
+            if returncode:
+                break
+
+        log_text = "".join(output)
+        sb.raw_log_file.write_text(log_text, encoding="utf-8")
+        error_blocks = self._extract_errors(log_text)
+        if returncode and not error_blocks:
+            # e.g. the Kconfig entry did not take and there is no rule for the object
+            error_blocks = [line for line in log_text.splitlines() if line.strip()][-5:]
+        self._write_errors(sb, error_blocks)
+
+        if returncode or error_blocks:
+            print(f"❌ Pre-check failed. Found {len(error_blocks)} errors.")
+            return False
+        print("✅ Pre-check passed.")
+        return True
+
+    def _kunit_run(self, sb: BuildSandbox, *test_names: str) -> str:
+        """Build and run just test_names in the sandbox; returns the raw log."""
+        self._install_tests(sb, *test_names)
+        self._update_makefile(sb, *test_names)
+        self._write_kunitconfig(sb, *test_names)
+        with open(sb.raw_log_file, "w", encoding="utf-8") as log:
+            subprocess.run(self._kunit_py(sb, "run", sb.build_dir, "--raw_output"), cwd=sb.source_dir,
+                           env=self.build_env, stdout=log, stderr=subprocess.STDOUT)
+        if not sb.raw_log_file.exists():
+            print(f"❌ Log not found: {sb.raw_log_file}")
+            return None
+        return sb.raw_log_file.read_text(encoding="utf-8", errors="replace")
+
+    def _compile_and_check(self, sb: BuildSandbox, test_name: str) -> bool:
+        print(f"⚙️  Building kernel in sandbox {sb.index} to validate test...")
+        log_text = self._kunit_run(sb, test_name)
+        if log_text is None:
+            return False
+
+        error_blocks = self._extract_errors(log_text)
+        self._write_errors(sb, error_blocks)
 
         if error_blocks:
             print(f"❌ Compilation failed. Found {len(error_blocks)} errors.")
@@ -189,43 +436,329 @@ class KUnitTestGenerator:
         print("✅ Compilation successful.")
         return True
 
+    # ---------------- Batch Verification ----------------
+    @staticmethod
+    def _suite_names(source: str) -> list:
+        """The .name of every struct kunit_suite a test file defines."""
+        return re.findall(r'struct\s+kunit_suite\s+\w+\s*=\s*\{[^}]*?\.name\s*=\s*"([^"]+)"', source, re.DOTALL)
+
+    def _split_batch_log(self, log_text: str, sources: dict) -> dict:
+        """
+        Attribute a batch log to its test files. Returns {test_name: (verdict, text)}
+        where verdict is True (built, every suite passed), False (its own errors
+        or failures, in text) or None (no result of its own, because the batch
+        broke on another file).
+        """
+        # Compiler diagnostics, by the test file named in them or in the include chain
+        errors = {name: [] for name in sources}
+        unattributed = []
+        lines = log_text.splitlines()
+        for block in self._extract_errors(log_text):
+            owner = next((name for name in sources if f"{name}.c" in block), None)
+            if owner is None:
+                idx = next((k for k, line in enumerate(lines) if block.split("\n")[0] in line), None)
+                context = "\n".join(lines[max(0, idx - 10):idx + 1]) if idx is not None else ""
+                owner = next((name for name in sources if f"{name}.c" in context), None)
+            (errors[owner] if owner else unattributed).append(block)
+
+        # KTAP: the results of each suite, and the lines reported inside it
+        ktap = re.compile(r'^(?:\[[^\]]*\]\s*)?(\s*)(not ok|ok|# Subtest:)\s*(?:\d+\s+)?(\S+)?')
+        suite_result, suite_lines, current = {}, {}, None
+        for line in lines:
+            m = ktap.match(line)
+            if not m:
+                if current and "#" in line:
+                    suite_lines[current].append(line.strip())
+                continue
+            indent, kind, name = m.groups()
+            if kind == "# Subtest:":
+                # Parameterised cases nest deeper; only suites start a new section
+                if len(indent) <= 4:
+                    current = name
+                    suite_lines.setdefault(name, [])
+            elif name in suite_lines and name not in suite_result:
+                suite_result[name] = kind == "ok"
+                current = None
+            elif current and kind == "not ok":
+                suite_lines[current].append(line.strip())
+
+        verdicts = {}
+        for name, source in sources.items():
+            if errors[name]:
+                verdicts[name] = (False, "\n\n".join(errors[name]))
+                continue
+            suites = self._suite_names(source)
+            missing = [suite for suite in suites if suite not in suite_result]
+            failed = [suite for suite in suites if suite_result.get(suite) is False]
+            if not suites:
+                verdicts[name] = (False, "No struct kunit_suite with a .name found in the test file.")
+            elif failed:
+                verdicts[name] = (False, "\n".join(f"{suite}: " + "\n".join(suite_lines[suite]) for suite in failed))
+            elif not missing:
+                verdicts[name] = (True, "")
+            elif unattributed:
+                verdicts[name] = (False, "\n\n".join(unattributed))
+            else:
+                verdicts[name] = (None, f"Suites {', '.join(missing)} did not report.")
+
+        # Nothing else broke the batch, so a missing suite is this file's fault
+        if not any(v is False for v, _ in verdicts.values()):
+            verdicts = {name: (False, text) if v is None else (v, text) for name, (v, text) in verdicts.items()}
+        return verdicts
+
+    def _run_batch_shard(self, sb: BuildSandbox, sources: dict):
+        """Build and run one sandbox's share of a batch; returns the verdicts and the time taken."""
+        print(f"⚙️  Building and running a batch of {len(sources)} tests in sandbox {sb.index}...")
+        start = time.perf_counter()
+        log_text = self._kunit_run(sb, *sources) or ""
+        run_time = time.perf_counter() - start
+        self._add_time("kunit.py", run_time)
+
+        verdicts = self._split_batch_log(log_text, sources)
+        for name, (verdict, text) in verdicts.items():
+            if verdict is not None:
+                (self.log_dir / f"{name}.log").write_text(text, encoding="utf-8")
+        return verdicts, run_time
+
+    def _run_batched(self, func_files: list, context: dict) -> dict:
+        """
+        Rounds of: generate a candidate for every pending function (up to
+        self.concurrency at a time), pre-check each in whichever sandbox is free,
+        then split the survivors across the sandboxes and build and run each
+        share in one kunit.py invocation. A candidate that only missed out
+        because another one broke its share is carried into the next round
+        without using up an attempt.
+        """
+        results = {}
+        attempts = {f: 0 for f in func_files}
+        error_logs = {f: context["error_logs"] for f in func_files}
+        ready = {}
+        todo = list(func_files)
+        builds = 0
+
+        def retry_or_fail(func_file: Path, logs: str):
+            if logs is not None:
+                error_logs[func_file] = logs
+            if attempts[func_file] < self.max_retries:
+                print(f"🔁 Retrying {func_file.name} with its own errors...")
+                todo.append(func_file)
+            else:
+                print(f"❌ Failed to produce a passing test for {func_file.name} after {self.max_retries} attempts.")
+                results[func_file] = False
+
+        with ThreadPoolExecutor(max_workers=self.concurrency, thread_name_prefix="kunit-llm") as llm_pool, \
+             ThreadPoolExecutor(max_workers=len(self._sandboxes), thread_name_prefix="kunit-build") as build_pool:
+            while todo or ready:
+                staged = {}
+                for func_file in todo:
+                    attempts[func_file] += 1
+                    generation = llm_pool.submit(self._generate_candidate, func_file,
+                                                 attempts[func_file], error_logs[func_file])
+                    staged[func_file] = build_pool.submit(
+                        lambda f, a, g: self._with_sandbox(self._stage_candidate, f, a, g.result()),
+                        func_file, attempts[func_file], generation)
+                todo = []
+
+                for func_file in func_files:
+                    if func_file not in staged:
+                        continue
+                    try:
+                        ok, logs, _ = staged[func_file].result()
+                    except Exception as e:
+                        print(f"❌ Generation failed for {func_file.name}: {e}")
+                        retry_or_fail(func_file, None)
+                        continue
+                    if ok:
+                        ready[func_file] = (self.output_dir / f"{func_file.stem}_kunit_test.c").read_text(encoding="utf-8")
+                    else:
+                        retry_or_fail(func_file, logs)
+
+                if not ready:
+                    continue
+
+                # Deal the ready tests out round-robin, one kunit.py run per sandbox
+                names = {f"{f.stem}_kunit_test": f for f in func_files if f in ready}
+                shards = [dict(list(names.items())[i::len(self._sandboxes)]) for i in range(len(self._sandboxes))]
+                runs = [(shard, build_pool.submit(self._with_sandbox, self._run_batch_shard,
+                                                  {name: ready[f] for name, f in shard.items()}))
+                        for shard in shards if shard]
+                for shard, run in runs:
+                    verdicts, run_time = run.result()
+                    builds += 1
+                    print(f"⏱️  batch build {builds} of {len(shard)} tests: kunit.py {run_time:.1f}s")
+                    for name, func_file in shard.items():
+                        verdict, text = verdicts[name]
+                        if verdict is None:
+                            print(f"⏸️  {name}: no result in this batch, carried over.")
+                            continue
+                        del ready[func_file]
+                        if verdict:
+                            print(f"✅ Test '{name}' built and passed.")
+                            results[func_file] = True
+                        else:
+                            print(f"❌ {name} failed in the batch.")
+                            retry_or_fail(func_file, text)
+
+        print(f"🏗️  {builds} kunit.py builds for {len(func_files)} functions.")
+        return results
+
     # ---------------- Main Loop ----------------
-    def generate_test_for_function(self, func_file_path: Path):
-        func_code = func_file_path.read_text(encoding="utf-8")
+    def _generate_candidate(self, func_file_path: Path, attempt: int, error_logs: str):
+        """One LLM round-trip; safe to run on a worker thread. Returns the test and its duration."""
+        print(f"\n🔹 Attempt {attempt}/{self.max_retries} — Generating test for {func_file_path.name}")
+        start = time.perf_counter()
+        generated_test = self.generator.generate(func_file_path.read_text(encoding="utf-8"), error_logs)
+        return generated_test, time.perf_counter() - start
+
+    def _stage_candidate(self, sb: BuildSandbox, func_file_path: Path, attempt: int, candidate):
+        """
+        Write a candidate out, register it in the sandbox and pre-check it there.
+        Returns whether it may go on to a full run, the error logs to retry with
+        if not, and the time taken by each stage so far.
+        """
+        generated_test, gen_time = candidate
         test_name = f"{func_file_path.stem}_kunit_test"
         out_file = self.output_dir / f"{test_name}.c"
-        context = self._load_context_files()
+        out_file.write_text(generated_test, encoding="utf-8")
+
+        self._update_makefile(sb, test_name)
+        self._update_kconfig(sb, test_name)
+        self._write_kunitconfig(sb, test_name)
+
+        times = {"generate": gen_time, "pre-check": None, "kunit.py": None}
+        ok = True
+        if self.precheck and self._prepare_precheck_tree(sb):
+            start = time.perf_counter()
+            ok = self._precheck_object(sb, test_name)
+            times["pre-check"] = time.perf_counter() - start
+
+        self._add_time("generate", gen_time)
+        self._add_time("pre-check", times["pre-check"])
+        if self.batch:
+            print(f"⏱️  {test_name} attempt {attempt}: generate {gen_time:.1f}s, " +
+                  (f"pre-check {times['pre-check']:.1f}s" if times["pre-check"] is not None else "pre-check skipped"))
+
+        error_logs = None
+        if not ok and sb.error_log_file.exists():
+            error_logs = sb.error_log_file.read_text(encoding="utf-8")
+        return ok, error_logs, times
+
+    def _verify_candidate(self, sb: BuildSandbox, func_file_path: Path, attempt: int, candidate):
+        """
+        Pre-check a candidate and then, if it built, run it with kunit.py, all in
+        sandbox sb. Returns whether it compiled, and the error logs to retry with
+        if it did not.
+        """
+        test_name = f"{func_file_path.stem}_kunit_test"
+        ok, error_logs, times = self._stage_candidate(sb, func_file_path, attempt, candidate)
+        if ok:
+            start = time.perf_counter()
+            ok = self._compile_and_check(sb, test_name)
+            times["kunit.py"] = time.perf_counter() - start
+            self._add_time("kunit.py", times["kunit.py"])
+            if not ok and sb.error_log_file.exists():
+                error_logs = sb.error_log_file.read_text(encoding="utf-8")
+
+        print(f"⏱️  {test_name} attempt {attempt}: " +
+              ", ".join(f"{stage} {t:.1f}s" if t is not None else f"{stage} skipped" for stage, t in times.items()))
+
+        if ok:
+            print(f"✅ Test '{test_name}' compiled successfully.")
+            return True, None
+        return False, error_logs
+
+    def generate_test_for_function(self, func_file_path: Path, context: dict = None) -> bool:
+        self._setup_sandboxes()
+        context = dict(context or self._load_context_files())
 
         for attempt in range(1, self.max_retries + 1):
-            print(f"\n🔹 Attempt {attempt}/{self.max_retries} — Generating test for {func_file_path.name}")
-            generated_test = self.generator.generate(func_code, context["error_logs"])
-            out_file.write_text(generated_test, encoding="utf-8")
-
-            self._update_makefile(test_name)
-            self._update_kconfig(test_name)
-            self._update_test_config(test_name)
-
-            if self._compile_and_check():
-                print(f"✅ Test '{test_name}' compiled successfully.")
-                return
-            else:
-                if self.error_log_file.exists():
-                    context["error_logs"] = self.error_log_file.read_text(encoding="utf-8")
-                print("🔁 Retrying with updated compile errors...")
+            candidate = self._generate_candidate(func_file_path, attempt, context["error_logs"])
+            ok, error_logs = self._with_sandbox(self._verify_candidate, func_file_path, attempt, candidate)
+            if ok:
+                return True
+            if error_logs is not None:
+                context["error_logs"] = error_logs
+            print("🔁 Retrying with updated compile errors...")
 
         print(f"❌ Failed to produce compilable test for {func_file_path.name} after {self.max_retries} attempts.")
-
-    def run(self):
-        print(f"--- 🚀 Starting KUnit Test Generation in '{self.base_dir}' ---")
+        return False
+
+    def _run_pipelined(self, func_files: list, context: dict) -> dict:
+        """
+        Keep up to self.concurrency generations in flight. Each finished candidate
+        is verified in the next free sandbox, so up to one build per sandbox runs
+        at once, and the outcome comes back to this thread on `events`. A failed
+        build resubmits its function with that build's errors, exactly as
+        generate_test_for_function() would, so each function sees the same
+        sequence of prompts whatever the other functions are doing.
+        """
+        events = queue.Queue()
+        results = {}
+        in_flight = 0
+
+        with ThreadPoolExecutor(max_workers=self.concurrency, thread_name_prefix="kunit-llm") as llm_pool, \
+             ThreadPoolExecutor(max_workers=len(self._sandboxes), thread_name_prefix="kunit-build") as build_pool:
+            def verify(func_file: Path, attempt: int, error_logs: str, future):
+                try:
+                    ok, new_logs = self._with_sandbox(self._verify_candidate, func_file, attempt, future.result())
+                except Exception as e:
+                    print(f"❌ Generation failed for {func_file.name}: {e}")
+                    ok, new_logs = False, None
+                events.put((func_file, attempt, error_logs, ok, new_logs))
+
+            def submit(func_file: Path, attempt: int, error_logs: str):
+                future = llm_pool.submit(self._generate_candidate, func_file, attempt, error_logs)
+                future.add_done_callback(lambda f: build_pool.submit(verify, func_file, attempt, error_logs, f))
+
+            for func_file in func_files:
+                submit(func_file, 1, context["error_logs"])
+                in_flight += 1
+
+            while in_flight:
+                func_file, attempt, error_logs, ok, new_logs = events.get()
+                if ok or attempt == self.max_retries:
+                    if not ok:
+                        print(f"❌ Failed to produce compilable test for {func_file.name} after {self.max_retries} attempts.")
+                    results[func_file] = ok
+                    in_flight -= 1
+                    continue
+
+                print(f"🔁 Retrying {func_file.name} with updated compile errors...")
+                submit(func_file, attempt + 1, new_logs if new_logs is not None else error_logs)
+
+        return results
+
+    def run(self, concurrency: int = None):
+        if concurrency is not None:
+            if concurrency < 1:
+                raise ValueError(f"❌ concurrency must be at least 1, got {concurrency}")
+            self.concurrency = concurrency
+
+        print(f"--- 🚀 Starting KUnit Test Generation in '{self.base_dir}' ({self.concurrency} in flight) ---")
         self.output_dir.mkdir(parents=True, exist_ok=True)
-        self.error_log_file.parent.mkdir(parents=True, exist_ok=True)
+        self.log_dir.mkdir(parents=True, exist_ok=True)
 
-        func_files = list(self.functions_dir.glob("*.c"))
+        func_files = sorted(self.functions_dir.glob("*.c"))
         if not func_files:
             print(f"❌ No C files found in '{self.functions_dir}'")
-            return
+            return {}
 
-        for func_file in func_files:
-            self.generate_test_for_function(func_file)
+        sandboxes = self._setup_sandboxes()
+        print(f"🧱 {len(sandboxes)} build sandbox(es), {self.jobs} jobs each" +
+              (", ccache on" if self.cc else ""))
 
-        print("\n--- ✅ All tests processed successfully. ---")
+        # Loaded once, so no function starts from another one's compile errors
+        context = self._load_context_files()
+        if self.batch:
+            results = self._run_batched(func_files, context)
+        elif self.concurrency == 1 and len(sandboxes) == 1:
+            results = {f: self.generate_test_for_function(f, context) for f in func_files}
+        else:
+            results = self._run_pipelined(func_files, context)
+
+        passed = sum(results.values())
+        print(f"\n--- ✅ All tests processed: {passed}/{len(func_files)} compiled. ---")
+        print("⏱️  Total time per stage: " +
+              ", ".join(f"{stage} {t:.1f}s" for stage, t in self.stage_times.items()))
+        print(self.generator.cache.summary())
+        return results
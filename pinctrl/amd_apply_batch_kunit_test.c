@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests checking that amd_apply_batch() leaves the registers exactly
+ * as the per-setting .set_mux() and .pin_config_*set() callbacks do
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/pinctrl/consumer.h>
+#include <linux/pinctrl/machine.h>
+
+#include "pinctrl-amd.c"
+#include "pinctrl_kunit.h"
+
+#define BATCH_REGS_SIZE		0x1000
+
+static unsigned long batch_pin_configs[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 2),
+};
+
+/* The debounce config ends the config list, the batch must keep that */
+static unsigned long batch_group_configs[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_DOWN, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_INPUT_DEBOUNCE, 500),
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 1),
+};
+
+static unsigned long batch_bad_configs[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 0),
+	PIN_CONF_PACKED(PIN_CONFIG_SLEW_RATE, 1),
+};
+
+static const struct pinctrl_map batch_good_maps[] = {
+	PIN_MAP_MUX_GROUP(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			  "IMX_F2_GPIO3", "iomux_gpio_3"),
+	PIN_MAP_MUX_GROUP(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			  "IMX_F1_GPIO5", "iomux_gpio_5"),
+	PIN_MAP_CONFIGS_PIN(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			    "GPIO_3", batch_pin_configs),
+	PIN_MAP_CONFIGS_GROUP(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			      "IMX_F1_GPIO5", batch_group_configs),
+	PIN_MAP_CONFIGS_PIN(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			    "GPIO_16", batch_pin_configs),
+};
+
+static const struct pinctrl_map batch_bad_maps[] = {
+	PIN_MAP_MUX_GROUP(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			  "IMX_F3_GPIO4", "iomux_gpio_4"),
+	PIN_MAP_CONFIGS_PIN(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			    "GPIO_4", batch_pin_configs),
+	PIN_MAP_CONFIGS_PIN(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			    "GPIO_7", batch_bad_configs),
+};
+
+struct amd_batch_test {
+	struct amd_gpio *gpio_dev;
+	struct device *consumer;
+	u8 *regs;
+	u8 *iomux;
+};
+
+static void unregister_maps_action(void *maps)
+{
+	pinctrl_unregister_mappings(maps);
+}
+
+static int amd_batch_test_init(struct kunit *test)
+{
+	struct amd_batch_test *priv;
+	struct amd_gpio *gpio_dev;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	gpio_dev = kunit_kzalloc(test, sizeof(*gpio_dev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev);
+	gpio_dev->pdev = kunit_kzalloc(test, sizeof(*gpio_dev->pdev),
+				       GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->pdev);
+	priv->regs = kunit_kzalloc(test, BATCH_REGS_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->regs);
+	priv->iomux = kunit_kzalloc(test, BATCH_REGS_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->iomux);
+
+	raw_spin_lock_init(&gpio_dev->lock);
+	gpio_dev->base = (__force void __iomem *)priv->regs;
+	gpio_dev->iomux_base = (__force void __iomem *)priv->iomux;
+	gpio_dev->groups = kerncz_groups;
+	gpio_dev->ngroups = ARRAY_SIZE(kerncz_groups);
+
+	amd_pinctrl_desc.name = "amd-batch-pctl";
+	amd_pinctrl_desc.pmxops = &amd_pmxops;
+	gpio_dev->pctrl = pinctrl_test_register(test, &amd_pinctrl_desc,
+						gpio_dev);
+
+	priv->consumer = kunit_device_register(test, "amd-batch-consumer");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, priv->consumer);
+
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+static void amd_batch_register_maps(struct kunit *test,
+				    const struct pinctrl_map *tmpl,
+				    unsigned int num_maps)
+{
+	struct amd_batch_test *priv = test->priv;
+	struct pinctrl_map *maps;
+	unsigned int i;
+	int ret;
+
+	maps = kunit_kmemdup(test, tmpl, num_maps * sizeof(*maps), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, maps);
+
+	for (i = 0; i < num_maps; i++) {
+		maps[i].dev_name = dev_name(priv->consumer);
+		maps[i].ctrl_dev_name = pinctrl_dev_get_devname(priv->gpio_dev->pctrl);
+	}
+
+	ret = pinctrl_register_mappings(maps, num_maps);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	ret = kunit_add_action_or_reset(test, unregister_maps_action, maps);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+}
+
+/*
+ * Select the default state of the consumer starting from the same register
+ * contents every time, and return the registers it left behind.
+ */
+static int amd_batch_select_default(struct kunit *test, bool batch,
+				    u8 *regs, u8 *iomux)
+{
+	struct amd_batch_test *priv = test->priv;
+	struct pinctrl_state *state;
+	struct pinctrl *p;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < BATCH_REGS_SIZE; i += 4)
+		*(u32 *)(priv->regs + i) = 0x00f0f000 ^ (i * 0x01010101);
+	/* Keep the special Pin0 debounce handling out of the picture */
+	*(u32 *)(priv->regs + WAKE_INT_MASTER_REG) = 0;
+	memset(priv->iomux, 0, BATCH_REGS_SIZE);
+
+	pinctrl_set_apply_batch(priv->gpio_dev->pctrl,
+				batch ? amd_apply_batch : NULL);
+
+	p = pinctrl_get(priv->consumer);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, p);
+	state = pinctrl_lookup_state(p, PINCTRL_STATE_DEFAULT);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, state);
+
+	ret = pinctrl_select_state(p, state);
+
+	memcpy(regs, priv->regs, BATCH_REGS_SIZE);
+	memcpy(iomux, priv->iomux, BATCH_REGS_SIZE);
+	pinctrl_put(p);
+
+	return ret;
+}
+
+static void amd_apply_batch_matches_per_setting(struct kunit *test)
+{
+	u8 *regs[2], *iomux[2];
+	unsigned int i;
+	int ret[2];
+
+	for (i = 0; i < 2; i++) {
+		regs[i] = kunit_kzalloc(test, BATCH_REGS_SIZE, GFP_KERNEL);
+		iomux[i] = kunit_kzalloc(test, BATCH_REGS_SIZE, GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, regs[i]);
+		KUNIT_ASSERT_NOT_NULL(test, iomux[i]);
+	}
+
+	amd_batch_register_maps(test, batch_good_maps,
+				ARRAY_SIZE(batch_good_maps));
+
+	ret[0] = amd_batch_select_default(test, false, regs[0], iomux[0]);
+	ret[1] = amd_batch_select_default(test, true, regs[1], iomux[1]);
+
+	KUNIT_EXPECT_EQ(test, ret[0], 0);
+	KUNIT_EXPECT_EQ(test, ret[1], 0);
+	KUNIT_EXPECT_EQ(test, iomux[1][3], 2);
+	KUNIT_EXPECT_EQ(test, iomux[1][5], 1);
+	KUNIT_EXPECT_MEMEQ(test, iomux[0], iomux[1], BATCH_REGS_SIZE);
+	KUNIT_EXPECT_MEMEQ(test, regs[0], regs[1], BATCH_REGS_SIZE);
+}
+
+static void amd_apply_batch_matches_per_setting_on_error(struct kunit *test)
+{
+	u8 *regs[2], *iomux[2];
+	unsigned int i;
+	int ret[2];
+
+	for (i = 0; i < 2; i++) {
+		regs[i] = kunit_kzalloc(test, BATCH_REGS_SIZE, GFP_KERNEL);
+		iomux[i] = kunit_kzalloc(test, BATCH_REGS_SIZE, GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, regs[i]);
+		KUNIT_ASSERT_NOT_NULL(test, iomux[i]);
+	}
+
+	amd_batch_register_maps(test, batch_bad_maps,
+				ARRAY_SIZE(batch_bad_maps));
+
+	ret[0] = amd_batch_select_default(test, false, regs[0], iomux[0]);
+	ret[1] = amd_batch_select_default(test, true, regs[1], iomux[1]);
+
+	KUNIT_EXPECT_EQ(test, ret[0], -ENOTSUPP);
+	KUNIT_EXPECT_EQ(test, ret[1], ret[0]);
+	KUNIT_EXPECT_MEMEQ(test, iomux[0], iomux[1], BATCH_REGS_SIZE);
+	KUNIT_EXPECT_MEMEQ(test, regs[0], regs[1], BATCH_REGS_SIZE);
+}
+
+static struct kunit_case amd_apply_batch_test_cases[] = {
+	KUNIT_CASE(amd_apply_batch_matches_per_setting),
+	KUNIT_CASE(amd_apply_batch_matches_per_setting_on_error),
+	{}
+};
+
+static struct kunit_suite amd_apply_batch_test_suite = {
+	.name = "amd_apply_batch",
+	.init = amd_batch_test_init,
+	.test_cases = amd_apply_batch_test_cases,
+};
+
+kunit_test_suite(amd_apply_batch_test_suite);
@@ -1 +1,148 @@
-// Error generating response: Error code: 429 - {'error': {'message': 'Rate limit exceeded: free-models-per-min. ', 'code': 429, 'metadata': {'headers': {'X-RateLimit-Limit': '16', 'X-RateLimit-Remaining': '0', 'X-RateLimit-Reset': '1758606540000'}, 'provider_name': None}}, 'user_id': 'user_3337P8cQS6lUUDYAV2MCplsf95n'}
\ No newline at end of file
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the pinctrl-amd debugfs dumps: both read the register
+ * window once, and the raw "regs" export matches the fake registers
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/ktime.h>
+
+#include "amd_kunit_mmio.h"
+#include "pinctrl-amd.c"
+
+#define DUMP_REGS_SIZE		0x300
+#define DUMP_NGPIO		(DUMP_REGS_SIZE / 4)
+#define DUMP_SEQ_SIZE		SZ_64K
+#define DUMP_BENCH_ROUNDS	100
+
+struct amd_dump_test {
+	struct amd_gpio *gpio_dev;
+	u32 *regs;
+	char *buf;
+};
+
+static int amd_dump_test_init(struct kunit *test)
+{
+	struct amd_dump_test *priv;
+	struct amd_gpio *gpio_dev;
+	unsigned int i;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	priv->buf = kunit_kzalloc(test, DUMP_SEQ_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->buf);
+	gpio_dev = amd_kunit_gpio_dev(test, "amd-dump-gpio", DUMP_NGPIO,
+				      DUMP_REGS_SIZE, &priv->regs);
+
+	/* Every interrupt, wake, pull and debounce setting shows up */
+	for (i = 0; i < DUMP_NGPIO; i++)
+		priv->regs[i] = 0x0ff0f9a5 ^ (i * 0x01010101);
+
+	gpio_dev->hwbank_num = DUMP_NGPIO / 64;
+	amd_kunit_add_gpiochip(test, gpio_dev);
+
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+static void amd_dump_show(struct amd_dump_test *priv, struct seq_file *sf)
+{
+	memset(sf, 0, sizeof(*sf));
+	sf->buf = priv->buf;
+	sf->size = DUMP_SEQ_SIZE;
+	amd_gpio_dbg_show(sf, &priv->gpio_dev->gc);
+}
+
+static void amd_gpio_dbg_show_reads_once(struct kunit *test)
+{
+	struct amd_dump_test *priv = test->priv;
+	unsigned int last = 128 + AMD_GPIO_PINS_BANK2 - 1;
+	char line[32];
+	struct seq_file sf;
+
+	amd_mmio_reads = 0;
+	amd_mmio_writes = 0;
+	amd_dump_show(priv, &sf);
+
+	KUNIT_EXPECT_EQ(test, amd_mmio_reads, DUMP_NGPIO);
+	KUNIT_EXPECT_EQ(test, amd_mmio_writes, 0);
+	KUNIT_ASSERT_FALSE(test, seq_has_overflowed(&sf));
+	sf.buf[sf.count] = '\0';
+
+	snprintf(line, sizeof(line), "WAKE_INT_MASTER_REG: 0x%08x\n",
+		 priv->regs[WAKE_INT_MASTER_REG / 4]);
+	KUNIT_EXPECT_TRUE(test, str_has_prefix(sf.buf, line));
+
+	/* The last pin decodes what was in its register */
+	snprintf(line, sizeof(line), "#%u\t", last);
+	KUNIT_EXPECT_NOT_NULL(test, strstr(sf.buf, line));
+	snprintf(line, sizeof(line), "|0x%x\n", priv->regs[last]);
+	KUNIT_EXPECT_NOT_NULL(test, strstr(sf.buf, line));
+	KUNIT_EXPECT_NULL(test, strstr(sf.buf, "GPIO bank3"));
+}
+
+static void amd_gpio_regs_export(struct kunit *test)
+{
+	struct amd_dump_test *priv = test->priv;
+	struct inode *inode;
+	struct file *file;
+	__le32 *raw;
+	unsigned int i;
+
+	inode = kunit_kzalloc(test, sizeof(*inode), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, inode);
+	file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, file);
+	inode->i_private = priv->gpio_dev;
+
+	amd_mmio_reads = 0;
+	KUNIT_ASSERT_EQ(test, amd_gpio_regs_open(inode, file), 0);
+	KUNIT_EXPECT_EQ(test, amd_mmio_reads, DUMP_NGPIO);
+
+	/* Later changes do not tear what was read at open */
+	priv->regs[5] = ~priv->regs[5];
+	raw = file->private_data;
+	for (i = 0; i < DUMP_NGPIO; i++) {
+		u32 expected = i == 5 ? ~priv->regs[i] : priv->regs[i];
+
+		KUNIT_EXPECT_EQ_MSG(test, le32_to_cpu(raw[i]), expected,
+				    "register %u", i);
+	}
+
+	KUNIT_EXPECT_EQ(test, amd_gpio_regs_release(inode, file), 0);
+}
+
+static void amd_gpio_dbg_show_bench(struct kunit *test)
+{
+	struct amd_dump_test *priv = test->priv;
+	struct seq_file sf;
+	unsigned int r;
+	ktime_t start;
+	u64 t;
+
+	start = ktime_get();
+	for (r = 0; r < DUMP_BENCH_ROUNDS; r++)
+		amd_dump_show(priv, &sf);
+	t = div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		    DUMP_BENCH_ROUNDS);
+
+	kunit_info(test, "dbg_show of %u banks: %zu bytes in %llu ns\n",
+		   priv->gpio_dev->hwbank_num, sf.count, t);
+}
+
+static struct kunit_case amd_gpio_dbg_show_test_cases[] = {
+	KUNIT_CASE(amd_gpio_dbg_show_reads_once),
+	KUNIT_CASE(amd_gpio_regs_export),
+	KUNIT_CASE_SLOW(amd_gpio_dbg_show_bench),
+	{}
+};
+
+static struct kunit_suite amd_gpio_dbg_show_test_suite = {
+	.name = "amd_gpio_dbg_show",
+	.init = amd_dump_test_init,
+	.test_cases = amd_gpio_dbg_show_test_cases,
+};
+
+kunit_test_suite(amd_gpio_dbg_show_test_suite);
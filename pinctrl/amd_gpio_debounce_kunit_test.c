@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the table driven debounce encoding of pinctrl-amd: every
+ * time from 0 to past a second encodes as the range checks it replaced did,
+ * reads back through amd_pinconf_get() as the time reported when setting
+ * it, and a benchmark of the time the encoding keeps the lock held
+ */
+#include <kunit/test.h>
+#include <linux/ktime.h>
+
+#include "pinctrl-amd.c"
+
+#define DB_REGS_SIZE		0x400
+#define DB_TEST_PIN		5
+/* Past the last range, so the -EINVAL path is covered too */
+#define DB_MAX_USEC		1000100
+#define DB_BENCH_STEP		7
+
+struct amd_db_test {
+	struct pinctrl_dev *pctldev;
+	struct amd_gpio *gpio_dev;
+	u32 *regs;
+};
+
+/* The range checks amd_gpio_debounce_reg() had before the table */
+static int amd_ref_debounce_reg(u32 master, unsigned int offset,
+				unsigned int debounce, u32 *reg)
+{
+	u32 time;
+	u32 pin_reg;
+	int ret = 0;
+
+	if (offset == 0 && (master & INTERNAL_GPIO0_DEBOUNCE))
+		debounce = 0;
+
+	pin_reg = *reg;
+
+	if (debounce) {
+		pin_reg |= DB_TYPE_REMOVE_GLITCH << DB_CNTRL_OFF;
+		pin_reg &= ~DB_TMR_OUT_MASK;
+		if (debounce < 61) {
+			pin_reg |= 1;
+			pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
+		} else if (debounce < 976) {
+			time = debounce / 61;
+			pin_reg |= time & DB_TMR_OUT_MASK;
+			pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
+		} else if (debounce < 3900) {
+			time = debounce / 244;
+			pin_reg |= time & DB_TMR_OUT_MASK;
+			pin_reg |= BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
+		} else if (debounce < 250000) {
+			time = debounce / 15625;
+			pin_reg |= time & DB_TMR_OUT_MASK;
+			pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg |= BIT(DB_TMR_LARGE_OFF);
+		} else if (debounce < 1000000) {
+			time = debounce / 62500;
+			pin_reg |= time & DB_TMR_OUT_MASK;
+			pin_reg |= BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg |= BIT(DB_TMR_LARGE_OFF);
+		} else {
+			pin_reg &= ~(DB_CNTRl_MASK << DB_CNTRL_OFF);
+			ret = -EINVAL;
+		}
+	} else {
+		pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
+		pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
+		pin_reg &= ~DB_TMR_OUT_MASK;
+		pin_reg &= ~(DB_CNTRl_MASK << DB_CNTRL_OFF);
+	}
+	*reg = pin_reg;
+
+	return ret;
+}
+
+static int amd_db_test_init(struct kunit *test)
+{
+	struct amd_db_test *priv;
+	struct amd_gpio *gpio_dev;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	gpio_dev = kunit_kzalloc(test, sizeof(*gpio_dev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev);
+	priv->regs = kunit_kzalloc(test, DB_REGS_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->regs);
+	priv->pctldev = kunit_kzalloc(test, sizeof(*priv->pctldev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->pctldev);
+	gpio_dev->pdev = kunit_kzalloc(test, sizeof(*gpio_dev->pdev),
+				       GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->pdev);
+
+	raw_spin_lock_init(&gpio_dev->lock);
+	gpio_dev->base = (__force void __iomem *)priv->regs;
+	priv->pctldev->driver_data = gpio_dev;
+
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+/* Register values to start from: clear, all set, and a mix */
+static const u32 db_start_regs[] = { 0, 0xffffffff, 0x00a5c3f6 };
+
+static void amd_debounce_check_pin(struct kunit *test, unsigned int pin,
+				   u32 master)
+{
+	struct amd_db_test *priv = test->priv;
+	unsigned int d, s, actual;
+	u32 reg, ref;
+	int ret, ref_ret;
+
+	priv->regs[WAKE_INT_MASTER_REG / 4] = master;
+
+	for (s = 0; s < ARRAY_SIZE(db_start_regs); s++) {
+		for (d = 0; d <= DB_MAX_USEC; d++) {
+			reg = ref = db_start_regs[s];
+			ret = amd_gpio_debounce_reg(priv->gpio_dev, pin, d, &reg,
+						    &actual);
+			ref_ret = amd_ref_debounce_reg(master, pin, d, &ref);
+
+			if (reg != ref || ret != ref_ret ||
+			    actual != amd_gpio_debounce_time(reg)) {
+				KUNIT_FAIL(test, "pin %u, %u usec from 0x%08x: 0x%08x (%d) for 0x%08x (%d), %u usec",
+					   pin, d, db_start_regs[s], reg, ret,
+					   ref, ref_ret, actual);
+				return;
+			}
+		}
+	}
+}
+
+static void amd_debounce_matches_ranges(struct kunit *test)
+{
+	amd_debounce_check_pin(test, DB_TEST_PIN, 0);
+}
+
+static void amd_debounce_pin0(struct kunit *test)
+{
+	struct amd_db_test *priv = test->priv;
+	unsigned int actual;
+	u32 reg;
+
+	/* Pin 0 is like any other unless it debounces internally */
+	amd_debounce_check_pin(test, 0, 0);
+	amd_debounce_check_pin(test, 0, INTERNAL_GPIO0_DEBOUNCE);
+
+	reg = 0xffffffff;
+	priv->regs[WAKE_INT_MASTER_REG / 4] = INTERNAL_GPIO0_DEBOUNCE;
+	KUNIT_EXPECT_EQ(test, amd_gpio_debounce_reg(priv->gpio_dev, 0, 5000,
+						    &reg, &actual), 0);
+	KUNIT_EXPECT_EQ(test, actual, 0);
+	KUNIT_EXPECT_EQ(test, amd_gpio_debounce_time(reg), 0);
+}
+
+static void amd_debounce_reads_back(struct kunit *test)
+{
+	struct amd_db_test *priv = test->priv;
+	unsigned long config;
+	unsigned int d, actual;
+	u32 reg;
+	int ret;
+
+	for (d = 0; d < 1000000; d++) {
+		reg = 0;
+		amd_gpio_debounce_reg(priv->gpio_dev, DB_TEST_PIN, d, &reg,
+				      &actual);
+
+		config = pinconf_to_config_packed(PIN_CONFIG_INPUT_DEBOUNCE, d);
+		ret = amd_pinconf_set(priv->pctldev, DB_TEST_PIN, &config, 1);
+		config = pinconf_to_config_packed(PIN_CONFIG_INPUT_DEBOUNCE, 0);
+		ret |= amd_pinconf_get(priv->pctldev, DB_TEST_PIN, &config);
+
+		if (ret || pinconf_to_config_argument(config) != actual) {
+			KUNIT_FAIL(test, "%u usec: read back %u usec for %u (%d)",
+				   d, pinconf_to_config_argument(config),
+				   actual, ret);
+			return;
+		}
+	}
+}
+
+static void amd_debounce_lock_hold(struct kunit *test)
+{
+	struct amd_db_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	u64 t_ref = 0, t_table = 0;
+	unsigned int d, n = 0, actual;
+	unsigned long flags;
+	ktime_t start;
+	u32 reg;
+
+	for (d = 0; d < 1000000; d += DB_BENCH_STEP, n++) {
+		reg = 0;
+		raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+		start = ktime_get();
+		amd_ref_debounce_reg(0, DB_TEST_PIN, d, &reg);
+		t_ref += ktime_to_ns(ktime_sub(ktime_get(), start));
+		raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+
+		reg = 0;
+		raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+		start = ktime_get();
+		amd_gpio_debounce_reg(gpio_dev, DB_TEST_PIN, d, &reg, &actual);
+		t_table += ktime_to_ns(ktime_sub(ktime_get(), start));
+		raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+	}
+
+	kunit_info(test, "debounce encoding under the lock, %u times: range checks %llu ns, table %llu ns on average\n",
+		   n, div_u64(t_ref, n), div_u64(t_table, n));
+}
+
+static struct kunit_case amd_gpio_debounce_test_cases[] = {
+	KUNIT_CASE(amd_debounce_matches_ranges),
+	KUNIT_CASE(amd_debounce_pin0),
+	KUNIT_CASE_SLOW(amd_debounce_reads_back),
+	KUNIT_CASE_SLOW(amd_debounce_lock_hold),
+	{}
+};
+
+static struct kunit_suite amd_gpio_debounce_test_suite = {
+	.name = "amd_gpio_debounce",
+	.init = amd_db_test_init,
+	.test_cases = amd_gpio_debounce_test_cases,
+};
+
+kunit_test_suite(amd_gpio_debounce_test_suite);
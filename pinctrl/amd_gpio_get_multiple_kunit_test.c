@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the bulk GPIO accessors of pinctrl-amd, counting the
+ * register accesses they make on a fake MMIO region
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/ktime.h>
+
+#include "amd_kunit_mmio.h"
+#include "pinctrl-amd.c"
+
+#define MULTI_REGS_SIZE		0x1000
+/* Two full banks and half of a third one */
+#define MULTI_NGPIO		160
+#define MULTI_BENCH_ROUNDS	1000
+
+struct amd_multi_test {
+	struct amd_gpio *gpio_dev;
+	u32 *regs;
+};
+
+static int amd_multi_test_init(struct kunit *test)
+{
+	struct amd_multi_test *priv;
+	struct amd_gpio *gpio_dev;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	gpio_dev = amd_kunit_gpio_dev(test, "amd-multi-gpio", MULTI_NGPIO,
+				      MULTI_REGS_SIZE, &priv->regs);
+
+	gpio_dev->gc.get = amd_gpio_get_value;
+	gpio_dev->gc.set_rv = amd_gpio_set_value;
+	gpio_dev->gc.get_multiple = amd_gpio_get_multiple;
+	gpio_dev->gc.set_multiple_rv = amd_gpio_set_multiple;
+	amd_kunit_add_gpiochip(test, gpio_dev);
+
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+/* Every third line in all banks, and the last line */
+static void amd_multi_mask(unsigned long *mask)
+{
+	unsigned int i;
+
+	bitmap_zero(mask, MULTI_NGPIO);
+	for (i = 0; i < MULTI_NGPIO; i += 3)
+		__set_bit(i, mask);
+	__set_bit(MULTI_NGPIO - 1, mask);
+}
+
+static void amd_gpio_get_multiple_reads_masked(struct kunit *test)
+{
+	struct amd_multi_test *priv = test->priv;
+	struct gpio_chip *gc = &priv->gpio_dev->gc;
+	DECLARE_BITMAP(mask, MULTI_NGPIO);
+	DECLARE_BITMAP(bits, MULTI_NGPIO);
+	unsigned int i, weight;
+
+	for (i = 0; i < MULTI_NGPIO; i++)
+		priv->regs[i] = (i % 2 ? BIT(PIN_STS_OFF) : 0) | BIT(i % 16);
+
+	amd_multi_mask(mask);
+	weight = bitmap_weight(mask, MULTI_NGPIO);
+	bitmap_fill(bits, MULTI_NGPIO);
+
+	amd_mmio_reads = 0;
+	amd_mmio_writes = 0;
+	KUNIT_ASSERT_EQ(test, amd_gpio_get_multiple(gc, mask, bits), 0);
+
+	/* One read per requested line, none for the others */
+	KUNIT_EXPECT_EQ(test, amd_mmio_reads, weight);
+	KUNIT_EXPECT_EQ(test, amd_mmio_writes, 0);
+
+	for (i = 0; i < MULTI_NGPIO; i++) {
+		if (test_bit(i, mask))
+			KUNIT_EXPECT_EQ(test, test_bit(i, bits), i % 2);
+		else
+			KUNIT_EXPECT_TRUE(test, test_bit(i, bits));
+	}
+
+	kunit_info(test, "get_multiple of %u lines in %u banks: %u reads\n",
+		   weight, DIV_ROUND_UP(MULTI_NGPIO, AMD_GPIO_PINS_PER_BANK),
+		   amd_mmio_reads);
+}
+
+static void amd_gpio_set_multiple_matches_set_value(struct kunit *test)
+{
+	struct amd_multi_test *priv = test->priv;
+	struct gpio_chip *gc = &priv->gpio_dev->gc;
+	DECLARE_BITMAP(mask, MULTI_NGPIO);
+	DECLARE_BITMAP(bits, MULTI_NGPIO);
+	unsigned int i, weight;
+	u32 *expected;
+
+	expected = kunit_kcalloc(test, MULTI_NGPIO, sizeof(*expected),
+				 GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, expected);
+
+	amd_multi_mask(mask);
+	weight = bitmap_weight(mask, MULTI_NGPIO);
+	for (i = 0; i < MULTI_NGPIO; i++)
+		__assign_bit(i, bits, i % 4 < 2);
+
+	/* What one amd_gpio_set_value() call per line leaves behind */
+	for (i = 0; i < MULTI_NGPIO; i++)
+		priv->regs[i] = 0x00f0f000 ^ (i * 0x01010101);
+	for_each_set_bit(i, mask, MULTI_NGPIO)
+		amd_gpio_set_value(gc, i, test_bit(i, bits));
+	memcpy(expected, priv->regs, MULTI_NGPIO * sizeof(*expected));
+
+	for (i = 0; i < MULTI_NGPIO; i++)
+		priv->regs[i] = 0x00f0f000 ^ (i * 0x01010101);
+	amd_mmio_reads = 0;
+	amd_mmio_writes = 0;
+	KUNIT_ASSERT_EQ(test, amd_gpio_set_multiple(gc, mask, bits), 0);
+
+	KUNIT_EXPECT_EQ(test, amd_mmio_reads, weight);
+	KUNIT_EXPECT_EQ(test, amd_mmio_writes, weight);
+	KUNIT_EXPECT_MEMEQ(test, priv->regs, expected,
+			   MULTI_NGPIO * sizeof(*expected));
+
+	kunit_info(test, "set_multiple of %u lines: %u reads, %u writes\n",
+		   weight, amd_mmio_reads, amd_mmio_writes);
+}
+
+static void amd_gpio_multiple_bench(struct kunit *test)
+{
+	struct amd_multi_test *priv = test->priv;
+	struct gpio_chip *gc = &priv->gpio_dev->gc;
+	DECLARE_BITMAP(mask, MULTI_NGPIO);
+	DECLARE_BITMAP(bits, MULTI_NGPIO);
+	u64 t_single, t_multiple;
+	unsigned int i, r;
+	ktime_t start;
+
+	amd_multi_mask(mask);
+	bitmap_zero(bits, MULTI_NGPIO);
+
+	start = ktime_get();
+	for (r = 0; r < MULTI_BENCH_ROUNDS; r++) {
+		for_each_set_bit(i, mask, MULTI_NGPIO)
+			amd_gpio_set_value(gc, i, r & 1);
+		for_each_set_bit(i, mask, MULTI_NGPIO)
+			__assign_bit(i, bits, amd_gpio_get_value(gc, i));
+	}
+	t_single = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (r = 0; r < MULTI_BENCH_ROUNDS; r++) {
+		if (r & 1)
+			bitmap_fill(bits, MULTI_NGPIO);
+		else
+			bitmap_zero(bits, MULTI_NGPIO);
+		amd_gpio_set_multiple(gc, mask, bits);
+		amd_gpio_get_multiple(gc, mask, bits);
+	}
+	t_multiple = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	kunit_info(test, "%u lines set and read back: per line calls %llu ns, bulk calls %llu ns per round\n",
+		   bitmap_weight(mask, MULTI_NGPIO),
+		   div_u64(t_single, MULTI_BENCH_ROUNDS),
+		   div_u64(t_multiple, MULTI_BENCH_ROUNDS));
+}
+
+static struct kunit_case amd_gpio_multiple_test_cases[] = {
+	KUNIT_CASE(amd_gpio_get_multiple_reads_masked),
+	KUNIT_CASE(amd_gpio_set_multiple_matches_set_value),
+	KUNIT_CASE_SLOW(amd_gpio_multiple_bench),
+	{}
+};
+
+static struct kunit_suite amd_gpio_multiple_test_suite = {
+	.name = "amd_gpio_get_multiple",
+	.init = amd_multi_test_init,
+	.test_cases = amd_gpio_multiple_test_cases,
+};
+
+kunit_test_suite(amd_gpio_multiple_test_suite);
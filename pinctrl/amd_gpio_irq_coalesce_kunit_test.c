@@ -0,0 +1,329 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the pinctrl-amd interrupt coalescing: storms a line of a
+ * fake register window through the interrupt handler, then runs the poll
+ * worker by hand and checks how the lines get masked and handed back
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/gpio/driver.h>
+#include <linux/interrupt.h>
+#include <linux/io.h>
+#include <linux/pinctrl/pinctrl.h>
+#include <linux/workqueue.h>
+
+#include "pinctrl-amd.h"
+
+static u32 *coalesce_regs;
+
+/* Like the hardware, ack the pending bits of a pin register written as 1 */
+static inline void amd_w1c_writel(u32 value, volatile void __iomem *addr)
+{
+	unsigned long idx = (__force u32 *)addr - coalesce_regs;
+	u32 pending;
+
+	if (idx < WAKE_INT_STATUS_REG0 / 4 && idx != WAKE_INT_MASTER_REG / 4) {
+		pending = readl(addr) & PIN_IRQ_PENDING & ~value;
+		value = (value & ~PIN_IRQ_PENDING) | pending;
+	}
+	writel(value, addr);
+}
+
+#undef writel
+#define writel amd_w1c_writel
+
+#include "amd_kunit_mmio.h"
+#include "pinctrl-amd.c"
+
+#define COALESCE_REGS_SIZE	0x400
+#define COALESCE_NGPIO		184
+#define COALESCE_RATE		8
+
+static const unsigned int coalesce_irq_pins[] = { 3, 17, 42, 183 };
+#define COALESCE_STORM_PIN	17
+
+static unsigned int coalesce_isr_count[COALESCE_NGPIO];
+
+struct amd_coalesce_test {
+	struct amd_gpio *gpio_dev;
+	u32 *regs;
+	int irqs[ARRAY_SIZE(coalesce_irq_pins)];
+};
+
+static irqreturn_t amd_coalesce_isr(int irq, void *data)
+{
+	coalesce_isr_count[(uintptr_t)data]++;
+
+	return IRQ_HANDLED;
+}
+
+static void free_irqs_action(void *data)
+{
+	struct amd_coalesce_test *priv = data;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(coalesce_irq_pins); i++)
+		free_irq(priv->irqs[i], (void *)(uintptr_t)coalesce_irq_pins[i]);
+}
+
+static int amd_coalesce_test_init(struct kunit *test)
+{
+	struct amd_coalesce_test *priv;
+	struct amd_gpio *gpio_dev;
+	struct gpio_irq_chip *girq;
+	unsigned int i;
+	int irq, ret;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	gpio_dev = amd_kunit_gpio_dev(test, "amd-coalesce-gpio", COALESCE_NGPIO,
+				      COALESCE_REGS_SIZE, &priv->regs);
+	coalesce_regs = priv->regs;
+	gpio_dev->irq_stats = kunit_kcalloc(test, COALESCE_NGPIO,
+					    sizeof(*gpio_dev->irq_stats),
+					    GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->irq_stats);
+	gpio_dev->coalesced = kunit_kcalloc(test, BITS_TO_LONGS(COALESCE_NGPIO),
+					    sizeof(unsigned long), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->coalesced);
+
+	gpio_dev->irq_window_start = jiffies;
+	INIT_DELAYED_WORK(&gpio_dev->poll_work, amd_gpio_poll);
+	gpio_dev->gc.get_direction = amd_gpio_get_direction;
+	girq = &gpio_dev->gc.irq;
+	gpio_irq_chip_set_chip(girq, &amd_gpio_irqchip);
+	girq->default_type = IRQ_TYPE_NONE;
+	girq->handler = handle_simple_irq;
+	amd_kunit_add_gpiochip(test, gpio_dev);
+	/* As in probe */
+	ret = kunit_add_action_or_reset(test, amd_gpio_cancel_poll, gpio_dev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	for (i = 0; i < ARRAY_SIZE(coalesce_irq_pins); i++) {
+		irq = gpio_dev->gc.to_irq(&gpio_dev->gc, coalesce_irq_pins[i]);
+		KUNIT_ASSERT_GT(test, irq, 0);
+		ret = request_irq(irq, amd_coalesce_isr, 0, "amd-coalesce",
+				  (void *)(uintptr_t)coalesce_irq_pins[i]);
+		KUNIT_ASSERT_EQ(test, ret, 0);
+		priv->irqs[i] = irq;
+	}
+	ret = kunit_add_action_or_reset(test, free_irqs_action, priv);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	memset(coalesce_isr_count, 0, sizeof(coalesce_isr_count));
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+/* Raise the interrupt status of @pin and the wake status bit covering it */
+static void amd_coalesce_inject(struct amd_coalesce_test *priv,
+				unsigned int pin)
+{
+	u64 status = BIT_ULL(pin / WAKE_INT_STATUS_PINS);
+
+	priv->regs[pin] |= BIT(INTERRUPT_STS_OFF);
+	priv->regs[WAKE_INT_STATUS_REG0 / 4] |= lower_32_bits(status);
+	priv->regs[WAKE_INT_STATUS_REG1 / 4] |= upper_32_bits(status);
+}
+
+static bool amd_coalesce_unmasked(struct amd_coalesce_test *priv,
+				  unsigned int pin)
+{
+	return priv->regs[pin] & BIT(INTERRUPT_MASK_OFF);
+}
+
+/* Storm the test line until the handler switches to polling */
+static void amd_coalesce_storm(struct kunit *test)
+{
+	struct amd_coalesce_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	unsigned int i;
+
+	WRITE_ONCE(gpio_dev->coalesce_rate, COALESCE_RATE);
+	for (i = 0; i <= COALESCE_RATE; i++) {
+		KUNIT_ASSERT_FALSE(test, gpio_dev->coalescing);
+		amd_coalesce_inject(priv, COALESCE_STORM_PIN);
+		amd_gpio_irq_handler(1, gpio_dev);
+	}
+	KUNIT_ASSERT_TRUE(test, gpio_dev->coalescing);
+
+	/* Run the worker from the test from now on */
+	cancel_delayed_work_sync(&gpio_dev->poll_work);
+}
+
+static void amd_gpio_irq_coalesce_off_by_default(struct kunit *test)
+{
+	struct amd_coalesce_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	unsigned int i;
+
+	for (i = 0; i < 10 * COALESCE_RATE; i++) {
+		amd_coalesce_inject(priv, COALESCE_STORM_PIN);
+		amd_gpio_irq_handler(1, gpio_dev);
+	}
+
+	KUNIT_EXPECT_FALSE(test, gpio_dev->coalescing);
+	KUNIT_EXPECT_TRUE(test, amd_coalesce_unmasked(priv, COALESCE_STORM_PIN));
+	KUNIT_EXPECT_EQ(test, coalesce_isr_count[COALESCE_STORM_PIN],
+			10 * COALESCE_RATE);
+	KUNIT_EXPECT_EQ(test, gpio_dev->irq_stats[COALESCE_STORM_PIN].count,
+			10 * COALESCE_RATE);
+}
+
+static void amd_gpio_irq_coalesce_polls_storm(struct kunit *test)
+{
+	struct amd_coalesce_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	unsigned int i, pin;
+
+	amd_coalesce_storm(test);
+
+	for (i = 0; i < ARRAY_SIZE(coalesce_irq_pins); i++) {
+		pin = coalesce_irq_pins[i];
+		KUNIT_EXPECT_FALSE_MSG(test, amd_coalesce_unmasked(priv, pin),
+				       "pin %u", pin);
+		KUNIT_EXPECT_TRUE_MSG(test, test_bit(pin, gpio_dev->coalesced),
+				      "pin %u", pin);
+	}
+
+	/* Masked lines no longer run from the interrupt handler */
+	amd_coalesce_inject(priv, COALESCE_STORM_PIN);
+	amd_coalesce_inject(priv, 42);
+	amd_gpio_irq_handler(1, gpio_dev);
+	KUNIT_EXPECT_EQ(test, coalesce_isr_count[COALESCE_STORM_PIN],
+			COALESCE_RATE + 1);
+	KUNIT_EXPECT_EQ(test, coalesce_isr_count[42], 0);
+
+	/* The worker runs them, clears their status and keeps them masked */
+	amd_gpio_poll(&gpio_dev->poll_work.work);
+	cancel_delayed_work_sync(&gpio_dev->poll_work);
+	KUNIT_EXPECT_EQ(test, coalesce_isr_count[COALESCE_STORM_PIN],
+			COALESCE_RATE + 2);
+	KUNIT_EXPECT_EQ(test, coalesce_isr_count[42], 1);
+	KUNIT_EXPECT_EQ(test, coalesce_isr_count[3], 0);
+	KUNIT_EXPECT_FALSE(test, priv->regs[42] & PIN_IRQ_PENDING);
+	KUNIT_EXPECT_FALSE(test, amd_coalesce_unmasked(priv, 42));
+	KUNIT_EXPECT_TRUE(test, gpio_dev->coalescing);
+
+	/* A quiet window hands the lines back to the interrupt handler */
+	priv->regs[WAKE_INT_MASTER_REG / 4] = 0;
+	gpio_dev->poll_window_start = jiffies - HZ;
+	amd_gpio_poll(&gpio_dev->poll_work.work);
+	KUNIT_EXPECT_FALSE(test, gpio_dev->coalescing);
+	KUNIT_EXPECT_FALSE(test, delayed_work_pending(&gpio_dev->poll_work));
+	KUNIT_EXPECT_TRUE(test, priv->regs[WAKE_INT_MASTER_REG / 4] & EOI_MASK);
+	for (i = 0; i < ARRAY_SIZE(coalesce_irq_pins); i++) {
+		pin = coalesce_irq_pins[i];
+		KUNIT_EXPECT_TRUE_MSG(test, amd_coalesce_unmasked(priv, pin),
+				      "pin %u", pin);
+	}
+	KUNIT_EXPECT_TRUE(test, bitmap_empty(gpio_dev->coalesced,
+					     COALESCE_NGPIO));
+}
+
+static void amd_gpio_irq_coalesce_keeps_core_mask(struct kunit *test)
+{
+	struct amd_coalesce_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	struct irq_data *d3, *d42;
+
+	d3 = irq_get_irq_data(priv->irqs[0]);
+	d42 = irq_get_irq_data(priv->irqs[2]);
+	amd_gpio_irq_mask(d42);
+
+	amd_coalesce_storm(test);
+	KUNIT_EXPECT_FALSE(test, test_bit(42, gpio_dev->coalesced));
+
+	/* Masked by the core while polling: stays masked afterwards */
+	amd_gpio_irq_mask(d3);
+	KUNIT_EXPECT_FALSE(test, test_bit(3, gpio_dev->coalesced));
+
+	/* Unmasked by the core while polling: only once polling stops */
+	amd_gpio_irq_unmask(d42);
+	KUNIT_EXPECT_FALSE(test, amd_coalesce_unmasked(priv, 42));
+	KUNIT_EXPECT_TRUE(test, test_bit(42, gpio_dev->coalesced));
+
+	/* Turning coalescing off stops polling right away */
+	WRITE_ONCE(gpio_dev->coalesce_rate, 0);
+	amd_gpio_poll(&gpio_dev->poll_work.work);
+	KUNIT_EXPECT_FALSE(test, gpio_dev->coalescing);
+	KUNIT_EXPECT_FALSE(test, amd_coalesce_unmasked(priv, 3));
+	KUNIT_EXPECT_TRUE(test, amd_coalesce_unmasked(priv, 42));
+	KUNIT_EXPECT_TRUE(test, amd_coalesce_unmasked(priv, COALESCE_STORM_PIN));
+}
+
+static void amd_gpio_irq_coalesce_disabled_on_remove(struct kunit *test)
+{
+	struct amd_coalesce_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	unsigned int i;
+
+	amd_coalesce_storm(test);
+	amd_gpio_disable_poll(gpio_dev);
+	KUNIT_EXPECT_FALSE(test, gpio_dev->coalescing);
+	KUNIT_EXPECT_TRUE(test, amd_coalesce_unmasked(priv, COALESCE_STORM_PIN));
+
+	/* The handler is still there, but can no longer queue the worker */
+	WRITE_ONCE(gpio_dev->coalesce_rate, COALESCE_RATE);
+	for (i = 0; i <= 2 * COALESCE_RATE; i++) {
+		amd_coalesce_inject(priv, COALESCE_STORM_PIN);
+		amd_gpio_irq_handler(1, gpio_dev);
+	}
+	KUNIT_EXPECT_FALSE(test, delayed_work_pending(&gpio_dev->poll_work));
+	KUNIT_EXPECT_FALSE(test, schedule_delayed_work(&gpio_dev->poll_work, 0));
+}
+
+static void amd_gpio_irq_coalesce_stats(struct kunit *test)
+{
+	struct amd_coalesce_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	unsigned long flags;
+	unsigned int i;
+
+	for (i = 0; i < 5; i++) {
+		amd_coalesce_inject(priv, COALESCE_STORM_PIN);
+		amd_gpio_irq_handler(1, gpio_dev);
+	}
+	amd_coalesce_inject(priv, 183);
+	amd_gpio_irq_handler(1, gpio_dev);
+
+	KUNIT_EXPECT_EQ(test, gpio_dev->irq_window_events, 6);
+	KUNIT_EXPECT_EQ(test, gpio_dev->irq_stats[COALESCE_STORM_PIN].window, 5);
+
+	/* The window that just ended gives the rates */
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	gpio_dev->irq_window_start = jiffies - HZ;
+	amd_gpio_irq_stats_roll(gpio_dev);
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+	KUNIT_EXPECT_EQ(test, gpio_dev->irq_stats[COALESCE_STORM_PIN].rate, 5);
+	KUNIT_EXPECT_EQ(test, gpio_dev->irq_stats[183].rate, 1);
+	KUNIT_EXPECT_EQ(test, gpio_dev->irq_stats[COALESCE_STORM_PIN].count, 5);
+	KUNIT_EXPECT_EQ(test, gpio_dev->irq_window_events, 0);
+
+	/* A window that ended long ago had no interrupts */
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	gpio_dev->irq_stats[COALESCE_STORM_PIN].window = 3;
+	gpio_dev->irq_window_start = jiffies - 3 * HZ;
+	amd_gpio_irq_stats_roll(gpio_dev);
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+	KUNIT_EXPECT_EQ(test, gpio_dev->irq_stats[COALESCE_STORM_PIN].rate, 0);
+}
+
+static struct kunit_case amd_gpio_irq_coalesce_test_cases[] = {
+	KUNIT_CASE(amd_gpio_irq_coalesce_off_by_default),
+	KUNIT_CASE(amd_gpio_irq_coalesce_polls_storm),
+	KUNIT_CASE(amd_gpio_irq_coalesce_keeps_core_mask),
+	KUNIT_CASE(amd_gpio_irq_coalesce_disabled_on_remove),
+	KUNIT_CASE(amd_gpio_irq_coalesce_stats),
+	{}
+};
+
+static struct kunit_suite amd_gpio_irq_coalesce_test_suite = {
+	.name = "amd_gpio_irq_coalesce",
+	.init = amd_coalesce_test_init,
+	.test_cases = amd_gpio_irq_coalesce_test_cases,
+};
+
+kunit_test_suite(amd_gpio_irq_coalesce_test_suite);
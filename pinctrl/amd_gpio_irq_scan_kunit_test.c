@@ -0,0 +1,333 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit harness for the pinctrl-amd interrupt handler: injects wake status
+ * patterns into a fake register window, checks which handlers run and what
+ * is left in the registers, and measures the time spent per interrupt
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+
+#include "amd_kunit_mmio.h"
+#include "pinctrl-amd.c"
+
+#define SCAN_REGS_SIZE		0x400
+#define SCAN_NGPIO		184
+#define SCAN_BENCH_ROUNDS	2000
+
+/* Lines with a handler, spread over banks and status groups */
+static const unsigned int scan_irq_pins[] = { 0, 5, 17, 42, 101, 183 };
+
+static unsigned int scan_isr_count[SCAN_NGPIO];
+
+struct amd_scan_test {
+	struct amd_gpio *gpio_dev;
+	u32 *regs;
+	int irqs[ARRAY_SIZE(scan_irq_pins)];
+};
+
+/* The handler before it scanned set bits only and batched the clears */
+static bool amd_ref_irq_handler(int irq, void *dev_id)
+{
+	struct amd_gpio *gpio_dev = dev_id;
+	struct gpio_chip *gc = &gpio_dev->gc;
+	unsigned int i, irqnr;
+	unsigned long flags;
+	u32 __iomem *regs;
+	bool ret = false;
+	u32  regval;
+	u64 status, mask;
+
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	status = readl(gpio_dev->base + WAKE_INT_STATUS_REG1);
+	status <<= 32;
+	status |= readl(gpio_dev->base + WAKE_INT_STATUS_REG0);
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+
+	status &= (1ULL << 46) - 1;
+	regs = gpio_dev->base;
+	for (mask = 1, irqnr = 0; status; mask <<= 1, regs += 4, irqnr += 4) {
+		if (!(status & mask))
+			continue;
+		status &= ~mask;
+
+		for (i = 0; i < 4; i++) {
+			regval = readl(regs + i);
+
+			if (irq < 0 && (regval & BIT(WAKE_STS_OFF)))
+				return true;
+
+			if (!(regval & PIN_IRQ_PENDING) ||
+			    !(regval & BIT(INTERRUPT_MASK_OFF)))
+				continue;
+			generic_handle_domain_irq_safe(gc->irq.domain, irqnr + i);
+
+			raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+			regval = readl(regs + i);
+			if (!gpiochip_line_is_irq(gc, irqnr + i))
+				regval &= ~BIT(INTERRUPT_MASK_OFF);
+			else
+				ret = true;
+			writel(regval, regs + i);
+			raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+		}
+	}
+	if (irq < 0)
+		return false;
+
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	regval = readl(gpio_dev->base + WAKE_INT_MASTER_REG);
+	regval |= EOI_MASK;
+	writel(regval, gpio_dev->base + WAKE_INT_MASTER_REG);
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+
+	return ret;
+}
+
+static irqreturn_t amd_scan_isr(int irq, void *data)
+{
+	scan_isr_count[(uintptr_t)data]++;
+
+	return IRQ_HANDLED;
+}
+
+static void free_irqs_action(void *data)
+{
+	struct amd_scan_test *priv = data;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(scan_irq_pins); i++)
+		free_irq(priv->irqs[i], (void *)(uintptr_t)scan_irq_pins[i]);
+}
+
+static int amd_scan_test_init(struct kunit *test)
+{
+	struct amd_scan_test *priv;
+	struct amd_gpio *gpio_dev;
+	struct gpio_irq_chip *girq;
+	unsigned int i;
+	int irq, ret;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	gpio_dev = amd_kunit_gpio_dev(test, "amd-scan-gpio", SCAN_NGPIO,
+				      SCAN_REGS_SIZE, &priv->regs);
+
+	gpio_dev->gc.get_direction = amd_gpio_get_direction;
+	girq = &gpio_dev->gc.irq;
+	gpio_irq_chip_set_chip(girq, &amd_gpio_irqchip);
+	girq->default_type = IRQ_TYPE_NONE;
+	girq->handler = handle_simple_irq;
+	amd_kunit_add_gpiochip(test, gpio_dev);
+
+	for (i = 0; i < ARRAY_SIZE(scan_irq_pins); i++) {
+		irq = gpio_dev->gc.to_irq(&gpio_dev->gc, scan_irq_pins[i]);
+		KUNIT_ASSERT_GT(test, irq, 0);
+		ret = request_irq(irq, amd_scan_isr, 0, "amd-scan",
+				  (void *)(uintptr_t)scan_irq_pins[i]);
+		KUNIT_ASSERT_EQ(test, ret, 0);
+		priv->irqs[i] = irq;
+	}
+	ret = kunit_add_action_or_reset(test, free_irqs_action, priv);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+/* Drop every pending status and the EOI, and zero the handler counts */
+static void amd_scan_reset(struct amd_scan_test *priv)
+{
+	unsigned int i;
+
+	for (i = 0; i < SCAN_NGPIO; i++)
+		priv->regs[i] &= ~PIN_IRQ_PENDING;
+	priv->regs[WAKE_INT_MASTER_REG / 4] = 0;
+	priv->regs[WAKE_INT_STATUS_REG0 / 4] = 0;
+	priv->regs[WAKE_INT_STATUS_REG1 / 4] = 0;
+	memset(scan_isr_count, 0, sizeof(scan_isr_count));
+}
+
+/* Raise @sts on @pins and the wake status bits covering them */
+static unsigned int amd_scan_inject(struct amd_scan_test *priv,
+				    const unsigned int *pins, unsigned int n,
+				    u32 sts)
+{
+	u64 status = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		priv->regs[pins[i]] |= sts;
+		status |= BIT_ULL(pins[i] / WAKE_INT_STATUS_PINS);
+	}
+	priv->regs[WAKE_INT_STATUS_REG0 / 4] |= lower_32_bits(status);
+	priv->regs[WAKE_INT_STATUS_REG1 / 4] |= upper_32_bits(status);
+
+	return hweight64(status);
+}
+
+static bool amd_scan_has_irq(unsigned int pin)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(scan_irq_pins); i++)
+		if (scan_irq_pins[i] == pin)
+			return true;
+
+	return false;
+}
+
+static const unsigned int scan_pattern_one[] = { 0 };
+static const unsigned int scan_pattern_two[] = { 5, 17 };
+/* 6 and 100 have no handler, 6 shares its status group with 5 */
+static const unsigned int scan_pattern_mixed[] = { 0, 5, 6, 42, 100, 101, 183 };
+
+static const struct {
+	const unsigned int *pins;
+	unsigned int num;
+} scan_patterns[] = {
+	{ scan_pattern_one, ARRAY_SIZE(scan_pattern_one) },
+	{ scan_pattern_two, ARRAY_SIZE(scan_pattern_two) },
+	{ scan_pattern_mixed, ARRAY_SIZE(scan_pattern_mixed) },
+	{ scan_irq_pins, ARRAY_SIZE(scan_irq_pins) },
+};
+
+static void amd_gpio_irq_scan_runs_pending_handlers(struct kunit *test)
+{
+	struct amd_scan_test *priv = test->priv;
+	unsigned int p, i, pin, groups, num;
+	const unsigned int *pins;
+	irqreturn_t ret;
+	u32 *expected;
+	bool ref;
+
+	expected = kunit_kzalloc(test, SCAN_REGS_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, expected);
+
+	for (p = 0; p < ARRAY_SIZE(scan_patterns); p++) {
+		pins = scan_patterns[p].pins;
+		num = scan_patterns[p].num;
+
+		/* The spurious lines have their interrupt unmasked too */
+		for (i = 0; i < num; i++)
+			priv->regs[pins[i]] |= BIT(INTERRUPT_MASK_OFF);
+
+		amd_scan_reset(priv);
+		amd_scan_inject(priv, pins, num, BIT(INTERRUPT_STS_OFF));
+		ref = amd_ref_irq_handler(1, priv->gpio_dev);
+		memcpy(expected, priv->regs, SCAN_REGS_SIZE);
+
+		for (i = 0; i < num; i++)
+			priv->regs[pins[i]] |= BIT(INTERRUPT_MASK_OFF);
+		amd_scan_reset(priv);
+		groups = amd_scan_inject(priv, pins, num,
+					 BIT(INTERRUPT_STS_OFF));
+		amd_mmio_reads = 0;
+		amd_mmio_writes = 0;
+		ret = amd_gpio_irq_handler(1, priv->gpio_dev);
+
+		KUNIT_EXPECT_EQ(test, ret, IRQ_RETVAL(ref));
+		KUNIT_EXPECT_MEMEQ_MSG(test, priv->regs, expected,
+				       SCAN_REGS_SIZE, "pattern %u", p);
+
+		for (i = 0; i < num; i++) {
+			pin = pins[i];
+			if (amd_scan_has_irq(pin))
+				KUNIT_EXPECT_EQ_MSG(test, scan_isr_count[pin], 1,
+						    "pin %u", pin);
+			else
+				KUNIT_EXPECT_FALSE_MSG(test,
+						       priv->regs[pin] & BIT(INTERRUPT_MASK_OFF),
+						       "spurious pin %u left unmasked",
+						       pin);
+		}
+		KUNIT_EXPECT_TRUE(test, priv->regs[WAKE_INT_MASTER_REG / 4] &
+					EOI_MASK);
+
+		/* Status, four pins per group, one re-read per pin, EOI */
+		KUNIT_EXPECT_EQ(test, amd_mmio_reads,
+				2 + groups * WAKE_INT_STATUS_PINS + num + 1);
+		KUNIT_EXPECT_EQ(test, amd_mmio_writes, num + 1);
+	}
+}
+
+static void amd_gpio_irq_scan_check_wake(struct kunit *test)
+{
+	static const unsigned int irq_pin[] = { 5 };
+	static const unsigned int wake_pin[] = { 42 };
+	struct amd_scan_test *priv = test->priv;
+
+	amd_scan_reset(priv);
+	amd_scan_inject(priv, irq_pin, 1, BIT(INTERRUPT_STS_OFF));
+	amd_scan_inject(priv, wake_pin, 1, BIT(WAKE_STS_OFF));
+
+	KUNIT_EXPECT_TRUE(test, amd_gpio_check_wake(priv->gpio_dev));
+	/* Group 1 comes before the wake pin, and nothing signals EOI */
+	KUNIT_EXPECT_EQ(test, scan_isr_count[5], 1);
+	KUNIT_EXPECT_EQ(test, scan_isr_count[42], 0);
+	KUNIT_EXPECT_EQ(test, priv->regs[WAKE_INT_MASTER_REG / 4], 0);
+
+	amd_scan_reset(priv);
+	amd_scan_inject(priv, irq_pin, 1, BIT(INTERRUPT_STS_OFF));
+	KUNIT_EXPECT_FALSE(test, amd_gpio_check_wake(priv->gpio_dev));
+}
+
+static u64 amd_scan_time(struct amd_scan_test *priv,
+			 irqreturn_t (*handler)(int, void *))
+{
+	unsigned int r;
+	ktime_t start;
+
+	start = ktime_get();
+	for (r = 0; r < SCAN_BENCH_ROUNDS; r++)
+		handler(1, priv->gpio_dev);
+
+	return div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		       SCAN_BENCH_ROUNDS);
+}
+
+static irqreturn_t amd_ref_irq_retval(int irq, void *dev_id)
+{
+	return IRQ_RETVAL(amd_ref_irq_handler(irq, dev_id));
+}
+
+static void amd_gpio_irq_scan_latency(struct kunit *test)
+{
+	static const unsigned int last_pin[] = { 183 };
+	struct amd_scan_test *priv = test->priv;
+	u64 t_ref, t_scan;
+	unsigned int p;
+
+	for (p = 0; p < 2; p++) {
+		const unsigned int *pins = p ? scan_irq_pins : last_pin;
+		unsigned int num = p ? ARRAY_SIZE(scan_irq_pins) : 1;
+
+		/* The fake status is not cleared, every round sees it */
+		amd_scan_reset(priv);
+		amd_scan_inject(priv, pins, num, BIT(INTERRUPT_STS_OFF));
+
+		t_ref = amd_scan_time(priv, amd_ref_irq_retval);
+		t_scan = amd_scan_time(priv, amd_gpio_irq_handler);
+
+		kunit_info(test, "%u pending pins: per bit scan %llu ns, set bit scan %llu ns per interrupt\n",
+			   num, t_ref, t_scan);
+	}
+}
+
+static struct kunit_case amd_gpio_irq_scan_test_cases[] = {
+	KUNIT_CASE(amd_gpio_irq_scan_runs_pending_handlers),
+	KUNIT_CASE(amd_gpio_irq_scan_check_wake),
+	KUNIT_CASE_SLOW(amd_gpio_irq_scan_latency),
+	{}
+};
+
+static struct kunit_suite amd_gpio_irq_scan_test_suite = {
+	.name = "amd_gpio_irq_scan",
+	.init = amd_scan_test_init,
+	.test_cases = amd_gpio_irq_scan_test_cases,
+};
+
+kunit_test_suite(amd_gpio_irq_scan_test_suite);
@@ -0,0 +1,387 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit stress test for the lockless pinctrl-amd read accessors: reader
+ * threads sample a fake register window through amd_gpio_get_value(),
+ * amd_gpio_get_direction(), amd_gpio_get_multiple() and amd_gpio_peek_cfg()
+ * while writer threads run amd_gpio_set_value(), the direction setters and
+ * amd_pinconf_set() on the same pins, and no read may see a register value
+ * that no writer ever wrote
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/atomic.h>
+#include <linux/delay.h>
+#include <linux/gpio/driver.h>
+#include <linux/io.h>
+#include <linux/kthread.h>
+#include <linux/pinctrl/pinctrl.h>
+
+#include "pinctrl-amd.h"
+
+/* Like the hardware, PIN_STS is read only */
+static inline void amd_ro_writel(u32 value, volatile void __iomem *addr)
+{
+	u32 sts = readl(addr) & BIT(PIN_STS_OFF);
+
+	writel((value & ~BIT(PIN_STS_OFF)) | sts, addr);
+}
+
+#undef writel
+#define writel amd_ro_writel
+
+#include "amd_kunit_mmio.h"
+#include "pinctrl-amd.c"
+
+#define STRESS_REGS_SIZE	0x100
+#define STRESS_NGPIO		(STRESS_REGS_SIZE / 4)
+#define STRESS_VALUE_WRITERS	2
+#define STRESS_READERS		4
+#define STRESS_MSECS		500
+#define STRESS_DEBOUNCE		488
+
+/* Bits only the output setters change */
+#define STRESS_OUT_BITS		(BIT(OUTPUT_VALUE_OFF) | BIT(OUTPUT_ENABLE_OFF))
+/* Bits amd_pinconf_set() changes in bytes 0 and 2, all in one write */
+#define STRESS_CONF_BITS	(GENMASK(DB_TMR_LARGE_OFF, 0) |		\
+				 (DRV_STRENGTH_SEL_MASK << DRV_STRENGTH_SEL_OFF) | \
+				 BIT(PULL_UP_ENABLE_OFF))
+/* Bits no one writes, but bit 15 of pin 63 would turn off pin 0 debounce */
+#define STRESS_SIG_BITS		(GENMASK(14, 8) | GENMASK(27, 24))
+
+static unsigned long stress_conf_on[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 2),
+	PIN_CONF_PACKED(PIN_CONFIG_INPUT_DEBOUNCE, STRESS_DEBOUNCE),
+};
+
+static unsigned long stress_conf_off[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 0),
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 0),
+	PIN_CONF_PACKED(PIN_CONFIG_INPUT_DEBOUNCE, 0),
+};
+
+struct amd_stress_test;
+
+struct amd_stress_thread {
+	struct amd_stress_test *priv;
+	struct task_struct *task;
+	unsigned int id;
+	unsigned long ops;
+};
+
+struct amd_stress_test {
+	struct amd_gpio *gpio_dev;
+	struct pinctrl_dev *pctldev;
+	u32 *regs;
+	bool shadow;
+	u32 conf_on;
+
+	/* What the writers last set on each pin */
+	u8 value[STRESS_NGPIO];
+	u8 output[STRESS_NGPIO];
+	u8 conf[STRESS_NGPIO];
+
+	atomic_t bad;
+	unsigned int bad_pin;
+	u32 bad_reg;
+	const char *bad_what;
+
+	struct amd_stress_thread readers[STRESS_READERS];
+	struct amd_stress_thread value_writers[STRESS_VALUE_WRITERS];
+	struct amd_stress_thread conf_writer;
+};
+
+static u32 amd_stress_sig(unsigned int pin)
+{
+	return ((pin * 0x9e3779b1) & STRESS_SIG_BITS) |
+	       (pin % 2 ? BIT(PIN_STS_OFF) : 0);
+}
+
+static int amd_stress_test_init(struct kunit *test)
+{
+	struct amd_stress_test *priv;
+	struct amd_gpio *gpio_dev;
+	unsigned int i;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	gpio_dev = amd_kunit_gpio_dev(test, "amd-stress-gpio", STRESS_NGPIO,
+				      STRESS_REGS_SIZE, &priv->regs);
+	gpio_dev->shadow_regs = kunit_kcalloc(test, STRESS_NGPIO,
+					      sizeof(*gpio_dev->shadow_regs),
+					      GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->shadow_regs);
+	priv->pctldev = kunit_kzalloc(test, sizeof(*priv->pctldev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->pctldev);
+
+	for (i = 0; i < STRESS_NGPIO; i++)
+		priv->regs[i] = amd_stress_sig(i);
+
+	priv->pctldev->driver_data = gpio_dev;
+	amd_kunit_add_gpiochip(test, gpio_dev);
+
+	/* The configuration bits the "on" writes leave behind */
+	KUNIT_ASSERT_EQ(test, amd_pinconf_set(priv->pctldev, 0, stress_conf_on,
+					      ARRAY_SIZE(stress_conf_on)), 0);
+	priv->conf_on = priv->regs[0] & STRESS_CONF_BITS;
+	KUNIT_ASSERT_EQ(test, amd_pinconf_set(priv->pctldev, 0, stress_conf_off,
+					      ARRAY_SIZE(stress_conf_off)), 0);
+	KUNIT_ASSERT_EQ(test, priv->regs[0], amd_stress_sig(0));
+	/* Every byte it touches changes, so a torn read shows up */
+	KUNIT_ASSERT_NE(test, priv->conf_on & GENMASK(7, 0), 0);
+	KUNIT_ASSERT_NE(test, priv->conf_on & GENMASK(23, 16), 0);
+
+	atomic_set(&priv->bad, 0);
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+static void amd_stress_bad(struct amd_stress_test *priv, const char *what,
+			   unsigned int pin, u32 reg)
+{
+	if (atomic_inc_return(&priv->bad) == 1) {
+		priv->bad_what = what;
+		priv->bad_pin = pin;
+		priv->bad_reg = reg;
+	}
+}
+
+/* Whether @reg is something the writers could have left in @pin */
+static bool amd_stress_valid(struct amd_stress_test *priv, unsigned int pin,
+			     u32 reg)
+{
+	u32 sig = amd_stress_sig(pin);
+	u32 conf = reg & STRESS_CONF_BITS;
+
+	if (priv->shadow)
+		sig &= ~PIN_VOLATILE_BITS;
+
+	if ((reg & ~(STRESS_CONF_BITS | STRESS_OUT_BITS)) != sig)
+		return false;
+
+	return conf == 0 || conf == priv->conf_on;
+}
+
+static int amd_stress_reader(void *data)
+{
+	struct amd_stress_thread *t = data;
+	struct amd_stress_test *priv = t->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	struct gpio_chip *gc = &gpio_dev->gc;
+	DECLARE_BITMAP(mask, STRESS_NGPIO);
+	DECLARE_BITMAP(bits, STRESS_NGPIO);
+	unsigned int pin;
+	u32 reg;
+	int dir;
+
+	bitmap_fill(mask, STRESS_NGPIO);
+
+	while (!kthread_should_stop()) {
+		for (pin = 0; pin < STRESS_NGPIO; pin++) {
+			reg = amd_gpio_peek_cfg(gpio_dev, pin);
+			if (!amd_stress_valid(priv, pin, reg))
+				amd_stress_bad(priv, "peek_cfg", pin, reg);
+
+			if (amd_gpio_get_value(gc, pin) != pin % 2)
+				amd_stress_bad(priv, "get_value", pin,
+					       readl(gpio_dev->base + pin * 4));
+
+			dir = amd_gpio_get_direction(gc, pin);
+			if (dir != GPIO_LINE_DIRECTION_IN &&
+			    dir != GPIO_LINE_DIRECTION_OUT)
+				amd_stress_bad(priv, "get_direction", pin, dir);
+		}
+
+		amd_gpio_get_multiple(gc, mask, bits);
+		for (pin = 0; pin < STRESS_NGPIO; pin++)
+			if (test_bit(pin, bits) != pin % 2)
+				amd_stress_bad(priv, "get_multiple", pin,
+					       readl(gpio_dev->base + pin * 4));
+
+		t->ops++;
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/*
+ * Each value writer owns every STRESS_VALUE_WRITERS'th pin, so only it
+ * changes their output bits and it can check that the lockless
+ * amd_gpio_get_direction() sees what it just set.
+ */
+static int amd_stress_value_writer(void *data)
+{
+	struct amd_stress_thread *t = data;
+	struct amd_stress_test *priv = t->priv;
+	struct gpio_chip *gc = &priv->gpio_dev->gc;
+	unsigned int pin;
+	int value, dir;
+
+	while (!kthread_should_stop()) {
+		for (pin = t->id; pin < STRESS_NGPIO;
+		     pin += STRESS_VALUE_WRITERS) {
+			value = (t->ops + pin) % 2;
+
+			if (t->ops % 4 == 0) {
+				amd_gpio_direction_output(gc, pin, value);
+				priv->output[pin] = 1;
+			} else if (t->ops % 4 == 2) {
+				amd_gpio_direction_input(gc, pin);
+				priv->output[pin] = 0;
+			} else {
+				amd_gpio_set_value(gc, pin, value);
+			}
+			if (t->ops % 4 != 2)
+				priv->value[pin] = value;
+
+			dir = amd_gpio_get_direction(gc, pin);
+			if (dir != (priv->output[pin] ? GPIO_LINE_DIRECTION_OUT :
+						      GPIO_LINE_DIRECTION_IN))
+				amd_stress_bad(priv, "own direction", pin, dir);
+		}
+
+		t->ops++;
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/* Flips the configuration bits of every pin between off and on */
+static int amd_stress_conf_writer(void *data)
+{
+	struct amd_stress_thread *t = data;
+	struct amd_stress_test *priv = t->priv;
+	unsigned int pin;
+
+	while (!kthread_should_stop()) {
+		for (pin = 0; pin < STRESS_NGPIO; pin++) {
+			priv->conf[pin] ^= 1;
+			if (priv->conf[pin])
+				amd_pinconf_set(priv->pctldev, pin, stress_conf_on,
+						ARRAY_SIZE(stress_conf_on));
+			else
+				amd_pinconf_set(priv->pctldev, pin, stress_conf_off,
+						ARRAY_SIZE(stress_conf_off));
+		}
+
+		t->ops++;
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static void amd_stress_start(struct kunit *test, struct amd_stress_thread *t,
+			     int (*fn)(void *data), const char *name,
+			     unsigned int id)
+{
+	t->priv = test->priv;
+	t->id = id;
+	t->task = kthread_run(fn, t, "%s/%u", name, id);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, t->task);
+	get_task_struct(t->task);
+}
+
+static unsigned long amd_stress_stop(struct amd_stress_thread *t)
+{
+	if (!IS_ERR_OR_NULL(t->task)) {
+		kthread_stop(t->task);
+		put_task_struct(t->task);
+		t->task = NULL;
+	}
+
+	return t->ops;
+}
+
+static void amd_stress_run(struct kunit *test, bool shadow)
+{
+	struct amd_stress_test *priv = test->priv;
+	unsigned long reads = 0, writes = 0;
+	unsigned int i, pin;
+	u32 expected;
+
+	priv->shadow = shadow;
+	amd_gpio_shadow_enable(priv->gpio_dev, shadow);
+
+	for (i = 0; i < STRESS_READERS; i++)
+		amd_stress_start(test, &priv->readers[i], amd_stress_reader,
+				 "amd-stress-rd", i);
+	for (i = 0; i < STRESS_VALUE_WRITERS; i++)
+		amd_stress_start(test, &priv->value_writers[i],
+				 amd_stress_value_writer, "amd-stress-wr", i);
+	amd_stress_start(test, &priv->conf_writer, amd_stress_conf_writer,
+			 "amd-stress-conf", 0);
+
+	msleep(STRESS_MSECS);
+
+	for (i = 0; i < STRESS_READERS; i++)
+		reads += amd_stress_stop(&priv->readers[i]);
+	for (i = 0; i < STRESS_VALUE_WRITERS; i++)
+		writes += amd_stress_stop(&priv->value_writers[i]);
+	writes += amd_stress_stop(&priv->conf_writer);
+
+	KUNIT_EXPECT_EQ_MSG(test, atomic_read(&priv->bad), 0,
+			    "%s of pin %u read 0x%08x", priv->bad_what,
+			    priv->bad_pin, priv->bad_reg);
+	KUNIT_EXPECT_GT(test, reads, 0);
+	KUNIT_EXPECT_GT(test, writes, 0);
+
+	/* The locked writers did not lose each other's updates either */
+	for (pin = 0; pin < STRESS_NGPIO; pin++) {
+		expected = amd_stress_sig(pin) |
+			   (priv->value[pin] ? BIT(OUTPUT_VALUE_OFF) : 0) |
+			   (priv->output[pin] ? BIT(OUTPUT_ENABLE_OFF) : 0) |
+			   (priv->conf[pin] ? priv->conf_on : 0);
+		KUNIT_EXPECT_EQ_MSG(test, priv->regs[pin], expected,
+				    "pin %u", pin);
+	}
+
+	kunit_info(test, "shadow %s: %lu passes over %u pins by %u readers, %lu by %u writers in %u ms\n",
+		   shadow ? "on" : "off", reads, STRESS_NGPIO, STRESS_READERS,
+		   writes, STRESS_VALUE_WRITERS + 1, STRESS_MSECS);
+}
+
+static void amd_gpio_lockless_read_mmio(struct kunit *test)
+{
+	amd_stress_run(test, false);
+}
+
+static void amd_gpio_lockless_read_shadow(struct kunit *test)
+{
+	amd_stress_run(test, true);
+}
+
+static void amd_stress_test_exit(struct kunit *test)
+{
+	struct amd_stress_test *priv = test->priv;
+	unsigned int i;
+
+	if (!priv)
+		return;
+
+	/* Stop whatever an assertion left running */
+	for (i = 0; i < STRESS_READERS; i++)
+		amd_stress_stop(&priv->readers[i]);
+	for (i = 0; i < STRESS_VALUE_WRITERS; i++)
+		amd_stress_stop(&priv->value_writers[i]);
+	amd_stress_stop(&priv->conf_writer);
+}
+
+static struct kunit_case amd_gpio_lockless_read_test_cases[] = {
+	KUNIT_CASE_SLOW(amd_gpio_lockless_read_mmio),
+	KUNIT_CASE_SLOW(amd_gpio_lockless_read_shadow),
+	{}
+};
+
+static struct kunit_suite amd_gpio_lockless_read_test_suite = {
+	.name = "amd_gpio_lockless_read",
+	.init = amd_stress_test_init,
+	.exit = amd_stress_test_exit,
+	.test_cases = amd_gpio_lockless_read_test_cases,
+};
+
+kunit_test_suite(amd_gpio_lockless_read_test_suite);
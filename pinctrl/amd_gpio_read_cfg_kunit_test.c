@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the pinctrl-amd shadow registers: what they save in MMIO
+ * reads and writes, and that they leave the hardware as running without
+ * them does
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+
+#include "amd_kunit_mmio.h"
+#include "pinctrl-amd.c"
+#include "pinctrl_kunit.h"
+
+#define SHADOW_REGS_SIZE	0x400
+/* Three banks, enough for every kerncz pin */
+#define SHADOW_NGPIO		192
+
+struct amd_shadow_test {
+	struct amd_gpio *gpio_dev;
+	struct device *dev;
+	u32 *regs;
+};
+
+static void amd_shadow_fill(u32 *regs)
+{
+	unsigned int i;
+
+	for (i = 0; i < SHADOW_NGPIO; i++)
+		regs[i] = 0x00f0f0f5 ^ (i * 0x01010101);
+	regs[WAKE_INT_MASTER_REG / 4] = 0;
+}
+
+static int amd_shadow_test_init(struct kunit *test)
+{
+	struct amd_shadow_test *priv;
+	struct amd_gpio *gpio_dev;
+	int ret;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	gpio_dev = amd_kunit_gpio_dev(test, "amd-shadow-gpio", SHADOW_NGPIO,
+				      SHADOW_REGS_SIZE, &priv->regs);
+	gpio_dev->shadow_regs = kunit_kcalloc(test, SHADOW_NGPIO,
+					      sizeof(*gpio_dev->shadow_regs),
+					      GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->shadow_regs);
+	gpio_dev->saved_regs = kunit_kcalloc(test, SHADOW_NGPIO,
+					     sizeof(*gpio_dev->saved_regs),
+					     GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->saved_regs);
+	gpio_dev->saveable = kunit_kcalloc(test, BITS_TO_LONGS(SHADOW_NGPIO),
+					   sizeof(unsigned long), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->saveable);
+	gpio_dev->saved = kunit_kcalloc(test, BITS_TO_LONGS(SHADOW_NGPIO),
+					sizeof(unsigned long), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->saved);
+
+	priv->dev = gpio_dev->gc.parent;
+	dev_set_drvdata(priv->dev, gpio_dev);
+
+	gpio_dev->groups = kerncz_groups;
+	gpio_dev->ngroups = ARRAY_SIZE(kerncz_groups);
+
+	amd_pinctrl_desc.name = dev_name(priv->dev);
+	gpio_dev->pctrl = pinctrl_register(&amd_pinctrl_desc, priv->dev,
+					   gpio_dev);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, gpio_dev->pctrl);
+	ret = kunit_add_action_or_reset(test, pinctrl_test_unregister,
+					gpio_dev->pctrl);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	gpio_dev->gc.get_direction = amd_gpio_get_direction;
+	gpio_dev->gc.direction_input = amd_gpio_direction_input;
+	gpio_dev->gc.direction_output = amd_gpio_direction_output;
+	gpio_dev->gc.get = amd_gpio_get_value;
+	gpio_dev->gc.set_rv = amd_gpio_set_value;
+	gpio_dev->gc.get_multiple = amd_gpio_get_multiple;
+	gpio_dev->gc.set_multiple_rv = amd_gpio_set_multiple;
+	amd_kunit_add_gpiochip(test, gpio_dev);
+
+	amd_shadow_fill(priv->regs);
+	amd_gpio_shadow_enable(gpio_dev, true);
+
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+static void amd_shadow_expect_in_sync(struct kunit *test)
+{
+	struct amd_shadow_test *priv = test->priv;
+	unsigned int i;
+
+	for (i = 0; i < SHADOW_NGPIO; i++)
+		KUNIT_EXPECT_EQ_MSG(test, priv->gpio_dev->shadow_regs[i],
+				    priv->regs[i] & ~PIN_VOLATILE_BITS,
+				    "pin %u", i);
+}
+
+static void amd_gpio_read_cfg_skips_mmio(struct kunit *test)
+{
+	struct amd_shadow_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	struct gpio_chip *gc = &gpio_dev->gc;
+	unsigned long config;
+	unsigned int pin;
+	int dir;
+
+	amd_mmio_reads = 0;
+	for (pin = 0; pin < 8; pin++) {
+		amd_gpio_get_direction(gc, pin);
+		config = PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 0);
+		KUNIT_EXPECT_EQ(test, amd_pinconf_get(gpio_dev->pctrl, pin,
+						      &config), 0);
+	}
+	KUNIT_EXPECT_EQ(test, amd_mmio_reads, 0);
+
+	/* The input level is volatile and still comes from the hardware */
+	priv->regs[3] |= BIT(PIN_STS_OFF);
+	KUNIT_EXPECT_EQ(test, amd_gpio_get_value(gc, 3), 1);
+	priv->regs[3] &= ~BIT(PIN_STS_OFF);
+	KUNIT_EXPECT_EQ(test, amd_gpio_get_value(gc, 3), 0);
+	KUNIT_EXPECT_EQ(test, amd_mmio_reads, 2);
+
+	/* A change behind the driver's back only shows with the shadow off */
+	priv->regs[4] ^= BIT(OUTPUT_ENABLE_OFF);
+	dir = amd_gpio_get_direction(gc, 4);
+	amd_gpio_shadow_enable(gpio_dev, false);
+	KUNIT_EXPECT_NE(test, amd_gpio_get_direction(gc, 4), dir);
+
+	amd_mmio_reads = 0;
+	amd_gpio_get_direction(gc, 4);
+	KUNIT_EXPECT_EQ(test, amd_mmio_reads, 1);
+
+	amd_gpio_shadow_enable(gpio_dev, true);
+	amd_shadow_expect_in_sync(test);
+}
+
+static void amd_gpio_shadow_resync(struct kunit *test)
+{
+	struct amd_shadow_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	struct gpio_chip *gc = &gpio_dev->gc;
+
+	/* Firmware turns pin 4 into an output: the shadow misses it */
+	priv->regs[4] &= ~BIT(OUTPUT_ENABLE_OFF);
+	amd_gpio_shadow_enable(gpio_dev, true);
+	priv->regs[4] |= BIT(OUTPUT_ENABLE_OFF);
+	KUNIT_EXPECT_EQ(test, amd_gpio_get_direction(gc, 4),
+			GPIO_LINE_DIRECTION_IN);
+
+	/* Turning it on again picks it up */
+	amd_gpio_shadow_enable(gpio_dev, true);
+	KUNIT_EXPECT_EQ(test, amd_gpio_get_direction(gc, 4),
+			GPIO_LINE_DIRECTION_OUT);
+	amd_shadow_expect_in_sync(test);
+}
+
+/* A mix of GPIO, pinconf and irq_chip writes */
+static void amd_shadow_run_writes(struct amd_gpio *gpio_dev)
+{
+	struct gpio_chip *gc = &gpio_dev->gc;
+	unsigned long configs[] = {
+		PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 1),
+		PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 2),
+	};
+	struct irq_data d = { .hwirq = 9, .chip_data = gc };
+	unsigned long mask = 0xf0, bits = 0x50;
+
+	amd_gpio_direction_output(gc, 5, 1);
+	amd_gpio_set_value(gc, 5, 0);
+	amd_gpio_direction_input(gc, 6);
+	amd_pinconf_set(gpio_dev->pctrl, 7, configs, ARRAY_SIZE(configs));
+	amd_pinconf_group_set(gpio_dev->pctrl, ARRAY_SIZE(kerncz_groups) - 1,
+			      configs, 1);
+	amd_gpio_set_multiple(gc, &mask, &bits);
+	amd_gpio_irq_mask(&d);
+	d.hwirq = 10;
+	amd_gpio_irq_unmask(&d);
+}
+
+static void amd_gpio_read_cfg_matches_mmio(struct kunit *test)
+{
+	struct amd_shadow_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	unsigned int i;
+	u32 *expected;
+
+	expected = kunit_kzalloc(test, SHADOW_REGS_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, expected);
+
+	amd_gpio_shadow_enable(gpio_dev, false);
+	amd_shadow_fill(priv->regs);
+	amd_shadow_run_writes(gpio_dev);
+	memcpy(expected, priv->regs, SHADOW_REGS_SIZE);
+
+	amd_shadow_fill(priv->regs);
+	amd_gpio_shadow_enable(gpio_dev, true);
+	amd_mmio_reads = 0;
+	amd_mmio_writes = 0;
+	amd_shadow_run_writes(gpio_dev);
+
+	KUNIT_EXPECT_EQ(test, amd_mmio_reads, 0);
+	KUNIT_EXPECT_GT(test, amd_mmio_writes, 0);
+	/* Without the shadow the pending bits were written back */
+	for (i = 0; i < SHADOW_NGPIO; i++)
+		KUNIT_EXPECT_EQ_MSG(test, priv->regs[i] & ~PIN_VOLATILE_BITS,
+				    expected[i] & ~PIN_VOLATILE_BITS,
+				    "pin %u", i);
+	amd_shadow_expect_in_sync(test);
+
+	kunit_info(test, "%u register writes, no reads\n", amd_mmio_writes);
+}
+
+#ifdef CONFIG_PM_SLEEP
+static void amd_gpio_resume_skips_unchanged(struct kunit *test)
+{
+	struct amd_shadow_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	const unsigned int pins[] = { 10, 11, 12 };
+	struct pin_desc *pd;
+	unsigned int i;
+	u32 restored;
+
+	for (i = 0; i < ARRAY_SIZE(pins); i++) {
+		pd = pin_desc_get(gpio_dev->pctrl, pins[i]);
+		KUNIT_ASSERT_NOT_NULL(test, pd);
+		pd->gpio_owner = "amd-shadow-test";
+		amd_gpio_mark_saveable(gpio_dev, pins[i]);
+	}
+
+	/* 10 gets masked, 11 already is, 12 is a wake source */
+	priv->regs[10] = BIT(INTERRUPT_ENABLE_OFF) | BIT(INTERRUPT_MASK_OFF);
+	priv->regs[11] = BIT(INTERRUPT_ENABLE_OFF) | BIT(PULL_UP_ENABLE_OFF);
+	priv->regs[12] = BIT(INTERRUPT_ENABLE_OFF) | BIT(INTERRUPT_MASK_OFF) |
+			 BIT(WAKE_CNTRL_OFF_S0I3);
+	amd_gpio_shadow_enable(gpio_dev, false);
+	amd_gpio_shadow_enable(gpio_dev, true);
+
+	amd_mmio_reads = 0;
+	amd_mmio_writes = 0;
+	KUNIT_ASSERT_EQ(test, amd_gpio_suspend_hibernate_common(priv->dev, true),
+			0);
+	KUNIT_EXPECT_EQ(test, amd_mmio_reads, 0);
+	KUNIT_EXPECT_EQ(test, amd_mmio_writes, 1);
+	KUNIT_EXPECT_FALSE(test, priv->regs[10] & BIT(INTERRUPT_MASK_OFF));
+
+	/* Only the pin masked for suspend needs restoring */
+	amd_mmio_writes = 0;
+	KUNIT_ASSERT_EQ(test, amd_gpio_resume(priv->dev), 0);
+	KUNIT_EXPECT_EQ(test, amd_mmio_writes, 1);
+	KUNIT_EXPECT_TRUE(test, priv->regs[10] & BIT(INTERRUPT_MASK_OFF));
+	amd_shadow_expect_in_sync(test);
+
+	/* A pin that lost its state, and one with a status to clear */
+	KUNIT_ASSERT_EQ(test, amd_gpio_suspend_hibernate_common(priv->dev, true),
+			0);
+	restored = priv->regs[11];
+	priv->regs[11] = 0;
+	priv->regs[12] |= BIT(WAKE_STS_OFF);
+	amd_mmio_writes = 0;
+	KUNIT_ASSERT_EQ(test, amd_gpio_resume(priv->dev), 0);
+	KUNIT_EXPECT_EQ(test, amd_mmio_writes, 3);
+	KUNIT_EXPECT_EQ(test, priv->regs[11], restored);
+	amd_shadow_expect_in_sync(test);
+}
+
+static void amd_gpio_suspend_drops_unclaimed(struct kunit *test)
+{
+	struct amd_shadow_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	struct pin_desc *pd;
+	u32 saved = priv->regs[20] & ~PIN_VOLATILE_BITS;
+
+	/* 20 is claimed, 21 was and is no more, 22 never was */
+	pd = pin_desc_get(gpio_dev->pctrl, 20);
+	KUNIT_ASSERT_NOT_NULL(test, pd);
+	pd->mux_owner = "amd-shadow-test";
+	amd_gpio_mark_saveable(gpio_dev, 20);
+	amd_gpio_mark_saveable(gpio_dev, 21);
+
+	KUNIT_ASSERT_EQ(test, amd_gpio_suspend_hibernate_common(priv->dev, true),
+			0);
+	KUNIT_EXPECT_TRUE(test, test_bit(20, gpio_dev->saved));
+	KUNIT_EXPECT_TRUE(test, test_bit(20, gpio_dev->saveable));
+	KUNIT_EXPECT_FALSE(test, test_bit(21, gpio_dev->saved));
+	KUNIT_EXPECT_FALSE(test, test_bit(21, gpio_dev->saveable));
+	KUNIT_EXPECT_EQ(test, bitmap_weight(gpio_dev->saved, SHADOW_NGPIO), 1);
+	KUNIT_EXPECT_EQ(test, gpio_dev->saved_regs[20], saved);
+
+	/* A pin muxed through the pinmux ops is picked up again */
+	KUNIT_EXPECT_EQ(test, amd_pmx_request(gpio_dev->pctrl, 22), 0);
+	KUNIT_EXPECT_TRUE(test, test_bit(22, gpio_dev->saveable));
+
+	KUNIT_ASSERT_EQ(test, amd_gpio_resume(priv->dev), 0);
+	amd_shadow_expect_in_sync(test);
+}
+#endif
+
+static struct kunit_case amd_gpio_read_cfg_test_cases[] = {
+	KUNIT_CASE(amd_gpio_read_cfg_skips_mmio),
+	KUNIT_CASE(amd_gpio_shadow_resync),
+	KUNIT_CASE(amd_gpio_read_cfg_matches_mmio),
+#ifdef CONFIG_PM_SLEEP
+	KUNIT_CASE(amd_gpio_resume_skips_unchanged),
+	KUNIT_CASE(amd_gpio_suspend_drops_unclaimed),
+#endif
+	{}
+};
+
+static struct kunit_suite amd_gpio_read_cfg_test_suite = {
+	.name = "amd_gpio_read_cfg",
+	.init = amd_shadow_test_init,
+	.test_cases = amd_gpio_read_cfg_test_cases,
+};
+
+kunit_test_suite(amd_gpio_read_cfg_test_suite);
@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * MMIO access counting and the fake controller for the pinctrl-amd KUnit
+ * tests. Include it before pinctrl-amd.c, so that every readl() and writel()
+ * of the driver bumps amd_mmio_reads or amd_mmio_writes on its way to the
+ * fake registers. A test that fakes how the hardware treats a write defines
+ * its own writel() first, the counting then wraps that one.
+ */
+#ifndef _AMD_KUNIT_MMIO_H
+#define _AMD_KUNIT_MMIO_H
+
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/gpio/driver.h>
+#include <linux/interrupt.h>
+#include <linux/io.h>
+#include <linux/pinctrl/pinctrl.h>
+#include <linux/workqueue.h>
+
+#include "pinctrl-amd.h"
+
+static unsigned int amd_mmio_reads;
+static unsigned int amd_mmio_writes;
+
+static inline u32 amd_counted_readl(const volatile void __iomem *addr)
+{
+	amd_mmio_reads++;
+	return readl(addr);
+}
+
+static inline void amd_counted_writel(u32 value, volatile void __iomem *addr)
+{
+	amd_mmio_writes++;
+	writel(value, addr);
+}
+
+#undef readl
+#undef writel
+#define readl amd_counted_readl
+#define writel amd_counted_writel
+
+static inline void amd_kunit_remove_gpiochip(void *gc)
+{
+	gpiochip_remove(gc);
+}
+
+/*
+ * Allocate a gpio_dev over @size bytes of zeroed registers, returned in
+ * @regs, with a gpiochip of @ngpio lines on a new KUnit device named @name.
+ * Fill in the callbacks the test needs, then call amd_kunit_add_gpiochip().
+ */
+static inline struct amd_gpio *
+amd_kunit_gpio_dev(struct kunit *test, const char *name, unsigned int ngpio,
+		   size_t size, u32 **regs)
+{
+	struct amd_gpio *gpio_dev;
+	struct device *dev;
+
+	gpio_dev = kunit_kzalloc(test, sizeof(*gpio_dev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev);
+	gpio_dev->pdev = kunit_kzalloc(test, sizeof(*gpio_dev->pdev),
+				       GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->pdev);
+	*regs = kunit_kzalloc(test, size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, *regs);
+
+	dev = kunit_device_register(test, name);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	raw_spin_lock_init(&gpio_dev->lock);
+	gpio_dev->base = (__force void __iomem *)*regs;
+	gpio_dev->gc.base = -1;
+	gpio_dev->gc.label = name;
+	gpio_dev->gc.parent = dev;
+	gpio_dev->gc.ngpio = ngpio;
+
+	return gpio_dev;
+}
+
+/* Add the gpiochip of @gpio_dev, removed again when the test ends */
+static inline void amd_kunit_add_gpiochip(struct kunit *test,
+					  struct amd_gpio *gpio_dev)
+{
+	int ret;
+
+	ret = gpiochip_add_data(&gpio_dev->gc, gpio_dev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	ret = kunit_add_action_or_reset(test, amd_kunit_remove_gpiochip,
+					&gpio_dev->gc);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+}
+
+#endif /* _AMD_KUNIT_MMIO_H */
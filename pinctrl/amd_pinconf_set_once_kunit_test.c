@@ -0,0 +1,313 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests checking that amd_pinconf_set() and amd_pinconf_group_set()
+ * write each pin register once, and leave it as applying the configs one
+ * at a time did
+ */
+#include <kunit/test.h>
+
+#include "amd_kunit_mmio.h"
+#include "pinctrl-amd.c"
+
+#define ONCE_REGS_SIZE		0x1000
+
+struct amd_once_test {
+	struct pinctrl_dev *pctldev;
+	struct amd_gpio *gpio_dev;
+	u32 *regs;
+	u32 *expected;
+};
+
+/* The debounce handling before it stopped writing the register itself */
+static int amd_ref_set_debounce(struct amd_gpio *gpio_dev, unsigned int offset,
+				unsigned int debounce)
+{
+	u32 time;
+	u32 pin_reg;
+	int ret = 0;
+
+	if (offset == 0) {
+		pin_reg = readl(gpio_dev->base + WAKE_INT_MASTER_REG);
+		if (pin_reg & INTERNAL_GPIO0_DEBOUNCE)
+			debounce = 0;
+	}
+
+	pin_reg = readl(gpio_dev->base + offset * 4);
+
+	if (debounce) {
+		pin_reg |= DB_TYPE_REMOVE_GLITCH << DB_CNTRL_OFF;
+		pin_reg &= ~DB_TMR_OUT_MASK;
+		if (debounce < 61) {
+			pin_reg |= 1;
+			pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
+		} else if (debounce < 976) {
+			time = debounce / 61;
+			pin_reg |= time & DB_TMR_OUT_MASK;
+			pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
+		} else if (debounce < 3900) {
+			time = debounce / 244;
+			pin_reg |= time & DB_TMR_OUT_MASK;
+			pin_reg |= BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
+		} else if (debounce < 250000) {
+			time = debounce / 15625;
+			pin_reg |= time & DB_TMR_OUT_MASK;
+			pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg |= BIT(DB_TMR_LARGE_OFF);
+		} else if (debounce < 1000000) {
+			time = debounce / 62500;
+			pin_reg |= time & DB_TMR_OUT_MASK;
+			pin_reg |= BIT(DB_TMR_OUT_UNIT_OFF);
+			pin_reg |= BIT(DB_TMR_LARGE_OFF);
+		} else {
+			pin_reg &= ~(DB_CNTRl_MASK << DB_CNTRL_OFF);
+			ret = -EINVAL;
+		}
+	} else {
+		pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
+		pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
+		pin_reg &= ~DB_TMR_OUT_MASK;
+		pin_reg &= ~(DB_CNTRl_MASK << DB_CNTRL_OFF);
+	}
+	writel(pin_reg, gpio_dev->base + offset * 4);
+
+	return ret;
+}
+
+/* One read-modify-write of the pin register per config */
+static int amd_ref_pinconf_set(struct amd_gpio *gpio_dev, unsigned int pin,
+			       unsigned long *configs, unsigned int num_configs)
+{
+	enum pin_config_param param;
+	unsigned int i;
+	int ret = 0;
+	u32 pin_reg;
+	u32 arg;
+
+	for (i = 0; i < num_configs; i++) {
+		param = pinconf_to_config_param(configs[i]);
+		arg = pinconf_to_config_argument(configs[i]);
+		pin_reg = readl(gpio_dev->base + pin * 4);
+
+		switch (param) {
+		case PIN_CONFIG_INPUT_DEBOUNCE:
+			return amd_ref_set_debounce(gpio_dev, pin, arg);
+		case PIN_CONFIG_BIAS_PULL_DOWN:
+			pin_reg &= ~BIT(PULL_DOWN_ENABLE_OFF);
+			pin_reg |= (arg & BIT(0)) << PULL_DOWN_ENABLE_OFF;
+			break;
+		case PIN_CONFIG_BIAS_PULL_UP:
+			pin_reg &= ~BIT(PULL_UP_ENABLE_OFF);
+			pin_reg |= (arg & BIT(0)) << PULL_UP_ENABLE_OFF;
+			break;
+		case PIN_CONFIG_DRIVE_STRENGTH:
+			pin_reg &= ~(DRV_STRENGTH_SEL_MASK << DRV_STRENGTH_SEL_OFF);
+			pin_reg |= (arg & DRV_STRENGTH_SEL_MASK) << DRV_STRENGTH_SEL_OFF;
+			break;
+		default:
+			ret = -ENOTSUPP;
+		}
+
+		writel(pin_reg, gpio_dev->base + pin * 4);
+	}
+
+	return ret;
+}
+
+static unsigned long once_pulls[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_DOWN, 0),
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 3),
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 0),
+};
+
+static unsigned long once_debounce_last[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_DOWN, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_INPUT_DEBOUNCE, 2000),
+};
+
+/* Everything after the debounce config is ignored */
+static unsigned long once_debounce_first[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_INPUT_DEBOUNCE, 100000),
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 2),
+};
+
+static unsigned long once_debounce_off[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_INPUT_DEBOUNCE, 0),
+};
+
+static unsigned long once_debounce_too_long[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 0),
+	PIN_CONF_PACKED(PIN_CONFIG_INPUT_DEBOUNCE, 2000000),
+};
+
+/* The unsupported config fails the call, the others still apply */
+static unsigned long once_unsupported[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_SLEW_RATE, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 2),
+	PIN_CONF_PACKED(PIN_CONFIG_INPUT_DEBOUNCE, 30),
+};
+
+static const struct {
+	unsigned long *configs;
+	unsigned int num_configs;
+} once_config_lists[] = {
+	{ once_pulls, ARRAY_SIZE(once_pulls) },
+	{ once_debounce_last, ARRAY_SIZE(once_debounce_last) },
+	{ once_debounce_first, ARRAY_SIZE(once_debounce_first) },
+	{ once_debounce_off, ARRAY_SIZE(once_debounce_off) },
+	{ once_debounce_too_long, ARRAY_SIZE(once_debounce_too_long) },
+	{ once_unsupported, ARRAY_SIZE(once_unsupported) },
+	{ once_pulls, 0 },
+};
+
+/* Pin 63 is skipped, its register is WAKE_INT_MASTER_REG */
+static const unsigned int once_pins[] = { 0, 1, 62, 64, 100, 183 };
+
+static int amd_once_test_init(struct kunit *test)
+{
+	struct amd_once_test *priv;
+	struct amd_gpio *gpio_dev;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	gpio_dev = kunit_kzalloc(test, sizeof(*gpio_dev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev);
+	gpio_dev->pdev = kunit_kzalloc(test, sizeof(*gpio_dev->pdev),
+				       GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->pdev);
+	priv->pctldev = kunit_kzalloc(test, sizeof(*priv->pctldev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->pctldev);
+	priv->regs = kunit_kzalloc(test, ONCE_REGS_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->regs);
+	priv->expected = kunit_kzalloc(test, ONCE_REGS_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->expected);
+
+	raw_spin_lock_init(&gpio_dev->lock);
+	gpio_dev->base = (__force void __iomem *)priv->regs;
+	gpio_dev->groups = kerncz_groups;
+	gpio_dev->ngroups = ARRAY_SIZE(kerncz_groups);
+	priv->pctldev->driver_data = gpio_dev;
+
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+static void amd_once_fill(struct amd_once_test *priv, u32 master)
+{
+	unsigned int i;
+
+	for (i = 0; i < ONCE_REGS_SIZE / 4; i++)
+		priv->regs[i] = 0x00f0f0f5 ^ (i * 0x01010101);
+	priv->regs[WAKE_INT_MASTER_REG / 4] = master;
+}
+
+static void amd_pinconf_set_once_matches_per_config(struct kunit *test)
+{
+	static const u32 masters[] = { 0, INTERNAL_GPIO0_DEBOUNCE };
+	struct amd_once_test *priv = test->priv;
+	unsigned int m, l, p, pin, num;
+	unsigned long *configs;
+	int ret, expected_ret;
+
+	for (m = 0; m < ARRAY_SIZE(masters); m++) {
+		for (l = 0; l < ARRAY_SIZE(once_config_lists); l++) {
+			configs = once_config_lists[l].configs;
+			num = once_config_lists[l].num_configs;
+
+			for (p = 0; p < ARRAY_SIZE(once_pins); p++) {
+				pin = once_pins[p];
+
+				amd_once_fill(priv, masters[m]);
+				expected_ret = amd_ref_pinconf_set(priv->gpio_dev,
+								   pin, configs,
+								   num);
+				memcpy(priv->expected, priv->regs, ONCE_REGS_SIZE);
+
+				amd_once_fill(priv, masters[m]);
+				amd_mmio_writes = 0;
+				ret = amd_pinconf_set(priv->pctldev, pin, configs,
+						      num);
+
+				KUNIT_EXPECT_EQ_MSG(test, ret, expected_ret,
+						    "list %u pin %u master %#x",
+						    l, pin, masters[m]);
+				KUNIT_EXPECT_EQ_MSG(test, amd_mmio_writes,
+						    num ? 1 : 0,
+						    "list %u pin %u", l, pin);
+				KUNIT_EXPECT_MEMEQ_MSG(test, priv->regs,
+						       priv->expected,
+						       ONCE_REGS_SIZE,
+						       "list %u pin %u master %#x",
+						       l, pin, masters[m]);
+			}
+		}
+	}
+}
+
+static void amd_pinconf_group_set_once_matches_per_pin(struct kunit *test)
+{
+	struct amd_once_test *priv = test->priv;
+	const struct pingroup *grp;
+	unsigned int g, l, i, num;
+	unsigned long *configs;
+	int ret, expected_ret;
+
+	for (g = 0; g < ARRAY_SIZE(kerncz_groups); g++) {
+		grp = &kerncz_groups[g];
+		if (grp->npins < 2)
+			continue;
+
+		for (l = 0; l < ARRAY_SIZE(once_config_lists); l++) {
+			configs = once_config_lists[l].configs;
+			num = once_config_lists[l].num_configs;
+
+			amd_once_fill(priv, 0);
+			expected_ret = 0;
+			for (i = 0; i < grp->npins; i++) {
+				if (amd_ref_pinconf_set(priv->gpio_dev,
+							grp->pins[i], configs,
+							num)) {
+					expected_ret = -ENOTSUPP;
+					break;
+				}
+			}
+			memcpy(priv->expected, priv->regs, ONCE_REGS_SIZE);
+
+			amd_once_fill(priv, 0);
+			amd_mmio_writes = 0;
+			ret = amd_pinconf_group_set(priv->pctldev, g, configs,
+						    num);
+
+			KUNIT_EXPECT_EQ_MSG(test, ret, expected_ret,
+					    "group %s list %u", grp->name, l);
+			KUNIT_EXPECT_LE(test, amd_mmio_writes,
+					num ? grp->npins : 0);
+			KUNIT_EXPECT_MEMEQ_MSG(test, priv->regs, priv->expected,
+					       ONCE_REGS_SIZE,
+					       "group %s list %u", grp->name, l);
+		}
+	}
+}
+
+static struct kunit_case amd_pinconf_set_once_test_cases[] = {
+	KUNIT_CASE(amd_pinconf_set_once_matches_per_config),
+	KUNIT_CASE(amd_pinconf_group_set_once_matches_per_pin),
+	{}
+};
+
+static struct kunit_suite amd_pinconf_set_once_test_suite = {
+	.name = "amd_pinconf_set_once",
+	.init = amd_once_test_init,
+	.test_cases = amd_pinconf_set_once_test_cases,
+};
+
+kunit_test_suite(amd_pinconf_set_once_test_suite);
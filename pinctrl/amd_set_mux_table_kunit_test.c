@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the precomputed pinctrl-amd mux table: it must agree with
+ * matching the group names of pmx_functions for every function and group,
+ * and amd_set_mux() must program the iomux byte it names
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+
+#include "pinctrl-amd.c"
+#include "pinctrl_kunit.h"
+
+#define MUX_IOMUX_SIZE		0x100
+
+struct amd_mux_test {
+	struct amd_gpio *gpio_dev;
+	u8 *iomux;
+};
+
+static int amd_mux_test_init(struct kunit *test)
+{
+	struct amd_mux_test *priv;
+	struct amd_gpio *gpio_dev;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	gpio_dev = kunit_kzalloc(test, sizeof(*gpio_dev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev);
+	gpio_dev->pdev = kunit_kzalloc(test, sizeof(*gpio_dev->pdev),
+				       GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, gpio_dev->pdev);
+	priv->iomux = kunit_kzalloc(test, MUX_IOMUX_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->iomux);
+
+	raw_spin_lock_init(&gpio_dev->lock);
+	gpio_dev->iomux_base = (__force void __iomem *)priv->iomux;
+	gpio_dev->groups = kerncz_groups;
+	gpio_dev->ngroups = ARRAY_SIZE(kerncz_groups);
+
+	amd_pinctrl_desc.name = "amd-mux-gpio";
+	gpio_dev->pctrl = pinctrl_test_register(test, &amd_pinctrl_desc,
+						gpio_dev);
+
+	KUNIT_ASSERT_EQ(test, amd_build_mux_table(gpio_dev), 0);
+
+	priv->gpio_dev = gpio_dev;
+	test->priv = priv;
+
+	return 0;
+}
+
+/* The select value amd_set_mux() used to find by name, or -1 */
+static int amd_ref_mux_index(struct amd_gpio *gpio_dev, unsigned int function,
+			     unsigned int group)
+{
+	int index;
+
+	for (index = 0; index < NSELECTS; index++)
+		if (!strcmp(gpio_dev->groups[group].name,
+			    pmx_functions[function].groups[index]))
+			return index;
+
+	return -1;
+}
+
+static int amd_table_mux_index(struct amd_gpio *gpio_dev,
+			       unsigned int function, unsigned int group)
+{
+	int index;
+
+	for (index = 0; index < NSELECTS; index++)
+		if (gpio_dev->mux_groups[function][index] == group)
+			return index;
+
+	return -1;
+}
+
+static void amd_mux_table_matches_names(struct kunit *test)
+{
+	struct amd_mux_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	unsigned int function, group, matches = 0;
+	bool imx;
+	int ref;
+
+	for (function = 0; function < ARRAY_SIZE(pmx_functions); function++) {
+		for (group = 0; group < gpio_dev->ngroups; group++) {
+			ref = amd_ref_mux_index(gpio_dev, function, group);
+			KUNIT_EXPECT_EQ_MSG(test,
+					    amd_table_mux_index(gpio_dev, function, group),
+					    ref, "function %s group %s",
+					    pmx_functions[function].name,
+					    gpio_dev->groups[group].name);
+			if (ref >= 0)
+				matches++;
+		}
+	}
+	KUNIT_EXPECT_EQ(test, matches, ARRAY_SIZE(pmx_functions) * NSELECTS);
+
+	for (group = 0; group < gpio_dev->ngroups; group++) {
+		imx = !strncmp(gpio_dev->groups[group].name, "IMX_F",
+			       strlen("IMX_F"));
+		KUNIT_EXPECT_EQ_MSG(test, test_bit(group, gpio_dev->mux_owned),
+				    imx, "group %s", gpio_dev->groups[group].name);
+	}
+}
+
+static void amd_set_mux_programs_iomux(struct kunit *test)
+{
+	struct amd_mux_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	const struct pingroup *grp;
+	unsigned int function, index, reg;
+	struct pin_desc *pd;
+	int group;
+
+	for (function = 0; function < ARRAY_SIZE(pmx_functions); function++) {
+		reg = pmx_functions[function].index;
+		for (index = 0; index < NSELECTS; index++) {
+			group = gpio_dev->mux_groups[function][index];
+			KUNIT_ASSERT_GE(test, group, 0);
+			grp = &gpio_dev->groups[group];
+
+			KUNIT_EXPECT_EQ(test, amd_set_mux(gpio_dev->pctrl,
+							  function, group), 0);
+			KUNIT_EXPECT_EQ_MSG(test, priv->iomux[reg], index,
+					    "group %s", grp->name);
+
+			pd = pin_desc_get(gpio_dev->pctrl, grp->pins[0]);
+			KUNIT_ASSERT_NOT_NULL(test, pd);
+			KUNIT_EXPECT_STREQ(test, pd->mux_owner, grp->name);
+			pd->mux_owner = NULL;
+		}
+	}
+}
+
+static void amd_set_mux_other_groups(struct kunit *test)
+{
+	struct amd_mux_test *priv = test->priv;
+	struct amd_gpio *gpio_dev = priv->gpio_dev;
+	unsigned int reg = pmx_functions[0].index;
+	int i2c0, other;
+
+	/* A group of no function, and one of another function */
+	i2c0 = pinctrl_get_group_selector(gpio_dev->pctrl, "i2c0");
+	KUNIT_ASSERT_GE(test, i2c0, 0);
+	other = gpio_dev->mux_groups[1][1];
+
+	priv->iomux[reg] = 2;
+	KUNIT_EXPECT_EQ(test, amd_set_mux(gpio_dev->pctrl, 0, i2c0), 0);
+	KUNIT_EXPECT_EQ(test, amd_set_mux(gpio_dev->pctrl, 0, other), 0);
+	KUNIT_EXPECT_EQ(test, priv->iomux[reg], 2);
+
+	/* An iomux byte reading back all ones is not there */
+	priv->iomux[reg] = FUNCTION_INVALID;
+	KUNIT_EXPECT_EQ(test, amd_set_mux(gpio_dev->pctrl, 0,
+					  gpio_dev->mux_groups[0][1]), -EINVAL);
+	KUNIT_EXPECT_EQ(test, priv->iomux[reg], FUNCTION_INVALID);
+}
+
+static struct kunit_case amd_set_mux_table_test_cases[] = {
+	KUNIT_CASE(amd_mux_table_matches_names),
+	KUNIT_CASE(amd_set_mux_programs_iomux),
+	KUNIT_CASE(amd_set_mux_other_groups),
+	{}
+};
+
+static struct kunit_suite amd_set_mux_table_test_suite = {
+	.name = "amd_set_mux_table",
+	.init = amd_mux_test_init,
+	.test_cases = amd_set_mux_table_test_cases,
+};
+
+kunit_test_suite(amd_set_mux_table_test_suite);
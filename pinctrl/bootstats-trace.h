@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Tracepoints for the pin control boot time statistics
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pinctrl
+
+#if !defined(_PINCTRL_BOOTSTATS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _PINCTRL_BOOTSTATS_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(pinctrl_boot_stage,
+
+	TP_PROTO(const char *devname, const char *ctrlname, const char *stage,
+		 u64 duration_ns, int ret),
+
+	TP_ARGS(devname, ctrlname, stage, duration_ns, ret),
+
+	TP_STRUCT__entry(
+		__string(devname, devname ?: "-")
+		__string(ctrlname, ctrlname ?: "-")
+		__string(stage, stage)
+		__field(u64, duration_ns)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(devname);
+		__assign_str(ctrlname);
+		__assign_str(stage);
+		__entry->duration_ns = duration_ns;
+		__entry->ret = ret;
+	),
+
+	TP_printk("dev=%s ctrl=%s stage=%s duration_ns=%llu ret=%d",
+		  __get_str(devname), __get_str(ctrlname), __get_str(stage),
+		  __entry->duration_ns, __entry->ret)
+);
+
+TRACE_EVENT(pinctrl_boot_hw_writes,
+
+	TP_PROTO(const char *devname, const char *ctrlname, unsigned int num),
+
+	TP_ARGS(devname, ctrlname, num),
+
+	TP_STRUCT__entry(
+		__string(devname, devname ?: "-")
+		__string(ctrlname, ctrlname ?: "-")
+		__field(unsigned int, num)
+	),
+
+	TP_fast_assign(
+		__assign_str(devname);
+		__assign_str(ctrlname);
+		__entry->num = num;
+	),
+
+	TP_printk("dev=%s ctrl=%s num=%u",
+		  __get_str(devname), __get_str(ctrlname), __entry->num)
+);
+
+#endif /* _PINCTRL_BOOTSTATS_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE bootstats-trace
+
+#include <trace/define_trace.h>
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Boot time statistics for the pin control subsystem
+ *
+ * Records how long obtaining and applying pin control handles takes, and
+ * how much work it does, per consumer device and per pin controller. The
+ * records are keyed by device name so that they survive a consumer being
+ * deferred and probed again, or a pin controller being unregistered.
+ *
+ * Nothing is recorded once the system is running, so that the records stay
+ * a picture of the boot and later state changes cost nothing.
+ */
+
+#include <linux/array_size.h>
+#include <linux/cleanup.h>
+#include <linux/debugfs.h>
+#include <linux/errno.h>
+#include <linux/hashtable.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/minmax.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/stringhash.h>
+
+#include "bootstats.h"
+
+#define CREATE_TRACE_POINTS
+#include "bootstats-trace.h"
+
+#define PINCTRL_BOOT_STATS_HASH_BITS	6
+
+/**
+ * struct pinctrl_boot_record - statistics of one consumer or pin controller
+ * @hnode: node in pinctrl_boot_consumers or pinctrl_boot_controllers
+ * @node: node in the matching list, which keeps the records in the order
+ *	they were first seen
+ * @name: the device name
+ * @calls: the number of times each stage ran
+ * @total_ns: the total time spent in each stage
+ * @max_ns: the longest time spent in each stage
+ * @maps: the number of maps parsed from the device tree
+ * @settings: the number of settings successfully created
+ * @hw_writes: the number of mux and config steps sent to the hardware
+ * @deferrals: the number of times a stage returned -EPROBE_DEFER
+ */
+struct pinctrl_boot_record {
+	struct hlist_node hnode;
+	struct list_head node;
+	const char *name;
+	u64 calls[PINCTRL_BOOT_NR_STAGES];
+	u64 total_ns[PINCTRL_BOOT_NR_STAGES];
+	u64 max_ns[PINCTRL_BOOT_NR_STAGES];
+	unsigned long maps;
+	unsigned long settings;
+	unsigned long hw_writes;
+	unsigned long deferrals;
+};
+
+static const char * const pinctrl_boot_stage_names[] = {
+	[PINCTRL_BOOT_DT_TO_MAP] = "dt_to_map",
+	[PINCTRL_BOOT_ADD_SETTING] = "add_setting",
+	[PINCTRL_BOOT_CLAIM_HOGS] = "claim_hogs",
+	[PINCTRL_BOOT_SELECT_DEFAULT] = "select_default",
+};
+static_assert(ARRAY_SIZE(pinctrl_boot_stage_names) == PINCTRL_BOOT_NR_STAGES);
+
+static DEFINE_MUTEX(pinctrl_boot_stats_mutex);
+static DEFINE_HASHTABLE(pinctrl_boot_consumers, PINCTRL_BOOT_STATS_HASH_BITS);
+static DEFINE_HASHTABLE(pinctrl_boot_controllers, PINCTRL_BOOT_STATS_HASH_BITS);
+static LIST_HEAD(pinctrl_boot_consumer_list);
+static LIST_HEAD(pinctrl_boot_controller_list);
+
+/* Must be called with pinctrl_boot_stats_mutex held */
+static struct pinctrl_boot_record *
+pinctrl_boot_record_get(struct hlist_head *table, struct list_head *list,
+			const char *name)
+{
+	struct pinctrl_boot_record *rec;
+	u32 hash;
+
+	if (!name)
+		return NULL;
+
+	hash = full_name_hash(NULL, name, strlen(name));
+	hlist_for_each_entry(rec,
+			     &table[hash_min(hash, PINCTRL_BOOT_STATS_HASH_BITS)],
+			     hnode)
+		if (!strcmp(rec->name, name))
+			return rec;
+
+	rec = kzalloc(sizeof(*rec), GFP_KERNEL);
+	if (!rec)
+		return NULL;
+	rec->name = kstrdup_const(name, GFP_KERNEL);
+	if (!rec->name) {
+		kfree(rec);
+		return NULL;
+	}
+
+	hlist_add_head(&rec->hnode,
+		       &table[hash_min(hash, PINCTRL_BOOT_STATS_HASH_BITS)]);
+	list_add_tail(&rec->node, list);
+
+	return rec;
+}
+
+static void pinctrl_boot_record_stage(struct pinctrl_boot_record *rec,
+				      enum pinctrl_boot_stage stage, u64 ns,
+				      int ret)
+{
+	if (!rec)
+		return;
+
+	rec->calls[stage]++;
+	rec->total_ns[stage] += ns;
+	rec->max_ns[stage] = max(rec->max_ns[stage], ns);
+
+	if (stage == PINCTRL_BOOT_ADD_SETTING && !ret)
+		rec->settings++;
+	if (ret == -EPROBE_DEFER)
+		rec->deferrals++;
+}
+
+static bool pinctrl_boot_stats_active(void)
+{
+	return system_state < SYSTEM_RUNNING;
+}
+
+/**
+ * pinctrl_boot_stats_start() - timestamp the start of a stage
+ *
+ * Returns 0 without reading the clock once the system is running.
+ */
+u64 pinctrl_boot_stats_start(void)
+{
+	return pinctrl_boot_stats_active() ? ktime_get_ns() : 0;
+}
+
+/**
+ * pinctrl_boot_stats_stage() - account one run of a stage
+ * @devname: the consumer device name, or NULL if it is not known
+ * @ctrlname: the pin controller device name, or NULL if it is not known
+ * @stage: the stage that ran
+ * @start: the value pinctrl_boot_stats_start() returned before it ran
+ * @ret: what the stage returned
+ *
+ * Every PINCTRL_BOOT_ADD_SETTING run that succeeded counts as one setting
+ * created.
+ */
+void pinctrl_boot_stats_stage(const char *devname, const char *ctrlname,
+			      enum pinctrl_boot_stage stage, u64 start, int ret)
+{
+	u64 ns;
+
+	if (!pinctrl_boot_stats_active())
+		return;
+
+	ns = ktime_get_ns() - start;
+	trace_pinctrl_boot_stage(devname, ctrlname,
+				 pinctrl_boot_stage_names[stage], ns, ret);
+
+	guard(mutex)(&pinctrl_boot_stats_mutex);
+
+	pinctrl_boot_record_stage(pinctrl_boot_record_get(pinctrl_boot_consumers,
+							  &pinctrl_boot_consumer_list,
+							  devname),
+				  stage, ns, ret);
+	pinctrl_boot_record_stage(pinctrl_boot_record_get(pinctrl_boot_controllers,
+							  &pinctrl_boot_controller_list,
+							  ctrlname),
+				  stage, ns, ret);
+}
+
+/**
+ * pinctrl_boot_stats_hw_writes() - account the mux and config steps of a
+ *	state commit
+ * @devname: the consumer device name
+ * @ctrlname: the pin controller device name, or NULL if the steps went to
+ *	several of them
+ * @num: the number of .set_mux(), .pin_config_set() or
+ *	.pin_config_group_set() calls, or of steps of a batch
+ *
+ * The core does not see the registers themselves, each step is counted as
+ * one write.
+ */
+void pinctrl_boot_stats_hw_writes(const char *devname, const char *ctrlname,
+				  unsigned int num)
+{
+	struct pinctrl_boot_record *rec;
+
+	if (!pinctrl_boot_stats_active())
+		return;
+
+	trace_pinctrl_boot_hw_writes(devname, ctrlname, num);
+
+	guard(mutex)(&pinctrl_boot_stats_mutex);
+
+	rec = pinctrl_boot_record_get(pinctrl_boot_consumers,
+				      &pinctrl_boot_consumer_list, devname);
+	if (rec)
+		rec->hw_writes += num;
+	rec = pinctrl_boot_record_get(pinctrl_boot_controllers,
+				      &pinctrl_boot_controller_list, ctrlname);
+	if (rec)
+		rec->hw_writes += num;
+}
+
+/**
+ * pinctrl_boot_stats_maps() - account maps parsed from the device tree
+ * @devname: the consumer device name
+ * @ctrlname: the name of the pin controller that parsed them
+ * @num: the number of maps
+ */
+void pinctrl_boot_stats_maps(const char *devname, const char *ctrlname,
+			     unsigned int num)
+{
+	struct pinctrl_boot_record *rec;
+
+	if (!pinctrl_boot_stats_active())
+		return;
+
+	guard(mutex)(&pinctrl_boot_stats_mutex);
+
+	rec = pinctrl_boot_record_get(pinctrl_boot_consumers,
+				      &pinctrl_boot_consumer_list, devname);
+	if (rec)
+		rec->maps += num;
+	rec = pinctrl_boot_record_get(pinctrl_boot_controllers,
+				      &pinctrl_boot_controller_list, ctrlname);
+	if (rec)
+		rec->maps += num;
+}
+
+#ifdef CONFIG_DEBUG_FS
+
+static void pinctrl_boot_stats_show_list(struct seq_file *s,
+					 struct list_head *list)
+{
+	struct pinctrl_boot_record *rec;
+	unsigned int i;
+
+	list_for_each_entry(rec, list, node) {
+		seq_printf(s, "%s: maps %lu settings %lu writes %lu deferrals %lu\n",
+			   rec->name, rec->maps, rec->settings, rec->hw_writes,
+			   rec->deferrals);
+		for (i = 0; i < PINCTRL_BOOT_NR_STAGES; i++) {
+			if (!rec->calls[i])
+				continue;
+			seq_printf(s, "  %-14s calls %llu total %llu us max %llu us\n",
+				   pinctrl_boot_stage_names[i], rec->calls[i],
+				   div_u64(rec->total_ns[i], NSEC_PER_USEC),
+				   div_u64(rec->max_ns[i], NSEC_PER_USEC));
+		}
+	}
+}
+
+static int pinctrl_boot_stats_show(struct seq_file *s, void *what)
+{
+	guard(mutex)(&pinctrl_boot_stats_mutex);
+
+	seq_puts(s, "Pin controllers:\n");
+	pinctrl_boot_stats_show_list(s, &pinctrl_boot_controller_list);
+	seq_puts(s, "\nConsumers:\n");
+	pinctrl_boot_stats_show_list(s, &pinctrl_boot_consumer_list);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(pinctrl_boot_stats);
+
+void pinctrl_boot_stats_init_debugfs(struct dentry *root)
+{
+	debugfs_create_file("boot_stats", 0444, root, NULL,
+			    &pinctrl_boot_stats_fops);
+}
+
+#else
+
+void pinctrl_boot_stats_init_debugfs(struct dentry *root)
+{
+}
+
+#endif /* CONFIG_DEBUG_FS */
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Internal interface between the core pin control system and the boot
+ * time statistics
+ */
+
+#include <linux/types.h>
+
+struct dentry;
+
+/*
+ * The stages of obtaining and applying pin control handles that are timed,
+ * per consumer device and per pin controller.
+ */
+enum pinctrl_boot_stage {
+	PINCTRL_BOOT_DT_TO_MAP,
+	PINCTRL_BOOT_ADD_SETTING,
+	PINCTRL_BOOT_CLAIM_HOGS,
+	PINCTRL_BOOT_SELECT_DEFAULT,
+	PINCTRL_BOOT_NR_STAGES,
+};
+
+#ifdef CONFIG_PINCTRL_BOOT_STATS
+
+u64 pinctrl_boot_stats_start(void);
+void pinctrl_boot_stats_stage(const char *devname, const char *ctrlname,
+			      enum pinctrl_boot_stage stage, u64 start, int ret);
+void pinctrl_boot_stats_hw_writes(const char *devname, const char *ctrlname,
+				  unsigned int num);
+void pinctrl_boot_stats_maps(const char *devname, const char *ctrlname,
+			     unsigned int num);
+void pinctrl_boot_stats_init_debugfs(struct dentry *root);
+
+#else
+
+static inline u64 pinctrl_boot_stats_start(void)
+{
+	return 0;
+}
+
+static inline void pinctrl_boot_stats_stage(const char *devname,
+					    const char *ctrlname,
+					    enum pinctrl_boot_stage stage,
+					    u64 start, int ret)
+{
+}
+
+static inline void pinctrl_boot_stats_hw_writes(const char *devname,
+						const char *ctrlname,
+						unsigned int num)
+{
+}
+
+static inline void pinctrl_boot_stats_maps(const char *devname,
+					   const char *ctrlname,
+					   unsigned int num)
+{
+}
+
+static inline void pinctrl_boot_stats_init_debugfs(struct dentry *root)
+{
+}
+
+#endif
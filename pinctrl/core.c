@@ -13,16 +13,27 @@
 #define pr_fmt(fmt) "pinctrl core: " fmt
 
 #include <linux/array_size.h>
+#include <linux/async.h>
 #include <linux/cleanup.h>
+#include <linux/cpumask.h>
 #include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/err.h>
 #include <linux/export.h>
+#include <linux/hash.h>
+#include <linux/hashtable.h>
 #include <linux/init.h>
 #include <linux/kref.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/overflow.h>
+#include <linux/rculist.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/stringhash.h>
+#include <linux/xarray.h>
 
 #include <linux/gpio.h>
 #include <linux/gpio/driver.h>
@@ -32,6 +43,7 @@
 #include <linux/pinctrl/machine.h>
 #include <linux/pinctrl/pinctrl.h>
 
+#include "bootstats.h"
 #include "core.h"
 #include "devicetree.h"
 #include "pinconf.h"
@@ -40,23 +52,37 @@
 static bool pinctrl_dummy_state;
 
 /* Mutex taken to protect pinctrl_list */
-static DEFINE_MUTEX(pinctrl_list_mutex);
+DEFINE_MUTEX(pinctrl_list_mutex);
 
 /* Mutex taken to protect pinctrl_maps */
 DEFINE_MUTEX(pinctrl_maps_mutex);
 
-/* Mutex taken to protect pinctrldev_list */
+/*
+ * Mutex taken to protect updates of pinctrldev_list and its hashes, lookups
+ * may instead walk them under rcu_read_lock()
+ */
 static DEFINE_MUTEX(pinctrldev_list_mutex);
 
 /* Global list of pin control devices (struct pinctrl_dev) */
 static LIST_HEAD(pinctrldev_list);
 
+#define PINCTRLDEV_HASH_BITS	5
+
+/* Indexes of pinctrldev_list by device name and by device tree node */
+static DEFINE_HASHTABLE(pinctrldev_name_hash, PINCTRLDEV_HASH_BITS);
+static DEFINE_HASHTABLE(pinctrldev_of_hash, PINCTRLDEV_HASH_BITS);
+
 /* List of pin controller handles (struct pinctrl) */
 static LIST_HEAD(pinctrl_list);
 
 /* List of pinctrl maps (struct pinctrl_maps) */
 LIST_HEAD(pinctrl_maps);
 
+#define PINCTRL_MAPS_HASH_BITS	8
+
+/* Index of pinctrl_maps by consumer device name (struct pinctrl_maps_dev) */
+static DEFINE_HASHTABLE(pinctrl_maps_hash, PINCTRL_MAPS_HASH_BITS);
+
 
 /**
  * pinctrl_provide_dummies() - indicate if pinctrl provides dummy state support
@@ -90,6 +116,18 @@ void *pinctrl_dev_get_drvdata(struct pinctrl_dev *pctldev)
 }
 EXPORT_SYMBOL_GPL(pinctrl_dev_get_drvdata);
 
+static struct hlist_head *pinctrldev_name_bucket(const char *devname)
+{
+	u32 key = full_name_hash(NULL, devname, strlen(devname));
+
+	return &pinctrldev_name_hash[hash_min(key, PINCTRLDEV_HASH_BITS)];
+}
+
+static struct hlist_head *pinctrldev_of_bucket(const struct device_node *np)
+{
+	return &pinctrldev_of_hash[hash_ptr(np, PINCTRLDEV_HASH_BITS)];
+}
+
 /**
  * get_pinctrl_dev_from_devname() - look up pin controller device
  * @devname: the name of a device instance, as returned by dev_name()
@@ -104,17 +142,18 @@ struct pinctrl_dev *get_pinctrl_dev_from_devname(const char *devname)
 	if (!devname)
 		return NULL;
 
-	mutex_lock(&pinctrldev_list_mutex);
+	rcu_read_lock();
 
-	list_for_each_entry(pctldev, &pinctrldev_list, node) {
+	hlist_for_each_entry_rcu(pctldev, pinctrldev_name_bucket(devname),
+				 name_hnode) {
 		if (!strcmp(dev_name(pctldev->dev), devname)) {
 			/* Matched on device name */
-			mutex_unlock(&pinctrldev_list_mutex);
+			rcu_read_unlock();
 			return pctldev;
 		}
 	}
 
-	mutex_unlock(&pinctrldev_list_mutex);
+	rcu_read_unlock();
 
 	return NULL;
 }
@@ -123,15 +162,15 @@ struct pinctrl_dev *get_pinctrl_dev_from_of_node(struct device_node *np)
 {
 	struct pinctrl_dev *pctldev;
 
-	mutex_lock(&pinctrldev_list_mutex);
+	rcu_read_lock();
 
-	list_for_each_entry(pctldev, &pinctrldev_list, node)
+	hlist_for_each_entry_rcu(pctldev, pinctrldev_of_bucket(np), of_hnode)
 		if (device_match_of_node(pctldev->dev, np)) {
-			mutex_unlock(&pinctrldev_list_mutex);
+			rcu_read_unlock();
 			return pctldev;
 		}
 
-	mutex_unlock(&pinctrldev_list_mutex);
+	rcu_read_unlock();
 
 	return NULL;
 }
@@ -186,6 +225,18 @@ static void pinctrl_free_pindescs(struct pinctrl_dev *pctldev,
 {
 	int i;
 
+	pinmux_free_claims(pctldev);
+
+	if (pctldev->pin_descs) {
+		for (i = 0; i < pctldev->num_pin_descs; i++)
+			if (pctldev->pin_descs[i].dynamic_name)
+				kfree(pctldev->pin_descs[i].name);
+		kfree(pctldev->pin_descs);
+		pctldev->pin_descs = NULL;
+		pctldev->num_pin_descs = 0;
+		return;
+	}
+
 	for (i = 0; i < num_pins; i++) {
 		struct pin_desc *pindesc;
 
@@ -202,27 +253,29 @@ static void pinctrl_free_pindescs(struct pinctrl_dev *pctldev,
 }
 
 static int pinctrl_register_one_pin(struct pinctrl_dev *pctldev,
-				    const struct pinctrl_pin_desc *pin)
+				    const struct pinctrl_pin_desc *pin,
+				    unsigned int index)
 {
 	struct pin_desc *pindesc;
 	int error;
 
+	/* Dense pin controllers have all descriptors allocated up front */
 	pindesc = pin_desc_get(pctldev, pin->number);
-	if (pindesc) {
+	if (pindesc && pindesc->pctldev) {
 		dev_err(pctldev->dev, "pin %d already registered\n",
 			pin->number);
 		return -EINVAL;
 	}
 
-	pindesc = kzalloc(sizeof(*pindesc), GFP_KERNEL);
-	if (!pindesc)
-		return -ENOMEM;
+	if (!pindesc) {
+		pindesc = kzalloc(sizeof(*pindesc), GFP_KERNEL);
+		if (!pindesc)
+			return -ENOMEM;
+	}
 
 	/* Set owner */
 	pindesc->pctldev = pctldev;
-#ifdef CONFIG_PINMUX
-	mutex_init(&pindesc->mux_lock);
-#endif
+	pindesc->index = index;
 
 	/* Copy basic pin info */
 	if (pin->name) {
@@ -238,33 +291,70 @@ static int pinctrl_register_one_pin(struct pinctrl_dev *pctldev,
 
 	pindesc->drv_data = pin->drv_data;
 
-	error = radix_tree_insert(&pctldev->pin_desc_tree, pin->number, pindesc);
-	if (error)
-		goto failed;
+	if (!pctldev->pin_descs) {
+		error = radix_tree_insert(&pctldev->pin_desc_tree, pin->number,
+					  pindesc);
+		if (error)
+			goto failed;
+	}
 
 	pr_debug("registered pin %d (%s) on %s\n",
 		 pin->number, pindesc->name, pctldev->desc->name);
 	return 0;
 
 failed:
-	kfree(pindesc);
+	/* Slots of the dense array go away with pinctrl_free_pindescs() */
+	if (!pctldev->pin_descs)
+		kfree(pindesc);
 	return error;
 }
 
+/*
+ * Pin numbers are dense if they cover a range without holes, which is true
+ * for most pin controllers. Duplicates are caught when registering the pins.
+ */
+static bool pinctrl_pins_are_dense(const struct pinctrl_pin_desc *pins,
+				   unsigned int num_descs, unsigned int *base)
+{
+	unsigned int i, lo = UINT_MAX, hi = 0;
+
+	if (!num_descs)
+		return false;
+
+	for (i = 0; i < num_descs; i++) {
+		lo = min(lo, pins[i].number);
+		hi = max(hi, pins[i].number);
+	}
+
+	*base = lo;
+
+	return hi - lo == num_descs - 1;
+}
+
 static int pinctrl_register_pins(struct pinctrl_dev *pctldev,
 				 const struct pinctrl_pin_desc *pins,
 				 unsigned int num_descs)
 {
-	unsigned int i;
+	unsigned int i, base;
 	int ret = 0;
 
+	if (pinctrl_pins_are_dense(pins, num_descs, &base)) {
+		pctldev->pin_descs = kcalloc(num_descs,
+					     sizeof(*pctldev->pin_descs),
+					     GFP_KERNEL);
+		if (!pctldev->pin_descs)
+			return -ENOMEM;
+		pctldev->pin_base = base;
+		pctldev->num_pin_descs = num_descs;
+	}
+
 	for (i = 0; i < num_descs; i++) {
-		ret = pinctrl_register_one_pin(pctldev, &pins[i]);
+		ret = pinctrl_register_one_pin(pctldev, &pins[i], i);
 		if (ret)
 			return ret;
 	}
 
-	return 0;
+	return pinmux_alloc_claims(pctldev, num_descs);
 }
 
 /**
@@ -335,30 +425,61 @@ pinctrl_match_gpio_range(struct pinctrl_dev *pctldev, struct gpio_chip *gc,
  * is false, it means that pinctrl device may not be ready.
  */
 #ifdef CONFIG_GPIOLIB
+/* Check if a gpio range overlaps with the gpio chip */
+static bool pinctrl_gpio_span_overlaps(struct gpio_chip *gc, unsigned int base,
+				       unsigned int npins)
+{
+	return !(base + npins - 1 < gc->base ||
+		 base > gc->base + gc->ngpio - 1);
+}
+
 static bool pinctrl_ready_for_gpio_range(struct gpio_chip *gc,
 					 unsigned int offset)
 {
+	const struct pinctrl_gpio_spans *spans;
+	struct pinctrl_gpio_range *range;
 	struct pinctrl_dev *pctldev;
-	struct pinctrl_gpio_range *range = NULL;
+	bool stale = false;
+	unsigned int i;
 
-	mutex_lock(&pinctrldev_list_mutex);
+	rcu_read_lock();
 
 	/* Loop over the pin controllers */
-	list_for_each_entry(pctldev, &pinctrldev_list, node) {
+	list_for_each_entry_rcu(pctldev, &pinctrldev_list, node) {
+		if (READ_ONCE(pctldev->gpio_spans_stale)) {
+			stale = true;
+			continue;
+		}
 		/* Loop over the ranges */
+		spans = rcu_dereference(pctldev->gpio_spans);
+		for (i = 0; spans && i < spans->num; i++) {
+			if (pinctrl_gpio_span_overlaps(gc, spans->span[i].base,
+						       spans->span[i].npins)) {
+				rcu_read_unlock();
+				return true;
+			}
+		}
+	}
+
+	rcu_read_unlock();
+
+	if (!stale)
+		return false;
+
+	/* Some copies are out of date, look at the ranges themselves */
+	mutex_lock(&pinctrldev_list_mutex);
+	list_for_each_entry(pctldev, &pinctrldev_list, node) {
 		mutex_lock(&pctldev->mutex);
 		list_for_each_entry(range, &pctldev->gpio_ranges, node) {
-			/* Check if any gpio range overlapped with gpio chip */
-			if (range->base + range->npins - 1 < gc->base ||
-			    range->base > gc->base + gc->ngpio - 1)
-				continue;
-			mutex_unlock(&pctldev->mutex);
-			mutex_unlock(&pinctrldev_list_mutex);
-			return true;
+			if (pinctrl_gpio_span_overlaps(gc, range->base,
+						       range->npins)) {
+				mutex_unlock(&pctldev->mutex);
+				mutex_unlock(&pinctrldev_list_mutex);
+				return true;
+			}
 		}
 		mutex_unlock(&pctldev->mutex);
 	}
-
 	mutex_unlock(&pinctrldev_list_mutex);
 
 	return false;
@@ -410,6 +531,42 @@ static int pinctrl_get_device_gpio_range(struct gpio_chip *gc,
 	return -EPROBE_DEFER;
 }
 
+/*
+ * Called with pctldev->mutex held whenever pctldev->gpio_ranges changed.
+ * Lockless readers only ever look at the copy, never at the ranges, so a
+ * range may be freed as soon as it is off the list.
+ */
+static void pinctrl_update_gpio_spans(struct pinctrl_dev *pctldev)
+{
+	struct pinctrl_gpio_spans *spans = NULL, *old;
+	struct pinctrl_gpio_range *range;
+	unsigned int num = 0;
+
+	list_for_each_entry(range, &pctldev->gpio_ranges, node)
+		num++;
+
+	if (num) {
+		spans = kmalloc(struct_size(spans, span, num), GFP_KERNEL);
+		if (!spans) {
+			WRITE_ONCE(pctldev->gpio_spans_stale, true);
+			return;
+		}
+		spans->num = num;
+		num = 0;
+		list_for_each_entry(range, &pctldev->gpio_ranges, node) {
+			spans->span[num].base = range->base;
+			spans->span[num].npins = range->npins;
+			num++;
+		}
+	}
+
+	old = rcu_replace_pointer(pctldev->gpio_spans, spans,
+				  lockdep_is_held(&pctldev->mutex));
+	WRITE_ONCE(pctldev->gpio_spans_stale, false);
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
 /**
  * pinctrl_add_gpio_range() - register a GPIO range for a controller
  * @pctldev: pin controller device to add the range to
@@ -427,6 +584,7 @@ void pinctrl_add_gpio_range(struct pinctrl_dev *pctldev,
 {
 	mutex_lock(&pctldev->mutex);
 	list_add_tail(&range->node, &pctldev->gpio_ranges);
+	pinctrl_update_gpio_spans(pctldev);
 	mutex_unlock(&pctldev->mutex);
 }
 EXPORT_SYMBOL_GPL(pinctrl_add_gpio_range);
@@ -527,16 +685,223 @@ EXPORT_SYMBOL_GPL(pinctrl_find_gpio_range_from_pin);
  * pinctrl_remove_gpio_range() - remove a range of GPIOs from a pin controller
  * @pctldev: pin controller device to remove the range from
  * @range: the GPIO range to remove
+ *
+ * The range may be freed as soon as this returns.
  */
 void pinctrl_remove_gpio_range(struct pinctrl_dev *pctldev,
 			       struct pinctrl_gpio_range *range)
 {
 	mutex_lock(&pctldev->mutex);
 	list_del(&range->node);
+	pinctrl_update_gpio_spans(pctldev);
 	mutex_unlock(&pctldev->mutex);
 }
 EXPORT_SYMBOL_GPL(pinctrl_remove_gpio_range);
 
+/*
+ * Group and function names are resolved to selectors for every mux and
+ * config map of every consumer. Drivers only offer get_count()/get_name()
+ * for that, so on controllers with thousands of groups a linear scan per
+ * map dominates boot. The index below is an open addressed hash table built
+ * from those callbacks on the first lookup, and kept at most half full.
+ */
+#define PINCTRL_NAME_INDEX_MIN_BITS	4
+
+static unsigned int pinctrl_name_index_hash(const char *name, unsigned int bits)
+{
+	return hash_32(full_name_hash(NULL, name, strlen(name)), bits);
+}
+
+/* Returns false if @name is already there, the first selector wins */
+static bool pinctrl_name_index_insert(struct pinctrl_name_index *index,
+				      const char *name, unsigned int selector)
+{
+	unsigned int mask = BIT(index->bits) - 1;
+	unsigned int i = pinctrl_name_index_hash(name, index->bits);
+
+	for (; index->slots[i].name; i = (i + 1) & mask)
+		if (!strcmp(index->slots[i].name, name))
+			return false;
+
+	index->slots[i].name = name;
+	index->slots[i].selector = selector;
+
+	return true;
+}
+
+static int pinctrl_name_index_alloc(struct pinctrl_name_index *index,
+				    unsigned int count)
+{
+	unsigned int bits;
+
+	bits = max(order_base_2(size_mul(count, 2)), PINCTRL_NAME_INDEX_MIN_BITS);
+	if (bits > 31)
+		return -ENOMEM;
+
+	index->slots = kvcalloc(BIT(bits), sizeof(*index->slots), GFP_KERNEL);
+	if (!index->slots)
+		return -ENOMEM;
+	index->bits = bits;
+
+	return 0;
+}
+
+static int pinctrl_name_index_build(struct pinctrl_dev *pctldev,
+				    struct pinctrl_name_index *index,
+				    unsigned int count,
+				    const char *(*get_name)(struct pinctrl_dev *pctldev,
+							    unsigned int selector))
+{
+	unsigned int selector;
+	int ret;
+
+	ret = pinctrl_name_index_alloc(index, count);
+	if (ret)
+		return ret;
+
+	for (selector = 0; selector < count; selector++) {
+		const char *name = get_name(pctldev, selector);
+
+		if (name)
+			pinctrl_name_index_insert(index, name, selector);
+	}
+	index->count = count;
+
+	return 0;
+}
+
+/**
+ * pinctrl_name_index_reset() - drop a name index, it is rebuilt when needed
+ * @pctldev: the pin controller owning @index
+ * @index: &pctldev->group_index or &pctldev->func_index
+ *
+ * Must be called whenever a group or function is removed or renamed, or its
+ * selector changes. pinctrl_name_index_lookup() cannot tell, the index
+ * would keep returning the old selectors.
+ */
+void pinctrl_name_index_reset(struct pinctrl_dev *pctldev,
+			      struct pinctrl_name_index *index)
+{
+	guard(mutex)(&pctldev->name_index_mutex);
+
+	kvfree(index->slots);
+	index->slots = NULL;
+	index->count = 0;
+}
+
+/**
+ * pinctrl_name_index_add() - add a name appended with the next selector
+ * @pctldev: the pin controller owning @index
+ * @index: &pctldev->group_index or &pctldev->func_index
+ * @name: the name of the new group or function
+ * @selector: its selector, which must be the previous count
+ *
+ * Keeps an index that was already built up to date without rescanning all
+ * names, which would make adding n groups one by one quadratic.
+ */
+void pinctrl_name_index_add(struct pinctrl_dev *pctldev,
+			    struct pinctrl_name_index *index,
+			    const char *name, unsigned int selector)
+{
+	struct pinctrl_name_index old;
+	unsigned int i;
+
+	guard(mutex)(&pctldev->name_index_mutex);
+
+	if (!index->slots)
+		return;
+
+	if (selector != index->count)
+		goto drop;
+
+	if (2 * (index->count + 1) > BIT(index->bits)) {
+		old = *index;
+		if (pinctrl_name_index_alloc(index, old.count + 1)) {
+			*index = old;
+			goto drop;
+		}
+		for (i = 0; i < BIT(old.bits); i++)
+			if (old.slots[i].name)
+				pinctrl_name_index_insert(index,
+							  old.slots[i].name,
+							  old.slots[i].selector);
+		kvfree(old.slots);
+	}
+
+	pinctrl_name_index_insert(index, name, selector);
+	index->count++;
+
+	return;
+
+drop:
+	kvfree(index->slots);
+	index->slots = NULL;
+	index->count = 0;
+}
+
+/**
+ * pinctrl_name_index_lookup() - look up the selector of a group or function
+ * @pctldev: the pin controller owning @index
+ * @index: &pctldev->group_index or &pctldev->func_index
+ * @name: the name to look up
+ * @get_count: returns the number of groups or functions
+ * @get_name: returns the name of a group or function selector
+ *
+ * Returns the lowest selector named @name like a linear scan would, or
+ * -EINVAL if there is none. The index is built when it is missing. Groups
+ * or functions appended behind its back are caught by their count, any
+ * other change must drop the index with pinctrl_name_index_reset().
+ */
+int pinctrl_name_index_lookup(struct pinctrl_dev *pctldev,
+			      struct pinctrl_name_index *index,
+			      const char *name,
+			      int (*get_count)(struct pinctrl_dev *pctldev),
+			      const char *(*get_name)(struct pinctrl_dev *pctldev,
+						      unsigned int selector))
+{
+	int count = get_count(pctldev);
+	unsigned int mask, i;
+	int selector;
+
+	guard(mutex)(&pctldev->name_index_mutex);
+
+	if (count <= 0)
+		return -EINVAL;
+
+	if (index->slots && index->count != count) {
+		kvfree(index->slots);
+		index->slots = NULL;
+	}
+
+	if (!index->slots &&
+	    pinctrl_name_index_build(pctldev, index, count, get_name)) {
+		/* Out of memory, fall back to a plain scan */
+		for (selector = 0; selector < count; selector++) {
+			const char *sname = get_name(pctldev, selector);
+
+			if (sname && !strcmp(sname, name))
+				return selector;
+		}
+
+		return -EINVAL;
+	}
+
+	mask = BIT(index->bits) - 1;
+	for (i = pinctrl_name_index_hash(name, index->bits);
+	     index->slots[i].name; i = (i + 1) & mask)
+		if (!strcmp(index->slots[i].name, name))
+			return index->slots[i].selector;
+
+	return -EINVAL;
+}
+
+static void pinctrl_free_name_indexes(struct pinctrl_dev *pctldev)
+{
+	kvfree(pctldev->group_index.slots);
+	kvfree(pctldev->func_index.slots);
+	mutex_destroy(&pctldev->name_index_mutex);
+}
+
 #ifdef CONFIG_GENERIC_PINCTRL_GROUPS
 
 /**
@@ -620,20 +985,11 @@ static int pinctrl_generic_group_name_to_selector(struct pinctrl_dev *pctldev,
 						  const char *function)
 {
 	const struct pinctrl_ops *ops = pctldev->desc->pctlops;
-	int ngroups = ops->get_groups_count(pctldev);
-	int selector = 0;
 
 	/* See if this pctldev has this group */
-	while (selector < ngroups) {
-		const char *gname = ops->get_group_name(pctldev, selector);
-
-		if (gname && !strcmp(function, gname))
-			return selector;
-
-		selector++;
-	}
-
-	return -EINVAL;
+	return pinctrl_name_index_lookup(pctldev, &pctldev->group_index,
+					 function, ops->get_groups_count,
+					 ops->get_group_name);
 }
 
 /**
@@ -672,6 +1028,8 @@ int pinctrl_generic_add_group(struct pinctrl_dev *pctldev, const char *name,
 		return error;
 
 	pctldev->num_groups++;
+	WRITE_ONCE(pctldev->groups_gen, pctldev->groups_gen + 1);
+	pinctrl_name_index_add(pctldev, &pctldev->group_index, name, selector);
 
 	return selector;
 }
@@ -698,6 +1056,8 @@ int pinctrl_generic_remove_group(struct pinctrl_dev *pctldev,
 	devm_kfree(pctldev->dev, group);
 
 	pctldev->num_groups--;
+	WRITE_ONCE(pctldev->groups_gen, pctldev->groups_gen + 1);
+	pinctrl_name_index_reset(pctldev, &pctldev->group_index);
 
 	return 0;
 }
@@ -719,6 +1079,7 @@ static void pinctrl_generic_free_groups(struct pinctrl_dev *pctldev)
 		radix_tree_delete(&pctldev->pin_group_tree, iter.index);
 
 	pctldev->num_groups = 0;
+	pinctrl_name_index_reset(pctldev, &pctldev->group_index);
 }
 
 #else
@@ -736,21 +1097,17 @@ int pinctrl_get_group_selector(struct pinctrl_dev *pctldev,
 			       const char *pin_group)
 {
 	const struct pinctrl_ops *pctlops = pctldev->desc->pctlops;
-	unsigned int ngroups = pctlops->get_groups_count(pctldev);
-	unsigned int group_selector = 0;
-
-	while (group_selector < ngroups) {
-		const char *gname = pctlops->get_group_name(pctldev,
-							    group_selector);
-		if (gname && !strcmp(gname, pin_group)) {
-			dev_dbg(pctldev->dev,
-				"found group selector %u for %s\n",
-				group_selector,
-				pin_group);
-			return group_selector;
-		}
-
-		group_selector++;
+	int group_selector;
+
+	group_selector = pinctrl_name_index_lookup(pctldev,
+						   &pctldev->group_index,
+						   pin_group,
+						   pctlops->get_groups_count,
+						   pctlops->get_group_name);
+	if (group_selector >= 0) {
+		dev_dbg(pctldev->dev, "found group selector %d for %s\n",
+			group_selector, pin_group);
+		return group_selector;
 	}
 
 	dev_err(pctldev->dev, "does not have pin group %s\n",
@@ -809,6 +1166,9 @@ int pinctrl_gpio_request(struct gpio_chip *gc, unsigned int offset)
 		return ret;
 	}
 
+	if (pctldev->async_hogs)
+		pinctrl_wait_for_hogs(pctldev);
+
 	mutex_lock(&pctldev->mutex);
 
 	/* Convert to the pin controllers number space */
@@ -1053,8 +1413,10 @@ static struct pinctrl *create_pinctrl(struct device *dev,
 {
 	struct pinctrl *p;
 	const char *devname;
-	struct pinctrl_maps *maps_node;
+	struct pinctrl_maps_dev *maps_dev;
+	struct pinctrl_map_ref *ref;
 	const struct pinctrl_map *map;
+	u64 start;
 	int ret;
 
 	/*
@@ -1069,20 +1431,21 @@ static struct pinctrl *create_pinctrl(struct device *dev,
 	INIT_LIST_HEAD(&p->states);
 	INIT_LIST_HEAD(&p->dt_maps);
 
+	devname = dev_name(dev);
+
+	start = pinctrl_boot_stats_start();
 	ret = pinctrl_dt_to_map(p, pctldev);
+	pinctrl_boot_stats_stage(devname, pctldev ? dev_name(pctldev->dev) : NULL,
+				 PINCTRL_BOOT_DT_TO_MAP, start, ret);
 	if (ret < 0) {
 		kfree(p);
 		return ERR_PTR(ret);
 	}
 
-	devname = dev_name(dev);
-
 	mutex_lock(&pinctrl_maps_mutex);
-	/* Iterate over the pin control maps to locate the right ones */
-	for_each_pin_map(maps_node, map) {
-		/* Map must be for this device */
-		if (strcmp(map->dev_name, devname))
-			continue;
+	/* Iterate over the pin control maps registered for this device */
+	maps_dev = pinctrl_find_maps_dev(devname);
+	for_each_dev_pin_map(maps_dev, ref, map) {
 		/*
 		 * If pctldev is not null, we are claiming hog for it,
 		 * that means, setting that is served by pctldev by itself.
@@ -1094,7 +1457,10 @@ static struct pinctrl *create_pinctrl(struct device *dev,
 		    strcmp(dev_name(pctldev->dev), map->ctrl_dev_name))
 			continue;
 
+		start = pinctrl_boot_stats_start();
 		ret = add_setting(p, pctldev, map);
+		pinctrl_boot_stats_stage(devname, map->ctrl_dev_name,
+					 PINCTRL_BOOT_ADD_SETTING, start, ret);
 		/*
 		 * At this point the adding of a setting may:
 		 *
@@ -1110,6 +1476,9 @@ static struct pinctrl *create_pinctrl(struct device *dev,
 		 */
 		if (ret == -EPROBE_DEFER) {
 			mutex_unlock(&pinctrl_maps_mutex);
+			/* Keep the DT maps for the next attempt */
+			if (!pctldev)
+				pinctrl_dt_park_maps(p);
 			pinctrl_free(p, false);
 			return ERR_PTR(ret);
 		}
@@ -1177,6 +1546,17 @@ static void pinctrl_free_setting(bool disable_setting,
 	}
 }
 
+/* Along with the programs it was recompiled from */
+static void pinctrl_free_state_prog(struct pinctrl_state_prog *prog)
+{
+	struct pinctrl_state_prog *replaced;
+
+	for (; prog; prog = replaced) {
+		replaced = prog->replaced;
+		kfree(prog);
+	}
+}
+
 static void pinctrl_free(struct pinctrl *p, bool inlist)
 {
 	struct pinctrl_state *state, *n1;
@@ -1190,6 +1570,7 @@ static void pinctrl_free(struct pinctrl *p, bool inlist)
 			kfree(setting);
 		}
 		list_del(&state->node);
+		pinctrl_free_state_prog(state->prog);
 		kfree(state);
 	}
 
@@ -1222,6 +1603,129 @@ void pinctrl_put(struct pinctrl *p)
 }
 EXPORT_SYMBOL_GPL(pinctrl_put);
 
+/**
+ * pinctrl_compile_state() - flatten the settings of a state for commit
+ * @state: the state to compile
+ *
+ * The mux settings go first and the config settings after them, which is the
+ * order pinctrl_commit_state() applies them in. The pins of each mux group are
+ * copied into the same allocation, so that committing the state does not have
+ * to ask the driver for them again, until a generic group of their pin
+ * controller is added or removed, see pinctrl_state_prog_stale().
+ */
+static struct pinctrl_state_prog *
+pinctrl_compile_state(struct pinctrl_state *state)
+{
+	struct pinctrl_setting *setting;
+	struct pinctrl_state_prog *prog;
+	struct pinctrl_state_op *op;
+	unsigned int num_ops = 0, num_mux = 0, total_pins = 0;
+	unsigned int m = 0, c, *pin_buf, *pin_end;
+	const unsigned int *pins = NULL;
+	unsigned int num_pins;
+
+	list_for_each_entry(setting, &state->settings, node) {
+		switch (setting->type) {
+		case PIN_MAP_TYPE_MUX_GROUP:
+			pinmux_get_setting_pins(setting, &pins, &num_pins);
+			total_pins += num_pins;
+			num_mux++;
+			break;
+		case PIN_MAP_TYPE_CONFIGS_PIN:
+		case PIN_MAP_TYPE_CONFIGS_GROUP:
+			break;
+		default:
+			return ERR_PTR(-EINVAL);
+		}
+		num_ops++;
+	}
+
+	prog = kzalloc(size_add(struct_size(prog, ops, num_ops),
+				array_size(total_pins, sizeof(*pin_buf))),
+		       GFP_KERNEL);
+	if (!prog)
+		return ERR_PTR(-ENOMEM);
+
+	prog->num_ops = num_ops;
+	prog->num_mux = num_mux;
+	pin_buf = (unsigned int *)&prog->ops[num_ops];
+	pin_end = pin_buf + total_pins;
+	c = num_mux;
+
+	if (num_ops)
+		prog->pctldev = list_first_entry(&state->settings,
+						 struct pinctrl_setting,
+						 node)->pctldev;
+
+	list_for_each_entry(setting, &state->settings, node) {
+		if (setting->pctldev != prog->pctldev)
+			prog->pctldev = NULL;
+		if (setting->pctldev->async_hogs)
+			prog->async_hogs = true;
+
+		if (setting->type != PIN_MAP_TYPE_MUX_GROUP) {
+			prog->ops[c++].setting = setting;
+			continue;
+		}
+
+		op = &prog->ops[m++];
+		op->setting = setting;
+		op->groups_gen = READ_ONCE(setting->pctldev->groups_gen);
+
+		pinmux_get_setting_pins(setting, &pins, &num_pins);
+		if (WARN_ON(num_pins > pin_end - pin_buf)) {
+			kfree(prog);
+			return ERR_PTR(-EINVAL);
+		}
+		if (num_pins)
+			memcpy(pin_buf, pins, num_pins * sizeof(*pin_buf));
+		op->pins = pin_buf;
+		op->num_pins = num_pins;
+		pin_buf += num_pins;
+	}
+
+	return prog;
+}
+
+/* Whether a group the program cached the pins of may have changed since */
+static bool pinctrl_state_prog_stale(const struct pinctrl_state_prog *prog)
+{
+	const struct pinctrl_state_op *op;
+	unsigned int i;
+
+	for (i = 0; i < prog->num_mux; i++) {
+		op = &prog->ops[i];
+		if (op->groups_gen !=
+		    READ_ONCE(op->setting->pctldev->groups_gen))
+			return true;
+	}
+
+	return false;
+}
+
+static struct pinctrl_state_prog *
+pinctrl_get_state_prog(struct pinctrl_state *state)
+{
+	struct pinctrl_state_prog *prog, *old;
+
+	prog = smp_load_acquire(&state->prog);
+	if (prog)
+		return prog;
+
+	prog = pinctrl_compile_state(state);
+	if (IS_ERR(prog))
+		return prog;
+
+	/* Lookups of the same state may race, the first program wins */
+	old = cmpxchg(&state->prog, NULL, prog);
+	if (old) {
+		kfree(prog);
+		return old;
+	}
+
+	return prog;
+}
+
 /**
  * pinctrl_lookup_state() - retrieves a state handle from a pinctrl handle
  * @p: the pinctrl handle to retrieve the state from
@@ -1230,6 +1734,7 @@ EXPORT_SYMBOL_GPL(pinctrl_put);
 struct pinctrl_state *pinctrl_lookup_state(struct pinctrl *p,
 						 const char *name)
 {
+	struct pinctrl_state_prog *prog;
 	struct pinctrl_state *state;
 
 	state = find_state(p, name);
@@ -1242,6 +1747,12 @@ struct pinctrl_state *pinctrl_lookup_state(struct pinctrl *p,
 		} else
 			state = ERR_PTR(-ENODEV);
 	}
+	if (IS_ERR(state))
+		return state;
+
+	prog = pinctrl_get_state_prog(state);
+	if (IS_ERR(prog))
+		return ERR_CAST(prog);
 
 	return state;
 }
@@ -1256,98 +1767,149 @@ static void pinctrl_link_add(struct pinctrl_dev *pctldev,
 				DL_FLAG_AUTOREMOVE_CONSUMER);
 }
 
-static void pinctrl_cond_disable_mux_setting(struct pinctrl_state *state,
-					     struct pinctrl_setting *target_setting)
+static void pinctrl_disable_mux_ops(const struct pinctrl_state_prog *prog,
+				    unsigned int num_ops)
 {
-	struct pinctrl_setting *setting;
-
-	list_for_each_entry(setting, &state->settings, node) {
-		if (target_setting && (&setting->node == &target_setting->node))
-			break;
+	const struct pinctrl_state_op *op;
+	unsigned int i;
 
-		if (setting->type == PIN_MAP_TYPE_MUX_GROUP)
-			pinmux_disable_setting(setting);
+	for (i = 0; i < num_ops; i++) {
+		op = &prog->ops[i];
+		pinmux_disable_setting_pins(op->setting, op->pins, op->num_pins);
 	}
 }
 
+#ifdef CONFIG_DEBUG_FS
+static void pinctrl_state_account(struct pinctrl_state *state, u64 start,
+				  int ret)
+{
+	struct pinctrl_state_stats *stats = &state->stats;
+	u64 delta = ktime_get_ns() - start;
+
+	stats->commits++;
+	if (ret)
+		stats->failures++;
+	stats->total_ns += delta;
+	if (delta > stats->max_ns)
+		stats->max_ns = delta;
+}
+#else
+static inline void pinctrl_state_account(struct pinctrl_state *state,
+					 u64 start, int ret)
+{
+}
+#endif
+
 /**
- * pinctrl_commit_state() - select/activate/program a pinctrl state to HW
+ * pinctrl_apply_state_prog() - run the program of a state
  * @p: the pinctrl handle for the device that requests configuration
  * @state: the state handle to select/activate/program
  */
-static int pinctrl_commit_state(struct pinctrl *p, struct pinctrl_state *state)
+static int pinctrl_apply_state_prog(struct pinctrl *p,
+				    struct pinctrl_state *state)
 {
-	struct pinctrl_setting *setting;
 	struct pinctrl_state *old_state = READ_ONCE(p->state);
+	int (*apply_batch)(struct pinctrl_dev *pctldev,
+			   const struct pinctrl_state_prog *prog);
+	const struct pinctrl_state_prog *old_prog = NULL;
+	struct pinctrl_state_prog *prog, *fresh, *old;
+	const struct pinctrl_state_op *op;
+	unsigned int i;
 	int ret;
 
-	if (old_state) {
+	/* Release the pins claimed, even if @state gets recompiled below */
+	if (old_state)
+		old_prog = old_state->prog;
+
+	prog = pinctrl_get_state_prog(state);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	if (pinctrl_state_prog_stale(prog)) {
+		fresh = pinctrl_compile_state(state);
+		if (IS_ERR(fresh))
+			return PTR_ERR(fresh);
+		fresh->replaced = prog;
+		old = cmpxchg(&state->prog, prog, fresh);
+		if (old != prog) {
+			/* Recompiled by another commit meanwhile */
+			fresh->replaced = NULL;
+			kfree(fresh);
+			fresh = old;
+		}
+		prog = fresh;
+	}
+
+	if (old_prog) {
 		/*
 		 * For each pinmux setting in the old state, forget SW's record
 		 * of mux owner for that pingroup. Any pingroups which are
 		 * still owned by the new state will be re-acquired by the call
-		 * to pinmux_enable_setting() in the loop below.
+		 * to pinmux_enable_setting_pins() in the loop below.
 		 */
-		pinctrl_cond_disable_mux_setting(old_state, NULL);
+		pinctrl_disable_mux_ops(old_prog, old_prog->num_mux);
 	}
 
 	p->state = NULL;
 
-	/* Apply all the settings for the new state - pinmux first */
-	list_for_each_entry(setting, &state->settings, node) {
-		switch (setting->type) {
-		case PIN_MAP_TYPE_MUX_GROUP:
-			ret = pinmux_enable_setting(setting);
-			break;
-		case PIN_MAP_TYPE_CONFIGS_PIN:
-		case PIN_MAP_TYPE_CONFIGS_GROUP:
-			ret = 0;
-			break;
-		default:
-			ret = -EINVAL;
-			break;
+	apply_batch = NULL;
+	if (prog->pctldev)
+		apply_batch = READ_ONCE(prog->pctldev->apply_batch);
+	if (apply_batch) {
+		/*
+		 * Do the pin ownership bookkeeping of all mux steps here and
+		 * leave programming the hardware, mux first and config after,
+		 * to the driver in a single call.
+		 */
+		for (i = 0; i < prog->num_mux; i++) {
+			op = &prog->ops[i];
+			ret = pinmux_claim_setting_pins(op->setting, op->pins,
+							op->num_pins);
+			if (ret < 0)
+				goto unapply_batch;
 		}
 
+		ret = apply_batch(prog->pctldev, prog);
 		if (ret < 0)
-			goto unapply_new_state;
+			goto unapply_batch;
+		pinctrl_boot_stats_hw_writes(dev_name(p->dev),
+					     dev_name(prog->pctldev->dev),
+					     prog->num_ops);
 
 		/* Do not link hogs (circular dependency) */
-		if (p != setting->pctldev->p)
-			pinctrl_link_add(setting->pctldev, p->dev);
+		if (p != prog->pctldev->p)
+			pinctrl_link_add(prog->pctldev, p->dev);
+
+		p->state = state;
+
+		return 0;
 	}
 
-	/* Apply all the settings for the new state - pinconf after */
-	list_for_each_entry(setting, &state->settings, node) {
-		switch (setting->type) {
-		case PIN_MAP_TYPE_MUX_GROUP:
-			ret = 0;
-			break;
-		case PIN_MAP_TYPE_CONFIGS_PIN:
-		case PIN_MAP_TYPE_CONFIGS_GROUP:
-			ret = pinconf_apply_setting(setting);
-			break;
-		default:
-			ret = -EINVAL;
-			break;
-		}
+	/* Apply all the settings for the new state - pinmux first */
+	for (i = 0; i < prog->num_ops; i++) {
+		op = &prog->ops[i];
 
-		if (ret < 0) {
-			goto unapply_mux_setting;
-		}
+		if (i < prog->num_mux)
+			ret = pinmux_enable_setting_pins(op->setting, op->pins,
+							 op->num_pins);
+		else
+			ret = pinconf_apply_setting(op->setting);
+		if (ret < 0)
+			goto unapply_new_state;
 
 		/* Do not link hogs (circular dependency) */
-		if (p != setting->pctldev->p)
-			pinctrl_link_add(setting->pctldev, p->dev);
+		if (p != op->setting->pctldev->p)
+			pinctrl_link_add(op->setting->pctldev, p->dev);
 	}
+	pinctrl_boot_stats_hw_writes(dev_name(p->dev),
+				     prog->pctldev ?
+				     dev_name(prog->pctldev->dev) : NULL,
+				     prog->num_ops);
 
 	p->state = state;
 
 	return 0;
 
-unapply_mux_setting:
-	pinctrl_cond_disable_mux_setting(state, NULL);
-	goto restore_old_state;
-
 unapply_new_state:
 	dev_err(p->dev, "Error applying setting, reverse things back\n");
 
@@ -1358,7 +1920,7 @@ unapply_new_state:
 	 * "unmux a pin"!), but it's not a big deal since the pins
 	 * are free to be muxed by another apply_setting.
 	 */
-	pinctrl_cond_disable_mux_setting(state, setting);
+	pinctrl_disable_mux_ops(prog, min(i, prog->num_mux));
 
 restore_old_state:
 	/* There's no infinite recursive loop here because p->state is NULL */
@@ -1366,6 +1928,56 @@ restore_old_state:
 		pinctrl_select_state(p, old_state);
 
 	return ret;
+
+unapply_batch:
+	dev_err(p->dev, "Error applying state %s, reverse things back\n",
+		state->name);
+
+	while (i--) {
+		op = &prog->ops[i];
+		pinmux_release_setting_pins(op->setting, op->pins, op->num_pins);
+	}
+	goto restore_old_state;
+}
+
+/*
+ * Do not program pins while the hogs of their controllers are applied. A
+ * failure there is the hogging controller's, not the consumer's, so it is
+ * not passed on.
+ */
+static void pinctrl_state_wait_for_hogs(struct pinctrl_state *state)
+{
+	const struct pinctrl_state_prog *prog;
+	unsigned int i;
+
+	prog = smp_load_acquire(&state->prog);
+	if (!prog || !prog->async_hogs)
+		return;
+
+	if (prog->pctldev) {
+		pinctrl_wait_for_hogs(prog->pctldev);
+		return;
+	}
+
+	for (i = 0; i < prog->num_ops; i++)
+		if (prog->ops[i].setting->pctldev->async_hogs)
+			pinctrl_wait_for_hogs(prog->ops[i].setting->pctldev);
+}
+
+/**
+ * pinctrl_commit_state() - select/activate/program a pinctrl state to HW
+ * @p: the pinctrl handle for the device that requests configuration
+ * @state: the state handle to select/activate/program
+ */
+static int pinctrl_commit_state(struct pinctrl *p, struct pinctrl_state *state)
+{
+	u64 start = IS_ENABLED(CONFIG_DEBUG_FS) ? ktime_get_ns() : 0;
+	int ret;
+
+	ret = pinctrl_apply_state_prog(p, state);
+	pinctrl_state_account(state, start, ret);
+
+	return ret;
 }
 
 /**
@@ -1378,6 +1990,8 @@ int pinctrl_select_state(struct pinctrl *p, struct pinctrl_state *state)
 	if (p->state == state)
 		return 0;
 
+	pinctrl_state_wait_for_hogs(state);
+
 	return pinctrl_commit_state(p, state);
 }
 EXPORT_SYMBOL_GPL(pinctrl_select_state);
@@ -1436,6 +2050,90 @@ void devm_pinctrl_put(struct pinctrl *p)
 }
 EXPORT_SYMBOL_GPL(devm_pinctrl_put);
 
+static unsigned int pinctrl_maps_hash_key(const char *devname)
+{
+	return full_name_hash(NULL, devname, strlen(devname));
+}
+
+/**
+ * pinctrl_find_maps_dev() - look up the mapping table index of a device
+ * @devname: the name of the consumer device, as returned by dev_name()
+ *
+ * Returns the index of all mapping table entries registered for @devname, or
+ * NULL if there are none. Must be called with pinctrl_maps_mutex held.
+ */
+struct pinctrl_maps_dev *pinctrl_find_maps_dev(const char *devname)
+{
+	struct pinctrl_maps_dev *maps_dev;
+
+	lockdep_assert_held(&pinctrl_maps_mutex);
+
+	hash_for_each_possible(pinctrl_maps_hash, maps_dev, hnode,
+			       pinctrl_maps_hash_key(devname))
+		if (!strcmp(maps_dev->dev_name, devname))
+			return maps_dev;
+
+	return NULL;
+}
+
+/* Removes the first @num_refs entries of @maps_node from the device index */
+static void pinctrl_unindex_maps(struct pinctrl_maps *maps_node,
+				 unsigned int num_refs)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_refs; i++) {
+		struct pinctrl_map_ref *ref = &maps_node->refs[i];
+		struct pinctrl_maps_dev *maps_dev = ref->maps_dev;
+
+		list_del(&ref->node);
+		if (list_empty(&maps_dev->refs)) {
+			hash_del(&maps_dev->hnode);
+			kfree_const(maps_dev->dev_name);
+			kfree(maps_dev);
+		}
+	}
+}
+
+static int pinctrl_index_maps(struct pinctrl_maps *maps_node)
+{
+	unsigned int i;
+
+	for (i = 0; i < maps_node->num_maps; i++) {
+		const struct pinctrl_map *map = &maps_node->maps[i];
+		struct pinctrl_map_ref *ref = &maps_node->refs[i];
+		struct pinctrl_maps_dev *maps_dev;
+
+		maps_dev = pinctrl_find_maps_dev(map->dev_name);
+		if (!maps_dev) {
+			maps_dev = kzalloc(sizeof(*maps_dev), GFP_KERNEL);
+			if (!maps_dev)
+				goto err_unindex;
+
+			/* The map itself may go away before the index does */
+			maps_dev->dev_name = kstrdup_const(map->dev_name,
+							   GFP_KERNEL);
+			if (!maps_dev->dev_name) {
+				kfree(maps_dev);
+				goto err_unindex;
+			}
+			INIT_LIST_HEAD(&maps_dev->refs);
+			hash_add(pinctrl_maps_hash, &maps_dev->hnode,
+				 pinctrl_maps_hash_key(map->dev_name));
+		}
+
+		ref->maps_dev = maps_dev;
+		ref->map = map;
+		list_add_tail(&ref->node, &maps_dev->refs);
+	}
+
+	return 0;
+
+err_unindex:
+	pinctrl_unindex_maps(maps_node, i);
+	return -ENOMEM;
+}
+
 /**
  * pinctrl_register_mappings() - register a set of pin controller mappings
  * @maps: the pincontrol mappings table to register. Note the pinctrl-core
@@ -1493,7 +2191,7 @@ int pinctrl_register_mappings(const struct pinctrl_map *maps,
 		}
 	}
 
-	maps_node = kzalloc(sizeof(*maps_node), GFP_KERNEL);
+	maps_node = kzalloc(struct_size(maps_node, refs, num_maps), GFP_KERNEL);
 	if (!maps_node)
 		return -ENOMEM;
 
@@ -1501,6 +2199,12 @@ int pinctrl_register_mappings(const struct pinctrl_map *maps,
 	maps_node->num_maps = num_maps;
 
 	mutex_lock(&pinctrl_maps_mutex);
+	ret = pinctrl_index_maps(maps_node);
+	if (ret) {
+		mutex_unlock(&pinctrl_maps_mutex);
+		kfree(maps_node);
+		return ret;
+	}
 	list_add_tail(&maps_node->node, &pinctrl_maps);
 	mutex_unlock(&pinctrl_maps_mutex);
 
@@ -1520,6 +2224,7 @@ void pinctrl_unregister_mappings(const struct pinctrl_map *map)
 	mutex_lock(&pinctrl_maps_mutex);
 	list_for_each_entry(maps_node, &pinctrl_maps, node) {
 		if (maps_node->maps == map) {
+			pinctrl_unindex_maps(maps_node, maps_node->num_maps);
 			list_del(&maps_node->node);
 			kfree(maps_node);
 			mutex_unlock(&pinctrl_maps_mutex);
@@ -1583,6 +2288,30 @@ int pinctrl_force_default(struct pinctrl_dev *pctldev)
 }
 EXPORT_SYMBOL_GPL(pinctrl_force_default);
 
+/**
+ * pinctrl_set_apply_batch() - let a pin controller program whole states
+ * @pctldev: pin controller device
+ * @apply_batch: callback programming all steps of a state program
+ *
+ * When all settings of a state go to @pctldev, pinctrl_select_state() does
+ * the pin ownership bookkeeping itself and then hands the compiled state to
+ * @apply_batch instead of calling .set_mux(), .pin_config_set() and
+ * .pin_config_group_set() once per setting. The callback must program the
+ * mux steps of the program before the config steps and leave the hardware
+ * exactly as the per-setting calls would, which lets it take its register
+ * lock once and coalesce accesses to the same register.
+ *
+ * Best called between pinctrl_register_and_init() and pinctrl_enable(), so
+ * that the hogs are applied the same way.
+ */
+void pinctrl_set_apply_batch(struct pinctrl_dev *pctldev,
+			     int (*apply_batch)(struct pinctrl_dev *pctldev,
+						const struct pinctrl_state_prog *prog))
+{
+	WRITE_ONCE(pctldev->apply_batch, apply_batch);
+}
+EXPORT_SYMBOL_GPL(pinctrl_set_apply_batch);
+
 /**
  * pinctrl_init_done() - tell pinctrl probe is done
  *
@@ -1636,10 +2365,18 @@ static int pinctrl_select_bound_state(struct device *dev,
  */
 int pinctrl_select_default_state(struct device *dev)
 {
+	u64 start;
+	int ret;
+
 	if (!dev->pins)
 		return 0;
 
-	return pinctrl_select_bound_state(dev, dev->pins->default_state);
+	start = pinctrl_boot_stats_start();
+	ret = pinctrl_select_bound_state(dev, dev->pins->default_state);
+	pinctrl_boot_stats_stage(dev_name(dev), NULL,
+				 PINCTRL_BOOT_SELECT_DEFAULT, start, ret);
+
+	return ret;
 }
 EXPORT_SYMBOL_GPL(pinctrl_select_default_state);
 
@@ -1964,6 +2701,45 @@ static int pinctrl_show(struct seq_file *s, void *what)
 }
 DEFINE_SHOW_ATTRIBUTE(pinctrl);
 
+static int pinctrl_state_stats_show(struct seq_file *s, void *what)
+{
+	const struct pinctrl_state_stats *stats;
+	const struct pinctrl_state_prog *prog;
+	struct pinctrl_state *state;
+	struct pinctrl *p;
+
+	seq_puts(s, "Commit statistics of the pin control states:\n");
+
+	mutex_lock(&pinctrl_list_mutex);
+
+	list_for_each_entry(p, &pinctrl_list, node) {
+		seq_printf(s, "device: %s current state: %s\n",
+			   dev_name(p->dev),
+			   p->state ? p->state->name : "none");
+
+		list_for_each_entry(state, &p->states, node) {
+			stats = &state->stats;
+
+			seq_printf(s, "  state: %s", state->name);
+			prog = smp_load_acquire(&state->prog);
+			if (prog)
+				seq_printf(s, " mux: %u config: %u",
+					   prog->num_mux,
+					   prog->num_ops - prog->num_mux);
+			seq_printf(s, " commits: %llu failures: %llu avg: %llu ns max: %llu ns\n",
+				   stats->commits, stats->failures,
+				   stats->commits ?
+				   div64_u64(stats->total_ns, stats->commits) : 0,
+				   stats->max_ns);
+		}
+	}
+
+	mutex_unlock(&pinctrl_list_mutex);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(pinctrl_state_stats);
+
 static struct dentry *debugfs_root;
 
 static void pinctrl_init_device_debugfs(struct pinctrl_dev *pctldev)
@@ -2025,6 +2801,9 @@ static void pinctrl_init_debugfs(void)
 			    debugfs_root, NULL, &pinctrl_maps_fops);
 	debugfs_create_file("pinctrl-handles", 0444,
 			    debugfs_root, NULL, &pinctrl_fops);
+	debugfs_create_file("pinctrl-state-stats", 0444,
+			    debugfs_root, NULL, &pinctrl_state_stats_fops);
+	pinctrl_boot_stats_init_debugfs(debugfs_root);
 }
 
 #else /* CONFIG_DEBUG_FS */
@@ -2091,6 +2870,9 @@ pinctrl_init_controller(struct pinctrl_desc *pctldesc, struct device *dev,
 	INIT_LIST_HEAD(&pctldev->gpio_ranges);
 	INIT_LIST_HEAD(&pctldev->node);
 	pctldev->dev = dev;
+	atomic_set(&pctldev->hogs_pending, 1);
+	init_completion(&pctldev->hogs_done);
+	mutex_init(&pctldev->name_index_mutex);
 	mutex_init(&pctldev->mutex);
 
 	/* check core ops for sanity */
@@ -2127,6 +2909,7 @@ pinctrl_init_controller(struct pinctrl_desc *pctldesc, struct device *dev,
 	return pctldev;
 
 out_err:
+	mutex_destroy(&pctldev->name_index_mutex);
 	mutex_destroy(&pctldev->mutex);
 	kfree(pctldev);
 	return ERR_PTR(ret);
@@ -2136,10 +2919,308 @@ static void pinctrl_uninit_controller(struct pinctrl_dev *pctldev, struct pinctr
 {
 	pinctrl_free_pindescs(pctldev, pctldesc->pins,
 			      pctldesc->npins);
+	pinctrl_free_name_indexes(pctldev);
+	kfree(rcu_access_pointer(pctldev->gpio_spans));
 	mutex_destroy(&pctldev->mutex);
 	kfree(pctldev);
 }
 
+/**
+ * struct pinctrl_hog_shard - steps of the default hog state applied together
+ * @pctldev: the pin controller hogging the pins
+ * @applied: the number of steps applied before an error, or all of them
+ * @num_ops: the number of entries in @ops
+ * @ops: indexes into the state program, in program order
+ */
+struct pinctrl_hog_shard {
+	struct pinctrl_dev *pctldev;
+	unsigned int applied;
+	unsigned int num_ops;
+	unsigned int ops[] __counted_by(num_ops);
+};
+
+static ASYNC_DOMAIN_EXCLUSIVE(pinctrl_hog_domain);
+
+/**
+ * pinctrl_enable_async_hogs() - apply the hogs of a controller in parallel
+ * @pctldev: pin controller device
+ * @hog_shard: optional callback returning the register shard of a pin
+ *
+ * Makes pinctrl_enable() split the default hog state into shards that touch
+ * disjoint sets of pins and apply them from the async domain instead of in
+ * line. Steps touching the same pin, or pins @hog_shard maps to the same
+ * shard, always stay in one shard and in program order, so a driver can use
+ * @hog_shard to keep pins sharing a register or a lock together.
+ *
+ * Must be called between pinctrl_register_and_init() and pinctrl_enable().
+ * Consumers selecting states on the controller wait for the hogs first, see
+ * pinctrl_wait_for_hogs(). Not exported until a driver outside the core
+ * opts in.
+ */
+void pinctrl_enable_async_hogs(struct pinctrl_dev *pctldev,
+			       unsigned int (*hog_shard)(struct pinctrl_dev *pctldev,
+							 unsigned int pin))
+{
+	pctldev->async_hogs = true;
+	pctldev->hog_shard = hog_shard;
+}
+
+/**
+ * pinctrl_wait_for_hogs() - wait until the hogs of a controller are applied
+ * @pctldev: pin controller device
+ *
+ * Returns 0, or the first error a shard applying the default hog state in
+ * the async domain ran into, in which case no hogged pin stays claimed. Only
+ * meant for the driver that opted in, consumers just wait.
+ */
+int pinctrl_wait_for_hogs(struct pinctrl_dev *pctldev)
+{
+	if (!completion_done(&pctldev->hogs_done))
+		wait_for_completion(&pctldev->hogs_done);
+
+	return READ_ONCE(pctldev->hogs_err);
+}
+
+static void pinctrl_hogs_finish(struct pinctrl_dev *pctldev)
+{
+	const struct pinctrl_state_prog *prog;
+	struct pinctrl_hog_shard *shard;
+	unsigned int i, j;
+
+	if (!pctldev->hog_shards)
+		goto done;
+
+	prog = pctldev->hog_default->prog;
+	if (pctldev->hogs_err) {
+		/* Like a failed serial apply, leave no pins claimed */
+		for (i = 0; i < pctldev->num_hog_shards; i++) {
+			shard = pctldev->hog_shards[i];
+			for (j = 0; j < shard->applied; j++) {
+				const struct pinctrl_state_op *op;
+
+				if (shard->ops[j] >= prog->num_mux)
+					break;
+				op = &prog->ops[shard->ops[j]];
+				pinmux_disable_setting_pins(op->setting,
+							    op->pins,
+							    op->num_pins);
+			}
+		}
+		dev_err(pctldev->dev, "failed to select default state: %d\n",
+			pctldev->hogs_err);
+	} else {
+		pctldev->p->state = pctldev->hog_default;
+	}
+
+	for (i = 0; i < pctldev->num_hog_shards; i++)
+		kfree(pctldev->hog_shards[i]);
+	kfree(pctldev->hog_shards);
+	pctldev->hog_shards = NULL;
+	pctldev->num_hog_shards = 0;
+
+done:
+	complete_all(&pctldev->hogs_done);
+}
+
+static void pinctrl_hogs_put(struct pinctrl_dev *pctldev)
+{
+	if (atomic_dec_and_test(&pctldev->hogs_pending))
+		pinctrl_hogs_finish(pctldev);
+}
+
+static void pinctrl_hog_shard_apply(void *data, async_cookie_t cookie)
+{
+	struct pinctrl_hog_shard *shard = data;
+	struct pinctrl_dev *pctldev = shard->pctldev;
+	const struct pinctrl_state_prog *prog = pctldev->hog_default->prog;
+	const struct pinctrl_state_op *op;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < shard->num_ops; i++) {
+		op = &prog->ops[shard->ops[i]];
+		if (shard->ops[i] < prog->num_mux)
+			ret = pinmux_enable_setting_pins(op->setting, op->pins,
+							 op->num_pins);
+		else
+			ret = pinconf_apply_setting(op->setting);
+		if (ret < 0)
+			break;
+	}
+	shard->applied = i;
+
+	if (ret < 0)
+		cmpxchg(&pctldev->hogs_err, 0, ret);
+
+	pinctrl_hogs_put(pctldev);
+}
+
+/* The pins a step of a state program touches */
+static int pinctrl_hog_op_pins(struct pinctrl_dev *pctldev,
+			       const struct pinctrl_state_op *op,
+			       const unsigned int **pins,
+			       unsigned int *num_pins)
+{
+	const struct pinctrl_setting *setting = op->setting;
+	const struct pinctrl_ops *pctlops = pctldev->desc->pctlops;
+
+	switch (setting->type) {
+	case PIN_MAP_TYPE_MUX_GROUP:
+		*pins = op->pins;
+		*num_pins = op->num_pins;
+		return 0;
+	case PIN_MAP_TYPE_CONFIGS_PIN:
+		*pins = &setting->data.configs.group_or_pin;
+		*num_pins = 1;
+		return 0;
+	case PIN_MAP_TYPE_CONFIGS_GROUP:
+		if (!pctlops->get_group_pins)
+			return -EINVAL;
+		return pctlops->get_group_pins(pctldev,
+					       setting->data.configs.group_or_pin,
+					       pins, num_pins);
+	default:
+		return -EINVAL;
+	}
+}
+
+static unsigned int pinctrl_hog_find(unsigned int *parent, unsigned int i)
+{
+	while (parent[i] != i)
+		i = parent[i] = parent[parent[i]];
+
+	return i;
+}
+
+/*
+ * Put steps of @prog that share a pin, or a register shard, in the same set,
+ * and deal the sets out to at most one shard per online CPU. Returns the
+ * number of shards, each step's shard in @shard_of.
+ */
+static int pinctrl_hog_partition(struct pinctrl_dev *pctldev,
+				 const struct pinctrl_state_prog *prog,
+				 unsigned int *shard_of)
+{
+	unsigned int nr_shards = num_online_cpus();
+	unsigned int i, j, num_pins, root, other, next = 0;
+	const unsigned int *pins;
+	unsigned int *parent;
+	unsigned long key;
+	void *entry;
+	int ret = 0;
+
+	DEFINE_XARRAY(owners);
+
+	parent = kcalloc(prog->num_ops, sizeof(*parent), GFP_KERNEL);
+	if (!parent)
+		return -ENOMEM;
+	for (i = 0; i < prog->num_ops; i++)
+		parent[i] = i;
+
+	for (i = 0; i < prog->num_ops && !ret; i++) {
+		ret = pinctrl_hog_op_pins(pctldev, &prog->ops[i], &pins,
+					  &num_pins);
+		for (j = 0; j < num_pins && !ret; j++) {
+			key = pctldev->hog_shard ?
+			      pctldev->hog_shard(pctldev, pins[j]) : pins[j];
+			entry = xa_load(&owners, key);
+			if (!entry) {
+				ret = xa_err(xa_store(&owners, key,
+						      xa_mk_value(i),
+						      GFP_KERNEL));
+				continue;
+			}
+			root = pinctrl_hog_find(parent, xa_to_value(entry));
+			other = pinctrl_hog_find(parent, i);
+			if (root != other)
+				parent[max(root, other)] = min(root, other);
+		}
+	}
+	xa_destroy(&owners);
+	if (ret)
+		goto out_free;
+
+	/*
+	 * The root of a set is its lowest step, so each set gets its shard
+	 * before the rest of its steps are reached.
+	 */
+	for (i = 0; i < prog->num_ops; i++) {
+		root = pinctrl_hog_find(parent, i);
+		shard_of[i] = root == i ? next++ % nr_shards : shard_of[root];
+	}
+	ret = min(next, nr_shards);
+
+out_free:
+	kfree(parent);
+	return ret;
+}
+
+/*
+ * Apply the default hog state in shards from the async domain. Returns
+ * false, with nothing started, if the state is better applied in line.
+ */
+static bool pinctrl_claim_hogs_async(struct pinctrl_dev *pctldev)
+{
+	const struct pinctrl_state_prog *prog = pctldev->hog_default->prog;
+	struct pinctrl_hog_shard **shards = NULL;
+	unsigned int *shard_of, *count = NULL;
+	unsigned int i;
+	int nr_shards;
+
+	if (!prog || prog->pctldev != pctldev || prog->num_ops < 2)
+		return false;
+
+	shard_of = kcalloc(prog->num_ops, sizeof(*shard_of), GFP_KERNEL);
+	if (!shard_of)
+		return false;
+
+	nr_shards = pinctrl_hog_partition(pctldev, prog, shard_of);
+	if (nr_shards < 2)
+		goto out_free;
+
+	count = kcalloc(nr_shards, sizeof(*count), GFP_KERNEL);
+	shards = kcalloc(nr_shards, sizeof(*shards), GFP_KERNEL);
+	if (!count || !shards)
+		goto out_free_shards;
+
+	for (i = 0; i < prog->num_ops; i++)
+		count[shard_of[i]]++;
+	for (i = 0; i < nr_shards; i++) {
+		shards[i] = kzalloc(struct_size(shards[i], ops, count[i]),
+				    GFP_KERNEL);
+		if (!shards[i])
+			goto out_free_shards;
+		shards[i]->pctldev = pctldev;
+		shards[i]->num_ops = count[i];
+	}
+	/* Fill back to front, program order is kept within every shard */
+	for (i = prog->num_ops; i-- > 0; )
+		shards[shard_of[i]]->ops[--count[shard_of[i]]] = i;
+
+	kfree(count);
+	kfree(shard_of);
+
+	pctldev->hog_shards = shards;
+	pctldev->num_hog_shards = nr_shards;
+	for (i = 0; i < nr_shards; i++) {
+		atomic_inc(&pctldev->hogs_pending);
+		async_schedule_domain(pinctrl_hog_shard_apply, shards[i],
+				      &pinctrl_hog_domain);
+	}
+
+	return true;
+
+out_free_shards:
+	if (shards)
+		for (i = 0; i < nr_shards; i++)
+			kfree(shards[i]);
+	kfree(shards);
+	kfree(count);
+out_free:
+	kfree(shard_of);
+	return false;
+}
+
 static int pinctrl_claim_hogs(struct pinctrl_dev *pctldev)
 {
 	pctldev->p = create_pinctrl(pctldev->dev, pctldev);
@@ -2161,8 +3242,10 @@ static int pinctrl_claim_hogs(struct pinctrl_dev *pctldev)
 	if (IS_ERR(pctldev->hog_default)) {
 		dev_dbg(pctldev->dev,
 			"failed to lookup the default state\n");
-	} else {
-		if (pinctrl_select_state(pctldev->p,
+	} else if (!pctldev->async_hogs ||
+		   !pinctrl_claim_hogs_async(pctldev)) {
+		/* Not through pinctrl_select_state(), it waits for the hogs */
+		if (pinctrl_commit_state(pctldev->p,
 					 pctldev->hog_default))
 			dev_err(pctldev->dev,
 				"failed to select default state\n");
@@ -2180,16 +3263,27 @@ static int pinctrl_claim_hogs(struct pinctrl_dev *pctldev)
 
 int pinctrl_enable(struct pinctrl_dev *pctldev)
 {
+	u64 start;
 	int error;
 
+	start = pinctrl_boot_stats_start();
 	error = pinctrl_claim_hogs(pctldev);
+	pinctrl_boot_stats_stage(NULL, dev_name(pctldev->dev),
+				 PINCTRL_BOOT_CLAIM_HOGS, start, error);
+	/* Completes hogs_done now, or once the last async shard is done */
+	pinctrl_hogs_put(pctldev);
 	if (error) {
 		dev_err(pctldev->dev, "could not claim hogs: %i\n", error);
 		return error;
 	}
 
 	mutex_lock(&pinctrldev_list_mutex);
-	list_add_tail(&pctldev->node, &pinctrldev_list);
+	list_add_tail_rcu(&pctldev->node, &pinctrldev_list);
+	/* Keep registration order, the first registered device wins lookups */
+	hlist_add_tail_rcu(&pctldev->name_hnode,
+			   pinctrldev_name_bucket(dev_name(pctldev->dev)));
+	hlist_add_tail_rcu(&pctldev->of_hnode,
+			   pinctrldev_of_bucket(dev_of_node(pctldev->dev)));
 	mutex_unlock(&pinctrldev_list_mutex);
 
 	pinctrl_init_device_debugfs(pctldev);
@@ -2274,6 +3368,10 @@ void pinctrl_unregister(struct pinctrl_dev *pctldev)
 	if (!pctldev)
 		return;
 
+	/* Let shards still applying the hogs finish */
+	if (pctldev->async_hogs)
+		async_synchronize_full_domain(&pinctrl_hog_domain);
+
 	mutex_lock(&pctldev->mutex);
 	pinctrl_remove_device_debugfs(pctldev);
 	mutex_unlock(&pctldev->mutex);
@@ -2284,7 +3382,9 @@ void pinctrl_unregister(struct pinctrl_dev *pctldev)
 	mutex_lock(&pinctrldev_list_mutex);
 	mutex_lock(&pctldev->mutex);
 	/* TODO: check that no pinmuxes are still active? */
-	list_del(&pctldev->node);
+	list_del_rcu(&pctldev->node);
+	hlist_del_init_rcu(&pctldev->name_hnode);
+	hlist_del_init_rcu(&pctldev->of_hnode);
 	pinmux_generic_free_functions(pctldev);
 	pinctrl_generic_free_groups(pctldev);
 	/* Destroy descriptor tree */
@@ -2295,9 +3395,18 @@ void pinctrl_unregister(struct pinctrl_dev *pctldev)
 		list_del(&range->node);
 
 	mutex_unlock(&pctldev->mutex);
+	mutex_unlock(&pinctrldev_list_mutex);
+
+	/* Wait for lockless lookups that may still see this controller */
+	synchronize_rcu();
+
+	/* No new maps can be translated by it, forget the cached ones */
+	pinctrl_dt_cache_drop_pctldev(pctldev);
+
+	kfree(rcu_access_pointer(pctldev->gpio_spans));
+	pinctrl_free_name_indexes(pctldev);
 	mutex_destroy(&pctldev->mutex);
 	kfree(pctldev);
-	mutex_unlock(&pinctrldev_list_mutex);
 }
 EXPORT_SYMBOL_GPL(pinctrl_unregister);
 
@@ -2403,6 +3512,7 @@ EXPORT_SYMBOL_GPL(devm_pinctrl_unregister);
 static int __init pinctrl_init(void)
 {
 	pr_info("initialized pinctrl subsystem\n");
+	pinctrl_dt_cache_init();
 	pinctrl_init_debugfs();
 	return 0;
 }
@@ -8,6 +8,7 @@
  * Author: Linus Walleij <linus.walleij@linaro.org>
  */
 
+#include <linux/completion.h>
 #include <linux/kref.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
@@ -24,21 +25,74 @@ struct module;
 struct pinctrl;
 struct pinctrl_desc;
 struct pinctrl_gpio_range;
+struct pinctrl_hog_shard;
 struct pinctrl_state;
+struct pinctrl_state_prog;
+
+/**
+ * struct pinctrl_name_slot - one slot of a struct pinctrl_name_index
+ * @name: the group or function name, NULL if the slot is free
+ * @selector: the selector @name resolves to
+ */
+struct pinctrl_name_slot {
+	const char *name;
+	unsigned int selector;
+};
+
+/**
+ * struct pinctrl_name_index - hash of group or function names to selectors
+ * @slots: open addressed hash table of 1 << @bits slots, NULL until the index
+ *	is built on the first lookup
+ * @bits: log2 of the number of slots
+ * @count: the number of groups or functions the index covers
+ */
+struct pinctrl_name_index {
+	struct pinctrl_name_slot *slots;
+	unsigned int bits;
+	unsigned int count;
+};
+
+/**
+ * struct pinctrl_gpio_spans - the GPIO numbers covered by the GPIO ranges of
+ *	a pin controller, copied for pinctrl_ready_for_gpio_range()
+ * @rcu: frees the copy once lockless readers are done with it
+ * @num: the number of entries in @span
+ * @span: the base and number of pins of each range
+ */
+struct pinctrl_gpio_spans {
+	struct rcu_head rcu;
+	unsigned int num;
+	struct {
+		unsigned int base;
+		unsigned int npins;
+	} span[] __counted_by(num);
+};
 
 /**
  * struct pinctrl_dev - pin control class device
  * @node: node to include this pin controller in the global pin controller list
+ * @name_hnode: node in the global hash of pin controllers by device name
+ * @of_hnode: node in the global hash of pin controllers by device tree node
  * @desc: the pin controller descriptor supplied when initializing this pin
  *	controller
  * @pin_desc_tree: each pin descriptor for this pin controller is stored in
- *	this radix tree
+ *	this radix tree, unless the pin numbers are dense
+ * @pin_descs: if the pin numbers of this pin controller are dense, the pin
+ *	descriptors indexed by pin number minus @pin_base instead of
+ *	@pin_desc_tree
+ * @pin_base: the lowest pin number when @pin_descs is used
+ * @num_pin_descs: the number of entries in @pin_descs
  * @pin_group_tree: optionally each pin group can be stored in this radix tree
  * @num_groups: optionally number of groups can be kept here
+ * @groups_gen: bumped whenever a generic group is added or removed, so that
+ *	state programs caching the pins of groups get recompiled
  * @pin_function_tree: optionally each function can be stored in this radix tree
  * @num_functions: optionally number of functions can be kept here
  * @gpio_ranges: a list of GPIO ranges that is handled by this pin controller,
  *	ranges are added to this list at runtime
+ * @gpio_spans: what lockless readers see of @gpio_ranges, NULL if empty
+ * @gpio_spans_stale: @gpio_spans could not be updated, so readers must walk
+ *	@gpio_ranges under @mutex instead
  * @dev: the device entry for this pin controller
  * @owner: module providing the pin controller, used for refcounting
  * @driver_data: driver data for drivers registering to the pin controller
@@ -46,28 +100,70 @@ struct pinctrl_state;
  * @p: result of pinctrl_get() for this device
  * @hog_default: default state for pins hogged by this device
  * @hog_sleep: sleep state for pins hogged by this device
+ * @apply_batch: optional callback programming all settings of a state at
+ *	once, see pinctrl_set_apply_batch()
+ * @async_hogs: apply the default hog state in parallel shards, see
+ *	pinctrl_enable_async_hogs()
+ * @hog_shard: optional callback returning the register shard of a pin
+ * @hog_shards: the shards the default hog state is being applied in
+ * @num_hog_shards: the number of entries in @hog_shards
+ * @hogs_pending: the shards still running, plus one held by pinctrl_enable()
+ * @hogs_err: the first error a shard ran into
+ * @hogs_done: completed once the hogs are applied
+ * @group_index: group name to selector index, see pinctrl_get_group_selector()
+ * @func_index: function name to selector index for pinmux
+ * @name_index_mutex: protects @group_index and @func_index
+ * @mux_claimed: bitmap with a bit per pin, by &struct pin_desc.index, set
+ *	while the pin is claimed for muxing
+ * @mux_refs: per pin, the owner id and the number of claims of the pin, see
+ *	pinmux_owner_id()
  * @mutex: mutex taken on each pin controller specific action
  * @device_root: debugfs root for this device
  */
 struct pinctrl_dev {
 	struct list_head node;
+	struct hlist_node name_hnode;
+	struct hlist_node of_hnode;
 	struct pinctrl_desc *desc;
 	struct radix_tree_root pin_desc_tree;
+	struct pin_desc *pin_descs;
+	unsigned int pin_base;
+	unsigned int num_pin_descs;
 #ifdef CONFIG_GENERIC_PINCTRL_GROUPS
 	struct radix_tree_root pin_group_tree;
 	unsigned int num_groups;
 #endif
+	unsigned int groups_gen;
 #ifdef CONFIG_GENERIC_PINMUX_FUNCTIONS
 	struct radix_tree_root pin_function_tree;
 	unsigned int num_functions;
 #endif
 	struct list_head gpio_ranges;
+	struct pinctrl_gpio_spans __rcu *gpio_spans;
+	bool gpio_spans_stale;
 	struct device *dev;
 	struct module *owner;
 	void *driver_data;
 	struct pinctrl *p;
 	struct pinctrl_state *hog_default;
 	struct pinctrl_state *hog_sleep;
+	int (*apply_batch)(struct pinctrl_dev *pctldev,
+			   const struct pinctrl_state_prog *prog);
+	bool async_hogs;
+	unsigned int (*hog_shard)(struct pinctrl_dev *pctldev,
+				  unsigned int pin);
+	struct pinctrl_hog_shard **hog_shards;
+	unsigned int num_hog_shards;
+	atomic_t hogs_pending;
+	int hogs_err;
+	struct completion hogs_done;
+	struct pinctrl_name_index group_index;
+	struct pinctrl_name_index func_index;
+	struct mutex name_index_mutex;
+#ifdef CONFIG_PINMUX
+	unsigned long *mux_claimed;
+	atomic_t *mux_refs;
+#endif
 	struct mutex mutex;
 #ifdef CONFIG_DEBUG_FS
 	struct dentry *device_root;
@@ -93,26 +189,88 @@ struct pinctrl {
 	struct kref users;
 };
 
+/**
+ * struct pinctrl_state_op - one step of a precompiled state program
+ * @setting: the mux or config setting applied by this step
+ * @pins: for mux settings, the pins of the group, resolved when the program
+ *	was compiled
+ * @num_pins: the number of entries in @pins
+ * @groups_gen: for mux settings, the &struct pinctrl_dev.groups_gen @pins
+ *	were resolved at
+ */
+struct pinctrl_state_op {
+	const struct pinctrl_setting *setting;
+	const unsigned int *pins;
+	unsigned int num_pins;
+	unsigned int groups_gen;
+};
+
+/**
+ * struct pinctrl_state_prog - the settings of a state flattened for commit
+ * @pctldev: the pin controller all steps go to, or NULL if the state has no
+ *	steps or spans several pin controllers
+ * @async_hogs: a pin controller of some step applies its hogs in the async
+ *	domain, so commits wait for them first
+ * @num_mux: the number of mux steps, which come first in @ops
+ * @num_ops: the total number of steps in @ops, config steps follow the mux
+ *	steps
+ * @ops: the steps, each kind in the order of the settings of the state
+ * @replaced: the program this one was recompiled from, kept along with it
+ *	until the &struct pinctrl is freed as other commits may still use it
+ */
+struct pinctrl_state_prog {
+	struct pinctrl_state_prog *replaced;
+	struct pinctrl_dev *pctldev;
+	bool async_hogs;
+	unsigned int num_mux;
+	unsigned int num_ops;
+	struct pinctrl_state_op ops[] __counted_by(num_ops);
+};
+
+/**
+ * struct pinctrl_state_stats - commit statistics of a pinctrl state
+ * @commits: number of times the state was committed
+ * @failures: number of those commits that failed
+ * @total_ns: time spent in all commits
+ * @max_ns: time spent in the slowest commit
+ */
+struct pinctrl_state_stats {
+	u64 commits;
+	u64 failures;
+	u64 total_ns;
+	u64 max_ns;
+};
+
 /**
  * struct pinctrl_state - a pinctrl state for a device
  * @node: list node for struct pinctrl's @states field
  * @name: the name of this state
  * @settings: a list of settings for this state
+ * @prog: the settings compiled for pinctrl_commit_state(), built when the
+ *	state is looked up and rebuilt by a commit if it went stale
+ * @stats: commit statistics shown in debugfs
  */
 struct pinctrl_state {
 	struct list_head node;
 	const char *name;
 	struct list_head settings;
+	struct pinctrl_state_prog *prog;
+#ifdef CONFIG_DEBUG_FS
+	struct pinctrl_state_stats stats;
+#endif
 };
 
 /**
  * struct pinctrl_setting_mux - setting data for MAP_TYPE_MUX_GROUP
  * @group: the group selector to program
  * @func: the function selector to program
+ * @owner: the id of the device name the pins of the group are claimed for,
+ *	see pinmux_owner_id()
  */
 struct pinctrl_setting_mux {
 	unsigned int group;
 	unsigned int func;
+	unsigned int owner;
 };
 
 /**
@@ -156,12 +314,13 @@ struct pinctrl_setting {
  *	datasheet or such
  * @dynamic_name: if the name of this pin was dynamically allocated
  * @drv_data: driver-defined per-pin data. pinctrl core does not touch this
- * @mux_usecount: If zero, the pin is not claimed, and @owner should be NULL.
- *	If non-zero, this pin is claimed by @owner. This field is an integer
- *	rather than a boolean, since pinctrl_get() might process multiple
- *	mapping table entries that refer to, and hence claim, the same group
- *	or pin, and each of these will increment the @usecount.
- * @mux_owner: The name of device that called pinctrl_get().
+ * @index: the position of the pin in the pins of the pin controller, which
+ *	is its bit in &struct pinctrl_dev.mux_claimed
+ * @mux_owner: The name of device that called pinctrl_get(), set while the
+ *	pin is claimed for muxing. Whether it is, and how many times, is kept
+ *	in &struct pinctrl_dev.mux_claimed and &struct pinctrl_dev.mux_refs,
+ *	since pinctrl_get() might process multiple mapping table entries that
+ *	refer to, and hence claim, the same group or pin.
  * @mux_setting: The most recent selected mux setting for this pin, if any.
  * @gpio_owner: If pinctrl_gpio_request() was called for this pin, this is
  *	the name of the GPIO that "owns" this pin.
@@ -171,26 +330,51 @@ struct pin_desc {
 	const char *name;
 	bool dynamic_name;
 	void *drv_data;
+	unsigned int index;
 	/* These fields only added when supporting pinmux drivers */
 #ifdef CONFIG_PINMUX
-	unsigned int mux_usecount;
 	const char *mux_owner;
 	const struct pinctrl_setting_mux *mux_setting;
 	const char *gpio_owner;
-	struct mutex mux_lock;
 #endif
 };
 
+/**
+ * struct pinctrl_maps_dev - index of all mapping table entries of a device
+ * @hnode: node in the hash of consumer device names
+ * @dev_name: the name of the consumer device all entries on @refs refer to
+ * @refs: list of struct pinctrl_map_ref, in map registration order
+ */
+struct pinctrl_maps_dev {
+	struct hlist_node hnode;
+	const char *dev_name;
+	struct list_head refs;
+};
+
+/**
+ * struct pinctrl_map_ref - a mapping table entry filed in a device index
+ * @node: list node for struct pinctrl_maps_dev's @refs field
+ * @maps_dev: the device index this entry is filed in
+ * @map: the mapping table entry
+ */
+struct pinctrl_map_ref {
+	struct list_head node;
+	struct pinctrl_maps_dev *maps_dev;
+	const struct pinctrl_map *map;
+};
+
 /**
  * struct pinctrl_maps - a list item containing part of the mapping table
  * @node: mapping table list node
  * @maps: array of mapping table entries
  * @num_maps: the number of entries in @maps
+ * @refs: one index reference per entry in @maps
  */
 struct pinctrl_maps {
 	struct list_head node;
 	const struct pinctrl_map *maps;
 	unsigned int num_maps;
+	struct pinctrl_map_ref refs[] __counted_by(num_maps);
 };
 
 #ifdef CONFIG_GENERIC_PINCTRL_GROUPS
@@ -242,9 +426,30 @@ const char *pin_get_name(struct pinctrl_dev *pctldev, const unsigned int pin);
 int pinctrl_get_group_selector(struct pinctrl_dev *pctldev,
 			       const char *pin_group);
 
+int pinctrl_name_index_lookup(struct pinctrl_dev *pctldev,
+			      struct pinctrl_name_index *index,
+			      const char *name,
+			      int (*get_count)(struct pinctrl_dev *pctldev),
+			      const char *(*get_name)(struct pinctrl_dev *pctldev,
+						      unsigned int selector));
+void pinctrl_name_index_add(struct pinctrl_dev *pctldev,
+			    struct pinctrl_name_index *index,
+			    const char *name, unsigned int selector);
+void pinctrl_name_index_reset(struct pinctrl_dev *pctldev,
+			      struct pinctrl_name_index *index);
+
 static inline struct pin_desc *pin_desc_get(struct pinctrl_dev *pctldev,
 					    unsigned int pin)
 {
+	if (pctldev->pin_descs) {
+		/* Pins below @pin_base wrap around and fail the check too */
+		pin -= pctldev->pin_base;
+		if (pin >= pctldev->num_pin_descs)
+			return NULL;
+
+		return &pctldev->pin_descs[pin];
+	}
+
 	return radix_tree_lookup(&pctldev->pin_desc_tree, pin);
 }
 
@@ -255,6 +460,15 @@ pinctrl_find_gpio_range_from_pin_nolock(struct pinctrl_dev *pctldev,
 extern int pinctrl_force_sleep(struct pinctrl_dev *pctldev);
 extern int pinctrl_force_default(struct pinctrl_dev *pctldev);
 
+void pinctrl_set_apply_batch(struct pinctrl_dev *pctldev,
+			     int (*apply_batch)(struct pinctrl_dev *pctldev,
+						const struct pinctrl_state_prog *prog));
+void pinctrl_enable_async_hogs(struct pinctrl_dev *pctldev,
+			       unsigned int (*hog_shard)(struct pinctrl_dev *pctldev,
+							 unsigned int pin));
+int pinctrl_wait_for_hogs(struct pinctrl_dev *pctldev);
+
+extern struct mutex pinctrl_list_mutex;
 extern struct mutex pinctrl_maps_mutex;
 extern struct list_head pinctrl_maps;
 
@@ -263,3 +477,13 @@ extern struct list_head pinctrl_maps;
 		for (unsigned int __i = 0;						\
 		     __i < _maps_node_->num_maps && (_map_ = &_maps_node_->maps[__i]);	\
 		     __i++)
+
+struct pinctrl_maps_dev *pinctrl_find_maps_dev(const char *devname);
+
+/* Iterate the maps of one consumer device, @_maps_dev_ may be NULL */
+#define for_each_dev_pin_map(_maps_dev_, _ref_, _map_)					\
+	for (_ref_ = (_maps_dev_) ? list_first_entry(&(_maps_dev_)->refs,		\
+						     typeof(*(_ref_)), node) : NULL;	\
+	     _ref_ && !list_entry_is_head(_ref_, &(_maps_dev_)->refs, node) &&	\
+	     (_map_ = (_ref_)->map);							\
+	     _ref_ = list_next_entry(_ref_, node))
@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the consumer device index used by create_pinctrl()
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/pinctrl/consumer.h>
+#include <linux/pinctrl/machine.h>
+
+#include "core.h"
+
+#define BENCH_NUM_DEVS		1000
+#define BENCH_MAPS_PER_DEV	10
+#define BENCH_NUM_MAPS		(BENCH_NUM_DEVS * BENCH_MAPS_PER_DEV)
+#define BENCH_NUM_GETS		16
+#define BENCH_ROUNDS		64
+
+static const char * const bench_states[BENCH_MAPS_PER_DEV] = {
+	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9",
+};
+
+static void unregister_maps_action(void *maps)
+{
+	pinctrl_unregister_mappings(maps);
+}
+
+static struct pinctrl_map *register_dummy_maps(struct kunit *test,
+					       char (*names)[24],
+					       unsigned int num_devs,
+					       unsigned int maps_per_dev)
+{
+	struct pinctrl_map *maps;
+	unsigned int i;
+	int ret;
+
+	maps = kunit_kcalloc(test, num_devs * maps_per_dev, sizeof(*maps),
+			     GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, maps);
+
+	/* Interleave devices so that a linear scan has to visit every map */
+	for (i = 0; i < num_devs * maps_per_dev; i++) {
+		maps[i].dev_name = names[i % num_devs];
+		maps[i].name = bench_states[i / num_devs];
+		maps[i].type = PIN_MAP_TYPE_DUMMY_STATE;
+	}
+
+	ret = pinctrl_register_mappings(maps, num_devs * maps_per_dev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	ret = kunit_add_action_or_reset(test, unregister_maps_action, maps);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	return maps;
+}
+
+static char (*alloc_names(struct kunit *test, const char *prefix,
+			  unsigned int num))[24]
+{
+	char (*names)[24];
+	unsigned int i;
+
+	names = kunit_kcalloc(test, num, sizeof(*names), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, names);
+
+	for (i = 0; i < num; i++)
+		snprintf(names[i], sizeof(names[i]), "%s-%u", prefix, i);
+
+	return names;
+}
+
+static void create_pinctrl_only_own_maps(struct kunit *test)
+{
+	char (*names)[24] = alloc_names(test, "pctl-own", 4);
+	struct pinctrl_state *state;
+	struct device *dev;
+	struct pinctrl *p;
+
+	register_dummy_maps(test, names, 3, 2);
+	dev = kunit_device_register(test, names[1]);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	p = pinctrl_get(dev);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, p);
+
+	state = pinctrl_lookup_state(p, "s0");
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test, state);
+	state = pinctrl_lookup_state(p, "s1");
+	KUNIT_EXPECT_NOT_ERR_OR_NULL(test, state);
+	KUNIT_EXPECT_EQ(test, list_count_nodes(&p->states), 2);
+
+	pinctrl_put(p);
+
+	/* A device without maps gets an empty handle */
+	dev = kunit_device_register(test, names[3]);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	p = pinctrl_get(dev);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, p);
+	KUNIT_EXPECT_TRUE(test, list_empty(&p->states));
+	pinctrl_put(p);
+}
+
+static void create_pinctrl_index_follows_unregister(struct kunit *test)
+{
+	char (*names)[24] = alloc_names(test, "pctl-unreg", 2);
+	struct pinctrl_map *maps;
+
+	maps = register_dummy_maps(test, names, 2, 3);
+
+	mutex_lock(&pinctrl_maps_mutex);
+	KUNIT_EXPECT_NOT_NULL(test, pinctrl_find_maps_dev(names[0]));
+	KUNIT_EXPECT_EQ(test,
+			list_count_nodes(&pinctrl_find_maps_dev(names[0])->refs),
+			3);
+	mutex_unlock(&pinctrl_maps_mutex);
+
+	kunit_release_action(test, unregister_maps_action, maps);
+
+	mutex_lock(&pinctrl_maps_mutex);
+	KUNIT_EXPECT_NULL(test, pinctrl_find_maps_dev(names[0]));
+	KUNIT_EXPECT_NULL(test, pinctrl_find_maps_dev(names[1]));
+	mutex_unlock(&pinctrl_maps_mutex);
+}
+
+static void create_pinctrl_keeps_map_order(struct kunit *test)
+{
+	char (*names)[24] = alloc_names(test, "pctl-order", 1);
+	const struct pinctrl_map *map;
+	struct pinctrl_maps_dev *maps_dev;
+	struct pinctrl_map_ref *ref;
+	unsigned int i = 0;
+
+	register_dummy_maps(test, names, 1, BENCH_MAPS_PER_DEV);
+
+	mutex_lock(&pinctrl_maps_mutex);
+	maps_dev = pinctrl_find_maps_dev(names[0]);
+	for_each_dev_pin_map(maps_dev, ref, map)
+		KUNIT_EXPECT_STREQ(test, map->name, bench_states[i++]);
+	mutex_unlock(&pinctrl_maps_mutex);
+
+	KUNIT_EXPECT_EQ(test, i, BENCH_MAPS_PER_DEV);
+}
+
+/* What create_pinctrl() had to do before the index existed */
+static unsigned int linear_scan(const char *devname)
+{
+	struct pinctrl_maps *maps_node;
+	const struct pinctrl_map *map;
+	unsigned int found = 0;
+
+	mutex_lock(&pinctrl_maps_mutex);
+	for_each_pin_map(maps_node, map)
+		if (!strcmp(map->dev_name, devname))
+			found++;
+	mutex_unlock(&pinctrl_maps_mutex);
+
+	return found;
+}
+
+static unsigned int indexed_scan(const char *devname)
+{
+	struct pinctrl_maps_dev *maps_dev;
+	struct pinctrl_map_ref *ref;
+	const struct pinctrl_map *map;
+	unsigned int found = 0;
+
+	mutex_lock(&pinctrl_maps_mutex);
+	maps_dev = pinctrl_find_maps_dev(devname);
+	for_each_dev_pin_map(maps_dev, ref, map)
+		found++;
+	mutex_unlock(&pinctrl_maps_mutex);
+
+	return found;
+}
+
+static void create_pinctrl_bench_10k_maps(struct kunit *test)
+{
+	char (*names)[24] = alloc_names(test, "pctl-bench", BENCH_NUM_DEVS);
+	struct device *devs[BENCH_NUM_GETS];
+	u64 t_linear, t_indexed, t_get;
+	unsigned int i, r;
+	ktime_t start;
+
+	register_dummy_maps(test, names, BENCH_NUM_DEVS, BENCH_MAPS_PER_DEV);
+
+	for (i = 0; i < BENCH_NUM_GETS; i++) {
+		/* Spread the probed devices over the whole table */
+		devs[i] = kunit_device_register(test,
+				names[i * (BENCH_NUM_DEVS / BENCH_NUM_GETS)]);
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, devs[i]);
+	}
+
+	start = ktime_get();
+	for (r = 0; r < BENCH_ROUNDS; r++)
+		for (i = 0; i < BENCH_NUM_GETS; i++)
+			KUNIT_ASSERT_EQ(test, linear_scan(dev_name(devs[i])),
+					BENCH_MAPS_PER_DEV);
+	t_linear = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (r = 0; r < BENCH_ROUNDS; r++)
+		for (i = 0; i < BENCH_NUM_GETS; i++)
+			KUNIT_ASSERT_EQ(test, indexed_scan(dev_name(devs[i])),
+					BENCH_MAPS_PER_DEV);
+	t_indexed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (r = 0; r < BENCH_ROUNDS; r++) {
+		for (i = 0; i < BENCH_NUM_GETS; i++) {
+			struct pinctrl *p = pinctrl_get(devs[i]);
+
+			KUNIT_ASSERT_NOT_ERR_OR_NULL(test, p);
+			KUNIT_ASSERT_EQ(test, list_count_nodes(&p->states),
+					BENCH_MAPS_PER_DEV);
+			pinctrl_put(p);
+		}
+	}
+	t_get = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	kunit_info(test, "%u maps: linear scan %llu ns, indexed %llu ns, pinctrl_get() %llu ns per lookup\n",
+		   BENCH_NUM_MAPS,
+		   div_u64(t_linear, BENCH_ROUNDS * BENCH_NUM_GETS),
+		   div_u64(t_indexed, BENCH_ROUNDS * BENCH_NUM_GETS),
+		   div_u64(t_get, BENCH_ROUNDS * BENCH_NUM_GETS));
+}
+
+static struct kunit_case create_pinctrl_test_cases[] = {
+	KUNIT_CASE(create_pinctrl_only_own_maps),
+	KUNIT_CASE(create_pinctrl_index_follows_unregister),
+	KUNIT_CASE(create_pinctrl_keeps_map_order),
+	KUNIT_CASE_SLOW(create_pinctrl_bench_10k_maps),
+	{}
+};
+
+static struct kunit_suite create_pinctrl_test_suite = {
+	.name = "create_pinctrl",
+	.test_cases = create_pinctrl_test_cases,
+};
+
+kunit_test_suite(create_pinctrl_test_suite);
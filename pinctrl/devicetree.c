@@ -5,11 +5,18 @@
  * Copyright (C) 2012 NVIDIA CORPORATION. All rights reserved.
  */
 
+#include <linux/cleanup.h>
 #include <linux/device.h>
+#include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/notifier.h>
 #include <linux/of.h>
 #include <linux/pinctrl/pinctrl.h>
 #include <linux/slab.h>
 
+#include "bootstats.h"
 #include "core.h"
 #include "devicetree.h"
 
@@ -19,14 +26,52 @@
  * @pctldev: the pin controller that allocated this struct, and will free it
  * @map: the mapping table entries
  * @num_maps: number of mapping table entries
+ * @phandle: the pin configuration node the entries were translated from,
+ *	0 for a dummy state
  */
 struct pinctrl_dt_map {
 	struct list_head node;
 	struct pinctrl_dev *pctldev;
 	struct pinctrl_map *map;
 	unsigned int num_maps;
+	phandle phandle;
+};
+
+/**
+ * struct pinctrl_dt_cache - maps translated for a consumer that deferred
+ * @node: list node for pinctrl_dt_cache_list
+ * @np: the device tree node of the consumer
+ * @dev_name: the name of the consumer device, which the maps carry
+ * @dt_maps: the struct pinctrl_dt_map chunks kept for the next attempt
+ * @parked: the time in jiffies the consumer last deferred
+ *
+ * A consumer whose probe is deferred tends to come back with the same
+ * device tree node and the same pinctrl-N phandle lists. Keep what the
+ * pin controllers translated so the retry does not run dt_node_to_map()
+ * again. Chunks are matched by phandle and state name, and dropped when the
+ * pin controller that made them goes away or the device tree changes.
+ *
+ * A consumer may also be deleted, or never be probed again, so entries that
+ * were not parked again within PINCTRL_DT_CACHE_TTL are dropped, and no more
+ * than PINCTRL_DT_CACHE_MAX consumers are kept, the least recent going
+ * first. Missing the cache only costs translating the maps again.
+ */
+struct pinctrl_dt_cache {
+	struct list_head node;
+	struct device_node *np;
+	const char *dev_name;
+	struct list_head dt_maps;
+	unsigned long parked;
 };
 
+#define PINCTRL_DT_CACHE_MAX	64
+#define PINCTRL_DT_CACHE_TTL	(60 * HZ)
+
+/* Ordered by &struct pinctrl_dt_cache.parked, oldest first */
+static LIST_HEAD(pinctrl_dt_cache_list);
+static unsigned int pinctrl_dt_cache_count;
+static DEFINE_MUTEX(pinctrl_dt_cache_mutex);
+
 static void dt_free_map(struct pinctrl_dev *pctldev,
 			struct pinctrl_map *map, unsigned int num_maps)
 {
@@ -47,6 +92,197 @@ static void dt_free_map(struct pinctrl_dev *pctldev,
 	}
 }
 
+/* Must be called with pinctrl_dt_cache_mutex held */
+static struct pinctrl_dt_cache *dt_cache_find(struct device *dev)
+{
+	struct pinctrl_dt_cache *cache;
+
+	list_for_each_entry(cache, &pinctrl_dt_cache_list, node)
+		if (cache->np == dev->of_node &&
+		    !strcmp(cache->dev_name, dev_name(dev)))
+			return cache;
+
+	return NULL;
+}
+
+/* Must be called with pinctrl_dt_cache_mutex held */
+static void dt_cache_free(struct pinctrl_dt_cache *cache)
+{
+	struct pinctrl_dt_map *dt_map, *n;
+
+	list_for_each_entry_safe(dt_map, n, &cache->dt_maps, node) {
+		list_del(&dt_map->node);
+		dt_free_map(dt_map->pctldev, dt_map->map, dt_map->num_maps);
+		kfree(dt_map);
+	}
+
+	list_del(&cache->node);
+	pinctrl_dt_cache_count--;
+	of_node_put(cache->np);
+	kfree_const(cache->dev_name);
+	kfree(cache);
+}
+
+/*
+ * Drop the entries past their time, and the oldest ones until @room more fit.
+ * Must be called with pinctrl_dt_cache_mutex held.
+ */
+static void dt_cache_expire(unsigned int room)
+{
+	struct pinctrl_dt_cache *cache, *n;
+
+	list_for_each_entry_safe(cache, n, &pinctrl_dt_cache_list, node) {
+		if (pinctrl_dt_cache_count + room <= PINCTRL_DT_CACHE_MAX &&
+		    time_before(jiffies, cache->parked + PINCTRL_DT_CACHE_TTL))
+			break;
+		dt_cache_free(cache);
+	}
+}
+
+/**
+ * pinctrl_dt_park_maps() - keep the DT maps of a deferred consumer
+ * @p: the pinctrl handle being torn down because its creation deferred
+ *
+ * Moves the translated chunks of @p to the cache, where the next
+ * pinctrl_dt_to_map() for the same device picks them up. Whatever cannot be
+ * kept is left on @p for pinctrl_dt_free_maps() to release.
+ */
+void pinctrl_dt_park_maps(struct pinctrl *p)
+{
+	struct pinctrl_dt_map *dt_map, *n;
+	struct pinctrl_dt_cache *cache;
+
+	if (!p->dev->of_node || list_empty(&p->dt_maps))
+		return;
+
+	guard(mutex)(&pinctrl_dt_cache_mutex);
+
+	cache = dt_cache_find(p->dev);
+	if (cache) {
+		cache->parked = jiffies;
+		list_move_tail(&cache->node, &pinctrl_dt_cache_list);
+	}
+	dt_cache_expire(!cache);
+
+	if (!cache) {
+		cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+		if (!cache)
+			return;
+		cache->dev_name = kstrdup_const(dev_name(p->dev), GFP_KERNEL);
+		if (!cache->dev_name) {
+			kfree(cache);
+			return;
+		}
+		cache->np = of_node_get(p->dev->of_node);
+		cache->parked = jiffies;
+		INIT_LIST_HEAD(&cache->dt_maps);
+		list_add_tail(&cache->node, &pinctrl_dt_cache_list);
+		pinctrl_dt_cache_count++;
+	}
+
+	list_for_each_entry_safe(dt_map, n, &p->dt_maps, node) {
+		/* Dummy states are cheaper to make again than to keep */
+		if (!dt_map->pctldev)
+			continue;
+		pinctrl_unregister_mappings(dt_map->map);
+		list_move_tail(&dt_map->node, &cache->dt_maps);
+	}
+}
+
+/*
+ * Hand the chunk translated from @phandle for @statename by an earlier,
+ * deferred attempt over to @p. Returns -ENOENT if there is none.
+ */
+static int dt_reuse_cached_map(struct pinctrl *p, const char *statename,
+			       phandle phandle)
+{
+	struct pinctrl_dt_cache *cache;
+	struct pinctrl_dt_map *dt_map;
+	bool found = false;
+
+	scoped_guard(mutex, &pinctrl_dt_cache_mutex) {
+		cache = dt_cache_find(p->dev);
+		if (!cache)
+			return -ENOENT;
+
+		list_for_each_entry(dt_map, &cache->dt_maps, node) {
+			if (dt_map->phandle == phandle &&
+			    !strcmp(dt_map->map[0].name, statename)) {
+				list_move_tail(&dt_map->node, &p->dt_maps);
+				found = true;
+				break;
+			}
+		}
+	}
+	if (!found)
+		return -ENOENT;
+
+	return pinctrl_register_mappings(dt_map->map, dt_map->num_maps);
+}
+
+/* Drop what is left of the cache for @dev once its maps are complete */
+static void dt_cache_drop(struct device *dev)
+{
+	struct pinctrl_dt_cache *cache;
+
+	guard(mutex)(&pinctrl_dt_cache_mutex);
+
+	cache = dt_cache_find(dev);
+	if (cache)
+		dt_cache_free(cache);
+}
+
+/**
+ * pinctrl_dt_cache_drop_pctldev() - forget the cached maps of a controller
+ * @pctldev: the pin controller being unregistered
+ */
+void pinctrl_dt_cache_drop_pctldev(struct pinctrl_dev *pctldev)
+{
+	struct pinctrl_dt_cache *cache, *n1;
+	struct pinctrl_dt_map *dt_map, *n2;
+
+	guard(mutex)(&pinctrl_dt_cache_mutex);
+
+	list_for_each_entry_safe(cache, n1, &pinctrl_dt_cache_list, node) {
+		list_for_each_entry_safe(dt_map, n2, &cache->dt_maps, node) {
+			if (dt_map->pctldev != pctldev)
+				continue;
+			list_del(&dt_map->node);
+			dt_free_map(pctldev, dt_map->map, dt_map->num_maps);
+			kfree(dt_map);
+		}
+		if (list_empty(&cache->dt_maps))
+			dt_cache_free(cache);
+	}
+}
+
+/*
+ * The cached maps point into device tree properties and were made from
+ * pin configuration nodes, so any change of the tree invalidates them.
+ */
+static int pinctrl_dt_cache_notify(struct notifier_block *nb,
+				   unsigned long action, void *arg)
+{
+	struct pinctrl_dt_cache *cache, *n;
+
+	guard(mutex)(&pinctrl_dt_cache_mutex);
+
+	list_for_each_entry_safe(cache, n, &pinctrl_dt_cache_list, node)
+		dt_cache_free(cache);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block pinctrl_dt_cache_nb = {
+	.notifier_call = pinctrl_dt_cache_notify,
+};
+
+void __init pinctrl_dt_cache_init(void)
+{
+	if (IS_ENABLED(CONFIG_OF_DYNAMIC))
+		WARN_ON(of_reconfig_notifier_register(&pinctrl_dt_cache_nb));
+}
+
 void pinctrl_dt_free_maps(struct pinctrl *p)
 {
 	struct pinctrl_dt_map *dt_map, *n1;
@@ -64,7 +300,8 @@ void pinctrl_dt_free_maps(struct pinctrl *p)
 
 static int dt_remember_or_free_map(struct pinctrl *p, const char *statename,
 				   struct pinctrl_dev *pctldev,
-				   struct pinctrl_map *map, unsigned int num_maps)
+				   struct pinctrl_map *map, unsigned int num_maps,
+				   phandle phandle)
 {
 	int i;
 	struct pinctrl_dt_map *dt_map;
@@ -91,6 +328,7 @@ static int dt_remember_or_free_map(struct pinctrl *p, const char *statename,
 	dt_map->pctldev = pctldev;
 	dt_map->map = map;
 	dt_map->num_maps = num_maps;
+	dt_map->phandle = phandle;
 	list_add_tail(&dt_map->node, &p->dt_maps);
 
 	return pinctrl_register_mappings(map, num_maps);
@@ -179,8 +417,12 @@ static int dt_to_map_one_config(struct pinctrl *p,
 		return 0;
 	}
 
+	pinctrl_boot_stats_maps(dev_name(p->dev), dev_name(pctldev->dev),
+				num_maps);
+
 	/* Stash the mapping table chunk away for later use */
-	return dt_remember_or_free_map(p, statename, pctldev, map, num_maps);
+	return dt_remember_or_free_map(p, statename, pctldev, map, num_maps,
+				       np_config->phandle);
 }
 
 static int dt_remember_dummy_state(struct pinctrl *p, const char *statename)
@@ -194,7 +436,7 @@ static int dt_remember_dummy_state(struct pinctrl *p, const char *statename)
 	/* There is no pctldev for PIN_MAP_TYPE_DUMMY_STATE */
 	map->type = PIN_MAP_TYPE_DUMMY_STATE;
 
-	return dt_remember_or_free_map(p, statename, NULL, map, 1);
+	return dt_remember_or_free_map(p, statename, NULL, map, 1, 0);
 }
 
 int pinctrl_dt_to_map(struct pinctrl *p, struct pinctrl_dev *pctldev)
@@ -255,6 +497,15 @@ int pinctrl_dt_to_map(struct pinctrl *p, struct pinctrl_dev *pctldev)
 		for (config = 0; config < size; config++) {
 			phandle = be32_to_cpup(list++);
 
+			/* Reuse what a deferred attempt already translated */
+			if (!pctldev) {
+				ret = dt_reuse_cached_map(p, statename, phandle);
+				if (ret == 0)
+					continue;
+				if (ret != -ENOENT)
+					goto err;
+			}
+
 			/* Look up the pin configuration node */
 			np_config = of_find_node_by_phandle(phandle);
 			if (!np_config) {
@@ -283,9 +534,16 @@ int pinctrl_dt_to_map(struct pinctrl *p, struct pinctrl_dev *pctldev)
 		}
 	}
 
+	/* Anything still cached for this device is stale by now */
+	if (!pctldev)
+		dt_cache_drop(p->dev);
+
 	return 0;
 
 err:
+	/* Hogs are not cached, their controller is still registering */
+	if (ret == -EPROBE_DEFER && !pctldev)
+		pinctrl_dt_park_maps(p);
 	pinctrl_dt_free_maps(p);
 	return ret;
 }
@@ -17,6 +17,9 @@ struct pinctrl_dev;
 
 void pinctrl_dt_free_maps(struct pinctrl *p);
 int pinctrl_dt_to_map(struct pinctrl *p, struct pinctrl_dev *pctldev);
+void pinctrl_dt_park_maps(struct pinctrl *p);
+void pinctrl_dt_cache_drop_pctldev(struct pinctrl_dev *pctldev);
+void pinctrl_dt_cache_init(void);
 
 int pinctrl_count_index_with_args(const struct device_node *np,
 				  const char *list_name);
@@ -37,6 +40,18 @@ static inline void pinctrl_dt_free_maps(struct pinctrl *p)
 {
 }
 
+static inline void pinctrl_dt_park_maps(struct pinctrl *p)
+{
+}
+
+static inline void pinctrl_dt_cache_drop_pctldev(struct pinctrl_dev *pctldev)
+{
+}
+
+static inline void pinctrl_dt_cache_init(void)
+{
+}
+
 static inline int pinctrl_count_index_with_args(const struct device_node *np,
 						const char *list_name)
 {
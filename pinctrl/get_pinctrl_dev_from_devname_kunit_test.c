@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit stress test for the lockless pin controller lookups
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/pinctrl/pinctrl.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#include "core.h"
+#include "pinctrl_kunit.h"
+
+#define STRESS_NUM_READERS	4
+#define STRESS_NUM_CHURN	8
+#define STRESS_CHURN_ROUNDS	200
+#define NUM_GPIO_RANGES		64
+
+struct lookup_ctx {
+	const char *stable_name;
+	struct pinctrl_dev *stable;
+	char (*churn_names)[24];
+	unsigned long lookups;
+	unsigned long mismatches;
+};
+
+static struct pinctrl_desc test_desc = {
+	.name = "pinctrl-lookup-test",
+	.pctlops = &pinctrl_test_pctlops,
+};
+
+static struct pinctrl_dev *register_test_pctldev(struct kunit *test,
+						 struct device *dev)
+{
+	struct pinctrl_dev *pctldev;
+
+	pctldev = pinctrl_register(&test_desc, dev, NULL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pctldev);
+
+	return pctldev;
+}
+
+static void get_pinctrl_dev_from_devname_basic(struct kunit *test)
+{
+	struct pinctrl_dev *pctldev;
+	struct device *dev;
+
+	dev = kunit_device_register(test, "pctl-lookup-basic");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	KUNIT_EXPECT_NULL(test, get_pinctrl_dev_from_devname(dev_name(dev)));
+
+	pctldev = register_test_pctldev(test, dev);
+	KUNIT_EXPECT_PTR_EQ(test, get_pinctrl_dev_from_devname(dev_name(dev)),
+			    pctldev);
+	KUNIT_EXPECT_NULL(test, get_pinctrl_dev_from_devname(NULL));
+	KUNIT_EXPECT_NULL(test, get_pinctrl_dev_from_devname("pctl-lookup-none"));
+
+	pinctrl_unregister(pctldev);
+	KUNIT_EXPECT_NULL(test, get_pinctrl_dev_from_devname(dev_name(dev)));
+}
+
+static void pinctrl_remove_gpio_range_no_wait(struct kunit *test)
+{
+	const struct pinctrl_gpio_spans *spans;
+	struct pinctrl_gpio_range *ranges;
+	struct pinctrl_dev *pctldev;
+	struct device *dev;
+	unsigned int i;
+	ktime_t start;
+	u64 elapsed;
+
+	dev = kunit_device_register(test, "pctl-lookup-ranges");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+	pctldev = register_test_pctldev(test, dev);
+
+	ranges = kcalloc(NUM_GPIO_RANGES, sizeof(*ranges), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ranges);
+	for (i = 0; i < NUM_GPIO_RANGES; i++) {
+		ranges[i].name = "pctl-lookup-range";
+		ranges[i].id = i;
+		ranges[i].base = 1000 + 8 * i;
+		ranges[i].npins = 8;
+	}
+	pinctrl_add_gpio_ranges(pctldev, ranges, NUM_GPIO_RANGES);
+
+	mutex_lock(&pctldev->mutex);
+	spans = rcu_dereference_protected(pctldev->gpio_spans,
+					  lockdep_is_held(&pctldev->mutex));
+	KUNIT_EXPECT_NOT_NULL(test, spans);
+	if (spans) {
+		KUNIT_EXPECT_EQ(test, spans->num, NUM_GPIO_RANGES);
+		KUNIT_EXPECT_EQ(test, spans->span[5].base, 1040);
+		KUNIT_EXPECT_EQ(test, spans->span[5].npins, 8);
+	}
+	mutex_unlock(&pctldev->mutex);
+
+	/* No grace period per range, and the ranges can go right away */
+	start = ktime_get();
+	for (i = 0; i < NUM_GPIO_RANGES; i++)
+		pinctrl_remove_gpio_range(pctldev, &ranges[i]);
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+	kfree(ranges);
+
+	KUNIT_EXPECT_TRUE(test, list_empty(&pctldev->gpio_ranges));
+	KUNIT_EXPECT_NULL(test, rcu_access_pointer(pctldev->gpio_spans));
+	kunit_info(test, "removed %u GPIO ranges in %llu us\n",
+		   NUM_GPIO_RANGES, div_u64(elapsed, NSEC_PER_USEC));
+
+	pinctrl_unregister(pctldev);
+}
+
+static int lookup_thread(void *data)
+{
+	struct lookup_ctx *ctx = data;
+
+	while (!kthread_should_stop()) {
+		if (get_pinctrl_dev_from_devname(ctx->stable_name) != ctx->stable)
+			ctx->mismatches++;
+
+		/* These may or may not be registered right now */
+		get_pinctrl_dev_from_devname(
+			ctx->churn_names[ctx->lookups % STRESS_NUM_CHURN]);
+
+		ctx->lookups++;
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static void get_pinctrl_dev_from_devname_stress(struct kunit *test)
+{
+	struct task_struct *readers[STRESS_NUM_READERS];
+	struct device *churn_devs[STRESS_NUM_CHURN];
+	struct pinctrl_dev *churn[STRESS_NUM_CHURN];
+	struct lookup_ctx *ctxs;
+	char (*churn_names)[24];
+	unsigned long lookups = 0, mismatches = 0;
+	unsigned int register_errors = 0;
+	struct pinctrl_dev *stable;
+	struct device *dev;
+	unsigned int i, r;
+	ktime_t start;
+	u64 elapsed;
+
+	churn_names = kunit_kcalloc(test, STRESS_NUM_CHURN,
+				    sizeof(*churn_names), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, churn_names);
+	ctxs = kunit_kcalloc(test, STRESS_NUM_READERS, sizeof(*ctxs),
+			     GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctxs);
+
+	dev = kunit_device_register(test, "pctl-lookup-stable");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+	stable = register_test_pctldev(test, dev);
+
+	for (i = 0; i < STRESS_NUM_CHURN; i++) {
+		snprintf(churn_names[i], sizeof(churn_names[i]),
+			 "pctl-lookup-churn-%u", i);
+		churn_devs[i] = kunit_device_register(test, churn_names[i]);
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, churn_devs[i]);
+	}
+
+	for (i = 0; i < STRESS_NUM_READERS; i++) {
+		ctxs[i].stable_name = dev_name(dev);
+		ctxs[i].stable = stable;
+		ctxs[i].churn_names = churn_names;
+		readers[i] = kthread_run(lookup_thread, &ctxs[i],
+					 "pctl-lookup/%u", i);
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, readers[i]);
+	}
+
+	/* No assertions until the readers are stopped */
+	start = ktime_get();
+	for (r = 0; r < STRESS_CHURN_ROUNDS && !register_errors; r++) {
+		for (i = 0; i < STRESS_NUM_CHURN; i++) {
+			churn[i] = pinctrl_register(&test_desc, churn_devs[i],
+						    NULL);
+			if (IS_ERR(churn[i]))
+				register_errors++;
+		}
+		for (i = 0; i < STRESS_NUM_CHURN; i++)
+			if (!IS_ERR(churn[i]))
+				pinctrl_unregister(churn[i]);
+	}
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < STRESS_NUM_READERS; i++) {
+		kthread_stop(readers[i]);
+		lookups += ctxs[i].lookups;
+		mismatches += ctxs[i].mismatches;
+	}
+
+	KUNIT_EXPECT_EQ(test, register_errors, 0);
+	KUNIT_EXPECT_EQ(test, mismatches, 0);
+	for (i = 0; i < STRESS_NUM_CHURN; i++)
+		KUNIT_EXPECT_NULL(test,
+				  get_pinctrl_dev_from_devname(churn_names[i]));
+
+	kunit_info(test, "%lu lookups by %u readers during %u register/unregister cycles in %llu us\n",
+		   lookups, STRESS_NUM_READERS,
+		   STRESS_CHURN_ROUNDS * STRESS_NUM_CHURN,
+		   div_u64(elapsed, NSEC_PER_USEC));
+
+	pinctrl_unregister(stable);
+}
+
+static struct kunit_case get_pinctrl_dev_test_cases[] = {
+	KUNIT_CASE(get_pinctrl_dev_from_devname_basic),
+	KUNIT_CASE(pinctrl_remove_gpio_range_no_wait),
+	KUNIT_CASE_SLOW(get_pinctrl_dev_from_devname_stress),
+	{}
+};
+
+static struct kunit_suite get_pinctrl_dev_test_suite = {
+	.name = "get_pinctrl_dev_from_devname",
+	.test_cases = get_pinctrl_dev_test_cases,
+};
+
+kunit_test_suite(get_pinctrl_dev_test_suite);
@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests checking that pcs_apply_batch() leaves the registers exactly
+ * as the per-setting .set_mux() and .pin_config_*set() callbacks do
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/pinctrl/consumer.h>
+#include <linux/pinctrl/machine.h>
+
+#include "pinctrl-single.c"
+#include "pinctrl_kunit.h"
+
+#define BATCH_REGS_SIZE		0x40
+
+static const unsigned int batch_uart_pins[] = { 0, 1 };
+static const unsigned int batch_spi_pins[] = { 4, 5, 6 };
+
+static const char *batch_uart_groups[] = { "uart_pins" };
+static const char *batch_spi_groups[] = { "spi_pins" };
+
+/* Pull bits 9:8, drive strength bits 6:4, the mux itself is bits 2:0 */
+static struct pcs_conf_vals batch_confs[] = {
+	{ PIN_CONFIG_BIAS_PULL_UP, 0x100, 0x100, 0, 0x300 },
+	{ PIN_CONFIG_BIAS_PULL_DOWN, 0x200, 0x200, 0, 0x300 },
+	{ PIN_CONFIG_DRIVE_STRENGTH, 0, 0, 0, 0x70 },
+};
+
+static unsigned long batch_pin_configs[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 5),
+};
+
+static unsigned long batch_group_configs[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_DOWN, 1),
+	PIN_CONF_PACKED(PIN_CONFIG_DRIVE_STRENGTH, 2),
+};
+
+static unsigned long batch_bad_configs[] = {
+	PIN_CONF_PACKED(PIN_CONFIG_BIAS_PULL_UP, 0),
+	PIN_CONF_PACKED(PIN_CONFIG_SLEW_RATE, 1),
+};
+
+static const struct pinctrl_map batch_good_maps[] = {
+	PIN_MAP_MUX_GROUP(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			  "uart_pins", "uart"),
+	PIN_MAP_MUX_GROUP(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			  "spi_pins", "spi"),
+	PIN_MAP_CONFIGS_PIN(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			    "PIN1", batch_pin_configs),
+	PIN_MAP_CONFIGS_GROUP(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			      "spi_pins", batch_group_configs),
+	PIN_MAP_CONFIGS_PIN(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			    "PIN5", batch_pin_configs),
+};
+
+static const struct pinctrl_map batch_bad_maps[] = {
+	PIN_MAP_MUX_GROUP(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			  "uart_pins", "uart"),
+	PIN_MAP_CONFIGS_PIN(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			    "PIN0", batch_pin_configs),
+	PIN_MAP_CONFIGS_PIN(NULL, PINCTRL_STATE_DEFAULT, NULL,
+			    "PIN1", batch_bad_configs),
+};
+
+struct pcs_batch_test {
+	struct pcs_device *pcs;
+	struct device *consumer;
+	u8 *regs;
+};
+
+static void unregister_maps_action(void *maps)
+{
+	pinctrl_unregister_mappings(maps);
+}
+
+/* A function muxing each of @pins to @mux, with the configs above */
+static void pcs_batch_add_function(struct kunit *test, const char *name,
+				   const char **groups,
+				   const unsigned int *pins,
+				   unsigned int npins, unsigned int mux)
+{
+	struct pcs_batch_test *priv = test->priv;
+	struct pcs_device *pcs = priv->pcs;
+	struct pcs_function *func;
+	struct pcs_func_vals *vals;
+	unsigned int i;
+	int ret;
+
+	vals = kunit_kcalloc(test, npins, sizeof(*vals), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, vals);
+	for (i = 0; i < npins; i++) {
+		vals[i].reg = pcs->base + pcs_pin_reg_offset_get(pcs, pins[i]);
+		vals[i].val = mux;
+	}
+
+	ret = pinctrl_generic_add_group(pcs->pctl, groups[0], pins, npins,
+					pcs);
+	KUNIT_ASSERT_GE(test, ret, 0);
+	ret = pcs_add_function(pcs, &func, name, vals, npins, groups, 1);
+	KUNIT_ASSERT_GE(test, ret, 0);
+
+	func->conf = batch_confs;
+	func->nconfs = ARRAY_SIZE(batch_confs);
+}
+
+static int pcs_batch_test_init(struct kunit *test)
+{
+	struct pcs_batch_test *priv;
+	struct pcs_device *pcs;
+	int ret;
+
+	priv = kunit_kzalloc(test, sizeof(*priv), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv);
+	pcs = kunit_kzalloc(test, sizeof(*pcs), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, pcs);
+	pcs->res = kunit_kzalloc(test, sizeof(*pcs->res), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, pcs->res);
+	priv->regs = kunit_kzalloc(test, BATCH_REGS_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, priv->regs);
+
+	pcs->dev = kunit_device_register(test, "pcs-batch-pctl");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pcs->dev);
+
+	raw_spin_lock_init(&pcs->lock);
+	mutex_init(&pcs->mutex);
+	INIT_LIST_HEAD(&pcs->gpiofuncs);
+	INIT_LIST_HEAD(&pcs->irqs);
+	pcs->base = (__force void __iomem *)priv->regs;
+	pcs->size = BATCH_REGS_SIZE;
+	pcs->width = 32;
+	pcs->fmask = 0x7;
+	pcs->flags = PCS_FEAT_PINCONF;
+	pcs->read = pcs_readl;
+	pcs->write = pcs_writel;
+
+	ret = pcs_allocate_pin_table(pcs);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	pcs->desc.name = dev_name(pcs->dev);
+	pcs->desc.pctlops = &pcs_pinctrl_ops;
+	pcs->desc.pmxops = &pcs_pinmux_ops;
+	pcs->desc.confops = &pcs_pinconf_ops;
+	pcs->desc.owner = THIS_MODULE;
+	ret = pinctrl_register_and_init(&pcs->desc, pcs->dev, pcs, &pcs->pctl);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	ret = kunit_add_action_or_reset(test, pinctrl_test_unregister,
+					pcs->pctl);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	priv->pcs = pcs;
+	test->priv = priv;
+
+	pcs_batch_add_function(test, "uart", batch_uart_groups,
+			       batch_uart_pins, ARRAY_SIZE(batch_uart_pins), 1);
+	pcs_batch_add_function(test, "spi", batch_spi_groups,
+			       batch_spi_pins, ARRAY_SIZE(batch_spi_pins), 3);
+
+	ret = pinctrl_enable(pcs->pctl);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	priv->consumer = kunit_device_register(test, "pcs-batch-consumer");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, priv->consumer);
+
+	return 0;
+}
+
+static void pcs_batch_register_maps(struct kunit *test,
+				    const struct pinctrl_map *tmpl,
+				    unsigned int num_maps)
+{
+	struct pcs_batch_test *priv = test->priv;
+	struct pinctrl_dev *pctldev = priv->pcs->pctl;
+	struct pinctrl_map *maps;
+	unsigned int i;
+	int ret;
+
+	maps = kunit_kmemdup(test, tmpl, num_maps * sizeof(*maps), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, maps);
+
+	for (i = 0; i < num_maps; i++) {
+		maps[i].dev_name = dev_name(priv->consumer);
+		maps[i].ctrl_dev_name = pinctrl_dev_get_devname(pctldev);
+	}
+
+	ret = pinctrl_register_mappings(maps, num_maps);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	ret = kunit_add_action_or_reset(test, unregister_maps_action, maps);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+}
+
+/*
+ * Select the default state of the consumer starting from the same register
+ * contents every time, and return the registers it left behind.
+ */
+static int pcs_batch_select_default(struct kunit *test, bool batch, u8 *regs)
+{
+	struct pcs_batch_test *priv = test->priv;
+	struct pinctrl_state *state;
+	struct pinctrl *p;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < BATCH_REGS_SIZE; i += 4)
+		*(u32 *)(priv->regs + i) = 0x00f0f000 ^ (i * 0x01010101);
+
+	pinctrl_set_apply_batch(priv->pcs->pctl,
+				batch ? pcs_apply_batch : NULL);
+
+	p = pinctrl_get(priv->consumer);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, p);
+	state = pinctrl_lookup_state(p, PINCTRL_STATE_DEFAULT);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, state);
+
+	ret = pinctrl_select_state(p, state);
+
+	memcpy(regs, priv->regs, BATCH_REGS_SIZE);
+	pinctrl_put(p);
+
+	return ret;
+}
+
+static void pcs_apply_batch_matches_per_setting(struct kunit *test)
+{
+	u8 *regs[2];
+	unsigned int i;
+	int ret[2];
+
+	for (i = 0; i < 2; i++) {
+		regs[i] = kunit_kzalloc(test, BATCH_REGS_SIZE, GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, regs[i]);
+	}
+
+	pcs_batch_register_maps(test, batch_good_maps,
+				ARRAY_SIZE(batch_good_maps));
+
+	ret[0] = pcs_batch_select_default(test, false, regs[0]);
+	ret[1] = pcs_batch_select_default(test, true, regs[1]);
+
+	KUNIT_EXPECT_EQ(test, ret[0], 0);
+	KUNIT_EXPECT_EQ(test, ret[1], 0);
+	KUNIT_EXPECT_EQ(test, *(u32 *)(regs[1] + 4) & 0x377, 0x151);
+	KUNIT_EXPECT_EQ(test, *(u32 *)(regs[1] + 16) & 0x377, 0x223);
+	KUNIT_EXPECT_MEMEQ(test, regs[0], regs[1], BATCH_REGS_SIZE);
+}
+
+static void pcs_apply_batch_matches_per_setting_on_error(struct kunit *test)
+{
+	u8 *regs[2];
+	unsigned int i;
+	int ret[2];
+
+	for (i = 0; i < 2; i++) {
+		regs[i] = kunit_kzalloc(test, BATCH_REGS_SIZE, GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, regs[i]);
+	}
+
+	pcs_batch_register_maps(test, batch_bad_maps,
+				ARRAY_SIZE(batch_bad_maps));
+
+	ret[0] = pcs_batch_select_default(test, false, regs[0]);
+	ret[1] = pcs_batch_select_default(test, true, regs[1]);
+
+	KUNIT_EXPECT_EQ(test, ret[0], -ENOTSUPP);
+	KUNIT_EXPECT_EQ(test, ret[1], ret[0]);
+	KUNIT_EXPECT_MEMEQ(test, regs[0], regs[1], BATCH_REGS_SIZE);
+}
+
+static struct kunit_case pcs_apply_batch_test_cases[] = {
+	KUNIT_CASE(pcs_apply_batch_matches_per_setting),
+	KUNIT_CASE(pcs_apply_batch_matches_per_setting_on_error),
+	{}
+};
+
+static struct kunit_suite pcs_apply_batch_test_suite = {
+	.name = "pcs_apply_batch",
+	.init = pcs_batch_test_init,
+	.test_cases = pcs_apply_batch_test_cases,
+};
+
+kunit_test_suite(pcs_apply_batch_test_suite);
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the dense pin descriptor array used by pin_desc_get()
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/pinctrl/pinctrl.h>
+#include <linux/radix-tree.h>
+
+#include "core.h"
+#include "pinctrl_kunit.h"
+
+#define BENCH_NUM_PINS		1000
+#define BENCH_ROUNDS		1000
+
+/* Register @num_pins pins numbered @first, @first + @stride, ... */
+static struct pinctrl_dev *register_pins(struct kunit *test, const char *name,
+					 unsigned int num_pins,
+					 unsigned int first,
+					 unsigned int stride)
+{
+	struct pinctrl_pin_desc *pins;
+	struct pinctrl_desc *desc;
+	unsigned int i;
+
+	pins = kunit_kcalloc(test, num_pins, sizeof(*pins), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, pins);
+	/* Register in reverse order, the array must not depend on it */
+	for (i = 0; i < num_pins; i++)
+		pins[i].number = first + (num_pins - 1 - i) * stride;
+
+	desc = kunit_kzalloc(test, sizeof(*desc), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, desc);
+	desc->name = name;
+	desc->pins = pins;
+	desc->npins = num_pins;
+	desc->pctlops = &pinctrl_test_pctlops;
+
+	return pinctrl_test_register(test, desc, NULL);
+}
+
+static void pin_desc_get_dense(struct kunit *test)
+{
+	struct pinctrl_dev *pctldev;
+	struct pin_desc *desc;
+
+	pctldev = register_pins(test, "pin-desc-dense", 64, 0, 1);
+	KUNIT_EXPECT_NOT_NULL(test, pctldev->pin_descs);
+
+	desc = pin_desc_get(pctldev, 17);
+	KUNIT_ASSERT_NOT_NULL(test, desc);
+	KUNIT_EXPECT_PTR_EQ(test, desc->pctldev, pctldev);
+	KUNIT_EXPECT_STREQ(test, desc->name, "PIN17");
+	KUNIT_EXPECT_STREQ(test, pin_get_name(pctldev, 63), "PIN63");
+	KUNIT_EXPECT_NULL(test, pin_desc_get(pctldev, 64));
+}
+
+static void pin_desc_get_dense_with_base(struct kunit *test)
+{
+	struct pinctrl_dev *pctldev;
+
+	pctldev = register_pins(test, "pin-desc-base", 32, 100, 1);
+	KUNIT_EXPECT_NOT_NULL(test, pctldev->pin_descs);
+
+	KUNIT_EXPECT_NULL(test, pin_desc_get(pctldev, 0));
+	KUNIT_EXPECT_NULL(test, pin_desc_get(pctldev, 99));
+	KUNIT_EXPECT_STREQ(test, pin_get_name(pctldev, 100), "PIN100");
+	KUNIT_EXPECT_STREQ(test, pin_get_name(pctldev, 131), "PIN131");
+	KUNIT_EXPECT_NULL(test, pin_desc_get(pctldev, 132));
+}
+
+static void pin_desc_get_sparse(struct kunit *test)
+{
+	struct pinctrl_dev *pctldev;
+
+	pctldev = register_pins(test, "pin-desc-sparse", 32, 0, 3);
+	KUNIT_EXPECT_NULL(test, pctldev->pin_descs);
+
+	KUNIT_EXPECT_STREQ(test, pin_get_name(pctldev, 0), "PIN0");
+	KUNIT_EXPECT_STREQ(test, pin_get_name(pctldev, 93), "PIN93");
+	KUNIT_EXPECT_NULL(test, pin_desc_get(pctldev, 1));
+}
+
+static void pin_desc_get_dense_duplicate(struct kunit *test)
+{
+	/* Looks dense by its range, but 1 is missing and 0 is there twice */
+	static const struct pinctrl_pin_desc pins[] = {
+		PINCTRL_PIN(0, "a"), PINCTRL_PIN(0, "b"), PINCTRL_PIN(2, "c"),
+	};
+	struct pinctrl_desc desc = {
+		.name = "pin-desc-dup",
+		.pins = pins,
+		.npins = ARRAY_SIZE(pins),
+		.pctlops = &pinctrl_test_pctlops,
+	};
+	struct pinctrl_dev *pctldev;
+	struct device *dev;
+
+	dev = kunit_device_register(test, desc.name);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	pctldev = pinctrl_register(&desc, dev, NULL);
+	KUNIT_EXPECT_TRUE(test, IS_ERR(pctldev));
+	if (!IS_ERR(pctldev))
+		pinctrl_unregister(pctldev);
+}
+
+static void pin_desc_get_bench_1000_pins(struct kunit *test)
+{
+	struct pinctrl_dev *pctldev;
+	struct pin_desc *desc;
+	u64 t_array, t_tree;
+	unsigned int i, r;
+	ktime_t start;
+	int ret;
+
+	RADIX_TREE(tree, GFP_KERNEL);
+
+	pctldev = register_pins(test, "pin-desc-bench", BENCH_NUM_PINS, 0, 1);
+	KUNIT_ASSERT_NOT_NULL(test, pctldev->pin_descs);
+
+	/* The same descriptors in a radix tree, as before the dense array */
+	for (i = 0; i < BENCH_NUM_PINS; i++) {
+		ret = radix_tree_insert(&tree, i, &pctldev->pin_descs[i]);
+		KUNIT_ASSERT_EQ(test, ret, 0);
+	}
+
+	start = ktime_get();
+	for (r = 0; r < BENCH_ROUNDS; r++) {
+		for (i = 0; i < BENCH_NUM_PINS; i++) {
+			desc = radix_tree_lookup(&tree, i);
+			if (unlikely(desc != &pctldev->pin_descs[i]))
+				goto mismatch;
+		}
+	}
+	t_tree = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (r = 0; r < BENCH_ROUNDS; r++) {
+		for (i = 0; i < BENCH_NUM_PINS; i++) {
+			desc = pin_desc_get(pctldev, i);
+			if (unlikely(desc != &pctldev->pin_descs[i]))
+				goto mismatch;
+		}
+	}
+	t_array = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	kunit_info(test, "%u pins: radix tree %llu ps, dense array %llu ps per lookup\n",
+		   BENCH_NUM_PINS,
+		   div_u64(t_tree * 1000, BENCH_ROUNDS * BENCH_NUM_PINS),
+		   div_u64(t_array * 1000, BENCH_ROUNDS * BENCH_NUM_PINS));
+
+mismatch:
+	KUNIT_EXPECT_EQ(test, r, BENCH_ROUNDS);
+	for (i = 0; i < BENCH_NUM_PINS; i++)
+		radix_tree_delete(&tree, i);
+}
+
+static struct kunit_case pin_desc_get_test_cases[] = {
+	KUNIT_CASE(pin_desc_get_dense),
+	KUNIT_CASE(pin_desc_get_dense_with_base),
+	KUNIT_CASE(pin_desc_get_sparse),
+	KUNIT_CASE(pin_desc_get_dense_duplicate),
+	KUNIT_CASE_SLOW(pin_desc_get_bench_1000_pins),
+	{}
+};
+
+static struct kunit_suite pin_desc_get_test_suite = {
+	.name = "pin_desc_get",
+	.test_cases = pin_desc_get_test_cases,
+};
+
+kunit_test_suite(pin_desc_get_test_suite);
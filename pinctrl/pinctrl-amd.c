@@ -10,6 +10,7 @@
 
 #include <linux/err.h>
 #include <linux/bug.h>
+#include <linux/debugfs.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/spinlock.h>
@@ -18,6 +19,8 @@
 #include <linux/errno.h>
 #include <linux/log2.h>
 #include <linux/io.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include <linux/gpio/driver.h>
 #include <linux/slab.h>
 #include <linux/platform_device.h>
@@ -32,6 +35,7 @@
 #include <linux/pinctrl/pinmux.h>
 #include <linux/string_choices.h>
 #include <linux/suspend.h>
+#include <linux/workqueue.h>
 
 #include "core.h"
 #include "pinctrl-utils.h"
@@ -41,16 +45,152 @@
 static struct amd_gpio *pinctrl_dev;
 #endif
 
-static int amd_gpio_get_direction(struct gpio_chip *gc, unsigned offset)
+static void amd_gpio_coalesce_stop(struct amd_gpio *gpio_dev);
+
+static bool shadow_regs;
+module_param(shadow_regs, bool, 0444);
+MODULE_PARM_DESC(shadow_regs,
+		 "Serve pin configuration reads from shadow registers (default: off)");
+
+/*
+ * While gpio_dev->shadow_on is set, gpio_dev->shadow_regs holds what was last
+ * written to each pin register, without PIN_VOLATILE_BITS, so reading the bits
+ * only software changes takes no MMIO read. Those volatile bits read as 0 from
+ * the shadow, and so a value built from it no longer acks pending interrupts
+ * as a side effect when written back.
+ *
+ * The shadow is off unless the shadow_regs parameter or the debugfs knob of
+ * the same name turns it on. ACPI firmware may write these registers itself,
+ * through AML or SMM, and the driver does not see it: with the shadow on, the
+ * next read-modify-write of such a pin writes the stale shadow bits back and
+ * undoes the firmware's change. Only turn it on where firmware leaves the pins
+ * alone at runtime. The shadow is reloaded from the hardware on resume, and
+ * whenever 1 is written to the debugfs knob.
+ */
+
+/* Called with gpio_dev->lock held */
+static u32 amd_gpio_read_cfg(struct amd_gpio *gpio_dev, unsigned int pin)
+{
+	if (gpio_dev->shadow_on)
+		return gpio_dev->shadow_regs[pin];
+
+	return readl(gpio_dev->base + pin * 4);
+}
+
+/* Called with gpio_dev->lock held, pairs with amd_gpio_peek_cfg() */
+static void amd_gpio_shadow_store(struct amd_gpio *gpio_dev, unsigned int pin,
+				  u32 pin_reg)
+{
+	WRITE_ONCE(gpio_dev->shadow_regs[pin], pin_reg & ~PIN_VOLATILE_BITS);
+}
+
+/* Called with gpio_dev->lock held */
+static void amd_gpio_write_cfg(struct amd_gpio *gpio_dev, unsigned int pin,
+			       u32 pin_reg)
+{
+	writel(pin_reg, gpio_dev->base + pin * 4);
+	if (gpio_dev->shadow_on)
+		amd_gpio_shadow_store(gpio_dev, pin, pin_reg);
+}
+
+/*
+ * Read pin register @pin without the lock, for accessors that only look at
+ * it and never write a value built from it back.
+ *
+ * Each pin register is a naturally aligned 32-bit word that readl() fetches
+ * in a single access, so every bit of the result comes from the same instant:
+ * a read racing with amd_gpio_write_cfg() on another CPU sees the register
+ * either before or after that write, never a mix of the two. The lock would
+ * only order the read against a whole read-modify-write, which changes which
+ * of those two values is seen, not whether it is consistent.
+ *
+ * That makes these bits safe to test on a lockless read:
+ *
+ *	PIN_STS		the sampled input level, only the hardware changes it
+ *	OUTPUT_VALUE	only changed by whole-register writes under the lock
+ *	OUTPUT_ENABLE	likewise
+ *
+ * and more generally any single bit or field looked at on its own. Combining
+ * two lockless reads of a pin, or writing back anything derived from one, is
+ * not safe: a writer can run in between, and its update would be lost. Those
+ * paths take gpio_dev->lock and use amd_gpio_read_cfg().
+ *
+ * With the shadow on, the entry is read instead. amd_gpio_shadow_store() writes
+ * it with WRITE_ONCE() so it cannot tear either, and shadow_on is published
+ * with release semantics after the shadow is reloaded, so seeing it set means
+ * seeing the reloaded values. A reader racing with the shadow being turned off
+ * may still see it once, holding what was last written while it was on.
+ */
+static u32 amd_gpio_peek_cfg(struct amd_gpio *gpio_dev, unsigned int pin)
+{
+	if (smp_load_acquire(&gpio_dev->shadow_on))
+		return READ_ONCE(gpio_dev->shadow_regs[pin]);
+
+	return readl(gpio_dev->base + pin * 4);
+}
+
+/* Turning the shadow on reloads it from the hardware, even if it already was */
+static void amd_gpio_shadow_enable(struct amd_gpio *gpio_dev, bool on)
 {
 	unsigned long flags;
-	u32 pin_reg;
-	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
+	unsigned int pin;
+
+	if (!gpio_dev->shadow_regs)
+		return;
 
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + offset * 4);
+	if (on) {
+		for (pin = 0; pin < gpio_dev->gc.ngpio; pin++)
+			amd_gpio_shadow_store(gpio_dev, pin,
+					      readl(gpio_dev->base + pin * 4));
+	}
+	smp_store_release(&gpio_dev->shadow_on, on);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+}
+
+/*
+ * Called with gpio_dev->lock held. Windows are at least a second long and
+ * only roll over when an interrupt or a reader comes along, so a window that
+ * ended more than a second ago had no interrupts at all.
+ */
+static void amd_gpio_irq_stats_roll(struct amd_gpio *gpio_dev)
+{
+	struct amd_gpio_irq_stat *stat;
+	unsigned long now = jiffies;
+	unsigned int pin;
+	bool stale;
+
+	if (time_before(now, gpio_dev->irq_window_start + HZ))
+		return;
+
+	stale = time_after_eq(now, gpio_dev->irq_window_start + 2 * HZ);
+	for (pin = 0; gpio_dev->irq_stats && pin < gpio_dev->gc.ngpio; pin++) {
+		stat = &gpio_dev->irq_stats[pin];
+		stat->rate = stale ? 0 : stat->window;
+		stat->window = 0;
+	}
+	gpio_dev->irq_window_start = now;
+	gpio_dev->irq_window_events = 0;
+}
+
+/*
+ * Every pin amd_gpio_should_save() could pick gets its bit set here: when it
+ * is claimed through pinmux, requested as an interrupt, or has its trigger or
+ * wake setting changed. Suspend only looks at those pins and drops the ones
+ * that turn out not to need saving.
+ */
+static void amd_gpio_mark_saveable(struct amd_gpio *gpio_dev, unsigned int pin)
+{
+	if (gpio_dev->saveable)
+		set_bit(pin, gpio_dev->saveable);
+}
+
+static int amd_gpio_get_direction(struct gpio_chip *gc, unsigned offset)
+{
+	u32 pin_reg;
+	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
+	pin_reg = amd_gpio_peek_cfg(gpio_dev, offset);
 	if (pin_reg & BIT(OUTPUT_ENABLE_OFF))
 		return GPIO_LINE_DIRECTION_OUT;
 
@@ -64,9 +204,9 @@ static int amd_gpio_direction_input(struct gpio_chip *gc, unsigned offset)
 	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + offset * 4);
+	pin_reg = amd_gpio_read_cfg(gpio_dev, offset);
 	pin_reg &= ~BIT(OUTPUT_ENABLE_OFF);
-	writel(pin_reg, gpio_dev->base + offset * 4);
+	amd_gpio_write_cfg(gpio_dev, offset, pin_reg);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
 	return 0;
@@ -80,27 +220,25 @@ static int amd_gpio_direction_output(struct gpio_chip *gc, unsigned offset,
 	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + offset * 4);
+	pin_reg = amd_gpio_read_cfg(gpio_dev, offset);
 	pin_reg |= BIT(OUTPUT_ENABLE_OFF);
 	if (value)
 		pin_reg |= BIT(OUTPUT_VALUE_OFF);
 	else
 		pin_reg &= ~BIT(OUTPUT_VALUE_OFF);
-	writel(pin_reg, gpio_dev->base + offset * 4);
+	amd_gpio_write_cfg(gpio_dev, offset, pin_reg);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
 	return 0;
 }
 
+/* PIN_STS is volatile and never in the shadow, so this always reads MMIO */
 static int amd_gpio_get_value(struct gpio_chip *gc, unsigned offset)
 {
 	u32 pin_reg;
-	unsigned long flags;
 	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
-	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
 	pin_reg = readl(gpio_dev->base + offset * 4);
-	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
 	return !!(pin_reg & BIT(PIN_STS_OFF));
 }
@@ -113,20 +251,131 @@ static int amd_gpio_set_value(struct gpio_chip *gc, unsigned int offset,
 	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + offset * 4);
+	pin_reg = amd_gpio_read_cfg(gpio_dev, offset);
 	if (value)
 		pin_reg |= BIT(OUTPUT_VALUE_OFF);
 	else
 		pin_reg &= ~BIT(OUTPUT_VALUE_OFF);
-	writel(pin_reg, gpio_dev->base + offset * 4);
+	amd_gpio_write_cfg(gpio_dev, offset, pin_reg);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
 	return 0;
 }
 
-static int amd_gpio_set_debounce(struct amd_gpio *gpio_dev, unsigned int offset,
-				 unsigned int debounce)
+/* Like amd_gpio_get_value(), each line is one lockless read of PIN_STS */
+static int amd_gpio_get_multiple(struct gpio_chip *gc, unsigned long *mask,
+				 unsigned long *bits)
+{
+	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
+	unsigned int offset;
+	u32 pin_reg;
+
+	for_each_set_bit(offset, mask, gc->ngpio) {
+		pin_reg = readl(gpio_dev->base + offset * 4);
+		__assign_bit(offset, bits, pin_reg & BIT(PIN_STS_OFF));
+	}
+
+	return 0;
+}
+
+/*
+ * Walk @mask one bank of AMD_GPIO_PINS_PER_BANK pins at a time, with the lock
+ * held once per bank that has any pin in @mask.
+ */
+static int amd_gpio_set_multiple(struct gpio_chip *gc, unsigned long *mask,
+				 unsigned long *bits)
+{
+	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
+	unsigned int offset, end;
+	unsigned long flags;
+	u32 pin_reg;
+
+	for (offset = 0; offset < gc->ngpio; offset = end) {
+		end = min_t(unsigned int, gc->ngpio,
+			    round_down(offset, AMD_GPIO_PINS_PER_BANK) +
+			    AMD_GPIO_PINS_PER_BANK);
+		offset = find_next_bit(mask, end, offset);
+		if (offset >= end)
+			continue;
+
+		raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+		for_each_set_bit_from(offset, mask, end) {
+			pin_reg = amd_gpio_read_cfg(gpio_dev, offset);
+			if (test_bit(offset, bits))
+				pin_reg |= BIT(OUTPUT_VALUE_OFF);
+			else
+				pin_reg &= ~BIT(OUTPUT_VALUE_OFF);
+			amd_gpio_write_cfg(gpio_dev, offset, pin_reg);
+		}
+		raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+	}
+
+	return 0;
+}
+
+/*
+ * Debounce timer ranges, shortest unit first:
+ *
+ *	TmrLarge	TmrOutUnit	Unit			Max Debounce Time
+ *	0		0		61 usec (2 RtcClk)	976 usec
+ *	0		1		244 usec (8 RtcClk)	3.9 msec
+ *	1		0		15.6 msec (512 RtcClk)	250 msec
+ *	1		1		62.5 msec (2048 RtcClk)	1 sec
+ *
+ * A time below @limit gets @unit, and time / @unit counts of it, which is
+ * computed as (time * @mult) >> AMD_DB_SHIFT. @mult is rounded up by less
+ * than @unit, so that is exact as long as a second times the largest unit
+ * stays below 2^AMD_DB_SHIFT.
+ */
+#define AMD_DB_SHIFT	40
+
+#define AMD_DB_RANGE(_limit, _unit, _bits) {				\
+	.limit = _limit,						\
+	.unit = _unit,							\
+	.mult = DIV_ROUND_UP_ULL(1ULL << AMD_DB_SHIFT, _unit),		\
+	.bits = _bits,							\
+}
+
+static const struct amd_debounce_range {
+	u32 limit;
+	u32 unit;
+	u64 mult;
+	u32 bits;
+} amd_debounce_ranges[] = {
+	AMD_DB_RANGE(976, 61, 0),
+	AMD_DB_RANGE(3900, 244, BIT(DB_TMR_OUT_UNIT_OFF)),
+	AMD_DB_RANGE(250000, 15625, BIT(DB_TMR_LARGE_OFF)),
+	AMD_DB_RANGE(1000000, 62500,
+		     BIT(DB_TMR_OUT_UNIT_OFF) | BIT(DB_TMR_LARGE_OFF)),
+};
+
+#define AMD_DB_RANGE_BITS	(BIT(DB_TMR_OUT_UNIT_OFF) | BIT(DB_TMR_LARGE_OFF))
+
+/* The time in usec the debounce fields of @pin_reg filter glitches for */
+static unsigned int amd_gpio_debounce_time(u32 pin_reg)
 {
+	unsigned int i;
+
+	if (!(pin_reg & (DB_CNTRl_MASK << DB_CNTRL_OFF)))
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(amd_debounce_ranges); i++)
+		if ((pin_reg & AMD_DB_RANGE_BITS) == amd_debounce_ranges[i].bits)
+			break;
+
+	return (pin_reg & DB_TMR_OUT_MASK) * amd_debounce_ranges[i].unit;
+}
+
+/*
+ * Update the debounce fields of @reg, the register value of pin @offset,
+ * for a debounce time of @debounce usec, and put the time the hardware will
+ * actually debounce for into @actual. The caller writes it back.
+ */
+static int amd_gpio_debounce_reg(struct amd_gpio *gpio_dev, unsigned int offset,
+				 unsigned int debounce, u32 *reg,
+				 unsigned int *actual)
+{
+	const struct amd_debounce_range *range = amd_debounce_ranges;
 	u32 time;
 	u32 pin_reg;
 	int ret = 0;
@@ -138,66 +387,65 @@ static int amd_gpio_set_debounce(struct amd_gpio *gpio_dev, unsigned int offset,
 			debounce = 0;
 	}
 
-	pin_reg = readl(gpio_dev->base + offset * 4);
+	pin_reg = *reg;
 
 	if (debounce) {
 		pin_reg |= DB_TYPE_REMOVE_GLITCH << DB_CNTRL_OFF;
 		pin_reg &= ~DB_TMR_OUT_MASK;
-		/*
-		Debounce	Debounce	Timer	Max
-		TmrLarge	TmrOutUnit	Unit	Debounce
-							Time
-		0	0	61 usec (2 RtcClk)	976 usec
-		0	1	244 usec (8 RtcClk)	3.9 msec
-		1	0	15.6 msec (512 RtcClk)	250 msec
-		1	1	62.5 msec (2048 RtcClk)	1 sec
-		*/
-
-		if (debounce < 61) {
-			pin_reg |= 1;
-			pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
-			pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
-		} else if (debounce < 976) {
-			time = debounce / 61;
-			pin_reg |= time & DB_TMR_OUT_MASK;
-			pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
-			pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
-		} else if (debounce < 3900) {
-			time = debounce / 244;
-			pin_reg |= time & DB_TMR_OUT_MASK;
-			pin_reg |= BIT(DB_TMR_OUT_UNIT_OFF);
-			pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
-		} else if (debounce < 250000) {
-			time = debounce / 15625;
-			pin_reg |= time & DB_TMR_OUT_MASK;
-			pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
-			pin_reg |= BIT(DB_TMR_LARGE_OFF);
-		} else if (debounce < 1000000) {
-			time = debounce / 62500;
-			pin_reg |= time & DB_TMR_OUT_MASK;
-			pin_reg |= BIT(DB_TMR_OUT_UNIT_OFF);
-			pin_reg |= BIT(DB_TMR_LARGE_OFF);
+
+		while (range < amd_debounce_ranges + ARRAY_SIZE(amd_debounce_ranges) &&
+		       debounce >= range->limit)
+			range++;
+
+		if (range < amd_debounce_ranges + ARRAY_SIZE(amd_debounce_ranges)) {
+			time = ((u64)debounce * range->mult) >> AMD_DB_SHIFT;
+			/* Anything shorter than a unit still gets one */
+			if (!time && range == amd_debounce_ranges)
+				time = 1;
+			pin_reg &= ~AMD_DB_RANGE_BITS;
+			pin_reg |= range->bits | time;
 		} else {
 			pin_reg &= ~(DB_CNTRl_MASK << DB_CNTRL_OFF);
 			ret = -EINVAL;
 		}
 	} else {
-		pin_reg &= ~BIT(DB_TMR_OUT_UNIT_OFF);
-		pin_reg &= ~BIT(DB_TMR_LARGE_OFF);
+		pin_reg &= ~AMD_DB_RANGE_BITS;
 		pin_reg &= ~DB_TMR_OUT_MASK;
 		pin_reg &= ~(DB_CNTRl_MASK << DB_CNTRL_OFF);
 	}
-	writel(pin_reg, gpio_dev->base + offset * 4);
+	*reg = pin_reg;
+	*actual = amd_gpio_debounce_time(pin_reg);
 
 	return ret;
 }
 
 #ifdef CONFIG_DEBUG_FS
+/*
+ * Copy the first @n registers from the hardware without the lock. Each one is
+ * consistent on its own, see amd_gpio_peek_cfg(), and a dump never needed
+ * them to be consistent with each other, so there is no reason to keep
+ * interrupts off across hundreds of MMIO reads.
+ */
+static u32 *amd_gpio_snapshot(struct amd_gpio *gpio_dev, unsigned int n)
+{
+	unsigned int i;
+	u32 *regs;
+
+	regs = kmalloc_array(n, sizeof(*regs), GFP_KERNEL);
+	if (!regs)
+		return NULL;
+
+	for (i = 0; i < n; i++)
+		regs[i] = readl(gpio_dev->base + i * 4);
+
+	return regs;
+}
+
 static void amd_gpio_dbg_show(struct seq_file *s, struct gpio_chip *gc)
 {
 	u32 pin_reg;
 	u32 db_cntrl;
-	unsigned long flags;
+	u32 *regs;
 	unsigned int bank, i, pin_num;
 	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
@@ -218,7 +466,11 @@ static void amd_gpio_dbg_show(struct seq_file *s, struct gpio_chip *gc)
 	char *debounce_enable;
 	char *wake_cntrlz;
 
-	seq_printf(s, "WAKE_INT_MASTER_REG: 0x%08x\n", readl(gpio_dev->base + WAKE_INT_MASTER_REG));
+	regs = amd_gpio_snapshot(gpio_dev, gc->ngpio);
+	if (!regs)
+		return;
+
+	seq_printf(s, "WAKE_INT_MASTER_REG: 0x%08x\n", regs[WAKE_INT_MASTER_REG / 4]);
 	for (bank = 0; bank < gpio_dev->hwbank_num; bank++) {
 		unsigned int time = 0;
 		unsigned int unit = 0;
@@ -248,9 +500,7 @@ static void amd_gpio_dbg_show(struct seq_file *s, struct gpio_chip *gc)
 		seq_puts(s, "gpio\t  int|active|trigger|S0i3| S3|S4/S5| Z|wake|pull|  orient|       debounce|reg\n");
 		for (; i < pin_num; i++) {
 			seq_printf(s, "#%d\t", i);
-			raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-			pin_reg = readl(gpio_dev->base + i * 4);
-			raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+			pin_reg = regs[i];
 
 			if (pin_reg & BIT(INTERRUPT_ENABLE_OFF)) {
 				u8 level = (pin_reg >> ACTIVE_LEVEL_OFF) &
@@ -372,11 +622,167 @@ static void amd_gpio_dbg_show(struct seq_file *s, struct gpio_chip *gc)
 			seq_printf(s, "0x%x\n", pin_reg);
 		}
 	}
+
+	kfree(regs);
+}
+
+/*
+ * "regs" holds the whole register window as read at open time: one
+ * little-endian 32-bit word per register, pin registers at the index of
+ * their pin, for collectors that decode it offline.
+ */
+static int amd_gpio_regs_open(struct inode *inode, struct file *file)
+{
+	struct amd_gpio *gpio_dev = inode->i_private;
+	unsigned int i, n = gpio_dev->gc.ngpio;
+	__le32 *raw;
+	u32 *regs;
+
+	regs = amd_gpio_snapshot(gpio_dev, n);
+	if (!regs)
+		return -ENOMEM;
+
+	raw = (__le32 *)regs;
+	for (i = 0; i < n; i++)
+		raw[i] = cpu_to_le32(regs[i]);
+	file->private_data = raw;
+
+	return 0;
+}
+
+static ssize_t amd_gpio_regs_read(struct file *file, char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	struct amd_gpio *gpio_dev = file_inode(file)->i_private;
+
+	return simple_read_from_buffer(buf, count, ppos, file->private_data,
+				       gpio_dev->gc.ngpio * sizeof(__le32));
+}
+
+static int amd_gpio_regs_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+
+	return 0;
+}
+
+static const struct file_operations amd_gpio_regs_fops = {
+	.owner		= THIS_MODULE,
+	.open		= amd_gpio_regs_open,
+	.read		= amd_gpio_regs_read,
+	.release	= amd_gpio_regs_release,
+	.llseek		= default_llseek,
+};
+
+static int amd_gpio_shadow_get(void *data, u64 *val)
+{
+	struct amd_gpio *gpio_dev = data;
+
+	*val = gpio_dev->shadow_on;
+
+	return 0;
+}
+
+static int amd_gpio_shadow_set(void *data, u64 val)
+{
+	amd_gpio_shadow_enable(data, val);
+
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(amd_gpio_shadow_fops, amd_gpio_shadow_get,
+			 amd_gpio_shadow_set, "%llu\n");
+
+static int amd_gpio_coalesce_get(void *data, u64 *val)
+{
+	struct amd_gpio *gpio_dev = data;
+
+	*val = READ_ONCE(gpio_dev->coalesce_rate);
+
+	return 0;
+}
+
+static int amd_gpio_coalesce_set(void *data, u64 val)
+{
+	struct amd_gpio *gpio_dev = data;
+
+	if (val > U32_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(gpio_dev->coalesce_rate, val);
+	if (!val)
+		amd_gpio_coalesce_stop(gpio_dev);
+
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(amd_gpio_coalesce_fops, amd_gpio_coalesce_get,
+			 amd_gpio_coalesce_set, "%llu\n");
+
+static int amd_gpio_irq_stats_show(struct seq_file *s, void *unused)
+{
+	struct amd_gpio *gpio_dev = s->private;
+	struct amd_gpio_irq_stat *stats;
+	unsigned int pin, ngpio = gpio_dev->gc.ngpio;
+	unsigned long flags;
+	bool coalescing;
+
+	stats = kcalloc(ngpio, sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return -ENOMEM;
+
+	/* Copy under the lock, print outside of it */
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	amd_gpio_irq_stats_roll(gpio_dev);
+	memcpy(stats, gpio_dev->irq_stats, ngpio * sizeof(*stats));
+	coalescing = gpio_dev->coalescing;
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+
+	seq_printf(s, "mode: %s (coalesce above %u irq/s)\n",
+		   coalescing ? "polling" : "interrupt",
+		   READ_ONCE(gpio_dev->coalesce_rate));
+	seq_puts(s, "pin\t       count\t  irq/s\n");
+	for (pin = 0; pin < ngpio; pin++) {
+		if (!stats[pin].count)
+			continue;
+		seq_printf(s, "%u\t%12llu\t%7u\n", pin, stats[pin].count,
+			   stats[pin].rate);
+	}
+
+	kfree(stats);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(amd_gpio_irq_stats);
+
+static void amd_gpio_init_debugfs(struct amd_gpio *gpio_dev)
+{
+	struct dentry *root = gpio_dev->pctrl->device_root;
+
+	/* Writing 1 turns the shadow on, or resyncs it if it already is */
+	debugfs_create_file_unsafe("shadow_regs", 0644, root, gpio_dev,
+				   &amd_gpio_shadow_fops);
+	/* Interrupt coalescing is off until a rate is written here */
+	debugfs_create_file_unsafe("irq_coalesce_rate", 0644, root, gpio_dev,
+				   &amd_gpio_coalesce_fops);
+	debugfs_create_file("irq_stats", 0444, root, gpio_dev,
+			    &amd_gpio_irq_stats_fops);
+	debugfs_create_file_size("regs", 0400, root, gpio_dev,
+				 &amd_gpio_regs_fops,
+				 gpio_dev->gc.ngpio * sizeof(__le32));
 }
 #else
 #define amd_gpio_dbg_show NULL
+static inline void amd_gpio_init_debugfs(struct amd_gpio *gpio_dev) {}
 #endif
 
+static int amd_gpio_irq_reqres(struct irq_data *d)
+{
+	struct gpio_chip *gc = irq_data_get_irq_chip_data(d);
+
+	amd_gpio_mark_saveable(gpiochip_get_data(gc), d->hwirq);
+
+	return gpiochip_irq_reqres(d);
+}
+
 static void amd_gpio_irq_enable(struct irq_data *d)
 {
 	u32 pin_reg;
@@ -387,10 +793,14 @@ static void amd_gpio_irq_enable(struct irq_data *d)
 	gpiochip_enable_irq(gc, d->hwirq);
 
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + (d->hwirq)*4);
+	pin_reg = amd_gpio_read_cfg(gpio_dev, d->hwirq);
 	pin_reg |= BIT(INTERRUPT_ENABLE_OFF);
-	pin_reg |= BIT(INTERRUPT_MASK_OFF);
-	writel(pin_reg, gpio_dev->base + (d->hwirq)*4);
+	/* amd_gpio_poll() unmasks it when it is done */
+	if (gpio_dev->coalescing)
+		__set_bit(d->hwirq, gpio_dev->coalesced);
+	else
+		pin_reg |= BIT(INTERRUPT_MASK_OFF);
+	amd_gpio_write_cfg(gpio_dev, d->hwirq, pin_reg);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 }
 
@@ -402,10 +812,12 @@ static void amd_gpio_irq_disable(struct irq_data *d)
 	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + (d->hwirq)*4);
+	if (gpio_dev->coalescing)
+		__clear_bit(d->hwirq, gpio_dev->coalesced);
+	pin_reg = amd_gpio_read_cfg(gpio_dev, d->hwirq);
 	pin_reg &= ~BIT(INTERRUPT_ENABLE_OFF);
 	pin_reg &= ~BIT(INTERRUPT_MASK_OFF);
-	writel(pin_reg, gpio_dev->base + (d->hwirq)*4);
+	amd_gpio_write_cfg(gpio_dev, d->hwirq, pin_reg);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
 	gpiochip_disable_irq(gc, d->hwirq);
@@ -419,9 +831,11 @@ static void amd_gpio_irq_mask(struct irq_data *d)
 	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + (d->hwirq)*4);
+	if (gpio_dev->coalescing)
+		__clear_bit(d->hwirq, gpio_dev->coalesced);
+	pin_reg = amd_gpio_read_cfg(gpio_dev, d->hwirq);
 	pin_reg &= ~BIT(INTERRUPT_MASK_OFF);
-	writel(pin_reg, gpio_dev->base + (d->hwirq)*4);
+	amd_gpio_write_cfg(gpio_dev, d->hwirq, pin_reg);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 }
 
@@ -433,9 +847,14 @@ static void amd_gpio_irq_unmask(struct irq_data *d)
 	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + (d->hwirq)*4);
-	pin_reg |= BIT(INTERRUPT_MASK_OFF);
-	writel(pin_reg, gpio_dev->base + (d->hwirq)*4);
+	if (gpio_dev->coalescing) {
+		/* amd_gpio_poll() unmasks it when it is done */
+		__set_bit(d->hwirq, gpio_dev->coalesced);
+	} else {
+		pin_reg = amd_gpio_read_cfg(gpio_dev, d->hwirq);
+		pin_reg |= BIT(INTERRUPT_MASK_OFF);
+		amd_gpio_write_cfg(gpio_dev, d->hwirq, pin_reg);
+	}
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 }
 
@@ -448,15 +867,17 @@ static int amd_gpio_irq_set_wake(struct irq_data *d, unsigned int on)
 	u32 wake_mask = BIT(WAKE_CNTRL_OFF_S0I3) | BIT(WAKE_CNTRL_OFF_S3);
 	int err;
 
+	amd_gpio_mark_saveable(gpio_dev, d->hwirq);
+
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + (d->hwirq)*4);
+	pin_reg = amd_gpio_read_cfg(gpio_dev, d->hwirq);
 
 	if (on)
 		pin_reg |= wake_mask;
 	else
 		pin_reg &= ~wake_mask;
 
-	writel(pin_reg, gpio_dev->base + (d->hwirq)*4);
+	amd_gpio_write_cfg(gpio_dev, d->hwirq, pin_reg);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
 	if (on)
@@ -493,8 +914,10 @@ static int amd_gpio_irq_set_type(struct irq_data *d, unsigned int type)
 	struct gpio_chip *gc = irq_data_get_irq_chip_data(d);
 	struct amd_gpio *gpio_dev = gpiochip_get_data(gc);
 
+	amd_gpio_mark_saveable(gpio_dev, d->hwirq);
+
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + (d->hwirq)*4);
+	pin_reg = amd_gpio_read_cfg(gpio_dev, d->hwirq);
 
 	switch (type & IRQ_TYPE_SENSE_MASK) {
 	case IRQ_TYPE_EDGE_RISING:
@@ -563,7 +986,7 @@ static int amd_gpio_irq_set_type(struct irq_data *d, unsigned int type)
 	writel(pin_reg_irq_en, gpio_dev->base + (d->hwirq)*4);
 	while ((readl(gpio_dev->base + (d->hwirq)*4) & mask) != mask)
 		continue;
-	writel(pin_reg, gpio_dev->base + (d->hwirq)*4);
+	amd_gpio_write_cfg(gpio_dev, d->hwirq, pin_reg);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
 	return ret;
@@ -595,21 +1018,212 @@ static const struct irq_chip amd_gpio_irqchip = {
 	 * prevent the system from suspending.
 	 */
 	.flags        = IRQCHIP_ENABLE_WAKEUP_ON_SUSPEND | IRQCHIP_IMMUTABLE,
-	GPIOCHIP_IRQ_RESOURCE_HELPERS,
+	.irq_request_resources = amd_gpio_irq_reqres,
+	.irq_release_resources = gpiochip_irq_relres,
 };
 
-#define PIN_IRQ_PENDING	(BIT(INTERRUPT_STS_OFF) | BIT(WAKE_STS_OFF))
+/*
+ * Called with gpio_dev->lock held, once the handlers of the pins of status
+ * group @first in @handled have run.
+ */
+static bool amd_gpio_irq_clear(struct amd_gpio *gpio_dev, unsigned int first,
+			       unsigned long handled)
+{
+	struct gpio_chip *gc = &gpio_dev->gc;
+	unsigned int i, pin;
+	bool ret = false;
+	u32 regval;
+
+	amd_gpio_irq_stats_roll(gpio_dev);
+
+	for_each_set_bit(i, &handled, WAKE_INT_STATUS_PINS) {
+		pin = first + i;
+
+		gpio_dev->irq_window_events++;
+		if (gpio_dev->irq_stats) {
+			gpio_dev->irq_stats[pin].count++;
+			gpio_dev->irq_stats[pin].window++;
+		}
+
+		/* Clear interrupt.
+		 * We must read the pin register again, in case the
+		 * value was changed while executing
+		 * generic_handle_domain_irq() above.
+		 * If the line is not an irq, disable it in order to
+		 * avoid a system hang caused by an interrupt storm.
+		 */
+		regval = readl(gpio_dev->base + pin * 4);
+		if (!gpiochip_line_is_irq(gc, pin)) {
+			regval &= ~BIT(INTERRUPT_MASK_OFF);
+			if (gpio_dev->coalescing)
+				__clear_bit(pin, gpio_dev->coalesced);
+			dev_dbg(&gpio_dev->pdev->dev,
+				"Disabling spurious GPIO IRQ %d\n", pin);
+		} else {
+			ret = true;
+		}
+		amd_gpio_write_cfg(gpio_dev, pin, regval);
+	}
+
+	return ret;
+}
+
+/*
+ * Called with gpio_dev->lock held. Once more than coalesce_rate interrupts
+ * came in within a window, mask all the interrupt lines and leave them to
+ * amd_gpio_poll(), so that a storming device costs a bounded number of
+ * register scans per second instead of an interrupt per event.
+ */
+static void amd_gpio_coalesce_start(struct amd_gpio *gpio_dev)
+{
+	u32 rate = READ_ONCE(gpio_dev->coalesce_rate);
+	struct gpio_chip *gc = &gpio_dev->gc;
+	unsigned int pin;
+	u32 pin_reg;
+
+	if (!rate || !gpio_dev->coalesced || gpio_dev->coalescing ||
+	    gpio_dev->irq_window_events <= rate)
+		return;
+
+	for (pin = 0; pin < gc->ngpio; pin++) {
+		if (!gpiochip_line_is_irq(gc, pin))
+			continue;
+		pin_reg = amd_gpio_read_cfg(gpio_dev, pin);
+		if (!(pin_reg & BIT(INTERRUPT_MASK_OFF)))
+			continue;
+		amd_gpio_write_cfg(gpio_dev, pin,
+				   pin_reg & ~BIT(INTERRUPT_MASK_OFF));
+		__set_bit(pin, gpio_dev->coalesced);
+	}
+
+	gpio_dev->coalescing = true;
+	gpio_dev->poll_window_start = jiffies;
+	gpio_dev->poll_window_events = 0;
+	schedule_delayed_work(&gpio_dev->poll_work, 0);
+
+	dev_dbg(&gpio_dev->pdev->dev,
+		"%u interrupts within a second, polling\n",
+		gpio_dev->irq_window_events);
+}
+
+/* Called with gpio_dev->lock held */
+static void amd_gpio_coalesce_stop_locked(struct amd_gpio *gpio_dev)
+{
+	unsigned int pin;
+	u32 pin_reg;
+
+	for_each_set_bit(pin, gpio_dev->coalesced, gpio_dev->gc.ngpio) {
+		pin_reg = amd_gpio_read_cfg(gpio_dev, pin);
+		amd_gpio_write_cfg(gpio_dev, pin,
+				   pin_reg | BIT(INTERRUPT_MASK_OFF));
+	}
+	bitmap_zero(gpio_dev->coalesced, gpio_dev->gc.ngpio);
+	gpio_dev->coalescing = false;
+
+	/* Let the GPIO unit raise whatever is still pending */
+	pin_reg = readl(gpio_dev->base + WAKE_INT_MASTER_REG);
+	pin_reg |= EOI_MASK;
+	writel(pin_reg, gpio_dev->base + WAKE_INT_MASTER_REG);
+}
+
+/*
+ * Runs the handlers of at most AMD_GPIO_POLL_BUDGET pending masked lines per
+ * pass, and hands them back to the interrupt handler after a window in which
+ * fewer than coalesce_rate of them were pending.
+ */
+static void amd_gpio_poll(struct work_struct *work)
+{
+	struct amd_gpio *gpio_dev = container_of(to_delayed_work(work),
+						 struct amd_gpio, poll_work);
+	struct gpio_chip *gc = &gpio_dev->gc;
+	unsigned int budget = AMD_GPIO_POLL_BUDGET;
+	unsigned long flags;
+	unsigned int pin;
+	bool stop = false;
+	u32 regval, rate;
+
+	for_each_set_bit(pin, gpio_dev->coalesced, gc->ngpio) {
+		if (!budget)
+			break;
+
+		regval = readl(gpio_dev->base + pin * 4);
+		if (!(regval & PIN_IRQ_PENDING))
+			continue;
+
+		generic_handle_domain_irq_safe(gc->irq.domain, pin);
+		budget--;
+
+		raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+		amd_gpio_irq_clear(gpio_dev, round_down(pin, WAKE_INT_STATUS_PINS),
+				   BIT(pin % WAKE_INT_STATUS_PINS));
+		raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+	}
+
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	rate = READ_ONCE(gpio_dev->coalesce_rate);
+	gpio_dev->poll_window_events += AMD_GPIO_POLL_BUDGET - budget;
+	if (!rate) {
+		stop = true;
+	} else if (time_after_eq(jiffies, gpio_dev->poll_window_start + HZ)) {
+		stop = gpio_dev->poll_window_events < rate;
+		gpio_dev->poll_window_start = jiffies;
+		gpio_dev->poll_window_events = 0;
+	}
+	if (stop)
+		amd_gpio_coalesce_stop_locked(gpio_dev);
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+
+	if (!stop)
+		schedule_delayed_work(&gpio_dev->poll_work,
+				      budget ? AMD_GPIO_POLL_INTERVAL : 0);
+}
+
+static void amd_gpio_cancel_poll(void *data)
+{
+	struct amd_gpio *gpio_dev = data;
+
+	cancel_delayed_work_sync(&gpio_dev->poll_work);
+}
+
+/* Leave polling mode, for suspend and for turning coalescing off */
+static void amd_gpio_coalesce_stop(struct amd_gpio *gpio_dev)
+{
+	unsigned long flags;
+
+	if (!gpio_dev->coalesced)
+		return;
+
+	cancel_delayed_work_sync(&gpio_dev->poll_work);
+
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	if (gpio_dev->coalescing)
+		amd_gpio_coalesce_stop_locked(gpio_dev);
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+}
+
+/*
+ * For remove: the interrupt handler is only freed by devres afterwards and
+ * can start polling until then, so turn the worker off for good before the
+ * irq domain it hands interrupts to goes away.
+ */
+static void amd_gpio_disable_poll(struct amd_gpio *gpio_dev)
+{
+	WRITE_ONCE(gpio_dev->coalesce_rate, 0);
+	disable_delayed_work_sync(&gpio_dev->poll_work);
+	amd_gpio_coalesce_stop(gpio_dev);
+}
 
 static bool do_amd_gpio_irq_handler(int irq, void *dev_id)
 {
 	struct amd_gpio *gpio_dev = dev_id;
 	struct gpio_chip *gc = &gpio_dev->gc;
+	u32 regval[WAKE_INT_STATUS_PINS];
+	unsigned long flags, handled;
 	unsigned int i, irqnr;
-	unsigned long flags;
-	u32 __iomem *regs;
+	u32 reg;
 	bool ret = false;
-	u32  regval;
-	u64 status, mask;
+	bool wake;
+	u64 status;
 
 	/* Read the wake status */
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
@@ -618,51 +1232,48 @@ static bool do_amd_gpio_irq_handler(int irq, void *dev_id)
 	status |= readl(gpio_dev->base + WAKE_INT_STATUS_REG0);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
-	/* Bit 0-45 contain the relevant status bits */
-	status &= (1ULL << 46) - 1;
-	regs = gpio_dev->base;
-	for (mask = 1, irqnr = 0; status; mask <<= 1, regs += 4, irqnr += 4) {
-		if (!(status & mask))
-			continue;
-		status &= ~mask;
+	/*
+	 * Only visit the set status bits, and read the registers of the four
+	 * pins a bit covers before running any of their handlers.
+	 */
+	status &= GENMASK_ULL(WAKE_INT_STATUS_BITS - 1, 0);
+	for (; status; status &= status - 1) {
+		irqnr = __ffs64(status) * WAKE_INT_STATUS_PINS;
 
-		/* Each status bit covers four pins */
-		for (i = 0; i < 4; i++) {
-			regval = readl(regs + i);
+		for (i = 0; i < WAKE_INT_STATUS_PINS; i++)
+			regval[i] = readl(gpio_dev->base + (irqnr + i) * 4);
 
-			if (regval & PIN_IRQ_PENDING)
+		handled = 0;
+		wake = false;
+		for (i = 0; i < WAKE_INT_STATUS_PINS; i++) {
+			if (regval[i] & PIN_IRQ_PENDING)
 				pm_pr_dbg("GPIO %d is active: 0x%x",
-					  irqnr + i, regval);
+					  irqnr + i, regval[i]);
 
 			/* caused wake on resume context for shared IRQ */
-			if (irq < 0 && (regval & BIT(WAKE_STS_OFF)))
-				return true;
+			if (irq < 0 && (regval[i] & BIT(WAKE_STS_OFF))) {
+				wake = true;
+				break;
+			}
 
-			if (!(regval & PIN_IRQ_PENDING) ||
-			    !(regval & BIT(INTERRUPT_MASK_OFF)))
+			if (!(regval[i] & PIN_IRQ_PENDING) ||
+			    !(regval[i] & BIT(INTERRUPT_MASK_OFF)))
 				continue;
 			generic_handle_domain_irq_safe(gc->irq.domain, irqnr + i);
+			__set_bit(i, &handled);
+		}
 
-			/* Clear interrupt.
-			 * We must read the pin register again, in case the
-			 * value was changed while executing
-			 * generic_handle_domain_irq() above.
-			 * If the line is not an irq, disable it in order to
-			 * avoid a system hang caused by an interrupt storm.
-			 */
+		/* One lock round trip for all the pins of the group */
+		if (handled) {
 			raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-			regval = readl(regs + i);
-			if (!gpiochip_line_is_irq(gc, irqnr + i)) {
-				regval &= ~BIT(INTERRUPT_MASK_OFF);
-				dev_dbg(&gpio_dev->pdev->dev,
-					"Disabling spurious GPIO IRQ %d\n",
-					irqnr + i);
-			} else {
-				ret = true;
-			}
-			writel(regval, regs + i);
+			ret |= amd_gpio_irq_clear(gpio_dev, irqnr, handled);
+			if (irq >= 0)
+				amd_gpio_coalesce_start(gpio_dev);
 			raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 		}
+
+		if (wake)
+			return true;
 	}
 	/* did not cause wake on resume context for shared IRQ */
 	if (irq < 0)
@@ -670,9 +1281,9 @@ static bool do_amd_gpio_irq_handler(int irq, void *dev_id)
 
 	/* Signal EOI to the GPIO unit */
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	regval = readl(gpio_dev->base + WAKE_INT_MASTER_REG);
-	regval |= EOI_MASK;
-	writel(regval, gpio_dev->base + WAKE_INT_MASTER_REG);
+	reg = readl(gpio_dev->base + WAKE_INT_MASTER_REG);
+	reg |= EOI_MASK;
+	writel(reg, gpio_dev->base + WAKE_INT_MASTER_REG);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
 	return ret;
@@ -736,11 +1347,11 @@ static int amd_pinconf_get(struct pinctrl_dev *pctldev,
 	enum pin_config_param param = pinconf_to_config_param(*config);
 
 	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-	pin_reg = readl(gpio_dev->base + pin*4);
+	pin_reg = amd_gpio_read_cfg(gpio_dev, pin);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 	switch (param) {
 	case PIN_CONFIG_INPUT_DEBOUNCE:
-		arg = pin_reg & DB_TMR_OUT_MASK;
+		arg = amd_gpio_debounce_time(pin_reg);
 		break;
 
 	case PIN_CONFIG_BIAS_PULL_DOWN:
@@ -766,27 +1377,40 @@ static int amd_pinconf_get(struct pinctrl_dev *pctldev,
 	return 0;
 }
 
-static int amd_pinconf_set(struct pinctrl_dev *pctldev, unsigned int pin,
-			   unsigned long *configs, unsigned int num_configs)
+/*
+ * Called with gpio_dev->lock held. All the configs are applied to one copy
+ * of the pin register, which is written back once. A debounce config ends
+ * the list, and an unsupported one fails the call without stopping the
+ * others.
+ */
+static int __amd_pinconf_set(struct amd_gpio *gpio_dev, unsigned int pin,
+			     unsigned long *configs, unsigned int num_configs)
 {
 	int i;
 	u32 arg;
 	int ret = 0;
 	u32 pin_reg;
-	unsigned long flags;
+	unsigned int actual;
 	enum pin_config_param param;
-	struct amd_gpio *gpio_dev = pinctrl_dev_get_drvdata(pctldev);
 
-	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	if (!num_configs)
+		return 0;
+
+	pin_reg = amd_gpio_read_cfg(gpio_dev, pin);
+
 	for (i = 0; i < num_configs; i++) {
 		param = pinconf_to_config_param(configs[i]);
 		arg = pinconf_to_config_argument(configs[i]);
-		pin_reg = readl(gpio_dev->base + pin*4);
 
 		switch (param) {
 		case PIN_CONFIG_INPUT_DEBOUNCE:
-			ret = amd_gpio_set_debounce(gpio_dev, pin, arg);
-			goto out_unlock;
+			ret = amd_gpio_debounce_reg(gpio_dev, pin, arg, &pin_reg,
+						    &actual);
+			if (!ret && actual != arg)
+				dev_dbg(&gpio_dev->pdev->dev,
+					"GPIO %u debounce %u usec for %u requested\n",
+					pin, actual, arg);
+			goto out;
 
 		case PIN_CONFIG_BIAS_PULL_DOWN:
 			pin_reg &= ~BIT(PULL_DOWN_ENABLE_OFF);
@@ -810,10 +1434,40 @@ static int amd_pinconf_set(struct pinctrl_dev *pctldev, unsigned int pin,
 				"Invalid config param %04x\n", param);
 			ret = -ENOTSUPP;
 		}
+	}
+
+out:
+	amd_gpio_write_cfg(gpio_dev, pin, pin_reg);
 
-		writel(pin_reg, gpio_dev->base + pin*4);
+	return ret;
+}
+
+/* Called with gpio_dev->lock held */
+static int __amd_pinconf_group_set(struct amd_gpio *gpio_dev,
+				   unsigned int group, unsigned long *configs,
+				   unsigned int num_configs)
+{
+	const struct pingroup *grp = &gpio_dev->groups[group];
+	unsigned int i;
+
+	for (i = 0; i < grp->npins; i++) {
+		if (__amd_pinconf_set(gpio_dev, grp->pins[i], configs,
+				      num_configs))
+			return -ENOTSUPP;
 	}
-out_unlock:
+
+	return 0;
+}
+
+static int amd_pinconf_set(struct pinctrl_dev *pctldev, unsigned int pin,
+			   unsigned long *configs, unsigned int num_configs)
+{
+	struct amd_gpio *gpio_dev = pinctrl_dev_get_drvdata(pctldev);
+	unsigned long flags;
+	int ret;
+
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	ret = __amd_pinconf_set(gpio_dev, pin, configs, num_configs);
 	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
 	return ret;
@@ -841,18 +1495,15 @@ static int amd_pinconf_group_set(struct pinctrl_dev *pctldev,
 				unsigned group, unsigned long *configs,
 				unsigned num_configs)
 {
-	const unsigned *pins;
-	unsigned npins;
-	int i, ret;
+	struct amd_gpio *gpio_dev = pinctrl_dev_get_drvdata(pctldev);
+	unsigned long flags;
+	int ret;
 
-	ret = amd_get_group_pins(pctldev, group, &pins, &npins);
-	if (ret)
-		return ret;
-	for (i = 0; i < npins; i++) {
-		if (amd_pinconf_set(pctldev, pins[i], configs, num_configs))
-			return -ENOTSUPP;
-	}
-	return 0;
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	ret = __amd_pinconf_group_set(gpio_dev, group, configs, num_configs);
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+
+	return ret;
 }
 
 static int amd_gpio_set_config(struct gpio_chip *gc, unsigned int pin,
@@ -889,9 +1540,9 @@ static void amd_gpio_irq_init(struct amd_gpio *gpio_dev)
 
 		raw_spin_lock_irqsave(&gpio_dev->lock, flags);
 
-		pin_reg = readl(gpio_dev->base + pin * 4);
+		pin_reg = amd_gpio_read_cfg(gpio_dev, pin);
 		pin_reg &= ~mask;
-		writel(pin_reg, gpio_dev->base + pin * 4);
+		amd_gpio_write_cfg(gpio_dev, pin, pin_reg);
 
 		raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 	}
@@ -957,30 +1608,42 @@ static bool amd_gpio_should_save(struct amd_gpio *gpio_dev, unsigned int pin)
 static int amd_gpio_suspend_hibernate_common(struct device *dev, bool is_suspend)
 {
 	struct amd_gpio *gpio_dev = dev_get_drvdata(dev);
-	struct pinctrl_desc *desc = gpio_dev->pctrl->desc;
-	unsigned long flags;
-	int i;
 	u32 wake_mask = is_suspend ? WAKE_SOURCE_SUSPEND : WAKE_SOURCE_HIBERNATE;
+	unsigned int pin, nsaved = 0, nmasked = 0;
+	ktime_t start = ktime_get();
+	unsigned long flags;
+	u32 *saved;
 
-	for (i = 0; i < desc->npins; i++) {
-		int pin = desc->pins[i].number;
+	/* Save the masks the irq core asked for, not the polling ones */
+	amd_gpio_coalesce_stop(gpio_dev);
 
-		if (!amd_gpio_should_save(gpio_dev, pin))
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	bitmap_zero(gpio_dev->saved, gpio_dev->gc.ngpio);
+	for_each_set_bit(pin, gpio_dev->saveable, gpio_dev->gc.ngpio) {
+		if (!amd_gpio_should_save(gpio_dev, pin)) {
+			clear_bit(pin, gpio_dev->saveable);
 			continue;
+		}
 
-		raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-		gpio_dev->saved_regs[i] = readl(gpio_dev->base + pin * 4) & ~PIN_IRQ_PENDING;
+		saved = &gpio_dev->saved_regs[pin];
+		*saved = amd_gpio_read_cfg(gpio_dev, pin) & ~PIN_IRQ_PENDING;
+		__set_bit(pin, gpio_dev->saved);
+		nsaved++;
 
 		/* mask any interrupts not intended to be a wake source */
-		if (!(gpio_dev->saved_regs[i] & wake_mask)) {
-			writel(gpio_dev->saved_regs[i] & ~BIT(INTERRUPT_MASK_OFF),
-			       gpio_dev->base + pin * 4);
-			pm_pr_dbg("Disabling GPIO #%d interrupt for %s.\n",
+		if (!(*saved & wake_mask) && (*saved & BIT(INTERRUPT_MASK_OFF))) {
+			amd_gpio_write_cfg(gpio_dev, pin,
+					   *saved & ~BIT(INTERRUPT_MASK_OFF));
+			nmasked++;
+			pm_pr_dbg("Disabling GPIO #%u interrupt for %s.\n",
 				  pin, is_suspend ? "suspend" : "hibernate");
 		}
-
-		raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
 	}
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+
+	pm_pr_dbg("%s: saved %u pins, masked %u, in %lld us\n",
+		  dev_name(dev), nsaved, nmasked,
+		  ktime_us_delta(ktime_get(), start));
 
 	return 0;
 }
@@ -1002,20 +1665,42 @@ static int amd_gpio_resume(struct device *dev)
 {
 	struct amd_gpio *gpio_dev = dev_get_drvdata(dev);
 	struct pinctrl_desc *desc = gpio_dev->pctrl->desc;
+	unsigned int nrestored = 0;
+	ktime_t start = ktime_get();
 	unsigned long flags;
+	u32 pin_reg, *saved;
 	int i;
 
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
 	for (i = 0; i < desc->npins; i++) {
 		int pin = desc->pins[i].number;
 
-		if (!amd_gpio_should_save(gpio_dev, pin))
+		if (!test_bit(pin, gpio_dev->saved)) {
+			/* Firmware may have changed it, resync the shadow */
+			if (gpio_dev->shadow_on)
+				amd_gpio_shadow_store(gpio_dev, pin,
+						      readl(gpio_dev->base + pin * 4));
 			continue;
+		}
 
-		raw_spin_lock_irqsave(&gpio_dev->lock, flags);
-		gpio_dev->saved_regs[i] |= readl(gpio_dev->base + pin * 4) & PIN_IRQ_PENDING;
-		writel(gpio_dev->saved_regs[i], gpio_dev->base + pin * 4);
-		raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+		saved = &gpio_dev->saved_regs[pin];
+		pin_reg = readl(gpio_dev->base + pin * 4);
+		*saved |= pin_reg & PIN_IRQ_PENDING;
+		/* Skip the write if the pin kept its state and nothing is pending */
+		if ((pin_reg & PIN_IRQ_PENDING) ||
+		    ((pin_reg ^ *saved) & ~PIN_VOLATILE_BITS)) {
+			amd_gpio_write_cfg(gpio_dev, pin, *saved);
+			nrestored++;
+		} else if (gpio_dev->shadow_on) {
+			amd_gpio_shadow_store(gpio_dev, pin, pin_reg);
+		}
 	}
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+
+	pm_pr_dbg("%s: restored %u of %u saved pins in %lld us\n",
+		  dev_name(dev), nrestored,
+		  bitmap_weight(gpio_dev->saved, gpio_dev->gc.ngpio),
+		  ktime_us_delta(ktime_get(), start));
 
 	return 0;
 }
@@ -1060,46 +1745,134 @@ static int amd_set_mux(struct pinctrl_dev *pctrldev, unsigned int function, unsi
 {
 	struct amd_gpio *gpio_dev = pinctrl_dev_get_drvdata(pctrldev);
 	struct device *dev = &gpio_dev->pdev->dev;
+	const struct pingroup *grp = &gpio_dev->groups[group];
+	void __iomem *iomux = gpio_dev->iomux_base + pmx_functions[function].index;
 	struct pin_desc *pd;
 	int ind, index;
 
 	if (!gpio_dev->iomux_base)
 		return -EINVAL;
 
-	for (index = 0; index < NSELECTS; index++) {
-		if (strcmp(gpio_dev->groups[group].name,  pmx_functions[function].groups[index]))
-			continue;
+	for (index = 0; index < NSELECTS; index++)
+		if (gpio_dev->mux_groups[function][index] == group)
+			break;
+	if (index == NSELECTS)
+		return 0;
 
-		if (readb(gpio_dev->iomux_base + pmx_functions[function].index) ==
-				FUNCTION_INVALID) {
-			dev_err(dev, "IOMUX_GPIO 0x%x not present or supported\n",
-				pmx_functions[function].index);
-			return -EINVAL;
-		}
+	if (readb(iomux) == FUNCTION_INVALID) {
+		dev_err(dev, "IOMUX_GPIO 0x%x not present or supported\n",
+			pmx_functions[function].index);
+		return -EINVAL;
+	}
+
+	writeb(index, iomux);
 
-		writeb(index, gpio_dev->iomux_base + pmx_functions[function].index);
+	if (index != (readb(iomux) & FUNCTION_MASK)) {
+		dev_err(dev, "IOMUX_GPIO 0x%x not present or supported\n",
+			pmx_functions[function].index);
+		return -EINVAL;
+	}
+
+	if (!test_bit(group, gpio_dev->mux_owned))
+		return 0;
+
+	for (ind = 0; ind < grp->npins; ind++) {
+		pd = pin_desc_get(gpio_dev->pctrl, grp->pins[ind]);
+		pd->mux_owner = grp->name;
+	}
+
+	return 0;
+}
+
+/*
+ * Resolve the group names of pmx_functions once, so that amd_set_mux() is
+ * down to comparing selectors. Needs the pin controller registered, for its
+ * group name index, and runs before pinctrl_enable() applies the hogs.
+ */
+static int amd_build_mux_table(struct amd_gpio *gpio_dev)
+{
+	struct device *dev = gpio_dev->pctrl->dev;
+	unsigned int function, index, group;
+	int selector;
+
+	gpio_dev->mux_groups = devm_kmalloc_array(dev, ARRAY_SIZE(pmx_functions),
+						  sizeof(*gpio_dev->mux_groups),
+						  GFP_KERNEL);
+	gpio_dev->mux_owned = devm_bitmap_zalloc(dev, gpio_dev->ngroups,
+						 GFP_KERNEL);
+	if (!gpio_dev->mux_groups || !gpio_dev->mux_owned)
+		return -ENOMEM;
 
-		if (index != (readb(gpio_dev->iomux_base + pmx_functions[function].index) &
-					FUNCTION_MASK)) {
-			dev_err(dev, "IOMUX_GPIO 0x%x not present or supported\n",
-				pmx_functions[function].index);
-			return -EINVAL;
+	for (function = 0; function < ARRAY_SIZE(pmx_functions); function++) {
+		for (index = 0; index < NSELECTS; index++) {
+			selector = pinctrl_name_index_lookup(gpio_dev->pctrl,
+					&gpio_dev->pctrl->group_index,
+					pmx_functions[function].groups[index],
+					amd_get_groups_count,
+					amd_get_group_name);
+			gpio_dev->mux_groups[function][index] =
+				selector < 0 ? -1 : selector;
 		}
+	}
 
-		for (ind = 0; ind < gpio_dev->groups[group].npins; ind++) {
-			if (strncmp(gpio_dev->groups[group].name, "IMX_F", strlen("IMX_F")))
-				continue;
+	for (group = 0; group < gpio_dev->ngroups; group++)
+		if (!strncmp(gpio_dev->groups[group].name, "IMX_F", strlen("IMX_F")))
+			__set_bit(group, gpio_dev->mux_owned);
+
+	return 0;
+}
+
+/*
+ * Program a whole state: the iomux bytes of the mux steps first, then all
+ * config steps with gpio_dev->lock taken once rather than once per pin.
+ */
+static int amd_apply_batch(struct pinctrl_dev *pctldev,
+			   const struct pinctrl_state_prog *prog)
+{
+	struct amd_gpio *gpio_dev = pinctrl_dev_get_drvdata(pctldev);
+	const struct pinctrl_setting_configs *conf;
+	const struct pinctrl_setting *setting;
+	unsigned long flags;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < prog->num_mux; i++) {
+		setting = prog->ops[i].setting;
+		ret = amd_set_mux(pctldev, setting->data.mux.func,
+				  setting->data.mux.group);
+		if (ret)
+			return ret;
+	}
 
-			pd = pin_desc_get(gpio_dev->pctrl, gpio_dev->groups[group].pins[ind]);
-			pd->mux_owner = gpio_dev->groups[group].name;
+	raw_spin_lock_irqsave(&gpio_dev->lock, flags);
+	for (; i < prog->num_ops && !ret; i++) {
+		setting = prog->ops[i].setting;
+		conf = &setting->data.configs;
+
+		if (setting->type == PIN_MAP_TYPE_CONFIGS_PIN) {
+			ret = __amd_pinconf_set(gpio_dev, conf->group_or_pin,
+						conf->configs,
+						conf->num_configs);
+			continue;
 		}
-		break;
+
+		ret = __amd_pinconf_group_set(gpio_dev, conf->group_or_pin,
+					      conf->configs, conf->num_configs);
 	}
+	raw_spin_unlock_irqrestore(&gpio_dev->lock, flags);
+
+	return ret;
+}
+
+static int amd_pmx_request(struct pinctrl_dev *pctldev, unsigned int pin)
+{
+	amd_gpio_mark_saveable(pinctrl_dev_get_drvdata(pctldev), pin);
 
 	return 0;
 }
 
 static const struct pinmux_ops amd_pmxops = {
+	.request = amd_pmx_request,
 	.get_functions_count = amd_get_functions_count,
 	.get_function_name = amd_get_fname,
 	.get_function_groups = amd_get_groups,
@@ -1163,20 +1936,14 @@ static int amd_gpio_probe(struct platform_device *pdev)
 	if (gpio_dev->irq < 0)
 		return gpio_dev->irq;
 
-#ifdef CONFIG_SUSPEND
-	gpio_dev->saved_regs = devm_kcalloc(&pdev->dev, amd_pinctrl_desc.npins,
-					    sizeof(*gpio_dev->saved_regs),
-					    GFP_KERNEL);
-	if (!gpio_dev->saved_regs)
-		return -ENOMEM;
-#endif
-
 	gpio_dev->pdev = pdev;
 	gpio_dev->gc.get_direction	= amd_gpio_get_direction;
 	gpio_dev->gc.direction_input	= amd_gpio_direction_input;
 	gpio_dev->gc.direction_output	= amd_gpio_direction_output;
 	gpio_dev->gc.get			= amd_gpio_get_value;
 	gpio_dev->gc.set_rv			= amd_gpio_set_value;
+	gpio_dev->gc.get_multiple	= amd_gpio_get_multiple;
+	gpio_dev->gc.set_multiple_rv	= amd_gpio_set_multiple;
 	gpio_dev->gc.set_config		= amd_gpio_set_config;
 	gpio_dev->gc.dbg_show		= amd_gpio_dbg_show;
 
@@ -1190,15 +1957,62 @@ static int amd_gpio_probe(struct platform_device *pdev)
 	gpio_dev->groups = kerncz_groups;
 	gpio_dev->ngroups = ARRAY_SIZE(kerncz_groups);
 
+	gpio_dev->shadow_regs = devm_kcalloc(&pdev->dev, gpio_dev->gc.ngpio,
+					     sizeof(*gpio_dev->shadow_regs),
+					     GFP_KERNEL);
+	if (!gpio_dev->shadow_regs)
+		return -ENOMEM;
+	amd_gpio_shadow_enable(gpio_dev, shadow_regs);
+
+#ifdef CONFIG_PM_SLEEP
+	/* Indexed by pin, filled in as pins get claimed */
+	gpio_dev->saved_regs = devm_kcalloc(&pdev->dev, gpio_dev->gc.ngpio,
+					    sizeof(*gpio_dev->saved_regs),
+					    GFP_KERNEL);
+	gpio_dev->saveable = devm_bitmap_zalloc(&pdev->dev, gpio_dev->gc.ngpio,
+						GFP_KERNEL);
+	gpio_dev->saved = devm_bitmap_zalloc(&pdev->dev, gpio_dev->gc.ngpio,
+					     GFP_KERNEL);
+	if (!gpio_dev->saved_regs || !gpio_dev->saveable || !gpio_dev->saved)
+		return -ENOMEM;
+#endif
+
+	gpio_dev->irq_stats = devm_kcalloc(&pdev->dev, gpio_dev->gc.ngpio,
+					   sizeof(*gpio_dev->irq_stats),
+					   GFP_KERNEL);
+	gpio_dev->coalesced = devm_bitmap_zalloc(&pdev->dev, gpio_dev->gc.ngpio,
+						 GFP_KERNEL);
+	if (!gpio_dev->irq_stats || !gpio_dev->coalesced)
+		return -ENOMEM;
+
+	gpio_dev->irq_window_start = jiffies;
+	INIT_DELAYED_WORK(&gpio_dev->poll_work, amd_gpio_poll);
+	ret = devm_add_action_or_reset(&pdev->dev, amd_gpio_cancel_poll,
+				       gpio_dev);
+	if (ret)
+		return ret;
+
 	amd_pinctrl_desc.name = dev_name(&pdev->dev);
 	amd_get_iomux_res(gpio_dev);
-	gpio_dev->pctrl = devm_pinctrl_register(&pdev->dev, &amd_pinctrl_desc,
-						gpio_dev);
-	if (IS_ERR(gpio_dev->pctrl)) {
+	ret = devm_pinctrl_register_and_init(&pdev->dev, &amd_pinctrl_desc,
+					     gpio_dev, &gpio_dev->pctrl);
+	if (ret) {
 		dev_err(&pdev->dev, "Couldn't register pinctrl driver\n");
-		return PTR_ERR(gpio_dev->pctrl);
+		return ret;
 	}
 
+	ret = amd_build_mux_table(gpio_dev);
+	if (ret)
+		return ret;
+
+	pinctrl_set_apply_batch(gpio_dev->pctrl, amd_apply_batch);
+
+	ret = pinctrl_enable(gpio_dev->pctrl);
+	if (ret)
+		return ret;
+
+	amd_gpio_init_debugfs(gpio_dev);
+
 	/* Disable and mask interrupts */
 	amd_gpio_irq_init(gpio_dev);
 
@@ -1246,6 +2060,7 @@ static void amd_gpio_remove(struct platform_device *pdev)
 
 	gpio_dev = platform_get_drvdata(pdev);
 
+	amd_gpio_disable_poll(gpio_dev);
 	gpiochip_remove(&gpio_dev->gc);
 	acpi_unregister_wakeup_handler(amd_gpio_check_wake, gpio_dev);
 	amd_gpio_unregister_s2idle_ops();
@@ -22,6 +22,9 @@
 
 #define WAKE_INT_STATUS_REG0 0x2f8
 #define WAKE_INT_STATUS_REG1 0x2fc
+/* Bits 0-45 of the wake status are valid, each covers four pins */
+#define WAKE_INT_STATUS_BITS	46
+#define WAKE_INT_STATUS_PINS	4
 
 #define DB_TMR_OUT_OFF			0
 #define DB_TMR_OUT_UNIT_OFF		4
@@ -84,6 +87,14 @@
 			      BIT(WAKE_CNTRL_OFF_S3))
 #define WAKE_SOURCE_HIBERNATE BIT(WAKE_CNTRL_OFF_S4)
 
+#define PIN_IRQ_PENDING	(BIT(INTERRUPT_STS_OFF) | BIT(WAKE_STS_OFF))
+/* Set by the hardware, never served from the shadow registers */
+#define PIN_VOLATILE_BITS	(BIT(PIN_STS_OFF) | PIN_IRQ_PENDING)
+
+/* Polling mode for interrupt storms, see amd_gpio_poll() */
+#define AMD_GPIO_POLL_INTERVAL	msecs_to_jiffies(10)
+#define AMD_GPIO_POLL_BUDGET	64
+
 struct amd_function {
 	const char *name;
 	const char * const groups[NSELECTS];
@@ -91,6 +102,12 @@ struct amd_function {
 	int index;
 };
 
+struct amd_gpio_irq_stat {
+	u64 count;	/* interrupts handled since probe */
+	u32 window;	/* interrupts in the current window */
+	u32 rate;	/* interrupts per second over the last window */
+};
+
 struct amd_gpio {
 	raw_spinlock_t          lock;
 	void __iomem            *base;
@@ -98,13 +115,32 @@ struct amd_gpio {
 
 	const struct pingroup *groups;
 	u32 ngroups;
+	/* Group selected by each iomux value of a function, -1 for none */
+	s16 (*mux_groups)[NSELECTS];
+	/* Groups whose pins amd_set_mux() marks as muxed */
+	unsigned long *mux_owned;
 	struct pinctrl_dev *pctrl;
 	struct gpio_chip        gc;
 	unsigned int            hwbank_num;
 	struct resource         *res;
 	struct platform_device  *pdev;
 	u32			*saved_regs;
+	unsigned long		*saveable;	/* pins suspend looks at */
+	unsigned long		*saved;		/* pins in saved_regs */
+	u32			*shadow_regs;
+	bool			shadow_on;	/* see amd_gpio_peek_cfg() */
 	int			irq;
+
+	/* Interrupt accounting and coalescing, see amd_gpio_coalesce_start() */
+	struct amd_gpio_irq_stat *irq_stats;
+	unsigned long		irq_window_start;
+	unsigned int		irq_window_events;
+	u32			coalesce_rate;
+	bool			coalescing;
+	unsigned long		*coalesced;
+	struct delayed_work	poll_work;
+	unsigned long		poll_window_start;
+	unsigned int		poll_window_events;
 };
 
 /*  KERNCZ configuration*/
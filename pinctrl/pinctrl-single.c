@@ -356,35 +356,21 @@ static int pcs_get_function(struct pinctrl_dev *pctldev, unsigned pin,
 	return 0;
 }
 
-static int pcs_set_mux(struct pinctrl_dev *pctldev, unsigned fselector,
-	unsigned group)
+/* Write the function registers of @func, called with pcs->lock held */
+static void pcs_write_function(struct pcs_device *pcs,
+			       const struct pcs_function *func,
+			       unsigned fselector)
 {
-	struct pcs_device *pcs;
-	struct function_desc *function;
-	struct pcs_function *func;
 	int i;
 
-	pcs = pinctrl_dev_get_drvdata(pctldev);
-	/* If function mask is null, needn't enable it. */
-	if (!pcs->fmask)
-		return 0;
-	function = pinmux_generic_get_function(pctldev, fselector);
-	if (!function)
-		return -EINVAL;
-	func = function->data;
-	if (!func)
-		return -EINVAL;
-
 	dev_dbg(pcs->dev, "enabling %s function%i\n",
 		func->name, fselector);
 
 	for (i = 0; i < func->nvals; i++) {
 		struct pcs_func_vals *vals;
-		unsigned long flags;
 		unsigned val, mask;
 
 		vals = &func->vals[i];
-		raw_spin_lock_irqsave(&pcs->lock, flags);
 		val = pcs->read(vals->reg);
 
 		if (pcs->bits_per_mux)
@@ -395,8 +381,31 @@ static int pcs_set_mux(struct pinctrl_dev *pctldev, unsigned fselector,
 		val &= ~mask;
 		val |= (vals->val & mask);
 		pcs->write(val, vals->reg);
-		raw_spin_unlock_irqrestore(&pcs->lock, flags);
 	}
+}
+
+static int pcs_set_mux(struct pinctrl_dev *pctldev, unsigned fselector,
+	unsigned group)
+{
+	struct pcs_device *pcs;
+	struct function_desc *function;
+	struct pcs_function *func;
+	unsigned long flags;
+
+	pcs = pinctrl_dev_get_drvdata(pctldev);
+	/* If function mask is null, needn't enable it. */
+	if (!pcs->fmask)
+		return 0;
+	function = pinmux_generic_get_function(pctldev, fselector);
+	if (!function)
+		return -EINVAL;
+	func = function->data;
+	if (!func)
+		return -EINVAL;
+
+	raw_spin_lock_irqsave(&pcs->lock, flags);
+	pcs_write_function(pcs, func, fselector);
+	raw_spin_unlock_irqrestore(&pcs->lock, flags);
 
 	return 0;
 }
@@ -652,6 +661,65 @@ static int pcs_pinconf_group_set(struct pinctrl_dev *pctldev,
 	return 0;
 }
 
+/*
+ * Program a whole state. The function register writes of all mux steps are
+ * done under a single hold of pcs->lock, the config steps then go through
+ * the same helpers as the per-setting callbacks.
+ */
+static int pcs_apply_batch(struct pinctrl_dev *pctldev,
+			   const struct pinctrl_state_prog *prog)
+{
+	struct pcs_device *pcs = pinctrl_dev_get_drvdata(pctldev);
+	const struct pinctrl_setting_configs *conf;
+	const struct pinctrl_setting *setting;
+	struct function_desc *function;
+	struct pcs_function *func;
+	unsigned long flags;
+	unsigned int i;
+	int ret = 0;
+
+	/* If function mask is null, needn't enable it. */
+	if (pcs->fmask && prog->num_mux) {
+		raw_spin_lock_irqsave(&pcs->lock, flags);
+		for (i = 0; i < prog->num_mux; i++) {
+			setting = prog->ops[i].setting;
+			function = pinmux_generic_get_function(pctldev,
+						setting->data.mux.func);
+			func = function ? function->data : NULL;
+			if (!func) {
+				ret = -EINVAL;
+				break;
+			}
+
+			pcs_write_function(pcs, func, setting->data.mux.func);
+		}
+		raw_spin_unlock_irqrestore(&pcs->lock, flags);
+		if (ret)
+			return ret;
+	}
+
+	/* pinconf_apply_setting() refuses configs without confops */
+	if (prog->num_ops > prog->num_mux && !PCS_HAS_PINCONF)
+		return -EINVAL;
+
+	for (i = prog->num_mux; i < prog->num_ops; i++) {
+		setting = prog->ops[i].setting;
+		conf = &setting->data.configs;
+
+		if (setting->type == PIN_MAP_TYPE_CONFIGS_PIN)
+			ret = pcs_pinconf_set(pctldev, conf->group_or_pin,
+					      conf->configs, conf->num_configs);
+		else
+			ret = pcs_pinconf_group_set(pctldev, conf->group_or_pin,
+						    conf->configs,
+						    conf->num_configs);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
 static void pcs_pinconf_dbg_show(struct pinctrl_dev *pctldev,
 				struct seq_file *s, unsigned pin)
 {
@@ -1887,6 +1955,8 @@ static int pcs_probe(struct platform_device *pdev)
 		goto free;
 	}
 
+	pinctrl_set_apply_batch(pcs->pctl, pcs_apply_batch);
+
 	ret = pcs_add_gpio_func(np, pcs);
 	if (ret < 0)
 		goto free;
@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests checking that hogs applied in async shards leave the hardware
+ * as applying them in line does
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/pinctrl/machine.h>
+#include <linux/pinctrl/pinconf.h>
+#include <linux/pinctrl/pinctrl.h>
+#include <linux/pinctrl/pinmux.h>
+
+#include "core.h"
+#include "pinctrl_kunit.h"
+
+#define HOG_NUM_PINS		256
+#define HOG_NUM_FUNCS		4
+#define HOG_NO_FAIL		UINT_MAX
+
+static unsigned long hog_configs[] = { 3, 5 };
+
+/* The registers of one synthetic controller */
+struct hog_regs {
+	u32 mux[HOG_NUM_PINS];
+	u32 conf[HOG_NUM_PINS];
+	unsigned int fail_pin;
+};
+
+struct hog_names {
+	char pins[HOG_NUM_PINS][16];
+	char groups[HOG_NUM_PINS][16];
+	const char *group_list[HOG_NUM_PINS];
+	char funcs[HOG_NUM_FUNCS][8];
+	unsigned int pin_numbers[HOG_NUM_PINS];
+	struct pinctrl_pin_desc descs[HOG_NUM_PINS];
+};
+
+static struct hog_names *hog_names;
+
+static int hog_get_groups_count(struct pinctrl_dev *pctldev)
+{
+	return HOG_NUM_PINS;
+}
+
+static const char *hog_get_group_name(struct pinctrl_dev *pctldev,
+				      unsigned int selector)
+{
+	return hog_names->groups[selector];
+}
+
+static int hog_get_group_pins(struct pinctrl_dev *pctldev,
+			      unsigned int selector, const unsigned int **pins,
+			      unsigned int *num_pins)
+{
+	*pins = &hog_names->pin_numbers[selector];
+	*num_pins = 1;
+
+	return 0;
+}
+
+static const struct pinctrl_ops hog_pctlops = {
+	.get_groups_count = hog_get_groups_count,
+	.get_group_name = hog_get_group_name,
+	.get_group_pins = hog_get_group_pins,
+};
+
+static int hog_get_functions_count(struct pinctrl_dev *pctldev)
+{
+	return HOG_NUM_FUNCS;
+}
+
+static const char *hog_get_function_name(struct pinctrl_dev *pctldev,
+					 unsigned int selector)
+{
+	return hog_names->funcs[selector];
+}
+
+static int hog_get_function_groups(struct pinctrl_dev *pctldev,
+				   unsigned int selector,
+				   const char * const **groups,
+				   unsigned int * const num_groups)
+{
+	*groups = hog_names->group_list;
+	*num_groups = HOG_NUM_PINS;
+
+	return 0;
+}
+
+static int hog_set_mux(struct pinctrl_dev *pctldev, unsigned int func,
+		       unsigned int group)
+{
+	struct hog_regs *regs = pinctrl_dev_get_drvdata(pctldev);
+
+	regs->mux[group] = func + 1;
+
+	return 0;
+}
+
+static const struct pinmux_ops hog_pmxops = {
+	.get_functions_count = hog_get_functions_count,
+	.get_function_name = hog_get_function_name,
+	.get_function_groups = hog_get_function_groups,
+	.set_mux = hog_set_mux,
+};
+
+/* Depends on the mux of the pin, so the order of the two matters too */
+static int hog_pin_config_set(struct pinctrl_dev *pctldev, unsigned int pin,
+			      unsigned long *configs, unsigned int num_configs)
+{
+	struct hog_regs *regs = pinctrl_dev_get_drvdata(pctldev);
+	unsigned int i;
+
+	if (pin == regs->fail_pin)
+		return -EINVAL;
+
+	for (i = 0; i < num_configs; i++)
+		regs->conf[pin] = regs->conf[pin] * 31 + configs[i] +
+				  (regs->mux[pin] << 20);
+
+	return 0;
+}
+
+static const struct pinconf_ops hog_confops = {
+	.pin_config_set = hog_pin_config_set,
+};
+
+static unsigned int hog_shard_by_bank(struct pinctrl_dev *pctldev,
+				      unsigned int pin)
+{
+	return pin / 16;
+}
+
+static void unregister_maps_action(void *maps)
+{
+	pinctrl_unregister_mappings(maps);
+}
+
+static int hog_test_init(struct kunit *test)
+{
+	unsigned int i;
+
+	hog_names = kunit_kzalloc(test, sizeof(*hog_names), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, hog_names);
+
+	for (i = 0; i < HOG_NUM_PINS; i++) {
+		snprintf(hog_names->pins[i], sizeof(hog_names->pins[i]),
+			 "PIN%u", i);
+		snprintf(hog_names->groups[i], sizeof(hog_names->groups[i]),
+			 "g%u", i);
+		hog_names->group_list[i] = hog_names->groups[i];
+		hog_names->pin_numbers[i] = i;
+		hog_names->descs[i].number = i;
+		hog_names->descs[i].name = hog_names->pins[i];
+	}
+	for (i = 0; i < HOG_NUM_FUNCS; i++)
+		snprintf(hog_names->funcs[i], sizeof(hog_names->funcs[i]),
+			 "f%u", i);
+
+	return 0;
+}
+
+/* Register a controller hogging every pin, and wait for the hogs */
+static struct pinctrl_dev *hog_register(struct kunit *test, const char *name,
+					struct hog_regs *regs, bool async,
+					unsigned int (*hog_shard)(struct pinctrl_dev *,
+								  unsigned int))
+{
+	struct pinctrl_dev *pctldev;
+	struct pinctrl_desc *desc;
+	struct pinctrl_map *maps;
+	struct device *dev;
+	unsigned int i;
+	int ret;
+
+	desc = kunit_kzalloc(test, sizeof(*desc), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, desc);
+	desc->name = name;
+	desc->pins = hog_names->descs;
+	desc->npins = HOG_NUM_PINS;
+	desc->pctlops = &hog_pctlops;
+	desc->pmxops = &hog_pmxops;
+	desc->confops = &hog_confops;
+
+	pctldev = pinctrl_test_register_and_init(test, desc, regs);
+	dev = pctldev->dev;
+
+	/* The hogs are only looked up once the controller is enabled */
+	maps = kunit_kcalloc(test, 2 * HOG_NUM_PINS, sizeof(*maps), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, maps);
+	for (i = 0; i < HOG_NUM_PINS; i++) {
+		struct pinctrl_map *mux = &maps[i];
+		struct pinctrl_map *conf = &maps[HOG_NUM_PINS + i];
+
+		mux->dev_name = dev_name(dev);
+		mux->name = PINCTRL_STATE_DEFAULT;
+		mux->type = PIN_MAP_TYPE_MUX_GROUP;
+		mux->ctrl_dev_name = dev_name(dev);
+		mux->data.mux.group = hog_names->groups[i];
+		mux->data.mux.function = hog_names->funcs[i % HOG_NUM_FUNCS];
+
+		conf->dev_name = dev_name(dev);
+		conf->name = PINCTRL_STATE_DEFAULT;
+		conf->type = PIN_MAP_TYPE_CONFIGS_PIN;
+		conf->ctrl_dev_name = dev_name(dev);
+		conf->data.configs.group_or_pin = hog_names->pins[i];
+		conf->data.configs.configs = hog_configs;
+		conf->data.configs.num_configs = ARRAY_SIZE(hog_configs);
+	}
+	ret = pinctrl_register_mappings(maps, 2 * HOG_NUM_PINS);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	ret = kunit_add_action_or_reset(test, unregister_maps_action, maps);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	if (async)
+		pinctrl_enable_async_hogs(pctldev, hog_shard);
+
+	ret = pinctrl_enable(pctldev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	pinctrl_wait_for_hogs(pctldev);
+
+	return pctldev;
+}
+
+static struct hog_regs *hog_alloc_regs(struct kunit *test, unsigned int fail)
+{
+	struct hog_regs *regs;
+
+	regs = kunit_kzalloc(test, sizeof(*regs), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, regs);
+	regs->fail_pin = fail;
+
+	return regs;
+}
+
+static void pinctrl_claim_hogs_async_matches_serial(struct kunit *test)
+{
+	struct hog_regs *serial, *by_pin, *by_bank;
+	struct pinctrl_dev *pctldev;
+
+	serial = hog_alloc_regs(test, HOG_NO_FAIL);
+	by_pin = hog_alloc_regs(test, HOG_NO_FAIL);
+	by_bank = hog_alloc_regs(test, HOG_NO_FAIL);
+
+	pctldev = hog_register(test, "hog-serial", serial, false, NULL);
+	KUNIT_EXPECT_EQ(test, pinctrl_wait_for_hogs(pctldev), 0);
+	KUNIT_EXPECT_PTR_EQ(test, pctldev->p->state, pctldev->hog_default);
+
+	pctldev = hog_register(test, "hog-async-pin", by_pin, true, NULL);
+	KUNIT_EXPECT_PTR_EQ(test, pctldev->p->state, pctldev->hog_default);
+	KUNIT_EXPECT_NULL(test, pctldev->hog_shards);
+
+	pctldev = hog_register(test, "hog-async-bank", by_bank, true,
+			       hog_shard_by_bank);
+	KUNIT_EXPECT_PTR_EQ(test, pctldev->p->state, pctldev->hog_default);
+
+	KUNIT_EXPECT_EQ(test, serial->mux[5], 2);
+	KUNIT_EXPECT_NE(test, serial->conf[5], 0);
+	KUNIT_EXPECT_MEMEQ(test, serial, by_pin, sizeof(*serial));
+	KUNIT_EXPECT_MEMEQ(test, serial, by_bank, sizeof(*serial));
+
+	kunit_info(test, "%u hogged pins in up to %u shards\n",
+		   HOG_NUM_PINS, num_online_cpus());
+}
+
+static void pinctrl_claim_hogs_async_failure(struct kunit *test)
+{
+	struct pinctrl_dev *pctldevs[2];
+	struct pin_desc *desc;
+	unsigned int i, j;
+
+	pctldevs[0] = hog_register(test, "hog-fail-serial",
+				   hog_alloc_regs(test, 100), false, NULL);
+	pctldevs[1] = hog_register(test, "hog-fail-async",
+				   hog_alloc_regs(test, 100), true, NULL);
+
+	/* In line failures are only logged, as they always were */
+	KUNIT_EXPECT_EQ(test, pinctrl_wait_for_hogs(pctldevs[0]), 0);
+	KUNIT_EXPECT_EQ(test, pinctrl_wait_for_hogs(pctldevs[1]), -EINVAL);
+
+	/* Neither keeps the state nor any of the pins claimed */
+	for (i = 0; i < ARRAY_SIZE(pctldevs); i++) {
+		KUNIT_EXPECT_NULL(test, pctldevs[i]->p->state);
+		for (j = 0; j < HOG_NUM_PINS; j++) {
+			desc = pin_desc_get(pctldevs[i], j);
+			KUNIT_ASSERT_NOT_NULL(test, desc);
+			KUNIT_EXPECT_FALSE(test, test_bit(desc->index,
+							 pctldevs[i]->mux_claimed));
+		}
+	}
+}
+
+static struct kunit_case pinctrl_claim_hogs_test_cases[] = {
+	KUNIT_CASE(pinctrl_claim_hogs_async_matches_serial),
+	KUNIT_CASE(pinctrl_claim_hogs_async_failure),
+	{}
+};
+
+static struct kunit_suite pinctrl_claim_hogs_test_suite = {
+	.name = "pinctrl_claim_hogs",
+	.init = hog_test_init,
+	.test_cases = pinctrl_claim_hogs_test_cases,
+};
+
+kunit_test_suite(pinctrl_claim_hogs_test_suite);
@@ -0,0 +1,331 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the group and function name indexes used by
+ * pinctrl_get_group_selector() and the pinmux map conversion
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/pinctrl/consumer.h>
+#include <linux/pinctrl/machine.h>
+#include <linux/pinctrl/pinctrl.h>
+#include <linux/pinctrl/pinmux.h>
+
+#include "core.h"
+#include "pinctrl_kunit.h"
+#include "pinmux.h"
+
+#define BENCH_NUM_GROUPS	4000
+#define BENCH_ROUNDS		4
+
+static int test_set_mux(struct pinctrl_dev *pctldev, unsigned int func,
+			unsigned int group)
+{
+	return 0;
+}
+
+static const struct pinctrl_ops test_pctlops = {
+	.get_groups_count = pinctrl_generic_get_group_count,
+	.get_group_name = pinctrl_generic_get_group_name,
+	.get_group_pins = pinctrl_generic_get_group_pins,
+};
+
+static const struct pinmux_ops test_pmxops = {
+	.get_functions_count = pinmux_generic_get_function_count,
+	.get_function_name = pinmux_generic_get_function_name,
+	.get_function_groups = pinmux_generic_get_function_groups,
+	.set_mux = test_set_mux,
+};
+
+struct name_index_test {
+	struct pinctrl_dev *pctldev;
+	char (*names)[16];
+	const char **funcs_groups;
+	unsigned int *pins;
+};
+
+static void unregister_maps_action(void *maps)
+{
+	pinctrl_unregister_mappings(maps);
+}
+
+/* One pin, one group and one function per index, all named "gN" */
+static struct name_index_test *register_synthetic(struct kunit *test,
+						  const char *name,
+						  unsigned int num)
+{
+	struct pinctrl_pin_desc *pins;
+	struct name_index_test *ctx;
+	struct pinctrl_desc *desc;
+	unsigned int i;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+	ctx->names = kunit_kcalloc(test, num, sizeof(*ctx->names), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->names);
+	ctx->funcs_groups = kunit_kcalloc(test, num, sizeof(*ctx->funcs_groups),
+					  GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->funcs_groups);
+	ctx->pins = kunit_kcalloc(test, num, sizeof(*ctx->pins), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->pins);
+	pins = kunit_kcalloc(test, num, sizeof(*pins), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, pins);
+
+	for (i = 0; i < num; i++) {
+		snprintf(ctx->names[i], sizeof(ctx->names[i]), "g%u", i);
+		ctx->funcs_groups[i] = ctx->names[i];
+		ctx->pins[i] = i;
+		pins[i].number = i;
+	}
+
+	desc = kunit_kzalloc(test, sizeof(*desc), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, desc);
+	desc->name = name;
+	desc->pins = pins;
+	desc->npins = num;
+	desc->pctlops = &test_pctlops;
+	desc->pmxops = &test_pmxops;
+
+	ctx->pctldev = pinctrl_test_register(test, desc, NULL);
+
+	return ctx;
+}
+
+static void add_groups_and_functions(struct kunit *test,
+				     struct name_index_test *ctx,
+				     unsigned int num)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		KUNIT_ASSERT_EQ(test,
+				pinctrl_generic_add_group(ctx->pctldev,
+							  ctx->names[i],
+							  &ctx->pins[i], 1,
+							  NULL),
+				i);
+		KUNIT_ASSERT_EQ(test,
+				pinmux_generic_add_function(ctx->pctldev,
+							    ctx->names[i],
+							    &ctx->funcs_groups[i],
+							    1, NULL),
+				i);
+	}
+}
+
+/* What pinctrl_get_group_selector() had to do before the index existed */
+static int linear_scan(struct pinctrl_dev *pctldev, const char *name)
+{
+	const struct pinctrl_ops *ops = pctldev->desc->pctlops;
+	int ngroups = ops->get_groups_count(pctldev);
+	int selector;
+
+	for (selector = 0; selector < ngroups; selector++) {
+		const char *gname = ops->get_group_name(pctldev, selector);
+
+		if (gname && !strcmp(gname, name))
+			return selector;
+	}
+
+	return -EINVAL;
+}
+
+static void pinctrl_name_index_finds_all(struct kunit *test)
+{
+	struct name_index_test *ctx = register_synthetic(test, "name-index", 64);
+	unsigned int i;
+
+	add_groups_and_functions(test, ctx, 64);
+
+	for (i = 0; i < 64; i++)
+		KUNIT_EXPECT_EQ(test,
+				pinctrl_get_group_selector(ctx->pctldev,
+							   ctx->names[i]),
+				i);
+	KUNIT_EXPECT_EQ(test, pinctrl_get_group_selector(ctx->pctldev, "g64"),
+			-EINVAL);
+	KUNIT_EXPECT_EQ(test, ctx->pctldev->group_index.count, 64);
+
+	/* Adding an existing name hands back its selector */
+	KUNIT_EXPECT_EQ(test,
+			pinctrl_generic_add_group(ctx->pctldev, "g17",
+						  &ctx->pins[17], 1, NULL),
+			17);
+	KUNIT_EXPECT_EQ(test,
+			pinmux_generic_add_function(ctx->pctldev, "g42",
+						    NULL, 0, NULL),
+			42);
+	KUNIT_EXPECT_EQ(test, ctx->pctldev->func_index.count, 64);
+}
+
+static void pinctrl_name_index_follows_remove(struct kunit *test)
+{
+	struct name_index_test *ctx = register_synthetic(test, "name-index-rm", 8);
+
+	add_groups_and_functions(test, ctx, 8);
+	KUNIT_EXPECT_EQ(test, pinctrl_get_group_selector(ctx->pctldev, "g7"), 7);
+
+	KUNIT_ASSERT_EQ(test, pinctrl_generic_remove_group(ctx->pctldev, 7), 0);
+	KUNIT_EXPECT_NULL(test, ctx->pctldev->group_index.slots);
+	KUNIT_EXPECT_EQ(test, pinctrl_get_group_selector(ctx->pctldev, "g7"),
+			-EINVAL);
+	KUNIT_EXPECT_EQ(test, pinctrl_get_group_selector(ctx->pctldev, "g6"), 6);
+
+	/* The name comes back under a new group */
+	KUNIT_EXPECT_EQ(test,
+			pinctrl_generic_add_group(ctx->pctldev, "g7",
+						  &ctx->pins[0], 1, NULL),
+			7);
+	KUNIT_EXPECT_EQ(test, pinctrl_get_group_selector(ctx->pctldev, "g7"), 7);
+
+	KUNIT_ASSERT_EQ(test, pinmux_generic_remove_function(ctx->pctldev, 7), 0);
+	KUNIT_EXPECT_NULL(test, ctx->pctldev->func_index.slots);
+	KUNIT_EXPECT_EQ(test,
+			pinmux_generic_add_function(ctx->pctldev, "g7",
+						    NULL, 0, NULL),
+			7);
+}
+
+static void pinctrl_state_prog_follows_group_pins(struct kunit *test)
+{
+	struct name_index_test *ctx = register_synthetic(test, "prog-regroup", 8);
+	struct pinctrl_state *def, *sleep;
+	struct pinctrl_map *maps;
+	struct device *consumer;
+	struct pinctrl *p;
+	int ret;
+
+	add_groups_and_functions(test, ctx, 8);
+
+	consumer = kunit_device_register(test, "prog-regroup-consumer");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, consumer);
+	maps = kunit_kcalloc(test, 2, sizeof(*maps), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, maps);
+	maps[0].dev_name = dev_name(consumer);
+	maps[0].name = PINCTRL_STATE_DEFAULT;
+	maps[0].type = PIN_MAP_TYPE_MUX_GROUP;
+	maps[0].ctrl_dev_name = pinctrl_dev_get_devname(ctx->pctldev);
+	maps[0].data.mux.group = "g7";
+	maps[0].data.mux.function = "g7";
+	maps[1] = maps[0];
+	maps[1].name = PINCTRL_STATE_SLEEP;
+	maps[1].data.mux.group = "g6";
+	maps[1].data.mux.function = "g6";
+	ret = pinctrl_register_mappings(maps, 2);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	ret = kunit_add_action_or_reset(test, unregister_maps_action, maps);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	p = pinctrl_get(consumer);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, p);
+	def = pinctrl_lookup_state(p, PINCTRL_STATE_DEFAULT);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, def);
+	sleep = pinctrl_lookup_state(p, PINCTRL_STATE_SLEEP);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, sleep);
+
+	KUNIT_ASSERT_EQ(test, pinctrl_select_state(p, def), 0);
+	KUNIT_EXPECT_NOT_NULL(test, pin_desc_get(ctx->pctldev, 7)->mux_owner);
+	KUNIT_ASSERT_EQ(test, pinctrl_select_state(p, sleep), 0);
+	KUNIT_EXPECT_NULL(test, pin_desc_get(ctx->pctldev, 7)->mux_owner);
+
+	/* "g7" comes back on another pin behind the compiled program's back */
+	KUNIT_ASSERT_EQ(test, pinctrl_generic_remove_group(ctx->pctldev, 7), 0);
+	KUNIT_ASSERT_EQ(test,
+			pinctrl_generic_add_group(ctx->pctldev, "g7",
+						  &ctx->pins[5], 1, NULL),
+			7);
+
+	KUNIT_ASSERT_EQ(test, pinctrl_select_state(p, def), 0);
+	KUNIT_EXPECT_NOT_NULL(test, pin_desc_get(ctx->pctldev, 5)->mux_owner);
+	KUNIT_EXPECT_NULL(test, pin_desc_get(ctx->pctldev, 7)->mux_owner);
+	KUNIT_EXPECT_NULL(test, pin_desc_get(ctx->pctldev, 6)->mux_owner);
+
+	KUNIT_ASSERT_EQ(test, pinctrl_select_state(p, sleep), 0);
+	KUNIT_EXPECT_NULL(test, pin_desc_get(ctx->pctldev, 5)->mux_owner);
+
+	pinctrl_put(p);
+}
+
+static void pinctrl_name_index_bench_4000_groups(struct kunit *test)
+{
+	struct name_index_test *ctx;
+	u64 t_add, t_linear, t_indexed, t_get;
+	struct pinctrl_map *maps;
+	struct device *consumer;
+	unsigned int i, r;
+	struct pinctrl *p;
+	ktime_t start;
+	int ret;
+
+	ctx = register_synthetic(test, "name-index-bench", BENCH_NUM_GROUPS);
+
+	start = ktime_get();
+	add_groups_and_functions(test, ctx, BENCH_NUM_GROUPS);
+	t_add = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (r = 0; r < BENCH_ROUNDS; r++)
+		for (i = 0; i < BENCH_NUM_GROUPS; i++)
+			KUNIT_ASSERT_EQ(test,
+					linear_scan(ctx->pctldev, ctx->names[i]),
+					i);
+	t_linear = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (r = 0; r < BENCH_ROUNDS; r++)
+		for (i = 0; i < BENCH_NUM_GROUPS; i++)
+			KUNIT_ASSERT_EQ(test,
+					pinctrl_get_group_selector(ctx->pctldev,
+								   ctx->names[i]),
+					i);
+	t_indexed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	/* A consumer muxing every group, as a board would at boot */
+	consumer = kunit_device_register(test, "name-index-consumer");
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, consumer);
+	maps = kunit_kcalloc(test, BENCH_NUM_GROUPS, sizeof(*maps), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, maps);
+	for (i = 0; i < BENCH_NUM_GROUPS; i++) {
+		maps[i].dev_name = dev_name(consumer);
+		maps[i].name = PINCTRL_STATE_DEFAULT;
+		maps[i].type = PIN_MAP_TYPE_MUX_GROUP;
+		maps[i].ctrl_dev_name = pinctrl_dev_get_devname(ctx->pctldev);
+		maps[i].data.mux.group = ctx->names[i];
+		maps[i].data.mux.function = ctx->names[i];
+	}
+	ret = pinctrl_register_mappings(maps, BENCH_NUM_GROUPS);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	ret = kunit_add_action_or_reset(test, unregister_maps_action, maps);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	start = ktime_get();
+	p = pinctrl_get(consumer);
+	t_get = ktime_to_ns(ktime_sub(ktime_get(), start));
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, p);
+	pinctrl_put(p);
+
+	kunit_info(test, "%u groups: linear scan %llu ns, indexed %llu ns per lookup\n",
+		   BENCH_NUM_GROUPS,
+		   div_u64(t_linear, BENCH_ROUNDS * BENCH_NUM_GROUPS),
+		   div_u64(t_indexed, BENCH_ROUNDS * BENCH_NUM_GROUPS));
+	kunit_info(test, "adding all groups and functions %llu us, converting %u mux maps %llu us\n",
+		   div_u64(t_add, NSEC_PER_USEC), BENCH_NUM_GROUPS,
+		   div_u64(t_get, NSEC_PER_USEC));
+}
+
+static struct kunit_case pinctrl_name_index_test_cases[] = {
+	KUNIT_CASE(pinctrl_name_index_finds_all),
+	KUNIT_CASE(pinctrl_name_index_follows_remove),
+	KUNIT_CASE(pinctrl_state_prog_follows_group_pins),
+	KUNIT_CASE_SLOW(pinctrl_name_index_bench_4000_groups),
+	{}
+};
+
+static struct kunit_suite pinctrl_name_index_test_suite = {
+	.name = "pinctrl_name_index",
+	.test_cases = pinctrl_name_index_test_cases,
+};
+
+kunit_test_suite(pinctrl_name_index_test_suite);
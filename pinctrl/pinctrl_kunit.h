@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Shared fixture for the pinctrl core KUnit tests: the operations of a pin
+ * controller that registers pins but has no groups, and registering a pin
+ * controller for the duration of a test.
+ */
+#ifndef __PINCTRL_KUNIT_H
+#define __PINCTRL_KUNIT_H
+
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/pinctrl/pinctrl.h>
+
+static int pinctrl_test_get_groups_count(struct pinctrl_dev *pctldev)
+{
+	return 0;
+}
+
+static const char *pinctrl_test_get_group_name(struct pinctrl_dev *pctldev,
+					       unsigned int selector)
+{
+	return NULL;
+}
+
+static const struct pinctrl_ops pinctrl_test_pctlops = {
+	.get_groups_count = pinctrl_test_get_groups_count,
+	.get_group_name = pinctrl_test_get_group_name,
+};
+
+static inline void pinctrl_test_unregister(void *pctldev)
+{
+	pinctrl_unregister(pctldev);
+}
+
+/*
+ * Initialize @desc on a new KUnit device named after it, and unregister it
+ * again when the test ends. The caller enables it with pinctrl_enable().
+ */
+static inline struct pinctrl_dev *
+pinctrl_test_register_and_init(struct kunit *test, struct pinctrl_desc *desc,
+			       void *driver_data)
+{
+	struct pinctrl_dev *pctldev;
+	struct device *dev;
+	int ret;
+
+	dev = kunit_device_register(test, desc->name);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	ret = pinctrl_register_and_init(desc, dev, driver_data, &pctldev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	ret = kunit_add_action_or_reset(test, pinctrl_test_unregister,
+					pctldev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	return pctldev;
+}
+
+/* Register @desc on a new KUnit device named after it, for the test only */
+static inline struct pinctrl_dev *
+pinctrl_test_register(struct kunit *test, struct pinctrl_desc *desc,
+		      void *driver_data)
+{
+	struct pinctrl_dev *pctldev;
+	struct device *dev;
+	int ret;
+
+	dev = kunit_device_register(test, desc->name);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dev);
+
+	pctldev = pinctrl_register(desc, dev, driver_data);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, pctldev);
+	ret = kunit_add_action_or_reset(test, pinctrl_test_unregister,
+					pctldev);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	return pctldev;
+}
+
+#endif /* __PINCTRL_KUNIT_H */
@@ -13,18 +13,26 @@
 #define pr_fmt(fmt) "pinmux core: " fmt
 
 #include <linux/array_size.h>
+#include <linux/atomic.h>
+#include <linux/bitfield.h>
+#include <linux/bitmap.h>
 #include <linux/ctype.h>
 #include <linux/cleanup.h>
 #include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/err.h>
+#include <linux/hashtable.h>
+#include <linux/idr.h>
 #include <linux/init.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/preempt.h>
 #include <linux/radix-tree.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/stringhash.h>
+#include <linux/wait_bit.h>
 
 #include <linux/pinctrl/machine.h>
 #include <linux/pinctrl/pinctrl.h>
@@ -75,6 +83,547 @@ int pinmux_validate_map(const struct pinctrl_map *map, int i)
 	return 0;
 }
 
+/*
+ * Pins claimed for muxing are tracked per pin controller in the bitmap
+ * mux_claimed, with a bit per pin set while the pin is claimed, and in
+ * mux_refs, with a word per pin holding the id of the owner and the number
+ * of claims. A group is claimed by setting the bits of its pins with one
+ * cmpxchg per bitmap word, only pins that were claimed already are then
+ * looked at one by one.
+ *
+ * A pin whose bit is set while its word is zero is just being claimed, or
+ * finishing its release, with preemption disabled. A pin whose word has an
+ * owner but no claims is being requested from the driver by its first
+ * claimant, or freed back to it, which may sleep. Other claimants wait for
+ * that, so nobody shares a pin the driver has not granted.
+ */
+#define PINMUX_REF_COUNT	GENMASK(15, 0)
+#define PINMUX_REF_OWNER	GENMASK(31, 16)
+
+#define PINMUX_OWNER_HASH_BITS	6
+
+/* Groups up to this size are claimed without allocating */
+#define PINMUX_CLAIM_ON_STACK	256
+
+/**
+ * struct pinmux_owner - the id of a name pins are claimed for
+ * @hnode: node in pinmux_owners
+ * @name: the device name
+ * @id: the id kept in the owner field of the words in mux_refs
+ * @users: the number of mux settings holding @id
+ */
+struct pinmux_owner {
+	struct hlist_node hnode;
+	const char *name;
+	unsigned int id;
+	unsigned int users;
+};
+
+static DEFINE_MUTEX(pinmux_owner_mutex);
+static DEFINE_HASHTABLE(pinmux_owners, PINMUX_OWNER_HASH_BITS);
+static DEFINE_IDA(pinmux_owner_ida);
+
+static struct pinmux_owner *pinmux_find_owner(const char *owner, u32 hash)
+{
+	struct pinmux_owner *o;
+
+	hash_for_each_possible(pinmux_owners, o, hnode, hash)
+		if (!strcmp(o->name, owner))
+			return o;
+
+	return NULL;
+}
+
+/**
+ * pinmux_owner_id() - get the id of the name pins are claimed for
+ * @owner: the name of the device claiming pins
+ *
+ * Owners are told apart by name, so each name gets an id the first time it
+ * is seen and keeps it until each call has been balanced by
+ * pinmux_owner_put(). Returns the id, or a negative error code.
+ */
+int pinmux_owner_id(const char *owner)
+{
+	u32 hash = full_name_hash(NULL, owner, strlen(owner));
+	struct pinmux_owner *o;
+	int id;
+
+	guard(mutex)(&pinmux_owner_mutex);
+
+	o = pinmux_find_owner(owner, hash);
+	if (o) {
+		o->users++;
+		return o->id;
+	}
+
+	o = kzalloc(sizeof(*o), GFP_KERNEL);
+	if (!o)
+		return -ENOMEM;
+	o->name = kstrdup_const(owner, GFP_KERNEL);
+	if (!o->name) {
+		kfree(o);
+		return -ENOMEM;
+	}
+	id = ida_alloc_range(&pinmux_owner_ida, 1,
+			     FIELD_MAX(PINMUX_REF_OWNER), GFP_KERNEL);
+	if (id < 0) {
+		kfree_const(o->name);
+		kfree(o);
+		return id;
+	}
+	o->id = id;
+	o->users = 1;
+	hash_add(pinmux_owners, &o->hnode, hash);
+
+	return o->id;
+}
+
+/**
+ * pinmux_owner_put() - drop a reference taken by pinmux_owner_id()
+ * @owner: the name of the device claiming pins
+ *
+ * The id of @owner may be handed to another name once no setting holds it,
+ * which is safe as settings release their pins before they are freed.
+ */
+void pinmux_owner_put(const char *owner)
+{
+	u32 hash = full_name_hash(NULL, owner, strlen(owner));
+	struct pinmux_owner *o;
+
+	guard(mutex)(&pinmux_owner_mutex);
+
+	o = pinmux_find_owner(owner, hash);
+	if (WARN_ON(!o) || --o->users)
+		return;
+
+	hash_del(&o->hnode);
+	ida_free(&pinmux_owner_ida, o->id);
+	kfree_const(o->name);
+	kfree(o);
+}
+
+/**
+ * pinmux_alloc_claims() - allocate the claim tracking of a pin controller
+ * @pctldev: the pin controller
+ * @num_pins: the number of pins it registered
+ */
+int pinmux_alloc_claims(struct pinctrl_dev *pctldev, unsigned int num_pins)
+{
+	if (!pctldev->desc->pmxops || !num_pins)
+		return 0;
+
+	pctldev->mux_claimed = bitmap_zalloc(num_pins, GFP_KERNEL);
+	pctldev->mux_refs = kcalloc(num_pins, sizeof(*pctldev->mux_refs),
+				    GFP_KERNEL);
+	if (!pctldev->mux_claimed || !pctldev->mux_refs) {
+		pinmux_free_claims(pctldev);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void pinmux_free_claims(struct pinctrl_dev *pctldev)
+{
+	bitmap_free(pctldev->mux_claimed);
+	pctldev->mux_claimed = NULL;
+	kfree(pctldev->mux_refs);
+	pctldev->mux_refs = NULL;
+}
+
+static inline int pinmux_ref(unsigned int owner, unsigned int count)
+{
+	return FIELD_PREP(PINMUX_REF_OWNER, owner) |
+	       FIELD_PREP(PINMUX_REF_COUNT, count);
+}
+
+static int pinmux_pin_index(struct pinctrl_dev *pctldev, unsigned int pin)
+{
+	const struct pin_desc *desc = pin_desc_get(pctldev, pin);
+
+	return desc ? desc->index : -EINVAL;
+}
+
+static bool pinmux_pin_claimed(struct pinctrl_dev *pctldev,
+			       const struct pin_desc *desc)
+{
+	return pctldev->mux_claimed &&
+	       test_bit(desc->index, pctldev->mux_claimed);
+}
+
+/*
+ * Claim the pin at @index for @owner when it is claimed already. Returns 1
+ * if it turned out to be free after all, and is now pending for @owner, 0 if
+ * @owner held it already, -EINVAL if someone else holds it, and -EAGAIN if
+ * it is pending for @owner, which the caller may be itself.
+ */
+static int pinmux_claim_ref(struct pinctrl_dev *pctldev, unsigned int index,
+			    unsigned int owner)
+{
+	atomic_t *ref = &pctldev->mux_refs[index];
+	int old;
+
+	for (;;) {
+		preempt_disable();
+		if (!test_and_set_bit_lock(index, pctldev->mux_claimed)) {
+			atomic_set_release(ref, pinmux_ref(owner, 0));
+			preempt_enable();
+			return 1;
+		}
+		preempt_enable();
+
+		old = atomic_read_acquire(ref);
+		if (!old) {
+			cpu_relax();
+			continue;
+		}
+		if (!FIELD_GET(PINMUX_REF_COUNT, old)) {
+			if (FIELD_GET(PINMUX_REF_OWNER, old) == owner)
+				return -EAGAIN;
+			wait_var_event(ref, atomic_read(ref) != old);
+			continue;
+		}
+		if (FIELD_GET(PINMUX_REF_OWNER, old) != owner ||
+		    FIELD_GET(PINMUX_REF_COUNT, old) == FIELD_MAX(PINMUX_REF_COUNT))
+			return -EINVAL;
+		if (atomic_try_cmpxchg(ref, &old, old + 1))
+			return 0;
+	}
+}
+
+/* Wait until the pin at @index is neither being requested nor freed */
+static void pinmux_wait_ref(struct pinctrl_dev *pctldev, unsigned int index)
+{
+	atomic_t *ref = &pctldev->mux_refs[index];
+	int old = atomic_read_acquire(ref);
+
+	if (old && !FIELD_GET(PINMUX_REF_COUNT, old))
+		wait_var_event(ref, atomic_read(ref) != old);
+}
+
+/* Turn the pending claim of @owner on the pin at @index into a real one */
+static void pinmux_grant_ref(struct pinctrl_dev *pctldev, unsigned int index,
+			     unsigned int owner)
+{
+	atomic_set_release(&pctldev->mux_refs[index], pinmux_ref(owner, 1));
+	wake_up_var(&pctldev->mux_refs[index]);
+}
+
+/* Drop a claim on the pin at @index, returns true if it was the last one */
+static bool pinmux_put_ref(struct pinctrl_dev *pctldev, unsigned int index)
+{
+	atomic_t *ref = &pctldev->mux_refs[index];
+	int old = atomic_read(ref);
+
+	do {
+		/* A pin should not be freed more times than allocated */
+		if (WARN_ON(!FIELD_GET(PINMUX_REF_COUNT, old)))
+			return false;
+	} while (!atomic_try_cmpxchg(ref, &old, old - 1));
+
+	return FIELD_GET(PINMUX_REF_COUNT, old) == 1;
+}
+
+/* Finish the release of the pins of bitmap word @word set in @mask */
+static void pinmux_unclaim_bits(struct pinctrl_dev *pctldev, unsigned int word,
+				unsigned long mask)
+{
+	unsigned long *addr = &pctldev->mux_claimed[word];
+	unsigned long old = READ_ONCE(*addr);
+	unsigned int bit;
+
+	preempt_disable();
+	for_each_set_bit(bit, &mask, BITS_PER_LONG)
+		atomic_set(&pctldev->mux_refs[word * BITS_PER_LONG + bit], 0);
+	/* A full barrier, the words are cleared before the bits are */
+	while (!try_cmpxchg(addr, &old, old & ~mask))
+		;
+	preempt_enable();
+
+	for_each_set_bit(bit, &mask, BITS_PER_LONG)
+		wake_up_var(&pctldev->mux_refs[word * BITS_PER_LONG + bit]);
+}
+
+/* Queue the pin at @index for pinmux_unclaim_bits(), by bitmap word */
+static void pinmux_unclaim_index(struct pinctrl_dev *pctldev,
+				 unsigned int index, unsigned int *word,
+				 unsigned long *mask)
+{
+	if (*mask && BIT_WORD(index) != *word) {
+		pinmux_unclaim_bits(pctldev, *word, *mask);
+		*mask = 0;
+	}
+	*word = BIT_WORD(index);
+	*mask |= BIT_MASK(index);
+}
+
+/* Hand a pin no one holds any more back to the driver */
+static void pinmux_free_pin(struct pinctrl_dev *pctldev, struct pin_desc *desc,
+			    unsigned int pin)
+{
+	const struct pinmux_ops *ops = pctldev->desc->pmxops;
+
+	/*
+	 * If there is no kind of request function for the pin we just assume
+	 * we got it by default and proceed.
+	 */
+	if (ops->free)
+		ops->free(pctldev, pin);
+
+	WRITE_ONCE(desc->mux_owner, NULL);
+	WRITE_ONCE(desc->mux_setting, NULL);
+
+	module_put(pctldev->owner);
+}
+
+/*
+ * Drop a claim on @desc, and once it was the last one free the pin back to
+ * the driver and then unclaim it.
+ */
+static void pinmux_drop_pin(struct pinctrl_dev *pctldev, struct pin_desc *desc,
+			    unsigned int pin, unsigned int *word,
+			    unsigned long *mask)
+{
+	if (!pinmux_put_ref(pctldev, desc->index))
+		return;
+
+	pinmux_free_pin(pctldev, desc, pin);
+	pinmux_unclaim_index(pctldev, desc->index, word, mask);
+}
+
+/*
+ * Undo a claim of @pins. The pins set in @fresh were free before the claim
+ * and are still pending, so no one else holds them, and only those before
+ * pins[@num_requested] were requested from the driver since. All others
+ * were requested by their earlier holders.
+ */
+static void pinmux_drop_pins(struct pinctrl_dev *pctldev,
+			     const unsigned int *pins, unsigned int num_pins,
+			     const unsigned long *fresh,
+			     unsigned int num_requested)
+{
+	unsigned int i, word = 0;
+	unsigned long mask = 0;
+	struct pin_desc *desc;
+
+	for (i = 0; i < num_pins; i++) {
+		desc = pin_desc_get(pctldev, pins[i]);
+		if (!desc)
+			continue;
+		if (!test_bit(i, fresh)) {
+			pinmux_drop_pin(pctldev, desc, pins[i], &word, &mask);
+			continue;
+		}
+		if (i < num_requested)
+			pinmux_free_pin(pctldev, desc, pins[i]);
+		pinmux_unclaim_index(pctldev, desc->index, &word, &mask);
+	}
+	if (mask)
+		pinmux_unclaim_bits(pctldev, word, mask);
+}
+
+/* Whether @pin is among the first @num entries of @pins */
+static bool pinmux_pin_listed(const unsigned int *pins, unsigned int num,
+			      unsigned int pin)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		if (pins[i] == pin)
+			return true;
+
+	return false;
+}
+
+/*
+ * Claim @pins for @owner, setting bit i of @fresh for each pins[i] that was
+ * free before. Those stay pending until pinmux_grant_ref(). On failure no pin
+ * stays claimed and @failed is the index in @pins of the pin that could not
+ * be claimed.
+ */
+static int pinmux_claim_pins(struct pinctrl_dev *pctldev,
+			     const unsigned int *pins, unsigned int num_pins,
+			     unsigned int owner, unsigned long *fresh,
+			     unsigned int *failed)
+{
+	unsigned long *claimed = pctldev->mux_claimed;
+	unsigned long mask, old;
+	unsigned int i, j, k, word = 0;
+	int index, ret;
+
+	for (i = 0; i < num_pins; i = j) {
+		/* The run of pins sharing a bitmap word with pins[i] */
+		mask = 0;
+		for (j = i; j < num_pins; j++) {
+			index = pinmux_pin_index(pctldev, pins[j]);
+			if (index < 0 || (mask && BIT_WORD(index) != word) ||
+			    (mask & BIT_MASK(index)))
+				break;
+			word = BIT_WORD(index);
+			mask |= BIT_MASK(index);
+		}
+		if (!mask) {
+			dev_err(pctldev->dev,
+				"pin %d is not registered so it cannot be requested\n",
+				pins[i]);
+			*failed = i;
+			pinmux_drop_pins(pctldev, pins, i, fresh, 0);
+			return -EINVAL;
+		}
+
+		preempt_disable();
+		old = READ_ONCE(claimed[word]);
+		while (!try_cmpxchg(&claimed[word], &old, old | mask))
+			;
+		for (k = i; k < j; k++) {
+			index = pinmux_pin_index(pctldev, pins[k]);
+			if (old & BIT_MASK(index))
+				continue;
+			atomic_set_release(&pctldev->mux_refs[index],
+					   pinmux_ref(owner, 0));
+			__set_bit(k, fresh);
+		}
+		preempt_enable();
+
+		/* Pins claimed already may be held by @owner too */
+		for (k = i; k < j; k++) {
+			if (test_bit(k, fresh))
+				continue;
+			index = pinmux_pin_index(pctldev, pins[k]);
+			while ((ret = pinmux_claim_ref(pctldev, index,
+						       owner)) == -EAGAIN) {
+				/* Pending for this very claim */
+				if (pinmux_pin_listed(pins, k, pins[k])) {
+					dev_err(pctldev->dev,
+						"pin %d is listed twice\n",
+						pins[k]);
+					ret = -EINVAL;
+					break;
+				}
+				pinmux_wait_ref(pctldev, index);
+			}
+			if (ret < 0)
+				goto err_claim;
+			if (ret)
+				__set_bit(k, fresh);
+		}
+	}
+
+	return 0;
+
+err_claim:
+	*failed = k;
+	pinmux_drop_pins(pctldev, pins, k, fresh, 0);
+	/* The rest of the run was only claimed where it was free */
+	word = 0;
+	mask = 0;
+	for (k++; k < j; k++)
+		if (test_bit(k, fresh))
+			pinmux_unclaim_index(pctldev,
+					     pinmux_pin_index(pctldev, pins[k]),
+					     &word, &mask);
+	if (mask)
+		pinmux_unclaim_bits(pctldev, word, mask);
+
+	return ret;
+}
+
+/* Request a pin just claimed for @owner from the driver */
+static int pinmux_request_pin(struct pinctrl_dev *pctldev,
+			      struct pin_desc *desc, unsigned int pin,
+			      const char *owner)
+{
+	const struct pinmux_ops *ops = pctldev->desc->pmxops;
+	const char *gpio_owner;
+	int status;
+
+	dev_dbg(pctldev->dev, "request pin %d (%s) for %s\n",
+		pin, desc->name, owner);
+
+	/* Claiming the pin was a full barrier, pairs with pin_request() */
+	gpio_owner = READ_ONCE(desc->gpio_owner);
+	if (ops->strict && gpio_owner) {
+		dev_err(pctldev->dev,
+			"pin %s already requested by %s; cannot claim for %s\n",
+			desc->name, gpio_owner, owner);
+		status = -EINVAL;
+		goto out;
+	}
+
+	WRITE_ONCE(desc->mux_owner, owner);
+
+	/* Let each pin increase references to this module */
+	if (!try_module_get(pctldev->owner)) {
+		dev_err(pctldev->dev,
+			"could not increase module refcount for pin %d\n",
+			pin);
+		status = -EINVAL;
+		goto out_clear_owner;
+	}
+
+	/*
+	 * If there is no kind of request function for the pin we just assume
+	 * we got it by default and proceed.
+	 */
+	if (ops->request)
+		status = ops->request(pctldev, pin);
+	else
+		status = 0;
+
+	if (!status)
+		return 0;
+
+	module_put(pctldev->owner);
+out_clear_owner:
+	WRITE_ONCE(desc->mux_owner, NULL);
+out:
+	dev_err_probe(pctldev->dev, status, "pin-%d (%s)\n", pin, owner);
+
+	return status;
+}
+
+/*
+ * Drop the claim of @setting on each of @pins, and free the pins no one
+ * holds any more. With @check, pins muxed by another setting since are left
+ * alone.
+ */
+static void pinmux_release_pins(const struct pinctrl_setting *setting,
+				const unsigned int *pins, unsigned int num_pins,
+				bool check)
+{
+	struct pinctrl_dev *pctldev = setting->pctldev;
+	const struct pinctrl_ops *pctlops = pctldev->desc->pctlops;
+	unsigned int i, word = 0;
+	unsigned long mask = 0;
+	struct pin_desc *desc;
+
+	for (i = 0; i < num_pins; i++) {
+		desc = pin_desc_get(pctldev, pins[i]);
+		if (desc == NULL) {
+			dev_warn(pctldev->dev,
+				 "could not get pin desc for pin %d\n",
+				 pins[i]);
+			continue;
+		}
+
+		if (check &&
+		    READ_ONCE(desc->mux_setting) != &setting->data.mux) {
+			const char *gname;
+
+			gname = pctlops->get_group_name(pctldev,
+						setting->data.mux.group);
+			dev_warn(pctldev->dev,
+				 "not freeing pin %d (%s) as part of deactivating group %s - it is already used for some other setting",
+				 pins[i], desc->name, gname);
+			continue;
+		}
+
+		pinmux_drop_pin(pctldev, desc, pins[i], &word, &mask);
+	}
+	if (mask)
+		pinmux_unclaim_bits(pctldev, word, mask);
+}
+
 /**
  * pinmux_can_be_used_for_gpio() - check if a specific pin
  *	is either muxed to a different function or used as gpio.
@@ -94,21 +643,21 @@ bool pinmux_can_be_used_for_gpio(struct pinctrl_dev *pctldev, unsigned int pin)
 	if (!desc || !ops)
 		return true;
 
-	guard(mutex)(&desc->mux_lock);
-	if (ops->strict && desc->mux_usecount)
+	if (ops->strict && pinmux_pin_claimed(pctldev, desc))
 		return false;
 
-	return !(ops->strict && !!desc->gpio_owner);
+	return !(ops->strict && !!READ_ONCE(desc->gpio_owner));
 }
 
 /**
- * pin_request() - request a single pin to be muxed in, typically for GPIO
+ * pin_request() - request a single pin for GPIO use
  * @pctldev: the associated pin controller device
  * @pin: the pin number in the global pin space
- * @owner: a representation of the owner of this pin; typically the device
- *	name that controls its mux function, or the requested GPIO name
- * @gpio_range: the range matching the GPIO pin if this is a request for a
- *	single GPIO pin
+ * @owner: a representation of the owner of this pin, the requested GPIO
+ *	name
+ * @gpio_range: the range matching the GPIO pin
+ *
+ * Pins claimed for muxing go through pinmux_claim_setting_pins() instead.
  */
 static int pin_request(struct pinctrl_dev *pctldev,
 		       int pin, const char *owner,
@@ -116,6 +665,7 @@ static int pin_request(struct pinctrl_dev *pctldev,
 {
 	struct pin_desc *desc;
 	const struct pinmux_ops *ops = pctldev->desc->pmxops;
+	const char *old;
 	int status = -EINVAL;
 
 	desc = pin_desc_get(pctldev, pin);
@@ -129,31 +679,20 @@ static int pin_request(struct pinctrl_dev *pctldev,
 	dev_dbg(pctldev->dev, "request pin %d (%s) for %s\n",
 		pin, desc->name, owner);
 
-	scoped_guard(mutex, &desc->mux_lock) {
-		if ((!gpio_range || ops->strict) &&
-		    desc->mux_usecount && strcmp(desc->mux_owner, owner)) {
-			dev_err(pctldev->dev,
-				"pin %s already requested by %s; cannot claim for %s\n",
-				desc->name, desc->mux_owner, owner);
-			goto out;
-		}
-
-		if ((gpio_range || ops->strict) && desc->gpio_owner) {
-			dev_err(pctldev->dev,
-				"pin %s already requested by %s; cannot claim for %s\n",
-				desc->name, desc->gpio_owner, owner);
-			goto out;
-		}
-
-		if (gpio_range) {
-			desc->gpio_owner = owner;
-		} else {
-			desc->mux_usecount++;
-			if (desc->mux_usecount > 1)
-				return 0;
+	old = cmpxchg(&desc->gpio_owner, NULL, owner);
+	if (old) {
+		dev_err(pctldev->dev,
+			"pin %s already requested by %s; cannot claim for %s\n",
+			desc->name, old, owner);
+		goto out;
+	}
 
-			desc->mux_owner = owner;
-		}
+	/* The cmpxchg() was a full barrier, pairs with pinmux_request_pin() */
+	if (ops->strict && pinmux_pin_claimed(pctldev, desc)) {
+		dev_err(pctldev->dev,
+			"pin %s already requested by %s; cannot claim for %s\n",
+			desc->name, READ_ONCE(desc->mux_owner), owner);
+		goto out_free_pin;
 	}
 
 	/* Let each pin increase references to this module */
@@ -161,7 +700,6 @@ static int pin_request(struct pinctrl_dev *pctldev,
 		dev_err(pctldev->dev,
 			"could not increase module refcount for pin %d\n",
 			pin);
-		status = -EINVAL;
 		goto out_free_pin;
 	}
 
@@ -169,7 +707,7 @@ static int pin_request(struct pinctrl_dev *pctldev,
 	 * If there is no kind of request function for the pin we just assume
 	 * we got it by default and proceed.
 	 */
-	if (gpio_range && ops->gpio_request_enable)
+	if (ops->gpio_request_enable)
 		/* This requests and enables a single GPIO pin */
 		status = ops->gpio_request_enable(pctldev, gpio_range, pin);
 	else if (ops->request)
@@ -181,17 +719,8 @@ static int pin_request(struct pinctrl_dev *pctldev,
 		module_put(pctldev->owner);
 
 out_free_pin:
-	if (status) {
-		scoped_guard(mutex, &desc->mux_lock) {
-			if (gpio_range) {
-				desc->gpio_owner = NULL;
-			} else {
-				desc->mux_usecount--;
-				if (!desc->mux_usecount)
-					desc->mux_owner = NULL;
-			}
-		}
-	}
+	if (status)
+		WRITE_ONCE(desc->gpio_owner, NULL);
 out:
 	if (status)
 		dev_err_probe(pctldev->dev, status, "pin-%d (%s)\n",
@@ -201,11 +730,10 @@ out:
 }
 
 /**
- * pin_free() - release a single muxed in pin so something else can be muxed
+ * pin_free() - release a single GPIO pin so something else can be muxed
  * @pctldev: pin controller device handling this pin
  * @pin: the pin to free
- * @gpio_range: the range matching the GPIO pin if this is a request for a
- *	single GPIO pin
+ * @gpio_range: the range matching the GPIO pin
  *
  * This function returns a pointer to the previous owner. This is used
  * for callers that dynamically allocate an owner name so it can be freed
@@ -225,38 +753,16 @@ static const char *pin_free(struct pinctrl_dev *pctldev, int pin,
 		return NULL;
 	}
 
-	scoped_guard(mutex, &desc->mux_lock) {
-		if (!gpio_range) {
-			/*
-			 * A pin should not be freed more times than allocated.
-			 */
-			if (WARN_ON(!desc->mux_usecount))
-				return NULL;
-			desc->mux_usecount--;
-			if (desc->mux_usecount)
-				return NULL;
-		}
-	}
-
 	/*
 	 * If there is no kind of request function for the pin we just assume
 	 * we got it by default and proceed.
 	 */
-	if (gpio_range && ops->gpio_disable_free)
+	if (ops->gpio_disable_free)
 		ops->gpio_disable_free(pctldev, gpio_range, pin);
 	else if (ops->free)
 		ops->free(pctldev, pin);
 
-	scoped_guard(mutex, &desc->mux_lock) {
-		if (gpio_range) {
-			owner = desc->gpio_owner;
-			desc->gpio_owner = NULL;
-		} else {
-			owner = desc->mux_owner;
-			desc->mux_owner = NULL;
-			desc->mux_setting = NULL;
-		}
-	}
+	owner = xchg(&desc->gpio_owner, NULL);
 
 	module_put(pctldev->owner);
 
@@ -332,20 +838,11 @@ static int pinmux_func_name_to_selector(struct pinctrl_dev *pctldev,
 					const char *function)
 {
 	const struct pinmux_ops *ops = pctldev->desc->pmxops;
-	unsigned int nfuncs = ops->get_functions_count(pctldev);
-	unsigned int selector = 0;
 
 	/* See if this pctldev has this function */
-	while (selector < nfuncs) {
-		const char *fname = ops->get_function_name(pctldev, selector);
-
-		if (!strcmp(function, fname))
-			return selector;
-
-		selector++;
-	}
-
-	return -EINVAL;
+	return pinctrl_name_index_lookup(pctldev, &pctldev->func_index,
+					 function, ops->get_functions_count,
+					 ops->get_function_name);
 }
 
 int pinmux_map_to_setting(const struct pinctrl_map *map,
@@ -405,147 +902,199 @@ int pinmux_map_to_setting(const struct pinctrl_map *map,
 	}
 	setting->data.mux.group = ret;
 
+	ret = pinmux_owner_id(setting->dev_name);
+	if (ret < 0)
+		return ret;
+	setting->data.mux.owner = ret;
+
 	return 0;
 }
 
 void pinmux_free_setting(const struct pinctrl_setting *setting)
 {
-	/* This function is currently unused */
+	pinmux_owner_put(setting->dev_name);
 }
 
-int pinmux_enable_setting(const struct pinctrl_setting *setting)
+/**
+ * pinmux_get_setting_pins() - resolve the pins of the group of a mux setting
+ * @setting: the mux setting
+ * @pins: returns the pins of the group, may be left untouched if empty
+ * @num_pins: returns the number of entries in @pins
+ *
+ * Failing to get the pins only affects the debug data, so this warns and
+ * reports an empty group rather than failing.
+ */
+void pinmux_get_setting_pins(const struct pinctrl_setting *setting,
+			     const unsigned int **pins, unsigned int *num_pins)
 {
 	struct pinctrl_dev *pctldev = setting->pctldev;
 	const struct pinctrl_ops *pctlops = pctldev->desc->pctlops;
-	const struct pinmux_ops *ops = pctldev->desc->pmxops;
 	int ret = 0;
-	const unsigned int *pins = NULL;
-	unsigned int num_pins = 0;
-	int i;
-	struct pin_desc *desc;
+
+	*num_pins = 0;
 
 	if (pctlops->get_group_pins)
 		ret = pctlops->get_group_pins(pctldev, setting->data.mux.group,
-					      &pins, &num_pins);
-
+					      pins, num_pins);
 	if (ret) {
 		const char *gname;
 
-		/* errors only affect debug data, so just warn */
 		gname = pctlops->get_group_name(pctldev,
 						setting->data.mux.group);
 		dev_warn(pctldev->dev,
 			 "could not get pins for group %s\n",
 			 gname);
-		num_pins = 0;
+		*num_pins = 0;
 	}
+}
 
-	/* Try to allocate all pins in this group, one by one */
-	for (i = 0; i < num_pins; i++) {
-		ret = pin_request(pctldev, pins[i], setting->dev_name, NULL);
-		if (ret) {
-			const char *gname;
-			const char *pname;
+/**
+ * pinmux_claim_setting_pins() - claim the pins of a mux setting
+ * @setting: the mux setting the pins are claimed for
+ * @pins: the pins of the group of @setting, from pinmux_get_setting_pins()
+ * @num_pins: the number of entries in @pins
+ *
+ * Requests all pins of the group and records @setting as their mux setting,
+ * but does not program the hardware. On failure no pin stays claimed.
+ */
+int pinmux_claim_setting_pins(const struct pinctrl_setting *setting,
+			      const unsigned int *pins, unsigned int num_pins)
+{
+	unsigned long fresh_on_stack[BITS_TO_LONGS(PINMUX_CLAIM_ON_STACK)] = {};
+	struct pinctrl_dev *pctldev = setting->pctldev;
+	const struct pinctrl_ops *pctlops = pctldev->desc->pctlops;
+	unsigned long *fresh = fresh_on_stack;
+	const char *gname, *pname;
+	unsigned int i, failed;
+	struct pin_desc *desc;
+	int ret;
 
-			desc = pin_desc_get(pctldev, pins[i]);
-			pname = desc ? desc->name : "non-existing";
-			gname = pctlops->get_group_name(pctldev,
-						setting->data.mux.group);
-			dev_err_probe(pctldev->dev, ret,
-				"could not request pin %d (%s) from group %s on device %s\n",
-				pins[i], pname, gname,
-				pinctrl_dev_get_name(pctldev));
-			goto err_pin_request;
+	if (num_pins > PINMUX_CLAIM_ON_STACK) {
+		fresh = bitmap_zalloc(num_pins, GFP_KERNEL);
+		if (!fresh)
+			return -ENOMEM;
+	}
+
+	/* Try to allocate all pins in this group at once */
+	ret = pinmux_claim_pins(pctldev, pins, num_pins,
+				setting->data.mux.owner, fresh, &failed);
+	if (ret)
+		goto err_pin_request;
+
+	/* Pins nobody held before are requested from the driver too */
+	for_each_set_bit(i, fresh, num_pins) {
+		ret = pinmux_request_pin(pctldev, pin_desc_get(pctldev, pins[i]),
+					 pins[i], setting->dev_name);
+		if (ret) {
+			failed = i;
+			goto err_free_pins;
 		}
 	}
 
+	/* Only now that the driver granted them, others may share them */
+	for_each_set_bit(i, fresh, num_pins)
+		pinmux_grant_ref(pctldev, pinmux_pin_index(pctldev, pins[i]),
+				 setting->data.mux.owner);
+
 	/* Now that we have acquired the pins, encode the mux setting */
 	for (i = 0; i < num_pins; i++) {
 		desc = pin_desc_get(pctldev, pins[i]);
-		if (desc == NULL) {
-			dev_warn(pctldev->dev,
-				 "could not get pin desc for pin %d\n",
-				 pins[i]);
-			continue;
-		}
-		scoped_guard(mutex, &desc->mux_lock)
-			desc->mux_setting = &(setting->data.mux);
+		WRITE_ONCE(desc->mux_setting, &(setting->data.mux));
 	}
 
-	ret = ops->set_mux(pctldev, setting->data.mux.func,
-			   setting->data.mux.group);
-
-	if (ret)
-		goto err_set_mux;
+	if (fresh != fresh_on_stack)
+		bitmap_free(fresh);
 
 	return 0;
 
-err_set_mux:
-	for (i = 0; i < num_pins; i++) {
-		desc = pin_desc_get(pctldev, pins[i]);
-		if (desc) {
-			scoped_guard(mutex, &desc->mux_lock)
-				desc->mux_setting = NULL;
-		}
-	}
-err_pin_request:
+err_free_pins:
 	/* On error release all taken pins */
-	while (--i >= 0)
-		pin_free(pctldev, pins[i], NULL);
+	pinmux_drop_pins(pctldev, pins, num_pins, fresh, failed);
+err_pin_request:
+	desc = pin_desc_get(pctldev, pins[failed]);
+	pname = desc ? desc->name : "non-existing";
+	gname = pctlops->get_group_name(pctldev, setting->data.mux.group);
+	dev_err_probe(pctldev->dev, ret,
+		"could not request pin %d (%s) from group %s on device %s\n",
+		pins[failed], pname, gname, pinctrl_dev_get_name(pctldev));
+
+	if (fresh != fresh_on_stack)
+		bitmap_free(fresh);
 
 	return ret;
 }
 
-void pinmux_disable_setting(const struct pinctrl_setting *setting)
+/**
+ * pinmux_release_setting_pins() - undo pinmux_claim_setting_pins()
+ * @setting: the mux setting the pins were claimed for
+ * @pins: the pins of the group of @setting
+ * @num_pins: the number of entries in @pins
+ *
+ * Used when programming the hardware failed after the pins were claimed.
+ */
+void pinmux_release_setting_pins(const struct pinctrl_setting *setting,
+				 const unsigned int *pins,
+				 unsigned int num_pins)
 {
 	struct pinctrl_dev *pctldev = setting->pctldev;
-	const struct pinctrl_ops *pctlops = pctldev->desc->pctlops;
-	int ret = 0;
-	const unsigned int *pins = NULL;
-	unsigned int num_pins = 0;
-	int i;
 	struct pin_desc *desc;
-	bool is_equal;
-
-	if (pctlops->get_group_pins)
-		ret = pctlops->get_group_pins(pctldev, setting->data.mux.group,
-					      &pins, &num_pins);
-	if (ret) {
-		const char *gname;
+	unsigned int i;
 
-		/* errors only affect debug data, so just warn */
-		gname = pctlops->get_group_name(pctldev,
-						setting->data.mux.group);
-		dev_warn(pctldev->dev,
-			 "could not get pins for group %s\n",
-			 gname);
-		num_pins = 0;
-	}
-
-	/* Flag the descs that no setting is active */
 	for (i = 0; i < num_pins; i++) {
 		desc = pin_desc_get(pctldev, pins[i]);
-		if (desc == NULL) {
-			dev_warn(pctldev->dev,
-				 "could not get pin desc for pin %d\n",
-				 pins[i]);
-			continue;
-		}
-		scoped_guard(mutex, &desc->mux_lock)
-			is_equal = (desc->mux_setting == &(setting->data.mux));
+		if (desc)
+			WRITE_ONCE(desc->mux_setting, NULL);
+	}
 
-		if (is_equal) {
-			pin_free(pctldev, pins[i], NULL);
-		} else {
-			const char *gname;
+	pinmux_release_pins(setting, pins, num_pins, false);
+}
 
-			gname = pctlops->get_group_name(pctldev,
-						setting->data.mux.group);
-			dev_warn(pctldev->dev,
-				 "not freeing pin %d (%s) as part of deactivating group %s - it is already used for some other setting",
-				 pins[i], desc->name, gname);
-		}
-	}
+/**
+ * pinmux_enable_setting_pins() - claim the pins of a mux setting and mux them
+ * @setting: the mux setting to enable
+ * @pins: the pins of the group of @setting, from pinmux_get_setting_pins()
+ * @num_pins: the number of entries in @pins
+ */
+int pinmux_enable_setting_pins(const struct pinctrl_setting *setting,
+			       const unsigned int *pins, unsigned int num_pins)
+{
+	struct pinctrl_dev *pctldev = setting->pctldev;
+	const struct pinmux_ops *ops = pctldev->desc->pmxops;
+	int ret;
+
+	ret = pinmux_claim_setting_pins(setting, pins, num_pins);
+	if (ret)
+		return ret;
+
+	ret = ops->set_mux(pctldev, setting->data.mux.func,
+			   setting->data.mux.group);
+	if (ret)
+		pinmux_release_setting_pins(setting, pins, num_pins);
+
+	return ret;
+}
+
+/**
+ * pinmux_disable_setting_pins() - release the pins claimed by a mux setting
+ * @setting: the mux setting to disable
+ * @pins: the pins of the group of @setting, from pinmux_get_setting_pins()
+ * @num_pins: the number of entries in @pins
+ */
+void pinmux_disable_setting_pins(const struct pinctrl_setting *setting,
+				 const unsigned int *pins,
+				 unsigned int num_pins)
+{
+	/* Only free the pins still flagged with this setting */
+	pinmux_release_pins(setting, pins, num_pins, true);
+}
+
+void pinmux_disable_setting(const struct pinctrl_setting *setting)
+{
+	const unsigned int *pins = NULL;
+	unsigned int num_pins;
+
+	pinmux_get_setting_pins(setting, &pins, &num_pins);
+	pinmux_disable_setting_pins(setting, pins, num_pins);
 }
 
 #ifdef CONFIG_DEBUG_FS
@@ -612,10 +1161,18 @@ static int pinmux_pins_show(struct seq_file *s, void *what)
 		seq_puts(s,
 		"Format: pin (name): mux_owner gpio_owner hog?\n");
 
+	/*
+	 * Pins are claimed without locks, but the settings they point at are
+	 * only freed under pinctrl_list_mutex and the GPIO owners only change
+	 * under the mutex of the pin controller.
+	 */
+	mutex_lock(&pinctrl_list_mutex);
 	mutex_lock(&pctldev->mutex);
 
 	/* The pin number can be retrived from the pin controller descriptor */
 	for (i = 0; i < pctldev->desc->npins; i++) {
+		const struct pinctrl_setting_mux *mux_setting;
+		const char *mux_owner, *gpio_owner;
 		struct pin_desc *desc;
 		bool is_hog = false;
 
@@ -625,45 +1182,46 @@ static int pinmux_pins_show(struct seq_file *s, void *what)
 		if (desc == NULL)
 			continue;
 
-		scoped_guard(mutex, &desc->mux_lock) {
-			if (desc->mux_owner &&
-			    !strcmp(desc->mux_owner, pinctrl_dev_get_name(pctldev)))
-				is_hog = true;
-
-			if (pmxops->strict) {
-				if (desc->mux_owner)
-					seq_printf(s, "pin %d (%s): device %s%s",
-						   pin, desc->name, desc->mux_owner,
-						   is_hog ? " (HOG)" : "");
-				else if (desc->gpio_owner)
-					seq_printf(s, "pin %d (%s): GPIO %s",
-						   pin, desc->name, desc->gpio_owner);
-				else
-					seq_printf(s, "pin %d (%s): UNCLAIMED",
-						   pin, desc->name);
-			} else {
-				/* For non-strict controllers */
-				seq_printf(s, "pin %d (%s): %s %s%s", pin, desc->name,
-					   desc->mux_owner ? desc->mux_owner
-					   : "(MUX UNCLAIMED)",
-					   desc->gpio_owner ? desc->gpio_owner
-					   : "(GPIO UNCLAIMED)",
-					   is_hog ? " (HOG)" : "");
-			}
+		mux_owner = READ_ONCE(desc->mux_owner);
+		mux_setting = READ_ONCE(desc->mux_setting);
+		gpio_owner = desc->gpio_owner;
+
+		if (mux_owner &&
+		    !strcmp(mux_owner, pinctrl_dev_get_name(pctldev)))
+			is_hog = true;
 
-			/* If mux: print function+group claiming the pin */
-			if (desc->mux_setting)
-				seq_printf(s, " function %s group %s\n",
-					   pmxops->get_function_name(pctldev,
-						desc->mux_setting->func),
-					   pctlops->get_group_name(pctldev,
-						desc->mux_setting->group));
+		if (pmxops->strict) {
+			if (mux_owner)
+				seq_printf(s, "pin %d (%s): device %s%s",
+					   pin, desc->name, mux_owner,
+					   is_hog ? " (HOG)" : "");
+			else if (gpio_owner)
+				seq_printf(s, "pin %d (%s): GPIO %s",
+					   pin, desc->name, gpio_owner);
 			else
-				seq_putc(s, '\n');
+				seq_printf(s, "pin %d (%s): UNCLAIMED",
+					   pin, desc->name);
+		} else {
+			/* For non-strict controllers */
+			seq_printf(s, "pin %d (%s): %s %s%s", pin, desc->name,
+				   mux_owner ? mux_owner : "(MUX UNCLAIMED)",
+				   gpio_owner ? gpio_owner : "(GPIO UNCLAIMED)",
+				   is_hog ? " (HOG)" : "");
 		}
+
+		/* If mux: print function+group claiming the pin */
+		if (mux_setting)
+			seq_printf(s, " function %s group %s\n",
+				   pmxops->get_function_name(pctldev,
+					mux_setting->func),
+				   pctlops->get_group_name(pctldev,
+					mux_setting->group));
+		else
+			seq_putc(s, '\n');
 	}
 
 	mutex_unlock(&pctldev->mutex);
+	mutex_unlock(&pinctrl_list_mutex);
 
 	return 0;
 }
@@ -900,6 +1458,7 @@ int pinmux_generic_add_function(struct pinctrl_dev *pctldev,
 		return error;
 
 	pctldev->num_functions++;
+	pinctrl_name_index_add(pctldev, &pctldev->func_index, name, selector);
 
 	return selector;
 }
@@ -926,6 +1485,7 @@ int pinmux_generic_remove_function(struct pinctrl_dev *pctldev,
 	devm_kfree(pctldev->dev, function);
 
 	pctldev->num_functions--;
+	pinctrl_name_index_reset(pctldev, &pctldev->func_index);
 
 	return 0;
 }
@@ -948,6 +1508,7 @@ void pinmux_generic_free_functions(struct pinctrl_dev *pctldev)
 		radix_tree_delete(&pctldev->pin_function_tree, iter.index);
 
 	pctldev->num_functions = 0;
+	pinctrl_name_index_reset(pctldev, &pctldev->func_index);
 }
 
 #endif /* CONFIG_GENERIC_PINMUX_FUNCTIONS */
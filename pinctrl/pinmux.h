@@ -26,6 +26,11 @@ int pinmux_check_ops(struct pinctrl_dev *pctldev);
 
 int pinmux_validate_map(const struct pinctrl_map *map, int i);
 
+int pinmux_alloc_claims(struct pinctrl_dev *pctldev, unsigned int num_pins);
+void pinmux_free_claims(struct pinctrl_dev *pctldev);
+int pinmux_owner_id(const char *owner);
+void pinmux_owner_put(const char *owner);
+
 bool pinmux_can_be_used_for_gpio(struct pinctrl_dev *pctldev, unsigned int pin);
 
 int pinmux_request_gpio(struct pinctrl_dev *pctldev,
@@ -40,8 +45,19 @@ int pinmux_gpio_direction(struct pinctrl_dev *pctldev,
 int pinmux_map_to_setting(const struct pinctrl_map *map,
 			  struct pinctrl_setting *setting);
 void pinmux_free_setting(const struct pinctrl_setting *setting);
-int pinmux_enable_setting(const struct pinctrl_setting *setting);
 void pinmux_disable_setting(const struct pinctrl_setting *setting);
+void pinmux_get_setting_pins(const struct pinctrl_setting *setting,
+			     const unsigned int **pins, unsigned int *num_pins);
+int pinmux_claim_setting_pins(const struct pinctrl_setting *setting,
+			      const unsigned int *pins, unsigned int num_pins);
+void pinmux_release_setting_pins(const struct pinctrl_setting *setting,
+				 const unsigned int *pins,
+				 unsigned int num_pins);
+int pinmux_enable_setting_pins(const struct pinctrl_setting *setting,
+			       const unsigned int *pins, unsigned int num_pins);
+void pinmux_disable_setting_pins(const struct pinctrl_setting *setting,
+				 const unsigned int *pins,
+				 unsigned int num_pins);
 
 #else
 
@@ -55,6 +71,16 @@ static inline int pinmux_validate_map(const struct pinctrl_map *map, int i)
 	return 0;
 }
 
+static inline int pinmux_alloc_claims(struct pinctrl_dev *pctldev,
+				      unsigned int num_pins)
+{
+	return 0;
+}
+
+static inline void pinmux_free_claims(struct pinctrl_dev *pctldev)
+{
+}
+
 static inline bool pinmux_can_be_used_for_gpio(struct pinctrl_dev *pctldev,
 					       unsigned int pin)
 {
@@ -91,12 +117,40 @@ static inline void pinmux_free_setting(const struct pinctrl_setting *setting)
 {
 }
 
-static inline int pinmux_enable_setting(const struct pinctrl_setting *setting)
+static inline void pinmux_disable_setting(const struct pinctrl_setting *setting)
+{
+}
+
+static inline void
+pinmux_get_setting_pins(const struct pinctrl_setting *setting,
+			const unsigned int **pins, unsigned int *num_pins)
+{
+	*num_pins = 0;
+}
+
+static inline int
+pinmux_claim_setting_pins(const struct pinctrl_setting *setting,
+			  const unsigned int *pins, unsigned int num_pins)
 {
 	return 0;
 }
 
-static inline void pinmux_disable_setting(const struct pinctrl_setting *setting)
+static inline void
+pinmux_release_setting_pins(const struct pinctrl_setting *setting,
+			    const unsigned int *pins, unsigned int num_pins)
+{
+}
+
+static inline int
+pinmux_enable_setting_pins(const struct pinctrl_setting *setting,
+			   const unsigned int *pins, unsigned int num_pins)
+{
+	return 0;
+}
+
+static inline void
+pinmux_disable_setting_pins(const struct pinctrl_setting *setting,
+			    const unsigned int *pins, unsigned int num_pins)
 {
 }
 
@@ -0,0 +1,531 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KUnit tests for the pin ownership bitmap used by
+ * pinmux_claim_setting_pins() and the release of the claimed pins
+ */
+#include <kunit/device.h>
+#include <kunit/test.h>
+#include <linux/completion.h>
+#include <linux/delay.h>
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/pinctrl/pinctrl.h>
+#include <linux/pinctrl/pinmux.h>
+
+#include "core.h"
+#include "pinctrl_kunit.h"
+#include "pinmux.h"
+
+#define OWN_NUM_PINS		512
+#define OWN_GROUP_PINS		64
+#define OWN_BENCH_THREADS	8
+#define OWN_BENCH_ROUNDS	2000
+
+/*
+ * Groups 0 to 2 overlap for the conflict tests. The benchmark groups
+ * interleave, pin N is in group OWN_FIRST_BENCH + N % OWN_BENCH_THREADS, so
+ * every thread claims pins in the same bitmap words as all the others.
+ */
+#define OWN_FIRST_BENCH		3
+#define OWN_NUM_GROUPS		(OWN_FIRST_BENCH + OWN_BENCH_THREADS)
+
+/* Groups 0 to 2 cover pins 0-63, 32-95 and 96-159 */
+static const unsigned int own_group_first[OWN_FIRST_BENCH] = { 0, 32, 96 };
+
+struct own_names {
+	char pins[OWN_NUM_PINS][16];
+	char groups[OWN_NUM_GROUPS][16];
+	unsigned int group_pins[OWN_NUM_GROUPS][OWN_GROUP_PINS];
+	struct pinctrl_pin_desc descs[OWN_NUM_PINS];
+};
+
+/* What the driver saw of the pins, and the pin it refuses plus one */
+struct own_regs {
+	atomic_t requested[OWN_NUM_PINS];
+	atomic_t overlapping;
+	unsigned int refuse;
+};
+
+static struct own_names *own_names;
+
+static int own_get_groups_count(struct pinctrl_dev *pctldev)
+{
+	return OWN_NUM_GROUPS;
+}
+
+static const char *own_get_group_name(struct pinctrl_dev *pctldev,
+				      unsigned int selector)
+{
+	return own_names->groups[selector];
+}
+
+static int own_get_group_pins(struct pinctrl_dev *pctldev,
+			      unsigned int selector, const unsigned int **pins,
+			      unsigned int *num_pins)
+{
+	*pins = own_names->group_pins[selector];
+	*num_pins = OWN_GROUP_PINS;
+
+	return 0;
+}
+
+static const struct pinctrl_ops own_pctlops = {
+	.get_groups_count = own_get_groups_count,
+	.get_group_name = own_get_group_name,
+	.get_group_pins = own_get_group_pins,
+};
+
+static int own_get_functions_count(struct pinctrl_dev *pctldev)
+{
+	return 1;
+}
+
+static const char *own_get_function_name(struct pinctrl_dev *pctldev,
+					 unsigned int selector)
+{
+	return "f0";
+}
+
+static int own_request(struct pinctrl_dev *pctldev, unsigned int pin)
+{
+	struct own_regs *regs = pinctrl_dev_get_drvdata(pctldev);
+
+	if (regs->refuse == pin + 1)
+		return -EBUSY;
+
+	if (atomic_inc_return(&regs->requested[pin]) != 1)
+		atomic_inc(&regs->overlapping);
+
+	return 0;
+}
+
+static int own_free(struct pinctrl_dev *pctldev, unsigned int pin)
+{
+	struct own_regs *regs = pinctrl_dev_get_drvdata(pctldev);
+
+	atomic_dec(&regs->requested[pin]);
+
+	return 0;
+}
+
+static int own_set_mux(struct pinctrl_dev *pctldev, unsigned int func,
+		       unsigned int group)
+{
+	return 0;
+}
+
+static const struct pinmux_ops own_pmxops = {
+	.request = own_request,
+	.free = own_free,
+	.get_functions_count = own_get_functions_count,
+	.get_function_name = own_get_function_name,
+	.set_mux = own_set_mux,
+};
+
+static const struct pinmux_ops own_strict_pmxops = {
+	.request = own_request,
+	.free = own_free,
+	.get_functions_count = own_get_functions_count,
+	.get_function_name = own_get_function_name,
+	.set_mux = own_set_mux,
+	.strict = true,
+};
+
+static int own_test_init(struct kunit *test)
+{
+	unsigned int i, j;
+
+	own_names = kunit_kzalloc(test, sizeof(*own_names), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, own_names);
+
+	for (i = 0; i < OWN_NUM_PINS; i++) {
+		snprintf(own_names->pins[i], sizeof(own_names->pins[i]),
+			 "PIN%u", i);
+		own_names->descs[i].number = i;
+		own_names->descs[i].name = own_names->pins[i];
+	}
+
+	for (i = 0; i < OWN_NUM_GROUPS; i++) {
+		snprintf(own_names->groups[i], sizeof(own_names->groups[i]),
+			 "g%u", i);
+		for (j = 0; j < OWN_GROUP_PINS; j++) {
+			if (i < OWN_FIRST_BENCH)
+				own_names->group_pins[i][j] =
+					own_group_first[i] + j;
+			else
+				own_names->group_pins[i][j] =
+					j * OWN_BENCH_THREADS + i -
+					OWN_FIRST_BENCH;
+		}
+	}
+
+	return 0;
+}
+
+static struct pinctrl_dev *own_register(struct kunit *test, const char *name,
+					const struct pinmux_ops *pmxops,
+					struct own_regs **regs)
+{
+	struct pinctrl_desc *desc;
+
+	*regs = kunit_kzalloc(test, sizeof(**regs), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, *regs);
+
+	desc = kunit_kzalloc(test, sizeof(*desc), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, desc);
+	desc->name = name;
+	desc->pins = own_names->descs;
+	desc->npins = OWN_NUM_PINS;
+	desc->pctlops = &own_pctlops;
+	desc->pmxops = pmxops;
+
+	return pinctrl_test_register(test, desc, *regs);
+}
+
+static void own_put_action(void *owner)
+{
+	pinmux_owner_put(owner);
+}
+
+static struct pinctrl_setting *own_setting(struct kunit *test,
+					   struct pinctrl_dev *pctldev,
+					   const char *owner,
+					   unsigned int group)
+{
+	struct pinctrl_setting *setting;
+	int id;
+
+	setting = kunit_kzalloc(test, sizeof(*setting), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, setting);
+
+	id = pinmux_owner_id(owner);
+	KUNIT_ASSERT_GT(test, id, 0);
+	KUNIT_ASSERT_EQ(test,
+			kunit_add_action_or_reset(test, own_put_action,
+						  (void *)owner),
+			0);
+
+	setting->type = PIN_MAP_TYPE_MUX_GROUP;
+	setting->pctldev = pctldev;
+	setting->dev_name = owner;
+	setting->data.mux.group = group;
+	setting->data.mux.owner = id;
+
+	return setting;
+}
+
+static int own_claim(struct pinctrl_setting *setting)
+{
+	return pinmux_claim_setting_pins(setting,
+			own_names->group_pins[setting->data.mux.group],
+			OWN_GROUP_PINS);
+}
+
+static void own_release(struct pinctrl_setting *setting)
+{
+	pinmux_disable_setting_pins(setting,
+			own_names->group_pins[setting->data.mux.group],
+			OWN_GROUP_PINS);
+}
+
+static unsigned int own_count_claimed(struct pinctrl_dev *pctldev,
+				      unsigned int first, unsigned int num)
+{
+	unsigned int pin, claimed = 0;
+
+	for (pin = first; pin < first + num; pin++)
+		if (test_bit(pin_desc_get(pctldev, pin)->index,
+			     pctldev->mux_claimed))
+			claimed++;
+
+	return claimed;
+}
+
+static void pinmux_claim_conflicts(struct kunit *test)
+{
+	struct pinctrl_setting *a0, *b0, *b1, *c1;
+	struct pinctrl_dev *pctldev;
+	struct own_regs *regs;
+	struct pin_desc *desc;
+	unsigned int pin;
+
+	pctldev = own_register(test, "own-conflict", &own_pmxops, &regs);
+	a0 = own_setting(test, pctldev, "own-dev0", 0);
+	b0 = own_setting(test, pctldev, "own-dev0", 1);
+	b1 = own_setting(test, pctldev, "own-dev1", 1);
+	c1 = own_setting(test, pctldev, "own-dev1", 2);
+
+	KUNIT_ASSERT_EQ(test, own_claim(a0), 0);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 0, 64), 64);
+
+	/* Overlaps a0 in pins 32-63, none of 64-95 may stay claimed */
+	KUNIT_EXPECT_EQ(test, own_claim(b1), -EINVAL);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 64, 32), 0);
+	KUNIT_EXPECT_EQ(test, atomic_read(&regs->requested[64]), 0);
+
+	/* The same owner may claim the shared pins twice */
+	KUNIT_ASSERT_EQ(test, own_claim(b0), 0);
+	KUNIT_ASSERT_EQ(test, own_claim(c1), 0);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 0, 160), 160);
+	desc = pin_desc_get(pctldev, 40);
+	KUNIT_EXPECT_STREQ(test, desc->mux_owner, "own-dev0");
+	KUNIT_EXPECT_PTR_EQ(test, desc->mux_setting, &b0->data.mux);
+
+	/* Pins 32-63 are still held by b0 */
+	own_release(a0);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 0, 32), 0);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 32, 64), 64);
+	KUNIT_EXPECT_STREQ(test, desc->mux_owner, "own-dev0");
+
+	own_release(b0);
+	own_release(c1);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 0, OWN_NUM_PINS), 0);
+
+	for (pin = 0; pin < OWN_NUM_PINS; pin++) {
+		desc = pin_desc_get(pctldev, pin);
+		KUNIT_EXPECT_NULL(test, desc->mux_owner);
+		KUNIT_EXPECT_EQ(test, atomic_read(&regs->requested[pin]), 0);
+	}
+	KUNIT_EXPECT_EQ(test, atomic_read(&regs->overlapping), 0);
+
+	/* With the pins released another owner gets them */
+	KUNIT_EXPECT_EQ(test, own_claim(b1), 0);
+	own_release(b1);
+}
+
+static void pinmux_claim_refused_request(struct kunit *test)
+{
+	struct pinctrl_setting *a0, *b0;
+	struct pinctrl_dev *pctldev;
+	struct own_regs *regs;
+	unsigned int pin;
+
+	pctldev = own_register(test, "own-refused", &own_pmxops, &regs);
+	a0 = own_setting(test, pctldev, "own-dev0", 0);
+	b0 = own_setting(test, pctldev, "own-dev0", 1);
+
+	KUNIT_ASSERT_EQ(test, own_claim(a0), 0);
+
+	/*
+	 * b0 shares pins 32-63 with a0 and gets 64-79 requested before the
+	 * driver refuses pin 80. Only 64-79 go back to the driver.
+	 */
+	regs->refuse = 80 + 1;
+	KUNIT_EXPECT_EQ(test, own_claim(b0), -EBUSY);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 0, 64), 64);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 64, 32), 0);
+	for (pin = 0; pin < 96; pin++)
+		KUNIT_EXPECT_EQ(test, atomic_read(&regs->requested[pin]),
+				pin < 64);
+	KUNIT_EXPECT_STREQ(test, pin_desc_get(pctldev, 40)->mux_owner,
+			   "own-dev0");
+	KUNIT_EXPECT_NULL(test, pin_desc_get(pctldev, 70)->mux_owner);
+
+	regs->refuse = 0;
+	own_release(a0);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 0, OWN_NUM_PINS), 0);
+	for (pin = 0; pin < 96; pin++)
+		KUNIT_EXPECT_EQ(test, atomic_read(&regs->requested[pin]), 0);
+}
+
+static void pinmux_owner_id_released(struct kunit *test)
+{
+	int id;
+
+	id = pinmux_owner_id("own-dev-gone");
+	KUNIT_ASSERT_GT(test, id, 0);
+	KUNIT_EXPECT_EQ(test, pinmux_owner_id("own-dev-gone"), id);
+	pinmux_owner_put("own-dev-gone");
+	pinmux_owner_put("own-dev-gone");
+
+	/* The lowest free id, which the name above gave back */
+	KUNIT_EXPECT_EQ(test, pinmux_owner_id("own-dev-new"), id);
+	pinmux_owner_put("own-dev-new");
+}
+
+static void pinmux_claim_strict_gpio(struct kunit *test)
+{
+	struct pinctrl_gpio_range range = { .name = "own-gpio" };
+	struct pinctrl_setting *a0;
+	struct pinctrl_dev *pctldev;
+	struct own_regs *regs;
+
+	pctldev = own_register(test, "own-strict", &own_strict_pmxops, &regs);
+	a0 = own_setting(test, pctldev, "own-dev0", 0);
+
+	KUNIT_ASSERT_EQ(test, pinmux_request_gpio(pctldev, &range, 10, 10), 0);
+	KUNIT_EXPECT_FALSE(test, pinmux_can_be_used_for_gpio(pctldev, 10));
+	KUNIT_EXPECT_EQ(test, own_claim(a0), -EINVAL);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 0, 64), 0);
+	KUNIT_EXPECT_EQ(test, atomic_read(&regs->requested[0]), 0);
+	pinmux_free_gpio(pctldev, 10, &range);
+
+	KUNIT_ASSERT_EQ(test, own_claim(a0), 0);
+	KUNIT_EXPECT_FALSE(test, pinmux_can_be_used_for_gpio(pctldev, 10));
+	KUNIT_EXPECT_TRUE(test, pinmux_can_be_used_for_gpio(pctldev, 100));
+	KUNIT_EXPECT_NE(test, pinmux_request_gpio(pctldev, &range, 10, 10), 0);
+	KUNIT_EXPECT_NULL(test, pin_desc_get(pctldev, 10)->gpio_owner);
+	own_release(a0);
+
+	KUNIT_EXPECT_TRUE(test, pinmux_can_be_used_for_gpio(pctldev, 10));
+}
+
+/* The per pin mutexes pinmux_claim_setting_pins() took before the bitmap */
+struct own_locked_pin {
+	struct mutex lock;
+	unsigned int usecount;
+	const char *owner;
+	const void *setting;
+};
+
+struct own_bench_ctx {
+	struct pinctrl_setting *setting;
+	struct own_locked_pin *locked;
+	struct completion done;
+	unsigned int failures;
+};
+
+static int own_locked_cycle(struct own_locked_pin *locked,
+			    const struct pinctrl_setting *setting)
+{
+	const unsigned int *pins = own_names->group_pins[setting->data.mux.group];
+	struct own_locked_pin *p;
+	unsigned int i;
+
+	for (i = 0; i < OWN_GROUP_PINS; i++) {
+		p = &locked[pins[i]];
+		guard(mutex)(&p->lock);
+		if (p->usecount && strcmp(p->owner, setting->dev_name))
+			return -EINVAL;
+		if (!p->usecount++)
+			p->owner = setting->dev_name;
+	}
+	for (i = 0; i < OWN_GROUP_PINS; i++) {
+		p = &locked[pins[i]];
+		scoped_guard(mutex, &p->lock)
+			p->setting = &setting->data.mux;
+	}
+	for (i = 0; i < OWN_GROUP_PINS; i++) {
+		p = &locked[pins[i]];
+		scoped_guard(mutex, &p->lock)
+			if (p->setting == &setting->data.mux && !--p->usecount)
+				p->owner = NULL;
+	}
+
+	return 0;
+}
+
+static int own_bench_thread(void *data)
+{
+	struct own_bench_ctx *ctx = data;
+	unsigned int r;
+
+	for (r = 0; r < OWN_BENCH_ROUNDS; r++) {
+		if (ctx->locked) {
+			if (own_locked_cycle(ctx->locked, ctx->setting))
+				ctx->failures++;
+		} else if (own_claim(ctx->setting)) {
+			ctx->failures++;
+		} else {
+			own_release(ctx->setting);
+		}
+	}
+	complete(&ctx->done);
+
+	while (!kthread_should_stop())
+		msleep(1);
+
+	return 0;
+}
+
+/* Claim and release the interleaved groups from a thread each */
+static u64 own_bench_run(struct kunit *test, struct pinctrl_dev *pctldev,
+			 struct own_locked_pin *locked, unsigned int *failures)
+{
+	struct task_struct *threads[OWN_BENCH_THREADS];
+	struct own_bench_ctx *ctxs;
+	unsigned int i;
+	ktime_t start;
+	u64 elapsed;
+
+	ctxs = kunit_kcalloc(test, OWN_BENCH_THREADS, sizeof(*ctxs),
+			     GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctxs);
+
+	start = ktime_get();
+	for (i = 0; i < OWN_BENCH_THREADS; i++) {
+		char owner[16];
+
+		snprintf(owner, sizeof(owner), "own-bench%u", i);
+		ctxs[i].setting = own_setting(test, pctldev,
+					      kunit_kstrdup(test, owner,
+							    GFP_KERNEL),
+					      OWN_FIRST_BENCH + i);
+		ctxs[i].locked = locked;
+		init_completion(&ctxs[i].done);
+		threads[i] = kthread_run(own_bench_thread, &ctxs[i],
+					 "pinmux-own/%u", i);
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, threads[i]);
+	}
+
+	for (i = 0; i < OWN_BENCH_THREADS; i++)
+		wait_for_completion(&ctxs[i].done);
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	*failures = 0;
+	for (i = 0; i < OWN_BENCH_THREADS; i++) {
+		kthread_stop(threads[i]);
+		*failures += ctxs[i].failures;
+	}
+
+	return elapsed;
+}
+
+static void pinmux_claim_bench_contention(struct kunit *test)
+{
+	struct own_locked_pin *locked;
+	unsigned int failures, i;
+	struct pinctrl_dev *pctldev;
+	struct own_regs *regs;
+	u64 t_bitmap, t_locked;
+
+	pctldev = own_register(test, "own-bench", &own_pmxops, &regs);
+
+	locked = kunit_kcalloc(test, OWN_NUM_PINS, sizeof(*locked), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, locked);
+	for (i = 0; i < OWN_NUM_PINS; i++)
+		mutex_init(&locked[i].lock);
+
+	t_locked = own_bench_run(test, pctldev, locked, &failures);
+	KUNIT_EXPECT_EQ(test, failures, 0);
+
+	t_bitmap = own_bench_run(test, pctldev, NULL, &failures);
+	KUNIT_EXPECT_EQ(test, failures, 0);
+	KUNIT_EXPECT_EQ(test, atomic_read(&regs->overlapping), 0);
+	KUNIT_EXPECT_EQ(test, own_count_claimed(pctldev, 0, OWN_NUM_PINS), 0);
+
+	kunit_info(test, "%u threads claiming %u pin groups: per pin mutex %llu ns, bitmap %llu ns per claim and release\n",
+		   OWN_BENCH_THREADS, OWN_GROUP_PINS,
+		   div_u64(t_locked, OWN_BENCH_THREADS * OWN_BENCH_ROUNDS),
+		   div_u64(t_bitmap, OWN_BENCH_THREADS * OWN_BENCH_ROUNDS));
+}
+
+static struct kunit_case pinmux_claim_test_cases[] = {
+	KUNIT_CASE(pinmux_claim_conflicts),
+	KUNIT_CASE(pinmux_claim_refused_request),
+	KUNIT_CASE(pinmux_owner_id_released),
+	KUNIT_CASE(pinmux_claim_strict_gpio),
+	KUNIT_CASE_SLOW(pinmux_claim_bench_contention),
+	{}
+};
+
+static struct kunit_suite pinmux_claim_test_suite = {
+	.name = "pinmux_claim_setting_pins",
+	.init = own_test_init,
+	.test_cases = pinmux_claim_test_cases,
+};
+
+kunit_test_suite(pinmux_claim_test_suite);